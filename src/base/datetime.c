@@ -1,5 +1,7 @@
 #include "datetime.h"
 
+#include "config.h"
+
 static const char* s_weekdays[] = {"Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"};
 
 static const char* s_months[] = {"January", "February", "March", "April", "May", "June",
@@ -9,7 +11,7 @@ static const char* s_months[] = {"January", "February", "March", "April", "May",
 static const uint8_t s_days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
 
 unsigned int gettick_ms() {
-#ifdef HAVE_CLOCK_GETTIME
+#if HAVE_CLOCK_GETTIME
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
     return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
@@ -21,7 +23,7 @@ unsigned int gettick_ms() {
 }
 
 unsigned long long gethrtime_us() {
-#ifdef HAVE_CLOCK_GETTIME
+#if HAVE_CLOCK_GETTIME
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
     return ts.tv_sec * (unsigned long long)1000000 + ts.tv_nsec / 1000;
@@ -32,6 +34,16 @@ unsigned long long gethrtime_us() {
 #endif
 }
 
+unsigned long long gethrtime_ns() {
+#if HAVE_CLOCK_GETTIME
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * (unsigned long long)1000000000 + ts.tv_nsec;
+#else
+    return gethrtime_us() * 1000;
+#endif
+}
+
 datetime_t datetime_now() {
     struct timeval tv;
     gettimeofday(&tv, NULL);
@@ -48,6 +48,8 @@ typedef struct timezone_s {
     const char* timezone;
 } timezone_t;
 
+// NOTE: gettick_ms, gethrtime_us and gethrtime_ns are of CLOCK_MONOTONIC if HAVE_CLOCK_GETTIME (config.h):
+// time since boot, not stepped by settimeofday or NTP, so never compare them with gettimeofday_*.
 extern unsigned int gettick_ms();
 static inline unsigned long long gettimeofday_ms() {
     struct timeval tv;
@@ -60,6 +62,7 @@ static inline unsigned long long gettimeofday_us() {
     return tv.tv_sec * (unsigned long long)1000000 + tv.tv_usec;
 }
 extern unsigned long long gethrtime_us();
+extern unsigned long long gethrtime_ns();
 
 extern datetime_t datetime_now();
 extern datetime_t datetime_localtime(time_t seconds);
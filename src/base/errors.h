@@ -63,6 +63,11 @@ void err_quit(const char* fmt, ...);
     F(1100, TASK_TIMEOUT, "Task timeout")          \
     F(1101, TASK_QUEUE_FULL, "Task queue full")    \
     F(1102, TASK_QUEUE_EMPTY, "Task queue empty")  \
+    F(1103, TASK_CANCELED, "Task canceled")        \
+                                                   \
+    F(1200, DNS_NXDOMAIN, "DNS name not exist")    \
+    F(1201, DNS_NODATA, "DNS no address of type")  \
+    F(1202, DNS_SERVFAIL, "DNS server failure")    \
                                                    \
     F(1400, REQUEST, "Bad request")                \
     F(1401, RESPONSE, "Bad response")
@@ -112,8 +112,10 @@ int log_add_fp(FILE* fp, int level) {
 
 static void init_event(log_Event* ev, void* udata) {
     if (!ev->time) {
+        // NOTE: localtime calls tzset every time, which mallocs, localtime_r does not.
+        static struct tm tm;
         time_t t = time(NULL);
-        ev->time = localtime(&t);
+        ev->time = localtime_r(&t, &tm);
     }
     ev->udata = udata;
 }
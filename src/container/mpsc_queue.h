@@ -0,0 +1,83 @@
+#ifndef MPSC_QUEUE_H_
+#define MPSC_QUEUE_H_
+
+#include <sched.h> // for sched_yield
+#include <stdatomic.h>
+#include <stddef.h> // for NULL
+
+/*
+ * Intrusive lock-free multi-producer single-consumer queue (Dmitry Vyukov).
+ *
+ * push: wait-free, one atomic exchange, any thread.
+ * pop:  consumer thread only, no atomic RMW except when the queue becomes empty.
+ *
+ * struct mpsc_queue q;
+ * mpsc_queue_init(&q);
+ * mpsc_queue_push(&q, &elem->node);
+ * while ((node = mpsc_queue_pop(&q)) != NULL) { elem = container_of(node, ...); }
+ */
+
+struct mpsc_node {
+    struct mpsc_node* _Atomic next;
+};
+
+struct mpsc_queue {
+    // producers push to head
+    struct mpsc_node* _Atomic head;
+    // consumer pops from tail
+    struct mpsc_node* tail;
+    struct mpsc_node stub;
+};
+
+static inline void mpsc_queue_init(struct mpsc_queue* q) {
+    atomic_store_explicit(&q->stub.next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&q->head, &q->stub, memory_order_relaxed);
+    q->tail = &q->stub;
+}
+
+static inline void mpsc_queue_push(struct mpsc_queue* q, struct mpsc_node* node) {
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    struct mpsc_node* prev = atomic_exchange_explicit(&q->head, node, memory_order_acq_rel);
+    // NOTE: between exchange and store, the queue is not linked, @see mpsc_queue_pop
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+static inline int mpsc_queue_empty(struct mpsc_queue* q) {
+    return q->tail == &q->stub && atomic_load_explicit(&q->head, memory_order_acquire) == &q->stub;
+}
+
+// NOTE: consumer only, return NULL if empty.
+// If a producer is preempted between exchange and store, wait for it,
+// so that a pushed node is never missed.
+static inline struct mpsc_node* mpsc_queue_pop(struct mpsc_queue* q) {
+    struct mpsc_node* tail = q->tail;
+    struct mpsc_node* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (tail == &q->stub) {
+        if (next == NULL) {
+            if (atomic_load_explicit(&q->head, memory_order_acquire) == tail)
+                return NULL;
+            // pushing
+            while ((next = atomic_load_explicit(&tail->next, memory_order_acquire)) == NULL) {
+                sched_yield();
+            }
+        }
+        q->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+    if (next) {
+        q->tail = next;
+        return tail;
+    }
+    if (atomic_load_explicit(&q->head, memory_order_acquire) == tail) {
+        // last node, push stub back so tail can move on
+        mpsc_queue_push(q, &q->stub);
+    }
+    while ((next = atomic_load_explicit(&tail->next, memory_order_acquire)) == NULL) {
+        sched_yield();
+    }
+    q->tail = next;
+    return tail;
+}
+
+#endif // MPSC_QUEUE_H_
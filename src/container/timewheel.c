@@ -0,0 +1,149 @@
+#include "timewheel.h"
+
+#include <string.h>
+
+#define TIMEWHEEL_ENTRY(p) container_of(p, struct timewheel_node, node)
+
+static inline void timewheel_bitmap_set(struct timewheel* tw, int idx) {
+    tw->bitmap[idx >> 6] |= 1ULL << (idx & 63);
+}
+
+static inline void timewheel_bitmap_clear(struct timewheel* tw, int idx) {
+    tw->bitmap[idx >> 6] &= ~(1ULL << (idx & 63));
+}
+
+// @return first not empty root slot >= idx, -1 if none
+static int timewheel_find_slot(struct timewheel* tw, int idx) {
+    for (int i = idx >> 6; i < TIMEWHEEL_ROOT_SIZE / 64; ++i) {
+        uint64_t bits = tw->bitmap[i];
+        if (i == (idx >> 6)) {
+            bits &= ~0ULL << (idx & 63);
+        }
+        if (bits) {
+            return (i << 6) + __builtin_ctzll(bits);
+        }
+    }
+    return -1;
+}
+
+// NOTE: called when tw->cur reaches a root wheel boundary,
+// move nodes of current level slot to lower levels, and upper levels if wrapped.
+static void timewheel_cascade(struct timewheel* tw) {
+    struct list_head list;
+    struct timewheel_node* node;
+    int shift = TIMEWHEEL_ROOT_BITS;
+    for (int level = 0; level < TIMEWHEEL_LEVELS; ++level, shift += TIMEWHEEL_LEVEL_BITS) {
+        int idx = (tw->cur >> shift) & TIMEWHEEL_LEVEL_MASK;
+        list_init(&list);
+        list_splice_init(&tw->levels[level][idx], &list);
+        while (!list_empty(&list)) {
+            node = TIMEWHEEL_ENTRY(list.next);
+            list_del(&node->node);
+            tw->nelts--;
+            timewheel_add(tw, node);
+        }
+        if (idx != 0)
+            break;
+    }
+}
+
+void timewheel_init(struct timewheel* tw, uint64_t now) {
+    tw->cur = now;
+    tw->nelts = 0;
+    memset(tw->bitmap, 0, sizeof(tw->bitmap));
+    for (int i = 0; i < TIMEWHEEL_ROOT_SIZE; ++i) {
+        list_init(&tw->root[i]);
+    }
+    for (int level = 0; level < TIMEWHEEL_LEVELS; ++level) {
+        for (int i = 0; i < TIMEWHEEL_LEVEL_SIZE; ++i) {
+            list_init(&tw->levels[level][i]);
+        }
+    }
+}
+
+void timewheel_add(struct timewheel* tw, struct timewheel_node* node) {
+    uint64_t expire = node->expire < tw->cur ? tw->cur : node->expire;
+    uint64_t delta = expire - tw->cur;
+    struct list_head* slot = NULL;
+    if (delta < TIMEWHEEL_ROOT_SIZE) {
+        int idx = expire & TIMEWHEEL_ROOT_MASK;
+        slot = &tw->root[idx];
+        timewheel_bitmap_set(tw, idx);
+    } else {
+        int level = 0;
+        int shift = TIMEWHEEL_ROOT_BITS;
+        while (level < TIMEWHEEL_LEVELS - 1 && delta >> (shift + TIMEWHEEL_LEVEL_BITS)) {
+            ++level;
+            shift += TIMEWHEEL_LEVEL_BITS;
+        }
+        if (delta >> (shift + TIMEWHEEL_LEVEL_BITS)) {
+            // NOTE: out of range, clamp to the farthest slot, re-cascaded later.
+            expire = tw->cur + (1ULL << (shift + TIMEWHEEL_LEVEL_BITS)) - 1;
+        }
+        slot = &tw->levels[level][(expire >> shift) & TIMEWHEEL_LEVEL_MASK];
+    }
+    list_add_tail(&node->node, slot);
+    tw->nelts++;
+}
+
+void timewheel_del(struct timewheel* tw, struct timewheel_node* node) {
+    struct list_head* entry = &node->node;
+    if (entry->next == NULL || entry->next == entry)
+        return;
+    if (entry->next == entry->prev) {
+        // NOTE: the last node of slot, entry->next is the slot
+        struct list_head* slot = entry->next;
+        if (slot >= tw->root && slot < tw->root + TIMEWHEEL_ROOT_SIZE) {
+            timewheel_bitmap_clear(tw, (int)(slot - tw->root));
+        }
+    }
+    list_del_init(entry);
+    tw->nelts--;
+}
+
+struct timewheel_node* timewheel_pop(struct timewheel* tw, uint64_t now) {
+    while (tw->cur <= now) {
+        int idx = tw->cur & TIMEWHEEL_ROOT_MASK;
+        if (!list_empty(&tw->root[idx])) {
+            struct timewheel_node* node = TIMEWHEEL_ENTRY(tw->root[idx].next);
+            timewheel_del(tw, node);
+            return node;
+        }
+        // skip empty slots, but stop at root wheel boundary to cascade
+        uint64_t next = now + 1;
+        if (tw->nelts) {
+            int slot = timewheel_find_slot(tw, idx);
+            uint64_t base = tw->cur & ~(uint64_t)TIMEWHEEL_ROOT_MASK;
+            uint64_t target = slot < 0 ? base + TIMEWHEEL_ROOT_SIZE : base + slot;
+            if (target < next) {
+                next = target;
+            }
+        }
+        tw->cur = next;
+        if ((tw->cur & TIMEWHEEL_ROOT_MASK) == 0) {
+            timewheel_cascade(tw);
+        }
+    }
+    return NULL;
+}
+
+uint64_t timewheel_next_expire(struct timewheel* tw) {
+    if (tw->nelts == 0)
+        return UINT64_MAX;
+    int slot = timewheel_find_slot(tw, tw->cur & TIMEWHEEL_ROOT_MASK);
+    uint64_t base = tw->cur & ~(uint64_t)TIMEWHEEL_ROOT_MASK;
+    return slot < 0 ? base + TIMEWHEEL_ROOT_SIZE : base + slot;
+}
+
+void timewheel_clear(struct timewheel* tw, struct list_head* list) {
+    for (int i = 0; i < TIMEWHEEL_ROOT_SIZE; ++i) {
+        list_splice_tail_init(&tw->root[i], list);
+    }
+    for (int level = 0; level < TIMEWHEEL_LEVELS; ++level) {
+        for (int i = 0; i < TIMEWHEEL_LEVEL_SIZE; ++i) {
+            list_splice_tail_init(&tw->levels[level][i], list);
+        }
+    }
+    memset(tw->bitmap, 0, sizeof(tw->bitmap));
+    tw->nelts = 0;
+}
@@ -0,0 +1,58 @@
+#ifndef TIMEWHEEL_H_
+#define TIMEWHEEL_H_
+
+#include <stdint.h>
+#include <stdlib.h> // for list.h
+
+#include "list.h"
+
+/*
+ * Hierarchical timing wheel: O(1) add/del, cascade on root wheel wrap.
+ *
+ * root: 256 slots of 1 tick, levels: 4 * 64 slots of 2^8, 2^14, 2^20, 2^26 ticks,
+ * covers 2^32 ticks (49.7 days with 1ms tick), further expires are clamped and re-cascaded.
+ *
+ * struct timewheel tw;
+ * timewheel_init(&tw, now);
+ * node->expire = now + 100;
+ * timewheel_add(&tw, node);
+ * while ((node = timewheel_pop(&tw, now)) != NULL) { ... }
+ */
+
+#define TIMEWHEEL_ROOT_BITS  8
+#define TIMEWHEEL_ROOT_SIZE  (1 << TIMEWHEEL_ROOT_BITS)
+#define TIMEWHEEL_ROOT_MASK  (TIMEWHEEL_ROOT_SIZE - 1)
+#define TIMEWHEEL_LEVEL_BITS 6
+#define TIMEWHEEL_LEVEL_SIZE (1 << TIMEWHEEL_LEVEL_BITS)
+#define TIMEWHEEL_LEVEL_MASK (TIMEWHEEL_LEVEL_SIZE - 1)
+#define TIMEWHEEL_LEVELS     4
+
+struct timewheel_node {
+    struct list_node node;
+    uint64_t expire; // tick
+};
+
+struct timewheel {
+    // ticks < cur have been expired
+    uint64_t cur;
+    uint32_t nelts;
+    // bit i set if root[i] is not empty
+    uint64_t bitmap[TIMEWHEEL_ROOT_SIZE / 64];
+    struct list_head root[TIMEWHEEL_ROOT_SIZE];
+    struct list_head levels[TIMEWHEEL_LEVELS][TIMEWHEEL_LEVEL_SIZE];
+};
+
+void timewheel_init(struct timewheel* tw, uint64_t now);
+// NOTE: node->expire < tw->cur will expire at tw->cur
+void timewheel_add(struct timewheel* tw, struct timewheel_node* node);
+// NOTE: del a node not in wheel is no-op
+void timewheel_del(struct timewheel* tw, struct timewheel_node* node);
+// advance to now, pop a node with expire <= now, NULL if none
+struct timewheel_node* timewheel_pop(struct timewheel* tw, uint64_t now);
+// @return tick <= next expire, UINT64_MAX if empty
+// NOTE: maybe a cascade tick rather than an exact expire
+uint64_t timewheel_next_expire(struct timewheel* tw);
+// move all nodes to list, for cleanup
+void timewheel_clear(struct timewheel* tw, struct list_head* list);
+
+#endif // TIMEWHEEL_H_
@@ -0,0 +1,482 @@
+#include "coroutine.h"
+
+#include <sys/mman.h>
+
+#include "errors.h"
+#include "event.h"
+#include "iowatcher.h"
+#include "log.h"
+#include "socket.h"
+#include "sockunion.h"
+#include "unpack.h"
+
+// NOTE: x86_64 switches by saving callee-saved registers on stack,
+// others fallback to ucontext, whose swapcontext costs a sigprocmask syscall.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && !defined(EVCO_USE_UCONTEXT)
+#define EVCO_ASM_SWITCH
+#else
+#include <ucontext.h>
+#endif
+
+typedef enum {
+    EVCO_SUSPENDED = 0,
+    EVCO_RUNNING,
+    EVCO_DEAD,
+} evco_status_e;
+
+// NOTE: placed at the top of its own stack, so a coroutine is one mmap.
+struct evco_s {
+    evloop_t* loop;
+    evco_fn fn;
+    void* arg;
+    char* stack;
+    size_t stack_size;
+    struct evco_s* caller; // NULL if resumed on loop stack
+    evco_status_e status;
+    unsigned io_closed : 1; // woken by evio_close, @see co_wait
+    struct list_node node; // loop->coroutines
+#ifdef EVCO_ASM_SWITCH
+    void* sp;
+    void* caller_sp;
+#else
+    ucontext_t ctx;
+    ucontext_t caller_ctx;
+#endif
+};
+
+#define EVCO_HEADER_SIZE (((sizeof(evco_t) + 63) / 64) * 64)
+#define EVCO_PAGE_SIZE   4096
+#ifdef EVCO_STACK_GUARD
+#define EVCO_GUARD_SIZE EVCO_PAGE_SIZE
+#else
+#define EVCO_GUARD_SIZE 0
+#endif
+
+#ifdef EVCO_ASM_SWITCH
+// void evco_switch(void** from_sp, void* to_sp)
+__asm__(".text\n"
+        ".globl evco_switch\n"
+        ".hidden evco_switch\n"
+        ".type evco_switch, @function\n"
+        "evco_switch:\n"
+        "    pushq %rbp\n"
+        "    pushq %rbx\n"
+        "    pushq %r12\n"
+        "    pushq %r13\n"
+        "    pushq %r14\n"
+        "    pushq %r15\n"
+        "    movq %rsp, (%rdi)\n"
+        "    movq %rsi, %rsp\n"
+        "    popq %r15\n"
+        "    popq %r14\n"
+        "    popq %r13\n"
+        "    popq %r12\n"
+        "    popq %rbx\n"
+        "    popq %rbp\n"
+        "    ret\n"
+        ".size evco_switch, .-evco_switch\n");
+void evco_switch(void** from_sp, void* to_sp);
+#define EVCO_SWITCH_IN(co)  evco_switch(&(co)->caller_sp, (co)->sp)
+#define EVCO_SWITCH_OUT(co) evco_switch(&(co)->sp, (co)->caller_sp)
+#else
+#define EVCO_SWITCH_IN(co)  swapcontext(&(co)->caller_ctx, &(co)->ctx)
+#define EVCO_SWITCH_OUT(co) swapcontext(&(co)->ctx, &(co)->caller_ctx)
+#endif
+
+// one loop per thread, so the running coroutine is per thread.
+static __thread evco_t* s_current = NULL;
+
+static char* co_stack_alloc(evloop_t* loop, size_t size) {
+    char* stack = NULL;
+    if (size == EVCO_DEFAULT_STACK_SIZE && loop->co_stacks) {
+        // NOTE: free list linked at the top of stacks
+        stack = (char*)loop->co_stacks;
+        loop->co_stacks = *(void**)(stack + size - sizeof(void*));
+        --loop->co_nstacks;
+        return stack;
+    }
+    stack = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (stack == MAP_FAILED) {
+        log_error("co stack mmap %zu bytes failed: %d", size, errno);
+        return NULL;
+    }
+#ifdef EVCO_STACK_GUARD
+    // NOTE: stacks grow down, overflow faults on the lowest page.
+    if (mprotect(stack, EVCO_GUARD_SIZE, PROT_NONE) != 0) {
+        log_error("co stack guard mprotect failed: %d", errno);
+        munmap(stack, size);
+        return NULL;
+    }
+#endif
+    return stack;
+}
+
+static void co_stack_free(evloop_t* loop, char* stack, size_t size) {
+    if (size == EVCO_DEFAULT_STACK_SIZE && loop->co_nstacks < EVCO_MAX_FREE_STACKS) {
+        *(void**)(stack + size - sizeof(void*)) = loop->co_stacks;
+        loop->co_stacks = stack;
+        ++loop->co_nstacks;
+        return;
+    }
+    munmap(stack, size);
+}
+
+void evloop_co_cleanup(evloop_t* loop) {
+    // NOTE: suspended coroutines can not be unwound, just release their stacks.
+    struct list_node* node = loop->coroutines.next;
+    while (node && node != &loop->coroutines) {
+        evco_t* co = list_entry(node, evco_t, node);
+        node = node->next;
+        munmap(co->stack, co->stack_size);
+    }
+    list_init(&loop->coroutines);
+    while (loop->co_stacks) {
+        char* stack = (char*)loop->co_stacks;
+        loop->co_stacks = *(void**)(stack + EVCO_DEFAULT_STACK_SIZE - sizeof(void*));
+        munmap(stack, EVCO_DEFAULT_STACK_SIZE);
+    }
+    loop->co_nstacks = 0;
+}
+
+static void co_entry() {
+    evco_t* co = s_current;
+    co->fn(co->arg);
+    co->status = EVCO_DEAD;
+    EVCO_SWITCH_OUT(co);
+    // NOTE: never resumed, the caller frees the stack.
+    abort();
+}
+
+int co_create(evloop_t* loop, evco_fn fn, void* arg, size_t stack_size) {
+    if (stack_size == 0) {
+        stack_size = EVCO_DEFAULT_STACK_SIZE;
+    }
+    stack_size = (stack_size + EVCO_PAGE_SIZE - 1) & ~(size_t)(EVCO_PAGE_SIZE - 1);
+    stack_size = MAX(stack_size, (size_t)(EVCO_GUARD_SIZE + EVCO_PAGE_SIZE));
+    char* stack = co_stack_alloc(loop, stack_size);
+    if (stack == NULL)
+        return -1;
+    evco_t* co = (evco_t*)(stack + stack_size - EVCO_HEADER_SIZE);
+    memset(co, 0, sizeof(evco_t));
+    co->loop = loop;
+    co->fn = fn;
+    co->arg = arg;
+    co->stack = stack;
+    co->stack_size = stack_size;
+    co->status = EVCO_SUSPENDED;
+    list_add(&co->node, &loop->coroutines);
+#ifdef EVCO_ASM_SWITCH
+    // NOTE: evco_switch pops 6 registers then returns to co_entry,
+    // which sees rsp % 16 == 8 as if called.
+    void** sp = (void**)co;
+    *--sp = NULL;
+    *--sp = (void*)co_entry;
+    for (int i = 0; i < 6; ++i) {
+        *--sp = NULL;
+    }
+    co->sp = sp;
+#else
+    getcontext(&co->ctx);
+    co->ctx.uc_stack.ss_sp = stack + EVCO_GUARD_SIZE;
+    co->ctx.uc_stack.ss_size = stack_size - EVCO_GUARD_SIZE - EVCO_HEADER_SIZE;
+    co->ctx.uc_link = NULL;
+    makecontext(&co->ctx, co_entry, 0);
+#endif
+    co_resume(co);
+    return 0;
+}
+
+evco_t* co_self() {
+    return s_current;
+}
+
+evloop_t* co_loop(evco_t* co) {
+    return co->loop;
+}
+
+void co_resume(evco_t* co) {
+    assert(co->status == EVCO_SUSPENDED);
+    co->caller = s_current;
+    co->status = EVCO_RUNNING;
+    s_current = co;
+    EVCO_SWITCH_IN(co);
+    s_current = co->caller;
+    if (co->status == EVCO_DEAD) {
+        list_del(&co->node);
+        co_stack_free(co->loop, co->stack, co->stack_size);
+    }
+}
+
+void co_suspend() {
+    evco_t* co = s_current;
+    assert(co != NULL);
+    co->status = EVCO_SUSPENDED;
+    EVCO_SWITCH_OUT(co);
+}
+
+static void co_resume_cb(event_t* ev) {
+    co_resume((evco_t*)ev->userdata);
+}
+
+void co_yield() {
+    evco_t* co = s_current;
+    if (co == NULL)
+        return;
+    event_t ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.cb = co_resume_cb;
+    ev.userdata = co;
+    evloop_post_event(co->loop, &ev);
+    co_suspend();
+}
+
+static void co_timer_cb(evtimer_t* timer) {
+    co_resume((evco_t*)timer->privdata);
+}
+
+int co_sleep(uint32_t ms) {
+    evco_t* co = s_current;
+    if (co == NULL)
+        return -1;
+    if (ms == 0) {
+        co_yield();
+        return 0;
+    }
+    evtimer_t* timer = evtimer_add(co->loop, co_timer_cb, ms, 1);
+    timer->privdata = co;
+    co_suspend();
+    return 0;
+}
+
+static void co_io_cb(evio_t* io) {
+    int revents = io->revents;
+    io->revents = 0;
+    if (revents & EV_READ) {
+        evco_t* reader = io->cold->co_reader;
+        if (reader) {
+            io->cold->co_reader = NULL;
+            co_resume(reader);
+        } else if (!evio_is_edge_triggered(io)) {
+            // NOTE: lazy del, keep it registered while coroutine reads again soon.
+            evio_del(io, EV_READ);
+        }
+    }
+    // NOTE: reader may close io, or even reuse it by accepting the same fd,
+    // a spurious wakeup is fine since co_write retries write first.
+    if (!io->ready || io->closed || (revents & EV_WRITE) == 0)
+        return;
+    evco_t* writer = io->cold->co_writer;
+    if (writer) {
+        io->cold->co_writer = NULL;
+        co_resume(writer);
+    } else if (!evio_is_edge_triggered(io)) {
+        evio_del(io, EV_WRITE);
+    }
+}
+
+static int co_wait(evio_t* io, int event) {
+    evco_t* co = s_current;
+    assert(co != NULL && co->loop == io->loop);
+    if (event == EV_READ) {
+        evio_cold(io)->co_reader = co;
+    } else {
+        evio_cold(io)->co_writer = co;
+    }
+    if ((io->events & event) == 0 || io->cb != (event_cb)co_io_cb) {
+        evio_add(io, co_io_cb, event);
+    }
+    co_suspend();
+    // NOTE: io may be reused by another coroutine before this one runs.
+    if (co->io_closed) {
+        co->io_closed = 0;
+        return -1;
+    }
+    return io->closed ? -1 : 0;
+}
+
+void evio_co_close(struct evco_s* reader, struct evco_s* writer) {
+    if (reader) {
+        reader->io_closed = 1;
+        co_resume(reader);
+    }
+    if (writer) {
+        writer->io_closed = 1;
+        co_resume(writer);
+    }
+}
+
+// NOTE: io_uring reads tcp (and accepts if io->accept) by multishot ops, pop their completions as nio.c
+static int co_sys_accept(evio_t* listenio) {
+#ifdef EVENT_IOURING
+    if (iouring_enabled(listenio->loop) && listenio->accept)
+        return iouring_accept(listenio);
+#endif
+    return accept(listenio->fd, NULL, NULL);
+}
+
+static int co_sys_read(evio_t* io, void* buf, int len) {
+#ifdef EVENT_IOURING
+    if (iouring_enabled(io->loop))
+        return iouring_recv(io, buf, len);
+#endif
+    return read(io->fd, buf, len);
+}
+
+evio_t* co_accept(evio_t* listenio) {
+    while (1) {
+        int connfd = co_sys_accept(listenio);
+        if (connfd >= 0) {
+            return evio_get(listenio->loop, connfd);
+        }
+        int err = socket_errno();
+        if (err == EINTR)
+            continue;
+        if (err != EAGAIN && err != EWOULDBLOCK) {
+            listenio->error = err;
+            return NULL;
+        }
+        if (co_wait(listenio, EV_READ) != 0)
+            return NULL;
+    }
+}
+
+evio_t* co_connect(evloop_t* loop, const char* host, int port) {
+    evio_t* io = evio_create_socket(loop, host, port, EIO_TYPE_TCP, EIO_CLIENT_SIDE);
+    if (io == NULL)
+        return NULL;
+    int ret = connect(io->fd, evio_peeraddr(io), sockunion_get_addrlen((sockaddr_u*)io->peeraddr));
+    if (ret != 0) {
+        int err = socket_errno();
+        if (err != EINPROGRESS) {
+            io->error = err;
+            goto error;
+        }
+        if (co_wait(io, EV_WRITE) != 0)
+            goto error;
+        socklen_t errlen = sizeof(err);
+        if (getsockopt(io->fd, SOL_SOCKET, SO_ERROR, &err, &errlen) != 0 || err != 0) {
+            io->error = err;
+            goto error;
+        }
+    }
+    socklen_t addrlen = sizeof(sockaddr_u);
+    getsockname(io->fd, evio_localaddr(io), &addrlen);
+    io->connected = 1;
+    return io;
+error:
+    evio_close(io);
+    return NULL;
+}
+
+int co_read(evio_t* io, void* buf, int len) {
+    // NOTE: bytes left by co_read_until first
+    if (io->readbuf.tail > io->readbuf.head) {
+        int n = MIN(len, (int)(io->readbuf.tail - io->readbuf.head));
+        memcpy(buf, io->readbuf.base + io->readbuf.head, n);
+        io->readbuf.head += n;
+        if (io->readbuf.head == io->readbuf.tail) {
+            io->readbuf.head = io->readbuf.tail = 0;
+        }
+        return n;
+    }
+    while (1) {
+        int n = co_sys_read(io, buf, len);
+        if (n >= 0) {
+            io->last_read_hrtime = io->loop->cur_hrtime;
+            return n;
+        }
+        int err = socket_errno();
+        if (err == EINTR)
+            continue;
+        if (err != EAGAIN && err != EWOULDBLOCK) {
+            io->error = err;
+            return -1;
+        }
+        if (co_wait(io, EV_READ) != 0)
+            return -1;
+    }
+}
+
+int co_read_until(evio_t* io, void* buf, int len, const char* delimiter) {
+    int delimiter_bytes = strlen(delimiter);
+    fifo_buf_t* readbuf = &io->readbuf;
+    // NOTE: leftover kept in readbuf of io, not shared loop->readbuf.
+    if (!evio_is_alloced_readbuf(io) || readbuf->len < (size_t)len) {
+        if (readbuf->head) {
+            memmove(readbuf->base, readbuf->base + readbuf->head, readbuf->tail - readbuf->head);
+            readbuf->tail -= readbuf->head;
+            readbuf->head = 0;
+        }
+        evio_alloc_readbuf(io, MAX(len, (int)readbuf->tail));
+        if (io->closed)
+            return -1;
+    }
+    size_t scan = readbuf->head;
+    while (1) {
+        const unsigned char* base = (const unsigned char*)readbuf->base;
+        const unsigned char* p = unpack_find_delimiter(base + scan, base + readbuf->tail,
+                                                       (const unsigned char*)delimiter, delimiter_bytes);
+        if (p) {
+            int n = p + delimiter_bytes - (base + readbuf->head);
+            if (n > len)
+                break;
+            memcpy(buf, base + readbuf->head, n);
+            readbuf->head += n;
+            if (readbuf->head == readbuf->tail) {
+                readbuf->head = readbuf->tail = 0;
+            }
+            return n;
+        }
+        if (readbuf->tail - readbuf->head >= (size_t)len)
+            break;
+        // NOTE: remember scanned position, only its tail may begin a delimiter.
+        scan = MAX(readbuf->head, readbuf->tail - MIN(readbuf->tail, (size_t)delimiter_bytes - 1));
+        if (readbuf->tail == readbuf->len) {
+            memmove(readbuf->base, readbuf->base + readbuf->head, readbuf->tail - readbuf->head);
+            scan -= readbuf->head;
+            readbuf->tail -= readbuf->head;
+            readbuf->head = 0;
+        }
+        int n = co_sys_read(io, readbuf->base + readbuf->tail, readbuf->len - readbuf->tail);
+        if (n > 0) {
+            readbuf->tail += n;
+            io->last_read_hrtime = io->loop->cur_hrtime;
+            continue;
+        }
+        if (n == 0)
+            return 0;
+        int err = socket_errno();
+        if (err == EINTR)
+            continue;
+        if (err != EAGAIN && err != EWOULDBLOCK) {
+            io->error = err;
+            return -1;
+        }
+        if (co_wait(io, EV_READ) != 0)
+            return -1;
+    }
+    io->error = ERR_OVER_LIMIT;
+    return -1;
+}
+
+int co_write(evio_t* io, const void* buf, int len) {
+    int nwrite = 0;
+    while (nwrite < len) {
+        int n = write(io->fd, (const char*)buf + nwrite, len - nwrite);
+        if (n >= 0) {
+            nwrite += n;
+            io->last_write_hrtime = io->loop->cur_hrtime;
+            continue;
+        }
+        int err = socket_errno();
+        if (err == EINTR)
+            continue;
+        if (err != EAGAIN && err != EWOULDBLOCK) {
+            io->error = err;
+            return -1;
+        }
+        if (co_wait(io, EV_WRITE) != 0)
+            return -1;
+    }
+    return nwrite;
+}
@@ -0,0 +1,78 @@
+#ifndef EV_COROUTINE_H_
+#define EV_COROUTINE_H_
+
+#include "eventloop.h"
+
+/*
+ * stackful coroutines scheduled by evloop, each runs on the loop thread
+ * and suspends on EAGAIN, the loop resumes it when io ready.
+ *
+ * static void echo_session(void* arg) {
+ *     evio_t* io = (evio_t*)arg;
+ *     char line[1024];
+ *     int n;
+ *     while ((n = co_read_until(io, line, sizeof(line), "\r\n")) > 0) {
+ *         if (co_write(io, line, n) < 0) break;
+ *     }
+ *     evio_close(io);
+ * }
+ *
+ * static void echo_server(void* arg) {
+ *     evio_t* listenio = (evio_t*)arg;
+ *     evio_t* io;
+ *     while ((io = co_accept(listenio)) != NULL) {
+ *         co_create(event_loop(io), echo_session, io, 0);
+ *     }
+ * }
+ *
+ * evio_t* listenio = evio_create_socket(loop, "0.0.0.0", 1234, EIO_TYPE_TCP, EIO_SERVER_SIDE);
+ * co_create(loop, echo_server, listenio, 0);
+ * evloop_run(loop);
+ *
+ * NOTE: co_* must be called in a coroutine on the loop thread.
+ * One coroutine reads and one writes an io at a time, do not mix
+ * co_read/co_write with evio_read/evio_write on the same io, and
+ * evio_close an io only in the coroutine using it.
+ */
+
+// NOTE: virtual size, only touched pages are resident, @see test_coroutine
+// No guard page by default, one more mapping per stack would hit vm.max_map_count
+// (65530) at ~32k coroutines: an overflow silently corrupts the memory below,
+// keep big buffers and deep recursion off coroutine stacks or pass a larger stack_size.
+// Build with -DEVCO_STACK_GUARD to map the lowest page PROT_NONE, overflow => SIGSEGV.
+#define EVCO_DEFAULT_STACK_SIZE (64 << 10)
+#define EVCO_MAX_FREE_STACKS    1024
+
+typedef struct evco_s evco_t;
+typedef void (*evco_fn)(void* arg);
+
+// create and run it until the first suspension.
+// @stack_size: 0 means EVCO_DEFAULT_STACK_SIZE, rounded up to pages, including the guard page if any.
+// @return 0 on success, -1 if stack allocation failed
+int co_create(evloop_t* loop, evco_fn fn, void* arg, size_t stack_size DEFAULT(0));
+// @return current coroutine, NULL if not in a coroutine
+evco_t* co_self();
+evloop_t* co_loop(evco_t* co);
+
+// low level: co_suspend switches back to the caller of co_resume,
+// build custom waits with them, e.g. resume in an event callback.
+void co_resume(evco_t* co);
+void co_suspend();
+
+// resume in next loop iteration
+void co_yield();
+int co_sleep(uint32_t ms);
+
+// @return accepted io, NULL on error
+evio_t* co_accept(evio_t* listenio);
+// @return connected io, NULL on error
+evio_t* co_connect(evloop_t* loop, const char* host, int port);
+// @return > 0 bytes read, 0 peer closed, -1 error @see evio_error
+int co_read(evio_t* io, void* buf, int len);
+// read until delimiter (included), @see unpack_find_delimiter
+// @return line length, 0 peer closed, -1 error, evio_error is ERR_OVER_LIMIT if no delimiter in len bytes
+int co_read_until(evio_t* io, void* buf, int len, const char* delimiter);
+// write all, @return len or -1 error
+int co_write(evio_t* io, const void* buf, int len);
+
+#endif // EV_COROUTINE_H_
@@ -0,0 +1,807 @@
+#include "evdns.h"
+
+#include "base.h"
+#include "errors.h"
+#include "event.h"
+#include "hashmap.h"
+#include "log.h"
+#include "socket.h"
+
+#ifdef OS_LINUX
+#include <sys/random.h>
+#endif
+
+#define DNS_HEADER_SIZE  12
+#define DNS_UDP_SIZE     512 // no EDNS0
+#define DNS_FLAG_QR      0x8000
+#define DNS_FLAG_RD      0x0100
+#define DNS_RCODE_SERVFAIL 2
+#define DNS_RCODE_NXDOMAIN 3
+#define DNS_TYPE_A       1
+#define DNS_TYPE_SOA     6
+#define DNS_TYPE_AAAA    28
+#define DNS_CLASS_IN     1
+#define DNS_MAX_LABEL    63
+#define DNS_MAX_POINTERS 16
+
+// NOTE: [0] A, [1] AAAA of a request
+static const uint16_t s_qtypes[2] = {DNS_TYPE_A, DNS_TYPE_AAAA};
+
+typedef struct evdns_result_s {
+    int status; // 0, ERR_DNS_NXDOMAIN, ERR_DNS_NODATA, or not cached ones
+    uint32_t ttl;
+    int naddrs;
+    sockaddr_u addrs[EVDNS_MAX_ADDRS];
+} evdns_result_t;
+
+typedef struct evdns_entry_s {
+    char name[EVDNS_MAX_NAME + 1];
+    uint16_t qtype;
+    uint64_t expire_ms; // monotonic
+    evdns_result_t result;
+} evdns_entry_t;
+
+typedef struct evdns_query_s {
+    struct list_node node; // dns->queries
+    struct list_head waits; // evdns_wait_t of requests
+    evtimer_t* timer;
+    uint16_t id;
+    uint16_t qtype;
+    int ns;    // nameserver sent to last
+    int nsent; // attempts
+    char name[EVDNS_MAX_NAME + 1];
+} evdns_query_t;
+
+typedef struct evdns_wait_s {
+    struct list_node node; // query->waits, or ready list once answered
+    evdns_req_t* req;
+} evdns_wait_t;
+
+struct evdns_req_s {
+    evdns_cb cb;
+    void* userdata;
+    uint8_t types; // bits of s_qtypes asked
+    // NOTE: NULL once answered
+    evdns_query_t* queries[2];
+    evdns_wait_t waits[2];
+    evdns_result_t results[2];
+    // in the ready list of evdns_query_done until cb called
+    struct list_node ready;
+};
+
+typedef struct evdns_s {
+    int nservers;
+    sockaddr_u servers[EVDNS_MAX_NAMESERVERS];
+    evio_t* ios[EVDNS_MAX_NAMESERVERS]; // connected udp, created by the first query to it
+    uint32_t timeout_ms;
+    uint32_t attempts;
+    // NOTE: a few in flight for a stub resolver, ids and questions matched by walking it
+    struct list_head queries;
+    hashmap_t* cache;
+    evdns_stats_t stats;
+} evdns_t;
+
+static evdns_t* evdns_get(evloop_t* loop) {
+    if (loop->dns == NULL) {
+        evdns_t* dns;
+        EV_ALLOC_SIZEOF(dns);
+        dns->timeout_ms = EVDNS_DEFAULT_TIMEOUT;
+        dns->attempts = EVDNS_DEFAULT_ATTEMPTS;
+        list_init(&dns->queries);
+        loop->dns = dns;
+    }
+    return loop->dns;
+}
+
+static void evdns_close_ios(evdns_t* dns) {
+    for (int i = 0; i < EVDNS_MAX_NAMESERVERS; ++i) {
+        evio_t* io = dns->ios[i];
+        if (io) {
+            evio_setcb_read(io, NULL);
+            evio_setcb_close(io, NULL);
+            evio_close(io);
+            dns->ios[i] = NULL;
+        }
+    }
+}
+
+static int evdns_normalize(const char* name, char* out);
+
+//------------------------------------cache---------------------------------------------
+static uint64_t evdns_entry_hash(const void* item, uint64_t seed0, uint64_t seed1) {
+    const evdns_entry_t* e = (const evdns_entry_t*)item;
+    return hashmap_murmur(e->name, strlen(e->name), seed0, seed1) ^ e->qtype;
+}
+
+static int evdns_entry_compare(const void* a, const void* b, void* udata) {
+    const evdns_entry_t* ea = (const evdns_entry_t*)a;
+    const evdns_entry_t* eb = (const evdns_entry_t*)b;
+    if (ea->qtype != eb->qtype)
+        return ea->qtype - eb->qtype;
+    return strcmp(ea->name, eb->name);
+}
+
+static bool evdns_cache_get(evloop_t* loop, evdns_t* dns, const char* name, uint16_t qtype, evdns_result_t* result) {
+    if (dns->cache == NULL)
+        return false;
+    evdns_entry_t key;
+    strcpy(key.name, name);
+    key.qtype = qtype;
+    const evdns_entry_t* e = (const evdns_entry_t*)hashmap_get(dns->cache, &key);
+    if (e == NULL)
+        return false;
+    uint64_t now_ms = evloop_now_hrtime(loop) / 1000;
+    if (e->expire_ms <= now_ms) {
+        hashmap_del(dns->cache, &key);
+        return false;
+    }
+    *result = e->result;
+    result->ttl = (uint32_t)((e->expire_ms - now_ms + 999) / 1000);
+    return true;
+}
+
+static void evdns_cache_put(evloop_t* loop, evdns_t* dns, const char* name, uint16_t qtype,
+                            const evdns_result_t* result) {
+    if (result->ttl == 0)
+        return;
+    if (dns->cache == NULL) {
+        dns->cache = hashmap_new(sizeof(evdns_entry_t), 0, 0, 0, evdns_entry_hash, evdns_entry_compare, NULL, NULL);
+        if (dns->cache == NULL)
+            return;
+    }
+    uint64_t now_ms = evloop_now_hrtime(loop) / 1000;
+    evdns_entry_t entry;
+    strcpy(entry.name, name);
+    entry.qtype = qtype;
+    entry.expire_ms = now_ms + (uint64_t)result->ttl * 1000;
+    entry.result = *result;
+    if (hashmap_count(dns->cache) >= EVDNS_CACHE_SIZE && hashmap_get(dns->cache, &entry) == NULL) {
+        // NOTE: evict an expired one, or the one expiring first
+        evdns_entry_t victim;
+        size_t i = 0;
+        void* item;
+        victim.expire_ms = UINT64_MAX;
+        while (hashmap_iter(dns->cache, &i, &item)) {
+            const evdns_entry_t* e = (const evdns_entry_t*)item;
+            if (e->expire_ms < victim.expire_ms) {
+                victim = *e;
+                if (e->expire_ms <= now_ms)
+                    break;
+            }
+        }
+        hashmap_del(dns->cache, &victim);
+    }
+    hashmap_set(dns->cache, &entry);
+}
+
+void evdns_flush_cache(evloop_t* loop, const char* name) {
+    evdns_t* dns = loop->dns;
+    if (dns == NULL || dns->cache == NULL)
+        return;
+    if (name == NULL) {
+        hashmap_clear(dns->cache, false);
+        return;
+    }
+    evdns_entry_t key;
+    if (evdns_normalize(name, key.name) < 0)
+        return;
+    for (int i = 0; i < 2; ++i) {
+        key.qtype = s_qtypes[i];
+        hashmap_del(dns->cache, &key);
+    }
+}
+
+//------------------------------------message-------------------------------------------
+// lowercase without the trailing dot
+// @return length, -1 if not a host name of letters, digits, '-' and '_'
+static int evdns_normalize(const char* name, char* out) {
+    int len = 0, label = 0;
+    for (const char* p = name; *p; ++p) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '.') {
+            if (label == 0)
+                return -1;
+            label = 0;
+        } else if (isalnum(c) || c == '-' || c == '_') {
+            if (++label > DNS_MAX_LABEL)
+                return -1;
+        } else {
+            return -1;
+        }
+        // NOTE: room for the trailing dot of a fully qualified name
+        if (len > EVDNS_MAX_NAME)
+            return -1;
+        out[len++] = tolower(c);
+    }
+    if (len > 0 && out[len - 1] == '.')
+        --len;
+    if (len == 0 || len > EVDNS_MAX_NAME)
+        return -1;
+    out[len] = '\0';
+    return len;
+}
+
+static bool evdns_is_localhost(const char* name, int len) {
+    // NOTE: RFC 6761, localhost and names under it
+    static const char localhost[] = "localhost";
+    int n = sizeof(localhost) - 1;
+    if (len < n || strcmp(name + len - n, localhost) != 0)
+        return false;
+    return len == n || name[len - n - 1] == '.';
+}
+
+// @return length of the query
+static int evdns_build_query(const evdns_query_t* q, uint8_t* msg) {
+    memset(msg, 0, DNS_HEADER_SIZE);
+    msg[0] = q->id >> 8;
+    msg[1] = q->id & 0xFF;
+    msg[2] = DNS_FLAG_RD >> 8;
+    msg[5] = 1; // qdcount
+    int off = DNS_HEADER_SIZE;
+    const char* label = q->name;
+    for (;;) {
+        const char* dot = strchr(label, '.');
+        int n = dot ? dot - label : strlen(label);
+        msg[off++] = n;
+        memcpy(msg + off, label, n);
+        off += n;
+        if (dot == NULL)
+            break;
+        label = dot + 1;
+    }
+    msg[off++] = 0;
+    msg[off++] = q->qtype >> 8;
+    msg[off++] = q->qtype & 0xFF;
+    msg[off++] = 0;
+    msg[off++] = DNS_CLASS_IN;
+    return off;
+}
+
+static uint16_t dns_u16(const uint8_t* p) { return (p[0] << 8) | p[1]; }
+
+static uint32_t dns_u32(const uint8_t* p) { return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+
+// @out: lowercase dotted name if not NULL
+// @return offset after the name at off, -1 if malformed
+static int evdns_read_name(const uint8_t* msg, int len, int off, char* out) {
+    int end = -1;
+    int n = 0, pointers = 0;
+    for (;;) {
+        if (off >= len)
+            return -1;
+        uint8_t c = msg[off];
+        if (c == 0) {
+            if (end < 0)
+                end = off + 1;
+            break;
+        }
+        if ((c & 0xC0) == 0xC0) {
+            if (off + 1 >= len || ++pointers > DNS_MAX_POINTERS)
+                return -1;
+            if (end < 0)
+                end = off + 2;
+            off = ((c & 0x3F) << 8) | msg[off + 1];
+            continue;
+        }
+        if ((c & 0xC0) || off + 1 + c > len || n + (n ? 1 : 0) + c > EVDNS_MAX_NAME)
+            return -1;
+        if (n)
+            ++n;
+        if (out) {
+            if (n)
+                out[n - 1] = '.';
+            for (int i = 0; i < c; ++i) {
+                out[n + i] = tolower(msg[off + 1 + i]);
+            }
+        }
+        n += c;
+        off += 1 + c;
+    }
+    if (out)
+        out[n] = '\0';
+    return end;
+}
+
+// @return query of the id and question, NULL if none
+static evdns_query_t* evdns_match(evdns_t* dns, const uint8_t* msg, int len, int* off) {
+    if (len < DNS_HEADER_SIZE || !(dns_u16(msg + 2) & DNS_FLAG_QR) || dns_u16(msg + 4) != 1)
+        return NULL;
+    char name[EVDNS_MAX_NAME + 1];
+    int end = evdns_read_name(msg, len, DNS_HEADER_SIZE, name);
+    if (end < 0 || end + 4 > len || dns_u16(msg + end + 2) != DNS_CLASS_IN)
+        return NULL;
+    uint16_t id = dns_u16(msg);
+    uint16_t qtype = dns_u16(msg + end);
+    struct list_node* node;
+    list_for_each(node, &dns->queries) {
+        evdns_query_t* q = list_entry(node, evdns_query_t, node);
+        if (q->id == id && q->qtype == qtype && strcmp(q->name, name) == 0) {
+            *off = end + 4;
+            return q;
+        }
+    }
+    return NULL;
+}
+
+// @return 0 if answered or negative, -1 to ask the next nameserver
+static int evdns_parse_answer(const uint8_t* msg, int len, int off, uint16_t qtype, evdns_result_t* result) {
+    memset(result, 0, sizeof(*result));
+    int rcode = dns_u16(msg + 2) & 0x0F;
+    if (rcode != 0 && rcode != DNS_RCODE_NXDOMAIN) {
+        result->status = rcode == DNS_RCODE_SERVFAIL ? ERR_DNS_SERVFAIL : ERR_RESPONSE;
+        return -1;
+    }
+    int addrlen = qtype == DNS_TYPE_A ? 4 : 16;
+    uint32_t ttl = EVDNS_MAX_TTL;
+    uint32_t negative_ttl = EVDNS_NEGATIVE_TTL;
+    int ancount = dns_u16(msg + 6);
+    int nscount = dns_u16(msg + 8);
+    bool malformed = false;
+    // NOTE: answers of a CNAME chain are trusted as the recursive resolver followed it
+    for (int i = 0; i < ancount + nscount; ++i) {
+        off = evdns_read_name(msg, len, off, NULL);
+        if (off < 0 || off + 10 > len || off + 10 + dns_u16(msg + off + 8) > len) {
+            malformed = true;
+            break;
+        }
+        uint16_t type = dns_u16(msg + off);
+        uint16_t klass = dns_u16(msg + off + 2);
+        uint32_t rrttl = dns_u32(msg + off + 4);
+        int rdlen = dns_u16(msg + off + 8);
+        const uint8_t* rdata = msg + off + 10;
+        off += 10 + rdlen;
+        // NOTE: RFC 2181, ttl with the most significant bit set as 0
+        if (rrttl > INT32_MAX)
+            rrttl = 0;
+        if (i < ancount) {
+            if (rcode == 0 && type == qtype && klass == DNS_CLASS_IN && rdlen == addrlen &&
+                result->naddrs < EVDNS_MAX_ADDRS) {
+                // NOTE: family2addrsize of sockunion_set is of sockaddr, not of the address
+                sockaddr_u* addr = &result->addrs[result->naddrs++];
+                if (qtype == DNS_TYPE_A) {
+                    addr->sin.sin_family = AF_INET;
+                    memcpy(&addr->sin.sin_addr, rdata, rdlen);
+                } else {
+                    addr->sin6.sin6_family = AF_INET6;
+                    memcpy(&addr->sin6.sin6_addr, rdata, rdlen);
+                }
+                ttl = MIN(ttl, rrttl);
+            }
+        } else if (result->naddrs == 0 && type == DNS_TYPE_SOA && rdlen >= 22) {
+            // NOTE: RFC 2308, negative ttl is the least of SOA ttl and its minimum field
+            negative_ttl = MIN(rrttl, dns_u32(rdata + rdlen - 4));
+            break;
+        }
+    }
+    if (result->naddrs > 0) {
+        result->ttl = ttl;
+        return 0;
+    }
+    if (malformed) {
+        result->status = ERR_RESPONSE;
+        return -1;
+    }
+    result->status = rcode == DNS_RCODE_NXDOMAIN ? ERR_DNS_NXDOMAIN : ERR_DNS_NODATA;
+    result->ttl = MIN(negative_ttl, EVDNS_MAX_TTL);
+    return 0;
+}
+
+//------------------------------------query---------------------------------------------
+static void evdns_on_read(evio_t* io, void* buf, int readbytes);
+
+static void evdns_on_close(evio_t* io) {
+    evdns_t* dns = event_loop(io)->dns;
+    for (int i = 0; dns && i < EVDNS_MAX_NAMESERVERS; ++i) {
+        if (dns->ios[i] == io)
+            dns->ios[i] = NULL;
+    }
+}
+
+static evio_t* evdns_io(evloop_t* loop, evdns_t* dns, int ns) {
+    if (dns->ios[ns])
+        return dns->ios[ns];
+    sockaddr_u* addr = &dns->servers[ns];
+    int fd = socket(addr->sa.sa_family, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        log_error("evdns socket: %s", strerror(errno));
+        return NULL;
+    }
+    // NOTE: connected, answers of other sources are dropped by the kernel
+    if (connect(fd, &addr->sa, sockunion_get_addrlen(addr)) < 0) {
+        log_error("evdns connect: %s", strerror(errno));
+        closesocket(fd);
+        return NULL;
+    }
+    evio_t* io = evio_get(loop, fd);
+    io->io_type = EIO_TYPE_UDP;
+    evio_set_peeraddr(io, &addr->sa, sockunion_get_addrlen(addr));
+    evio_setcb_read(io, evdns_on_read);
+    evio_setcb_close(io, evdns_on_close);
+    evio_read(io);
+    dns->ios[ns] = io;
+    return io;
+}
+
+static uint16_t evdns_query_id(evdns_t* dns) {
+    // NOTE: unpredictable ids against spoofed answers
+    for (;;) {
+        uint16_t id = 0;
+#ifdef OS_LINUX
+        if (getrandom(&id, sizeof(id), GRND_NONBLOCK) != sizeof(id))
+#endif
+            id = (uint16_t)rand();
+        bool used = false;
+        struct list_node* node;
+        list_for_each(node, &dns->queries) {
+            if (list_entry(node, evdns_query_t, node)->id == id) {
+                used = true;
+                break;
+            }
+        }
+        if (!used)
+            return id;
+    }
+}
+
+// NOTE: a lost send is left to the timer as a lost datagram
+static void evdns_query_send(evloop_t* loop, evdns_t* dns, evdns_query_t* q) {
+    uint8_t msg[DNS_UDP_SIZE];
+    int len = evdns_build_query(q, msg);
+    ++q->nsent;
+    evio_t* io = evdns_io(loop, dns, q->ns);
+    if (io) {
+        evio_write(io, msg, len);
+    }
+}
+
+static void evdns_query_free(evdns_t* dns, evdns_query_t* q) {
+    evtimer_del(q->timer);
+    list_del(&q->node);
+    --dns->stats.inflight;
+    EV_FREE(q);
+}
+
+// NOTE: any addresses win, then NXDOMAIN, then failures, then NODATA
+static int evdns_status_rank(int status) {
+    return status == ERR_DNS_NXDOMAIN ? 3 : status == ERR_DNS_NODATA ? 1 : 2;
+}
+
+static void evdns_deliver(evdns_req_t* req) {
+    evdns_addrs_t addrs;
+    addrs.naddrs = 0;
+    addrs.ttl = UINT32_MAX;
+    int status = ERR_DNS_NODATA, rank = 0;
+    for (int i = 0; i < 2; ++i) {
+        if (!(req->types & (1 << i)))
+            continue;
+        const evdns_result_t* r = &req->results[i];
+        memcpy(addrs.addrs + addrs.naddrs, r->addrs, r->naddrs * sizeof(sockaddr_u));
+        addrs.naddrs += r->naddrs;
+        addrs.ttl = MIN(addrs.ttl, r->ttl);
+        if (r->status != 0 && evdns_status_rank(r->status) > rank) {
+            status = r->status;
+            rank = evdns_status_rank(r->status);
+        }
+    }
+    if (addrs.naddrs > 0)
+        status = 0;
+    if (addrs.ttl == UINT32_MAX)
+        addrs.ttl = 0;
+    req->cb(req, status, &addrs, req->userdata);
+    EV_FREE(req);
+}
+
+static void evdns_query_done(evloop_t* loop, evdns_t* dns, evdns_query_t* q, const evdns_result_t* result) {
+    int status = result->status;
+    if (status == 0 || status == ERR_DNS_NXDOMAIN || status == ERR_DNS_NODATA) {
+        evdns_cache_put(loop, dns, q->name, q->qtype, result);
+    } else if (status == ERR_TASK_TIMEOUT) {
+        ++dns->stats.timeouts;
+    }
+    // NOTE: requests answered move to ready first, cb may cancel others or resolve again
+    struct list_head ready;
+    list_init(&ready);
+    struct list_node *node, *next;
+    list_for_each_safe(node, next, &q->waits) {
+        evdns_wait_t* wait = list_entry(node, evdns_wait_t, node);
+        evdns_req_t* req = wait->req;
+        int i = wait - req->waits;
+        list_del(node);
+        req->queries[i] = NULL;
+        req->results[i] = *result;
+        if (req->queries[!i] == NULL) {
+            list_add_tail(&req->ready, &ready);
+        }
+    }
+    evdns_query_free(dns, q);
+    while (!list_empty(&ready)) {
+        evdns_req_t* req = list_entry(ready.next, evdns_req_t, ready);
+        list_del(&req->ready);
+        evdns_deliver(req);
+    }
+}
+
+// @return 0 if sent to the next nameserver, -1 if attempts used up
+static int evdns_query_retry(evloop_t* loop, evdns_t* dns, evdns_query_t* q) {
+    if (q->nsent >= dns->nservers * (int)dns->attempts)
+        return -1;
+    q->ns = (q->ns + 1) % dns->nservers;
+    ++dns->stats.retries;
+    evdns_query_send(loop, dns, q);
+    return 0;
+}
+
+static void evdns_on_timeout(evtimer_t* timer) {
+    evloop_t* loop = event_loop(timer);
+    evdns_t* dns = loop->dns;
+    evdns_query_t* q = (evdns_query_t*)event_userdata(timer);
+    if (evdns_query_retry(loop, dns, q) != 0) {
+        evdns_result_t result;
+        memset(&result, 0, sizeof(result));
+        result.status = ERR_TASK_TIMEOUT;
+        evdns_query_done(loop, dns, q, &result);
+    }
+}
+
+static void evdns_on_read(evio_t* io, void* buf, int readbytes) {
+    evloop_t* loop = event_loop(io);
+    evdns_t* dns = loop->dns;
+    const uint8_t* msg = (const uint8_t*)buf;
+    int off = 0;
+    evdns_query_t* q = evdns_match(dns, msg, readbytes, &off);
+    if (q == NULL) {
+        ++dns->stats.mismatches;
+        return;
+    }
+    evdns_result_t result;
+    if (evdns_parse_answer(msg, readbytes, off, q->qtype, &result) != 0) {
+        if (evdns_query_retry(loop, dns, q) == 0) {
+            evtimer_reset(q->timer, 0);
+            return;
+        }
+    }
+    evdns_query_done(loop, dns, q, &result);
+}
+
+static evdns_query_t* evdns_query_start(evloop_t* loop, evdns_t* dns, const char* name, uint16_t qtype) {
+    evdns_query_t* q;
+    EV_ALLOC_SIZEOF(q);
+    strcpy(q->name, name);
+    q->qtype = qtype;
+    q->id = evdns_query_id(dns);
+    list_init(&q->waits);
+    q->timer = evtimer_add(loop, evdns_on_timeout, dns->timeout_ms, INFINITE);
+    event_set_userdata(q->timer, q);
+    list_add_tail(&q->node, &dns->queries);
+    ++dns->stats.inflight;
+    ++dns->stats.queries;
+    evdns_query_send(loop, dns, q);
+    return q;
+}
+
+//------------------------------------api-----------------------------------------------
+int evdns_set_nameservers(evloop_t* loop, const char* servers) {
+    if (servers == NULL)
+        return -1;
+    sockaddr_u addrs[EVDNS_MAX_NAMESERVERS];
+    int n = 0;
+    const char* p = servers;
+    while (*p && n < EVDNS_MAX_NAMESERVERS) {
+        p += strspn(p, " \t,");
+        int len = strcspn(p, " \t,");
+        if (len == 0)
+            break;
+        char host[64];
+        int port = EVDNS_PORT;
+        if (len >= (int)sizeof(host)) {
+            p += len;
+            continue;
+        }
+        memcpy(host, p, len);
+        host[len] = '\0';
+        p += len;
+        char* ip = host;
+        char* colon = strrchr(host, ':');
+        if (host[0] == '[') {
+            // [ipv6]:port
+            char* bracket = strchr(host, ']');
+            if (bracket == NULL)
+                continue;
+            *bracket = '\0';
+            ip = host + 1;
+            if (bracket[1] == ':')
+                port = atoi(bracket + 2);
+        } else if (colon && strchr(host, ':') == colon) {
+            // ipv4:port
+            *colon = '\0';
+            port = atoi(colon + 1);
+        }
+        if (port <= 0 || port > 65535 || str2sockunion(ip, &addrs[n]) != 0) {
+            log_warn("evdns invalid nameserver: %s", ip);
+            continue;
+        }
+        sockunion_set_port(&addrs[n], port);
+        ++n;
+    }
+    if (n == 0)
+        return -1;
+    evdns_t* dns = evdns_get(loop);
+    evdns_close_ios(dns);
+    memcpy(dns->servers, addrs, n * sizeof(sockaddr_u));
+    dns->nservers = n;
+    return n;
+}
+
+int evdns_load_resolv_conf(evloop_t* loop, const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+        return -1;
+    char servers[EVDNS_MAX_NAMESERVERS * 64] = {0};
+    int n = 0;
+    uint32_t timeout_ms = 0, attempts = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        char* saveptr = NULL;
+        char* key = strtok_r(line, " \t\r\n", &saveptr);
+        if (key == NULL || *key == '#' || *key == ';')
+            continue;
+        char* value;
+        if (strcmp(key, "nameserver") == 0) {
+            value = strtok_r(NULL, " \t\r\n", &saveptr);
+            // NOTE: scoped ipv6 as fe80::1%eth0 not supported
+            if (value && n < EVDNS_MAX_NAMESERVERS && strlen(value) < 60 && strchr(value, '%') == NULL) {
+                snprintf(servers + strlen(servers), sizeof(servers) - strlen(servers), "%s ", value);
+                ++n;
+            }
+        } else if (strcmp(key, "options") == 0) {
+            while ((value = strtok_r(NULL, " \t\r\n", &saveptr)) != NULL) {
+                if (strncmp(value, "timeout:", 8) == 0) {
+                    timeout_ms = atoi(value + 8) * 1000;
+                } else if (strncmp(value, "attempts:", 9) == 0) {
+                    attempts = atoi(value + 9);
+                }
+            }
+        }
+    }
+    fclose(fp);
+    evdns_set_timeout(loop, timeout_ms, attempts);
+    // NOTE: as glibc, the local nameserver if none listed
+    return evdns_set_nameservers(loop, n ? servers : "127.0.0.1");
+}
+
+void evdns_set_timeout(evloop_t* loop, uint32_t timeout_ms, uint32_t attempts) {
+    evdns_t* dns = evdns_get(loop);
+    if (timeout_ms)
+        dns->timeout_ms = timeout_ms;
+    if (attempts)
+        dns->attempts = attempts;
+}
+
+static uint8_t evdns_family_types(int family) { return family == AF_INET ? 1 : family == AF_INET6 ? 2 : 3; }
+
+// ip literal as the answer of its type, NODATA of the other
+static int evdns_literal(evdns_req_t* req, const char* name) {
+    sockaddr_u addr;
+    if (str2sockunion(name, &addr) != 0)
+        return -1;
+    int i = addr.sa.sa_family == AF_INET ? 0 : 1;
+    req->results[i].naddrs = 1;
+    req->results[i].addrs[0] = addr;
+    req->results[!i].status = ERR_DNS_NODATA;
+    return 0;
+}
+
+evdns_req_t* evdns_resolve(evloop_t* loop, const char* name, int family, evdns_cb cb, void* userdata) {
+    if (cb == NULL)
+        return NULL;
+    evdns_t* dns = evdns_get(loop);
+    ++dns->stats.requests;
+    evdns_req_t* req;
+    EV_ALLOC_SIZEOF(req);
+    req->cb = cb;
+    req->userdata = userdata;
+    req->types = evdns_family_types(family);
+    char lname[EVDNS_MAX_NAME + 1];
+    int len;
+    if ((family != AF_INET && family != AF_INET6 && family != AF_UNSPEC) || name == NULL) {
+        req->results[0].status = req->results[1].status = ERR_INVALID_PARAM;
+    } else if (evdns_literal(req, name) == 0) {
+        // NOTE: no query, as getaddrinfo with AI_NUMERICHOST
+    } else if ((len = evdns_normalize(name, lname)) < 0) {
+        req->results[0].status = req->results[1].status = ERR_INVALID_PARAM;
+    } else if (evdns_is_localhost(lname, len)) {
+        evdns_literal(req, "127.0.0.1");
+        evdns_literal(req, "::1");
+        req->results[0].status = 0;
+    } else {
+        if (dns->nservers == 0 && evdns_load_resolv_conf(loop, EVDNS_RESOLV_CONF) < 0) {
+            evdns_set_nameservers(loop, "127.0.0.1");
+        }
+        for (int i = 0; i < 2; ++i) {
+            if (!(req->types & (1 << i)))
+                continue;
+            uint16_t qtype = s_qtypes[i];
+            if (evdns_cache_get(loop, dns, lname, qtype, &req->results[i])) {
+                ++dns->stats.cache_hits;
+                continue;
+            }
+            evdns_query_t* q = NULL;
+            struct list_node* node;
+            list_for_each(node, &dns->queries) {
+                evdns_query_t* it = list_entry(node, evdns_query_t, node);
+                if (it->qtype == qtype && strcmp(it->name, lname) == 0) {
+                    q = it;
+                    ++dns->stats.coalesced;
+                    break;
+                }
+            }
+            if (q == NULL) {
+                q = evdns_query_start(loop, dns, lname, qtype);
+            }
+            req->queries[i] = q;
+            req->waits[i].req = req;
+            list_add_tail(&req->waits[i].node, &q->waits);
+        }
+        if (req->queries[0] || req->queries[1])
+            return req;
+    }
+    evdns_deliver(req);
+    return NULL;
+}
+
+void evdns_cancel(evdns_req_t* req) {
+    if (req == NULL)
+        return;
+    if (req->queries[0] == NULL && req->queries[1] == NULL) {
+        // NOTE: answered, in the ready list of evdns_query_done
+        list_del(&req->ready);
+    }
+    for (int i = 0; i < 2; ++i) {
+        evdns_query_t* q = req->queries[i];
+        if (q == NULL)
+            continue;
+        list_del(&req->waits[i].node);
+        if (list_empty(&q->waits)) {
+            evdns_query_free(event_loop(q->timer)->dns, q);
+        }
+    }
+    EV_FREE(req);
+}
+
+int evdns_stats(evloop_t* loop, evdns_stats_t* stats) {
+    if (stats == NULL)
+        return -1;
+    evdns_t* dns = loop->dns;
+    if (dns == NULL) {
+        memset(stats, 0, sizeof(*stats));
+        return 0;
+    }
+    *stats = dns->stats;
+    stats->cached = dns->cache ? hashmap_count(dns->cache) : 0;
+    return 0;
+}
+
+void evloop_dns_cleanup(evloop_t* loop) {
+    evdns_t* dns = loop->dns;
+    if (dns == NULL)
+        return;
+    // NOTE: pending requests freed without cb, as timers and ios of the loop
+    while (!list_empty(&dns->queries)) {
+        evdns_query_t* q = list_entry(dns->queries.next, evdns_query_t, node);
+        while (!list_empty(&q->waits)) {
+            evdns_wait_t* wait = list_entry(q->waits.next, evdns_wait_t, node);
+            evdns_req_t* req = wait->req;
+            list_del(&wait->node);
+            req->queries[wait - req->waits] = NULL;
+            if (req->queries[0] == NULL && req->queries[1] == NULL) {
+                EV_FREE(req);
+            }
+        }
+        evdns_query_free(dns, q);
+    }
+    evdns_close_ios(dns);
+    if (dns->cache) {
+        hashmap_free(dns->cache);
+    }
+    EV_FREE(loop->dns);
+}
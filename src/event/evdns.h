@@ -0,0 +1,81 @@
+#ifndef EV_DNS_H_
+#define EV_DNS_H_
+
+#include "eventloop.h"
+#include "sockunion.h"
+
+/*
+ * non-blocking stub resolver on the loop: udp queries to the nameservers of resolv.conf,
+ * A and AAAA in parallel, one query in flight per name and type shared by all requests,
+ * answers cached by their ttl, NXDOMAIN and NODATA by the SOA minimum (RFC 2308).
+ *
+ * static void on_resolved(evdns_req_t* req, int status, const evdns_addrs_t* addrs, void* userdata) {
+ *     if (status != 0) return;
+ *     char ip[SU_ADDRSTRLEN];
+ *     sockunion2str(&addrs->addrs[0], ip, sizeof(ip));
+ *     evloop_create_tcp_client((evloop_t*)userdata, ip, 80, on_connect, on_close);
+ * }
+ * evdns_resolve(loop, "example.com", AF_UNSPEC, on_resolved, loop);
+ *
+ * NOTE: loop thread only. No /etc/hosts but localhost, no search domains,
+ * and no tcp retry of truncated answers, the addresses in them are used.
+ */
+
+#define EVDNS_RESOLV_CONF      "/etc/resolv.conf"
+#define EVDNS_PORT             53
+#define EVDNS_MAX_NAMESERVERS  3     // MAXNS of resolv.h
+#define EVDNS_MAX_NAME         253
+#define EVDNS_MAX_ADDRS        16    // of a type, more are dropped
+#define EVDNS_DEFAULT_TIMEOUT  5000  // ms per attempt, options timeout:n of resolv.conf
+#define EVDNS_DEFAULT_ATTEMPTS 2     // per nameserver, options attempts:n of resolv.conf
+#define EVDNS_CACHE_SIZE       1024  // names and types
+#define EVDNS_MAX_TTL          86400 // s
+// NXDOMAIN or NODATA without SOA
+#define EVDNS_NEGATIVE_TTL     30 // s
+
+typedef struct evdns_req_s evdns_req_t;
+
+typedef struct evdns_addrs_s {
+    int naddrs;
+    uint32_t ttl;                          // s, the least of answers
+    sockaddr_u addrs[2 * EVDNS_MAX_ADDRS]; // port 0, A before AAAA
+} evdns_addrs_t;
+
+// @status: 0 with addrs->naddrs > 0, ERR_DNS_NXDOMAIN, ERR_DNS_NODATA, ERR_DNS_SERVFAIL,
+// ERR_RESPONSE for refused or malformed answers, ERR_TASK_TIMEOUT, ERR_INVALID_PARAM for bad names.
+typedef void (*evdns_cb)(evdns_req_t* req, int status, const evdns_addrs_t* addrs, void* userdata);
+
+// @servers: "ip[:port]" separated by spaces or commas, instead of those of resolv.conf.
+// @return number of nameservers, -1 if none valid
+int evdns_set_nameservers(evloop_t* loop, const char* servers);
+// nameserver and options timeout/attempts, loaded by the first evdns_resolve if no nameservers set,
+// 127.0.0.1 if none in it as glibc.
+// @return number of nameservers, -1 if unreadable
+int evdns_load_resolv_conf(evloop_t* loop, const char* path DEFAULT(EVDNS_RESOLV_CONF));
+// @timeout_ms: per attempt, @attempts: per nameserver, 0 keeps the current
+void evdns_set_timeout(evloop_t* loop, uint32_t timeout_ms, uint32_t attempts DEFAULT(0));
+
+// @family: AF_INET, AF_INET6, or AF_UNSPEC for A and AAAA in parallel.
+// cb is called once, unless evdns_cancel, before evdns_resolve returns for ip literals,
+// localhost, cache hits and errors.
+// @return handle valid until cb called, NULL if cb called already
+evdns_req_t* evdns_resolve(evloop_t* loop, const char* name, int family, evdns_cb cb, void* userdata DEFAULT(NULL));
+// cb not called, query stopped if no other requests of the name
+void evdns_cancel(evdns_req_t* req);
+// drop cached answers, all names if name is NULL
+void evdns_flush_cache(evloop_t* loop, const char* name DEFAULT(NULL));
+
+typedef struct evdns_stats_s {
+    uint64_t requests;    // evdns_resolve
+    uint64_t cache_hits;  // of a type, negative ones included
+    uint64_t coalesced;   // of a type, joined a query in flight
+    uint64_t queries;     // sent, not counting retries
+    uint64_t retries;     // sent again on timeout, SERVFAIL or refused
+    uint64_t timeouts;    // queries without answer after all attempts
+    uint64_t mismatches;  // answers dropped, unknown id or question
+    uint32_t inflight;    // queries
+    uint32_t cached;      // names and types
+} evdns_stats_t;
+int evdns_stats(evloop_t* loop, evdns_stats_t* stats);
+
+#endif // EV_DNS_H_
@@ -65,6 +65,15 @@ static void evio_socket_init(evio_t* io) {
     } else {
         nonblocking(io->fd);
     }
+    if (io->loop->so_busy_poll_us > 0 && so_busy_poll(io->fd, io->loop->so_busy_poll_us) != 0) {
+        log_debug("so_busy_poll fd=%d error=%d", io->fd, socket_errno());
+    }
+    // NOTE: lean stream io fills localaddr/peeraddr on first evio_localaddr/evio_peeraddr
+    if (io->lean && (io->io_type & EIO_TYPE_SOCK_STREAM)) {
+        EV_FREE(io->localaddr);
+        EV_FREE(io->peeraddr);
+        return;
+    }
     // fill io->localaddr io->peeraddr
     if (io->localaddr == NULL) {
         EV_ALLOC(io->localaddr, sizeof(sockaddr_u));
@@ -97,7 +106,102 @@ void evio_init(evio_t* io) {
     // write_queue init when hwrite try_write failed
     // write_queue_init(&io->write_queue, 4);
 
-    recursive_mutex_init(&io->write_mutex);
+    io->cold = (struct evio_cold_s*)&evio_cold_none;
+    // NOTE: written in loop thread only, no write_mutex, cold fields allocated on first use.
+    if (io->loop->flags & EVLOOP_FLAG_LEAN) {
+        io->lean = 1;
+        return;
+    }
+    recursive_mutex_init(&evio_cold(io)->write_mutex);
+}
+
+const struct evio_cold_s evio_cold_none = {0};
+
+struct evio_cold_s* evio_cold_alloc(evio_t* io) {
+    EV_ALLOC(io->cold, io->lean ? EVIO_COLD_LEAN_SIZE : sizeof(struct evio_cold_s));
+    return io->cold;
+}
+
+void evio_cold_free(evio_t* io) {
+    if (io->cold == &evio_cold_none)
+        return;
+    if (!io->lean) {
+        recursive_mutex_destroy(&io->cold->write_mutex);
+    }
+    EV_FREE(io->cold);
+    io->cold = (struct evio_cold_s*)&evio_cold_none;
+}
+
+// NOTE: ios are freed by evloop_free only, and may be attached to other loops,
+// so slabs are shared by all loops and kept until exit.
+#define EVIO_SLAB_SIZE 64
+static mutex_t s_evio_slab_mutex = PTHREAD_MUTEX_INITIALIZER;
+static evio_t* s_evio_slab_free = NULL;
+static void* s_evio_slabs = NULL; // linked by the first pointer of each slab
+
+evio_t* evio_slab_alloc() {
+    mutex_lock(&s_evio_slab_mutex);
+    if (s_evio_slab_free == NULL) {
+        char* slab = NULL;
+        EV_ALLOC(slab, sizeof(void*) + EVIO_SLAB_SIZE * sizeof(evio_t));
+        *(void**)slab = s_evio_slabs;
+        s_evio_slabs = slab;
+        evio_t* ios = (evio_t*)(slab + sizeof(void*));
+        for (int i = EVIO_SLAB_SIZE - 1; i >= 0; --i) {
+            *(evio_t**)&ios[i] = s_evio_slab_free;
+            s_evio_slab_free = &ios[i];
+        }
+    }
+    evio_t* io = s_evio_slab_free;
+    s_evio_slab_free = *(evio_t**)io;
+    mutex_unlock(&s_evio_slab_mutex);
+    memset(io, 0, sizeof(evio_t));
+    io->slab = 1;
+    return io;
+}
+
+void evio_slab_free(evio_t* io) {
+    mutex_lock(&s_evio_slab_mutex);
+    *(evio_t**)io = s_evio_slab_free;
+    s_evio_slab_free = io;
+    mutex_unlock(&s_evio_slab_mutex);
+}
+
+static void evio_cold_reset(evio_t* io) {
+    struct evio_cold_s* cold = io->cold;
+    if (cold == &evio_cold_none)
+        return;
+    cold->write_high_water = cold->write_low_water = 0;
+    cold->watermark_cb = NULL;
+    // timers
+    cold->connect_timeout = 0;
+    cold->connect_timer = NULL;
+    cold->close_timeout = 0;
+    cold->close_timer = NULL;
+    cold->read_timeout = 0;
+    cold->read_timer = NULL;
+    cold->write_timeout = 0;
+    cold->write_timer = NULL;
+    cold->keepalive_timeout = 0;
+    cold->keepalive_timer = NULL;
+    cold->heartbeat_interval = 0;
+    cold->heartbeat_fn = NULL;
+    cold->heartbeat_timer = NULL;
+    // upstream
+    cold->upstream_io = NULL;
+    // unpack
+    cold->unpack_setting = NULL;
+    cold->rcvlowat = 0;
+    cold->budget = NULL;
+    // coroutines
+    cold->co_reader = cold->co_writer = NULL;
+    // ssl
+    cold->ssl = NULL;
+    cold->ssl_ctx = NULL;
+    cold->hostname = NULL;
+    // zerocopy
+    cold->zerocopy_threshold = 0;
+    cold->zerocopy_seq = 0;
 }
 
 void evio_ready(evio_t* io) {
@@ -111,11 +215,15 @@ void evio_ready(evio_t* io) {
     io->recv = io->send = 0;
     io->recvfrom = io->sendto = 0;
     io->close = 0;
+    io->udp_gro = io->udp_nogso = 0;
+    io->zerocopy = io->zerocopy_wait = 0;
+    io->no_rcvlowat = 0;
     // public:
     io->id = evio_next_id();
     io->io_type = EIO_TYPE_UNKNOWN;
     io->error = 0;
     io->events = io->revents = 0;
+    io->again_events = 0;
     io->last_read_hrtime = io->last_write_hrtime = io->loop->cur_hrtime;
     // readbuf
     io->alloced_readbuf = 0;
@@ -129,35 +237,17 @@ void evio_ready(evio_t* io) {
     // write_queue
     io->write_bufsize = 0;
     io->max_write_bufsize = MAX_WRITE_BUFSIZE;
+    io->write_above_high = io->write_pause_upstream = 0;
+    io->budget_paused = 0;
     // callbacks
     io->read_cb = NULL;
     io->write_cb = NULL;
     io->close_cb = NULL;
     io->accept_cb = NULL;
     io->connect_cb = NULL;
-    // timers
-    io->connect_timeout = 0;
-    io->connect_timer = NULL;
-    io->close_timeout = 0;
-    io->close_timer = NULL;
-    io->read_timeout = 0;
-    io->read_timer = NULL;
-    io->write_timeout = 0;
-    io->write_timer = NULL;
-    io->keepalive_timeout = 0;
-    io->keepalive_timer = NULL;
-    io->heartbeat_interval = 0;
-    io->heartbeat_fn = NULL;
-    io->heartbeat_timer = NULL;
-    // upstream
-    io->upstream_io = NULL;
-    // unpack
-    io->unpack_setting = NULL;
-    // ssl
-    io->ssl = NULL;
-    io->ssl_ctx = NULL;
     io->alloced_ssl_ctx = 0;
-    io->hostname = NULL;
+    // timers, upstream, unpack, ssl
+    evio_cold_reset(io);
     // context
     io->ctx = NULL;
     // private:
@@ -180,21 +270,47 @@ void evio_done(evio_t* io) {
         return;
     io->ready = 0;
 
+    // NOTE: stop watching the error queue, pending zerocopy buffers taken by evio_close.
+    io->zerocopy_wait = 0;
     evio_del(io, EV_RDWR);
+#if defined(EVENT_EPOLL) || defined(EVENT_IOURING)
+    if (io->epoll_events) {
+        // NOTE: edge-triggered fd stays registered even if io->events == 0
+        iowatcher_del_event(io->loop, io->fd, EV_RDWR);
+    }
+#endif
+#ifdef EVENT_IOURING
+    iouring_io_done(io);
+#endif
 
     // readbuf
     evio_free_readbuf(io);
+    EV_FREE(io->cold->batch);
+    evio_splice_free(io);
+    evio_chain_free(io);
 
     // write_queue
-    offset_buf_t* pbuf = NULL;
-    recursive_mutex_lock(&io->write_mutex);
+    write_buf_t* pbuf = NULL;
+    evio_write_lock(io);
     while (!write_queue_empty(&io->write_queue)) {
         pbuf = write_queue_front(&io->write_queue);
-        EV_FREE(pbuf->base);
+        evbuf_unref(pbuf->ref);
         write_queue_pop_front(&io->write_queue);
     }
-    write_queue_cleanup(&io->write_queue);
-    recursive_mutex_unlock(&io->write_mutex);
+    evloop_memory_add(io->loop, -(long long)io->write_bufsize);
+    io->write_bufsize = 0;
+    // NOTE: keep a small write_queue for the next connection of this fd, cleanup in evio_free,
+    // lean ios keep nothing.
+    if (io->write_queue.maxsize > EVIO_WRITE_QUEUE_KEEP_SIZE || io->lean) {
+        write_queue_cleanup(&io->write_queue);
+    }
+    evio_write_unlock(io);
+
+    // NOTE: zerocopy sends not completed yet were taken by evio_close, released once fd closed.
+    struct zerocopy_queue* pending = &io->cold->zerocopy_pending;
+    if (pending->maxsize) {
+        zerocopy_queue_cleanup(pending);
+    }
 
 #if WITH_RUDP
     if ((io->io_type & EIO_TYPE_SOCK_DGRAM) || (io->io_type & EIO_TYPE_SOCK_RAW)) {
@@ -206,11 +322,27 @@ void evio_done(evio_t* io) {
 void evio_free(evio_t* io) {
     if (io == NULL)
         return;
+    // NOTE: loop is going away, do not wait write_queue drained.
+    io->close = 1;
     evio_close(io);
-    recursive_mutex_destroy(&io->write_mutex);
+#ifdef EVENT_IOURING
+    // NOTE: evio_close maybe async
+    iouring_io_free(io);
+#endif
+    // NOTE: evio_done not called if evio_close is async
+    evio_free_readbuf(io);
+    EV_FREE(io->cold->batch);
+    evio_splice_free(io);
+    evio_chain_free(io);
+    write_queue_cleanup(&io->write_queue);
+    evio_cold_free(io);
     EV_FREE(io->localaddr);
     EV_FREE(io->peeraddr);
-    EV_FREE(io);
+    if (io->slab) {
+        evio_slab_free(io);
+    } else {
+        EV_FREE(io);
+    }
 }
 
 bool evio_is_opened(evio_t* io) {
@@ -256,10 +388,20 @@ int evio_revents(evio_t* io) {
 }
 
 struct sockaddr* evio_localaddr(evio_t* io) {
+    if (io->localaddr == NULL) {
+        EV_ALLOC(io->localaddr, sizeof(sockaddr_u));
+        socklen_t addrlen = sizeof(sockaddr_u);
+        getsockname(io->fd, io->localaddr, &addrlen);
+    }
     return io->localaddr;
 }
 
 struct sockaddr* evio_peeraddr(evio_t* io) {
+    if (io->peeraddr == NULL) {
+        EV_ALLOC(io->peeraddr, sizeof(sockaddr_u));
+        socklen_t addrlen = sizeof(sockaddr_u);
+        getpeername(io->fd, io->peeraddr, &addrlen);
+    }
     return io->peeraddr;
 }
 
@@ -316,8 +458,8 @@ void evio_accept_cb(evio_t* io) {
     char localaddrstr[SU_ADDRSTRLEN] = {0};
     char peeraddrstr[SU_ADDRSTRLEN] = {0};
     printd("accept connfd=%d [%s] <= [%s]\n", io->fd,
-            SU_ADDRSTR(io->localaddr, localaddrstr),
-            SU_ADDRSTR(io->peeraddr, peeraddrstr));
+            SU_ADDRSTR(evio_localaddr(io), localaddrstr),
+            SU_ADDRSTR(evio_peeraddr(io), peeraddrstr));
     */
     if (io->accept_cb) {
         // printd("accept_cb------\n");
@@ -331,8 +473,8 @@ void evio_connect_cb(evio_t* io) {
     char localaddrstr[SU_ADDRSTRLEN] = {0};
     char peeraddrstr[SU_ADDRSTRLEN] = {0};
     printd("connect connfd=%d [%s] => [%s]\n", io->fd,
-            SU_ADDRSTR(io->localaddr, localaddrstr),
-            SU_ADDRSTR(io->peeraddr, peeraddrstr));
+            SU_ADDRSTR(evio_localaddr(io), localaddrstr),
+            SU_ADDRSTR(evio_peeraddr(io), peeraddrstr));
     */
     io->connected = 1;
     if (io->connect_cb) {
@@ -342,8 +484,16 @@ void evio_connect_cb(evio_t* io) {
     }
 }
 
+// NOTE: lean io returns empty readbuf to loop->bufpool, taken back by evio_prepare_readbuf.
+void evio_lean_readbuf(evio_t* io) {
+    if (io->lean && io->readbuf.head == io->readbuf.tail && evio_is_alloced_readbuf(io)) {
+        io->readbuf.head = io->readbuf.tail = 0;
+        evio_free_readbuf(io);
+    }
+}
+
 void evio_handle_read(evio_t* io, void* buf, int readbytes) {
-    if (io->unpack_setting) {
+    if (io->cold->unpack_setting) {
         // evio_set_unpack
         evio_unpack(io, buf, readbytes);
     } else {
@@ -371,6 +521,7 @@ void evio_handle_read(evio_t* io, void* buf, int readbytes) {
                     }
                     io->read_flags &= ~EIO_READ_UNTIL_DELIM;
                     evio_read_cb(io, (void*)sp, len);
+                    evio_lean_readbuf(io);
                     return;
                 }
             }
@@ -399,6 +550,7 @@ void evio_handle_read(evio_t* io, void* buf, int readbytes) {
             evio_alloc_readbuf(io, small_size);
         }
     }
+    evio_lean_readbuf(io);
 }
 
 void evio_read_cb(evio_t* io, void* buf, int len) {
@@ -412,6 +564,10 @@ void evio_read_cb(evio_t* io, void* buf, int len) {
         io->read_cb(io, buf, len);
         // printd("read_cb======\n");
     }
+    // NOTE: do not wait for the end of loop iteration, other ios may read a lot in it.
+    if (io->loop->mem_budget) {
+        evloop_memory_check(io->loop);
+    }
 
     // for readbuf autosize
     if (evio_is_alloced_readbuf(io) && io->readbuf.len > READ_BUFSIZE_HIGH_WATER) {
@@ -432,6 +588,34 @@ void evio_write_cb(evio_t* io, const void* buf, int len) {
     }
 }
 
+bool evio_write_cross_high(evio_t* io) {
+    if (io->cold->write_high_water == 0 || io->write_above_high || io->write_bufsize < io->cold->write_high_water)
+        return false;
+    io->write_above_high = 1;
+    return true;
+}
+
+bool evio_write_cross_low(evio_t* io) {
+    if (!io->write_above_high || io->write_bufsize > io->cold->write_low_water)
+        return false;
+    io->write_above_high = 0;
+    return true;
+}
+
+void evio_write_watermark_cb(evio_t* io, int above_high) {
+    evio_t* upstream_io = io->cold->upstream_io;
+    if (io->write_pause_upstream && upstream_io && !upstream_io->closed) {
+        if (above_high) {
+            evio_read_stop(upstream_io);
+        } else {
+            evio_read(upstream_io);
+        }
+    }
+    if (io->cold->watermark_cb) {
+        io->cold->watermark_cb(io, above_high);
+    }
+}
+
 void evio_close_cb(evio_t* io) {
     io->connected = 0;
     io->closed = 1;
@@ -461,83 +645,86 @@ void evio_set_peeraddr(evio_t* io, struct sockaddr* addr, int addrlen) {
 }
 
 int evio_set_hostname(evio_t* io, const char* hostname) {
-    SAFE_FREE(io->hostname);
-    io->hostname = strdup(hostname);
+    struct evio_cold_s* cold = evio_cold(io);
+    SAFE_FREE(cold->hostname);
+    cold->hostname = strdup(hostname);
     return 0;
 }
 
 const char* evio_get_hostname(evio_t* io) {
-    return io->hostname;
+    return io->cold->hostname;
 }
 
 void evio_del_connect_timer(evio_t* io) {
-    if (io->connect_timer) {
-        evtimer_del(io->connect_timer);
-        io->connect_timer = NULL;
-        io->connect_timeout = 0;
+    if (io->cold->connect_timer) {
+        evtimer_del(io->cold->connect_timer);
+        io->cold->connect_timer = NULL;
+        io->cold->connect_timeout = 0;
     }
 }
 
 void evio_del_close_timer(evio_t* io) {
-    if (io->close_timer) {
-        evtimer_del(io->close_timer);
-        io->close_timer = NULL;
-        io->close_timeout = 0;
+    if (io->cold->close_timer) {
+        evtimer_del(io->cold->close_timer);
+        io->cold->close_timer = NULL;
+        io->cold->close_timeout = 0;
     }
 }
 
 void evio_del_read_timer(evio_t* io) {
-    if (io->read_timer) {
-        evtimer_del(io->read_timer);
-        io->read_timer = NULL;
-        io->read_timeout = 0;
+    if (io->cold->read_timer) {
+        evtimer_del(io->cold->read_timer);
+        io->cold->read_timer = NULL;
+        io->cold->read_timeout = 0;
     }
 }
 
 void evio_del_write_timer(evio_t* io) {
-    if (io->write_timer) {
-        evtimer_del(io->write_timer);
-        io->write_timer = NULL;
-        io->write_timeout = 0;
+    if (io->cold->write_timer) {
+        evtimer_del(io->cold->write_timer);
+        io->cold->write_timer = NULL;
+        io->cold->write_timeout = 0;
     }
 }
 
 void evio_del_keepalive_timer(evio_t* io) {
-    if (io->keepalive_timer) {
-        evtimer_del(io->keepalive_timer);
-        io->keepalive_timer = NULL;
-        io->keepalive_timeout = 0;
+    if (io->cold->keepalive_timer) {
+        evtimer_del(io->cold->keepalive_timer);
+        io->cold->keepalive_timer = NULL;
+        io->cold->keepalive_timeout = 0;
     }
 }
 
 void evio_del_heartbeat_timer(evio_t* io) {
-    if (io->heartbeat_timer) {
-        evtimer_del(io->heartbeat_timer);
-        io->heartbeat_timer = NULL;
-        io->heartbeat_interval = 0;
-        io->heartbeat_fn = NULL;
+    if (io->cold->heartbeat_timer) {
+        evtimer_del(io->cold->heartbeat_timer);
+        io->cold->heartbeat_timer = NULL;
+        io->cold->heartbeat_interval = 0;
+        io->cold->heartbeat_fn = NULL;
     }
 }
 
 void evio_set_connect_timeout(evio_t* io, int timeout_ms) {
-    io->connect_timeout = timeout_ms;
+    struct evio_cold_s* cold = evio_cold(io);
+    cold->connect_timeout = timeout_ms;
 }
 
 void evio_set_close_timeout(evio_t* io, int timeout_ms) {
-    io->close_timeout = timeout_ms;
+    struct evio_cold_s* cold = evio_cold(io);
+    cold->close_timeout = timeout_ms;
 }
 
 static void __read_timeout_cb(evtimer_t* timer) {
     evio_t* io = (evio_t*)timer->privdata;
     uint64_t inactive_ms = (io->loop->cur_hrtime - io->last_read_hrtime) / 1000;
-    if (inactive_ms + 100 < io->read_timeout) {
-        evtimer_reset(io->read_timer, io->read_timeout - inactive_ms);
+    if (inactive_ms + 100 < io->cold->read_timeout) {
+        evtimer_reset(io->cold->read_timer, io->cold->read_timeout - inactive_ms);
     } else {
         if (io->io_type & EIO_TYPE_SOCKET) {
             char localaddrstr[SU_ADDRSTRLEN] = {0};
             char peeraddrstr[SU_ADDRSTRLEN] = {0};
-            log_warn("read timeout [%s] <=> [%s]", SU_ADDRSTR(io->localaddr, localaddrstr),
-                     SU_ADDRSTR(io->peeraddr, peeraddrstr));
+            log_warn("read timeout [%s] <=> [%s]", SU_ADDRSTR(evio_localaddr(io), localaddrstr),
+                     SU_ADDRSTR(evio_peeraddr(io), peeraddrstr));
         }
         io->error = ETIMEDOUT;
         evio_close(io);
@@ -551,28 +738,29 @@ void evio_set_read_timeout(evio_t* io, int timeout_ms) {
         return;
     }
 
-    if (io->read_timer) {
+    struct evio_cold_s* cold = evio_cold(io);
+    if (cold->read_timer) {
         // reset
-        evtimer_reset(io->read_timer, timeout_ms);
+        evtimer_reset(cold->read_timer, timeout_ms);
     } else {
         // add
-        io->read_timer = evtimer_add(io->loop, __read_timeout_cb, timeout_ms, 1);
-        io->read_timer->privdata = io;
+        cold->read_timer = evtimer_add(io->loop, __read_timeout_cb, timeout_ms, 1);
+        cold->read_timer->privdata = io;
     }
-    io->read_timeout = timeout_ms;
+    cold->read_timeout = timeout_ms;
 }
 
 static void __write_timeout_cb(evtimer_t* timer) {
     evio_t* io = (evio_t*)timer->privdata;
     uint64_t inactive_ms = (io->loop->cur_hrtime - io->last_write_hrtime) / 1000;
-    if (inactive_ms + 100 < io->write_timeout) {
-        evtimer_reset(io->write_timer, io->write_timeout - inactive_ms);
+    if (inactive_ms + 100 < io->cold->write_timeout) {
+        evtimer_reset(io->cold->write_timer, io->cold->write_timeout - inactive_ms);
     } else {
         if (io->io_type & EIO_TYPE_SOCKET) {
             char localaddrstr[SU_ADDRSTRLEN] = {0};
             char peeraddrstr[SU_ADDRSTRLEN] = {0};
-            log_warn("write timeout [%s] <=> [%s]", SU_ADDRSTR(io->localaddr, localaddrstr),
-                     SU_ADDRSTR(io->peeraddr, peeraddrstr));
+            log_warn("write timeout [%s] <=> [%s]", SU_ADDRSTR(evio_localaddr(io), localaddrstr),
+                     SU_ADDRSTR(evio_peeraddr(io), peeraddrstr));
         }
         io->error = ETIMEDOUT;
         evio_close(io);
@@ -586,29 +774,30 @@ void evio_set_write_timeout(evio_t* io, int timeout_ms) {
         return;
     }
 
-    if (io->write_timer) {
+    struct evio_cold_s* cold = evio_cold(io);
+    if (cold->write_timer) {
         // reset
-        evtimer_reset(io->write_timer, timeout_ms);
+        evtimer_reset(cold->write_timer, timeout_ms);
     } else {
         // add
-        io->write_timer = evtimer_add(io->loop, __write_timeout_cb, timeout_ms, 1);
-        io->write_timer->privdata = io;
+        cold->write_timer = evtimer_add(io->loop, __write_timeout_cb, timeout_ms, 1);
+        cold->write_timer->privdata = io;
     }
-    io->write_timeout = timeout_ms;
+    cold->write_timeout = timeout_ms;
 }
 
 static void __keepalive_timeout_cb(evtimer_t* timer) {
     evio_t* io = (evio_t*)timer->privdata;
     uint64_t last_rw_hrtime = MAX(io->last_read_hrtime, io->last_write_hrtime);
     uint64_t inactive_ms = (io->loop->cur_hrtime - last_rw_hrtime) / 1000;
-    if (inactive_ms + 100 < io->keepalive_timeout) {
-        evtimer_reset(io->keepalive_timer, io->keepalive_timeout - inactive_ms);
+    if (inactive_ms + 100 < io->cold->keepalive_timeout) {
+        evtimer_reset(io->cold->keepalive_timer, io->cold->keepalive_timeout - inactive_ms);
     } else {
         if (io->io_type & EIO_TYPE_SOCKET) {
             char localaddrstr[SU_ADDRSTRLEN] = {0};
             char peeraddrstr[SU_ADDRSTRLEN] = {0};
-            log_warn("keepalive timeout [%s] <=> [%s]", SU_ADDRSTR(io->localaddr, localaddrstr),
-                     SU_ADDRSTR(io->peeraddr, peeraddrstr));
+            log_warn("keepalive timeout [%s] <=> [%s]", SU_ADDRSTR(evio_localaddr(io), localaddrstr),
+                     SU_ADDRSTR(evio_peeraddr(io), peeraddrstr));
         }
         io->error = ETIMEDOUT;
         evio_close(io);
@@ -622,21 +811,23 @@ void evio_set_keepalive_timeout(evio_t* io, int timeout_ms) {
         return;
     }
 
-    if (io->keepalive_timer) {
+    struct evio_cold_s* cold = evio_cold(io);
+    if (cold->keepalive_timer) {
         // reset
-        evtimer_reset(io->keepalive_timer, timeout_ms);
+        evtimer_reset(cold->keepalive_timer, timeout_ms);
     } else {
         // add
-        io->keepalive_timer = evtimer_add(io->loop, __keepalive_timeout_cb, timeout_ms, 1);
-        io->keepalive_timer->privdata = io;
+        cold->keepalive_timer = evtimer_add(io->loop, __keepalive_timeout_cb, timeout_ms, 1);
+        cold->keepalive_timer->privdata = io;
     }
-    io->keepalive_timeout = timeout_ms;
+    evtimer_set_slack(cold->keepalive_timer, EVTIMER_DEFAULT_SLACK(timeout_ms));
+    cold->keepalive_timeout = timeout_ms;
 }
 
 static void __heartbeat_timer_cb(evtimer_t* timer) {
     evio_t* io = (evio_t*)timer->privdata;
-    if (io && io->heartbeat_fn) {
-        io->heartbeat_fn(io);
+    if (io && io->cold->heartbeat_fn) {
+        io->cold->heartbeat_fn(io);
     }
 }
 
@@ -647,16 +838,18 @@ void evio_set_heartbeat(evio_t* io, int interval_ms, evio_send_heartbeat_fn fn)
         return;
     }
 
-    if (io->heartbeat_timer) {
+    struct evio_cold_s* cold = evio_cold(io);
+    if (cold->heartbeat_timer) {
         // reset
-        evtimer_reset(io->heartbeat_timer, interval_ms);
+        evtimer_reset(cold->heartbeat_timer, interval_ms);
     } else {
         // add
-        io->heartbeat_timer = evtimer_add(io->loop, __heartbeat_timer_cb, interval_ms, INFINITE);
-        io->heartbeat_timer->privdata = io;
+        cold->heartbeat_timer = evtimer_add(io->loop, __heartbeat_timer_cb, interval_ms, INFINITE);
+        cold->heartbeat_timer->privdata = io;
     }
-    io->heartbeat_interval = interval_ms;
-    io->heartbeat_fn = fn;
+    evtimer_set_slack(cold->heartbeat_timer, EVTIMER_DEFAULT_SLACK(interval_ms));
+    cold->heartbeat_interval = interval_ms;
+    cold->heartbeat_fn = fn;
 }
 
 //-----------------iobuf---------------------------------------------
@@ -668,10 +861,23 @@ void evio_alloc_readbuf(evio_t* io, int len) {
         return;
     }
     if (evio_is_alloced_readbuf(io)) {
-        io->readbuf.base = (char*)ev_zrealloc(io->readbuf.base, len, io->readbuf.len);
+        // NOTE: grow or shrink within the same size class needs no copy.
+        int idx = bufpool_class_index(len);
+        if (idx >= 0 && idx == bufpool_class_index(io->readbuf.len)) {
+            evloop_memory_add(io->loop, (long long)len - (long long)io->readbuf.len);
+            io->readbuf.len = len;
+            io->small_readbytes_cnt = 0;
+            return;
+        }
+        char* base = (char*)evloop_bufpool_alloc(io->loop, len);
+        memcpy(base, io->readbuf.base, MIN(io->readbuf.tail, (size_t)len));
+        evloop_bufpool_free(io->loop, io->readbuf.base, io->readbuf.len);
+        evloop_memory_add(io->loop, -(long long)io->readbuf.len);
+        io->readbuf.base = base;
     } else {
-        EV_ALLOC(io->readbuf.base, len);
+        io->readbuf.base = (char*)evloop_bufpool_alloc(io->loop, len);
     }
+    evloop_memory_add(io->loop, len);
     io->readbuf.len = len;
     io->alloced_readbuf = 1;
     io->small_readbytes_cnt = 0;
@@ -679,7 +885,8 @@ void evio_alloc_readbuf(evio_t* io, int len) {
 
 void evio_free_readbuf(evio_t* io) {
     if (evio_is_alloced_readbuf(io)) {
-        EV_FREE(io->readbuf.base);
+        evloop_bufpool_free(io->loop, io->readbuf.base, io->readbuf.len);
+        evloop_memory_add(io->loop, -(long long)io->readbuf.len);
         io->alloced_readbuf = 0;
         // reset to loop->readbuf
         io->readbuf.base = io->loop->readbuf.base;
@@ -687,6 +894,26 @@ void evio_free_readbuf(evio_t* io) {
     }
 }
 
+// NOTE: readbuf.len is the size allocated from loop->bufpool, only set by evio_alloc_readbuf.
+static int evio_unpack_readbuf_len(unpack_setting_t* setting) {
+    if (setting->mode == UNPACK_BY_FIXED_LENGTH) {
+        return setting->fixed_length;
+    }
+    return MIN(EVLOOP_READ_BUFSIZE, setting->package_max_length);
+}
+
+void evio_prepare_readbuf(evio_t* io) {
+    if (!evio_is_loop_readbuf(io))
+        return;
+    if (io->cold->unpack_setting) {
+        evio_alloc_readbuf(io, evio_unpack_readbuf_len(io->cold->unpack_setting));
+    } else if (io->read_flags & EIO_READ_UNTIL_LENGTH) {
+        evio_alloc_readbuf(io, io->read_until_length);
+    } else if (io->read_flags & EIO_READ_UNTIL_DELIM) {
+        evio_alloc_readbuf(io, EVLOOP_READ_BUFSIZE);
+    }
+}
+
 void evio_memmove_readbuf(evio_t* io) {
     fifo_buf_t* buf = &io->readbuf;
     if (buf->tail == buf->head) {
@@ -727,6 +954,80 @@ size_t evio_write_bufsize(evio_t* io) {
     return io->write_bufsize;
 }
 
+int evio_set_write_watermarks(evio_t* io, uint32_t high, uint32_t low, watermark_cb cb, int pause_upstream) {
+    if (high && low >= high)
+        return -1;
+    struct evio_cold_s* cold = evio_cold(io);
+    cold->write_high_water = high;
+    cold->write_low_water = low;
+    cold->watermark_cb = cb;
+    io->write_pause_upstream = high && pause_upstream;
+    io->write_above_high = 0;
+    return 0;
+}
+
+bool evio_write_above_high_water(evio_t* io) {
+    return io->write_above_high;
+}
+
+evbuf_t* evbuf_new(void* base, size_t len, evbuf_free_cb free_cb, void* userdata) {
+    evbuf_t* buf;
+    EV_ALLOC_SIZEOF(buf);
+    buf->base = (char*)base;
+    buf->len = len;
+    atomic_init(&buf->refcnt, 1);
+    buf->free_cb = free_cb;
+    buf->userdata = userdata;
+    return buf;
+}
+
+evbuf_t* evbuf_alloc(size_t len) {
+    evbuf_t* buf;
+    // NOTE: one block, base follows evbuf_t
+    EV_ALLOC(buf, sizeof(evbuf_t) + len);
+    buf->base = (char*)(buf + 1);
+    buf->len = len;
+    atomic_init(&buf->refcnt, 1);
+    return buf;
+}
+
+evbuf_t* evloop_evbuf_alloc(evloop_t* loop, size_t len) {
+    evbuf_t* buf = (evbuf_t*)evloop_bufpool_alloc(loop, sizeof(evbuf_t) + len);
+    buf->base = (char*)(buf + 1);
+    buf->len = len;
+    atomic_init(&buf->refcnt, 1);
+    buf->free_cb = NULL;
+    buf->userdata = NULL;
+    buf->pool = loop;
+    return buf;
+}
+
+evbuf_t* evbuf_ref(evbuf_t* buf) {
+    atomic_fetch_add_explicit(&buf->refcnt, 1, memory_order_relaxed);
+    return buf;
+}
+
+void evbuf_unref(evbuf_t* buf) {
+    if (atomic_fetch_sub_explicit(&buf->refcnt, 1, memory_order_acq_rel) != 1)
+        return;
+    if (buf->free_cb) {
+        buf->free_cb(buf->base, buf->len, buf->userdata);
+    }
+    if (buf->pool) {
+        evloop_bufpool_free(buf->pool, buf, sizeof(evbuf_t) + buf->len);
+        return;
+    }
+    EV_FREE(buf);
+}
+
+void* evbuf_base(evbuf_t* buf) {
+    return buf->base;
+}
+
+size_t evbuf_len(evbuf_t* buf) {
+    return buf->len;
+}
+
 int evio_read_once(evio_t* io) {
     io->read_flags |= EIO_READ_ONCE;
     return evio_read_start(io);
@@ -749,9 +1050,9 @@ int evio_read_until_length(evio_t* io, unsigned int len) {
     if (io->readbuf.head > 1024 || io->readbuf.tail - io->readbuf.head < 1024) {
         evio_memmove_readbuf(io);
     }
-    // NOTE: prepare readbuf
+    // NOTE: prepare readbuf, lean io takes it right before read, @see evio_prepare_readbuf
     int need_len = io->readbuf.head + len;
-    if (evio_is_loop_readbuf(io) || io->readbuf.len < need_len) {
+    if (evio_is_loop_readbuf(io) ? !io->lean : io->readbuf.len < need_len) {
         evio_alloc_readbuf(io, need_len);
     }
     return evio_read_once(io);
@@ -777,8 +1078,8 @@ int evio_read_until_delim(evio_t* io, unsigned char delim) {
     }
     io->read_flags = EIO_READ_UNTIL_DELIM;
     io->read_until_length = delim;
-    // NOTE: prepare readbuf
-    if (evio_is_loop_readbuf(io) || io->readbuf.len < EVLOOP_READ_BUFSIZE) {
+    // NOTE: prepare readbuf, lean io takes it right before read, @see evio_prepare_readbuf
+    if (evio_is_loop_readbuf(io) ? !io->lean : io->readbuf.len < EVLOOP_READ_BUFSIZE) {
         evio_alloc_readbuf(io, EVLOOP_READ_BUFSIZE);
     }
     return evio_read_once(io);
@@ -807,35 +1108,36 @@ void evio_set_unpack(evio_t* io, unpack_setting_t* setting) {
     if (setting == NULL)
         return;
 
-    io->unpack_setting = setting;
-    if (io->unpack_setting->package_max_length == 0) {
-        io->unpack_setting->package_max_length = DEFAULT_PACKAGE_MAX_LENGTH;
+    evio_cold(io)->unpack_setting = setting;
+    if (setting->package_max_length == 0) {
+        setting->package_max_length = DEFAULT_PACKAGE_MAX_LENGTH;
     }
-    if (io->unpack_setting->mode == UNPACK_BY_FIXED_LENGTH) {
-        assert(io->unpack_setting->fixed_length != 0 &&
-               io->unpack_setting->fixed_length <= io->unpack_setting->package_max_length);
-    } else if (io->unpack_setting->mode == UNPACK_BY_DELIMITER) {
-        if (io->unpack_setting->delimiter_bytes == 0) {
-            io->unpack_setting->delimiter_bytes = strlen((char*)io->unpack_setting->delimiter);
+    if (setting->mode == UNPACK_BY_FIXED_LENGTH) {
+        assert(setting->fixed_length != 0 && setting->fixed_length <= setting->package_max_length);
+    } else if (setting->mode == UNPACK_BY_DELIMITER) {
+        if (setting->delimiter_bytes == 0) {
+            setting->delimiter_bytes = strlen((char*)setting->delimiter);
         }
-    } else if (io->unpack_setting->mode == UNPACK_BY_LENGTH_FIELD) {
-        assert(io->unpack_setting->body_offset >=
-               io->unpack_setting->length_field_offset + io->unpack_setting->length_field_bytes);
+    } else if (setting->mode == UNPACK_BY_LENGTH_FIELD) {
+        assert(setting->body_offset >= setting->length_field_offset + setting->length_field_bytes);
     }
 
-    // NOTE: unpack must have own readbuf
-    if (io->unpack_setting->mode == UNPACK_BY_FIXED_LENGTH) {
-        io->readbuf.len = io->unpack_setting->fixed_length;
-    } else {
-        io->readbuf.len = MIN(EVLOOP_READ_BUFSIZE, io->unpack_setting->package_max_length);
+    // NOTE: unpack must have own readbuf, lean io takes it right before read
+    io->max_read_bufsize = setting->package_max_length;
+    if (!io->lean) {
+        evio_alloc_readbuf(io, evio_unpack_readbuf_len(setting));
+    }
+}
+
+void evio_set_budget(evio_t* io, const evio_budget_t* budget) {
+    if (budget || io->cold->budget) {
+        evio_cold(io)->budget = budget;
     }
-    io->max_read_bufsize = io->unpack_setting->package_max_length;
-    evio_alloc_readbuf(io, io->readbuf.len);
 }
 
 void evio_unset_unpack(evio_t* io) {
-    if (io->unpack_setting) {
-        io->unpack_setting = NULL;
+    if (io->cold->unpack_setting) {
+        io->cold->unpack_setting = NULL;
         // NOTE: unpack has own readbuf
         evio_free_readbuf(io);
     }
@@ -843,7 +1145,7 @@ void evio_unset_unpack(evio_t* io) {
 
 //-----------------upstream---------------------------------------------
 void evio_read_upstream(evio_t* io) {
-    evio_t* upstream_io = io->upstream_io;
+    evio_t* upstream_io = io->cold->upstream_io;
     if (upstream_io) {
         evio_read(io);
         evio_read(upstream_io);
@@ -851,7 +1153,7 @@ void evio_read_upstream(evio_t* io) {
 }
 
 void evio_read_upstream_on_write_complete(evio_t* io, const void* buf, int writebytes) {
-    evio_t* upstream_io = io->upstream_io;
+    evio_t* upstream_io = io->cold->upstream_io;
     if (upstream_io && evio_write_is_complete(io)) {
         evio_setcb_write(io, NULL);
         evio_read(upstream_io);
@@ -859,9 +1161,12 @@ void evio_read_upstream_on_write_complete(evio_t* io, const void* buf, int write
 }
 
 void evio_write_upstream(evio_t* io, void* buf, int bytes) {
-    evio_t* upstream_io = io->upstream_io;
+    evio_t* upstream_io = io->cold->upstream_io;
     if (upstream_io) {
         int nwrite = evio_write(upstream_io, buf, bytes);
+        // NOTE: watermarks pause io only above high water of upstream_io.
+        if (upstream_io->write_pause_upstream)
+            return;
         // if (!evio_write_is_complete(upstream_io)) {
         if (nwrite >= 0 && nwrite < bytes) {
             evio_read_stop(io);
@@ -871,33 +1176,43 @@ void evio_write_upstream(evio_t* io, void* buf, int bytes) {
 }
 
 void evio_close_upstream(evio_t* io) {
-    evio_t* upstream_io = io->upstream_io;
+    evio_t* upstream_io = io->cold->upstream_io;
     if (upstream_io) {
         evio_close(upstream_io);
     }
 }
 
 void evio_setup_upstream(evio_t* io1, evio_t* io2) {
-    io1->upstream_io = io2;
-    io2->upstream_io = io1;
+    evio_cold(io1)->upstream_io = io2;
+    evio_cold(io2)->upstream_io = io1;
 }
 
 evio_t* evio_get_upstream(evio_t* io) {
-    return io->upstream_io;
+    return io->cold->upstream_io;
+}
+
+static void evio_read_upstream_or_splice(evio_t* io) {
+    if (evio_read_upstream_splice(io) != 0) {
+        log_warn("splice upstream unsupported, fallback to copy");
+        evio_read_upstream(io);
+    }
 }
 
-evio_t* evio_setup_tcp_upstream(evio_t* io, const char* host, int port, int ssl) {
+evio_t* evio_setup_tcp_upstream(evio_t* io, const char* host, int port, int ssl, int splice) {
     evio_t* upstream_io = evio_create_socket(io->loop, host, port, EIO_TYPE_TCP, EIO_CLIENT_SIDE);
     if (upstream_io == NULL)
         return NULL;
-    if (ssl)
+    if (ssl) {
         // evio_enable_ssl(upstream_io);
-        evio_setup_upstream(io, upstream_io);
+        // NOTE: ssl bytes must be decrypted in user space
+        splice = 0;
+    }
+    evio_setup_upstream(io, upstream_io);
     evio_setcb_read(io, evio_write_upstream);
     evio_setcb_read(upstream_io, evio_write_upstream);
     evio_setcb_close(io, evio_close_upstream);
     evio_setcb_close(upstream_io, evio_close_upstream);
-    evio_setcb_connect(upstream_io, evio_read_upstream);
+    evio_setcb_connect(upstream_io, splice ? evio_read_upstream_or_splice : evio_read_upstream);
     evio_connect(upstream_io);
     return upstream_io;
 }
@@ -8,13 +8,34 @@
 #include "heap.h"
 #include "iowatcher.h"
 #include "list.h"
+#include "mpsc_queue.h"
 #include "queue.h"
+#include "thread.h"
+#include "timewheel.h"
 
 #define EVLOOP_READ_BUFSIZE       8192       // 8K
+#define EVLOOP_MAX_CUSTOM_EVENTS  1024       // handled per eventfd wakeup
 #define READ_BUFSIZE_HIGH_WATER  65536      // 64K
 #define WRITE_BUFSIZE_HIGH_WATER (1U << 23) // 8M
 #define MAX_READ_BUFSIZE         (1U << 24) // 16M
 #define MAX_WRITE_BUFSIZE        (1U << 24) // 16M
+// evloop bufpool: class i is (4K << i), free list capped to 4M per class
+#define EVLOOP_BUFPOOL_MIN_SIZE  4096
+#define EVLOOP_BUFPOOL_MAX_FREE  (1U << 22) // 4M
+// max write_queue buffers per writev
+#ifdef IOV_MAX
+#define EVIO_WRITEV_MAX_IOV        IOV_MAX
+#else
+#define EVIO_WRITEV_MAX_IOV        1024
+#endif
+// pipe size of splice upstream
+#define EVIO_SPLICE_PIPE_SIZE      (1U << 18) // 256K
+// write_queue kept by evio_done for fd reuse
+#define EVIO_WRITE_QUEUE_KEEP_SIZE 64
+// SO_RCVLOWAT of tcp framing: the rest of a frame if not less than min, capped by max
+// NOTE: the kernel grows rcvbuf to hold rcvlowat bytes, so a few segments are enough.
+#define EVIO_MIN_RCVLOWAT (1U << 14) // 16K
+#define EVIO_MAX_RCVLOWAT (1U << 18) // 256K
 
 // evio_read_flags
 #define EIO_READ_ONCE            0x1
@@ -22,7 +43,6 @@
 #define EIO_READ_UNTIL_DELIM     0x4
 
 ARRAY_DECL(evio_t*, io_array);
-QUEUE_DECL(event_t, event_queue);
 
 typedef struct buf_s {
     char* base;
@@ -35,6 +55,35 @@ typedef struct offset_buf_s {
     size_t offset;
 } offset_buf_t;
 
+struct evbuf_s {
+    char* base;
+    size_t len;
+    atomic_int refcnt;
+    evbuf_free_cb free_cb;
+    void* userdata;
+    evloop_t* pool; // allocated from pool->bufpool, @see evloop_evbuf_alloc
+};
+
+// write_queue element: [base, base + len) of ref, written offset.
+// NOTE: evio_write copies the remain into an evbuf_alloc, evio_write_ref refs the buf.
+typedef struct write_buf_s {
+    char* base;
+    size_t len;
+    size_t offset;
+    evbuf_t* ref;
+} write_buf_t;
+
+// NOTE: free blocks are linked by their first bytes.
+typedef struct bufpool_class_s {
+    void* free_list;
+    uint32_t nfree;
+    uint32_t max_free;
+    uint32_t inuse;
+    uint32_t inuse_high;
+    uint64_t hits;
+    uint64_t misses;
+} bufpool_class_t;
+
 typedef struct fifo_buf_s {
     char* base;
     size_t len;
@@ -64,23 +113,112 @@ struct evloop_s {
     struct list_head idles;
     uint32_t nidles;
     // timers
-    struct heap timers;     // monotonic time
-    struct heap realtimers; // realtime
+    struct timewheel timers; // monotonic time, 1ms tick
+    // the same timeouts by deadline + slack, blocktime only, @see evtimer_set_slack
+    struct timewheel timer_limits;
+    struct heap realtimers;  // realtime
+    // high resolution timeouts by next_timeout in us, @see evtimer_add_us
+    struct heap hrtimers;
+    int timerfd;             // -1: not created yet
+    uint64_t timerfd_expire; // armed deadline in us, 0: disarmed or fired
+    evloop_hrtimer_stats_t hrtimer_stats;
     uint32_t ntimers;
     // ios: with fd as array.index
     struct io_array ios;
     uint32_t nios;
+    // ios not drained within budget, @see evio_ready_again
+    struct io_array again_ios;
+    evio_budget_t io_budget;
+    evloop_fairness_stats_t fairness_stats;
+    // NOTE: written in loop thread only, read by evloop_naccepts of any thread
+    atomic_ullong naccepts;
     // one loop per thread, so one readbuf per loop is OK.
     buf_t readbuf;
+    // one loop per thread, so free lists need no lock, @see evloop_bufpool_alloc
+    bufpool_class_t bufpool[EVLOOP_BUFPOOL_CLASSES];
     void* iowatcher;
+    // busy poll, @see EVLOOP_FLAG_BUSY_POLL
+    uint32_t busy_poll_max_us;
+    uint32_t busy_poll_us;     // current spin window
+    uint64_t busy_poll_gap_us; // ewma of idle gap between wakeups
+    int so_busy_poll_us;
+#ifdef EVENT_IOURING
+    int iouring; // 0: fallback to epoll
+#endif
     // custom_events
     int eventfds[2];
-    event_queue custom_events;
+    // NOTE: lock-free, the mutex only guards eventfds creation.
+    struct mpsc_queue custom_events;
+    // 1: eventfds written, loop not drained yet
+    atomic_int custom_events_wakeup;
     pthread_mutex_t custom_events_mutex;
+    // NOTE: written in loop thread only, odd stats_seq while writing, @see evloop_stats
+    evloop_stats_t* stats;
+    atomic_uint stats_seq;
+    uint64_t stats_nested_ns; // custom events timed inside eventfd io callback
+    // coroutines alive, and free stacks of EVCO_DEFAULT_STACK_SIZE, @see co_create
+    struct list_head coroutines;
+    void* co_stacks;
+    uint32_t co_nstacks;
+    // works not completed yet, @see evloop_queue_work
+    struct list_head works;
+    // NOTE: pushed by pool threads, drained by one custom event per batch.
+    struct mpsc_queue works_done;
+    atomic_int works_done_wakeup;
+    // works which pool threads may still touch loop for
+    atomic_uint works_active;
+    atomic_ullong works_started;
+    evloop_work_stats_t work_stats;
+    // stub resolver, created by the first evdns call, @see evdns.c
+    struct evdns_s* dns;
+    // alloced readbufs and write queues of ios, @see evloop_set_memory_budget
+    atomic_ullong mem_used;
+    size_t mem_budget; // 0: no budget
+    size_t mem_resume;
+    size_t mem_paused_at; // mem_used when ios paused last time
+    uint64_t mem_throttle_start_us;
+    evloop_memory_stats_t mem_stats;
+    evloop_zerocopy_stats_t zerocopy_stats;
 };
 
 uint64_t evloop_next_event_id();
 
+static inline void evloop_histogram_add(evloop_histogram_t* hist, uint64_t ns) {
+    int i = ns < 256 ? 0 : (63 - __builtin_clzll(ns)) - 7;
+    if (i >= EVLOOP_STATS_BUCKETS)
+        i = EVLOOP_STATS_BUCKETS - 1;
+    ++hist->buckets[i];
+    ++hist->count;
+    hist->sum_ns += ns;
+    if (ns > hist->max_ns)
+        hist->max_ns = ns;
+}
+
+// NOTE: write queues grow in other threads too, @see evio_write
+static inline void evloop_memory_add(evloop_t* loop, long long bytes) {
+    atomic_fetch_add_explicit(&loop->mem_used, bytes, memory_order_relaxed);
+}
+
+// throttle or resume ios by loop->mem_budget, called per loop iteration and after read_cb.
+void evloop_memory_check(evloop_t* loop);
+
+// @return class index of size, -1 if too large
+static inline int bufpool_class_index(size_t size) {
+    if (size <= EVLOOP_BUFPOOL_MIN_SIZE)
+        return 0;
+    // size <= 2^bits == (4K << idx)
+    int bits = 64 - __builtin_clzll((unsigned long long)size - 1);
+    int idx = bits - 12;
+    return idx < EVLOOP_BUFPOOL_CLASSES ? idx : -1;
+}
+
+// NOTE: size rounded up to class size, called in other threads or
+// size > MAX_READ_BUFSIZE fallback to malloc/free.
+void* evloop_bufpool_alloc(evloop_t* loop, size_t size);
+void evloop_bufpool_free(evloop_t* loop, void* ptr, size_t size);
+// evbuf_alloc from loop->bufpool, returned to it by evbuf_unref
+evbuf_t* evloop_evbuf_alloc(evloop_t* loop, size_t len);
+
 struct evidle_s {
     EVENT_FIELDS
     uint32_t repeat;
@@ -88,11 +226,16 @@ struct evidle_s {
     struct list_node node;
 };
 
-#define ETIMER_FIELDS      \
-    EVENT_FIELDS           \
-    uint32_t repeat;       \
-    uint64_t next_timeout; \
-    struct heap_node node;
+// NOTE: evtimeout_t in loop->timers as wnode, eperiod_t in loop->realtimers as node,
+// evtimeout_t of EVENT_TYPE_HRTIMEOUT in loop->hrtimers as node.
+#define ETIMER_FIELDS                \
+    EVENT_FIELDS                     \
+    uint32_t repeat;                 \
+    uint64_t next_timeout;           \
+    union {                          \
+        struct heap_node node;       \
+        struct timewheel_node wnode; \
+    };
 
 struct evtimer_s {
     ETIMER_FIELDS
@@ -100,7 +243,9 @@ struct evtimer_s {
 
 struct evtimeout_s {
     ETIMER_FIELDS
-    uint32_t timeout;
+    uint32_t timeout; // ms, us if EVENT_TYPE_HRTIMEOUT
+    uint32_t slack; // ms
+    struct timewheel_node lnode; // in loop->timer_limits
 };
 
 struct eperiod_s {
@@ -112,8 +257,64 @@ struct eperiod_s {
     int8_t month;
 };
 
-QUEUE_DECL(offset_buf_t, write_queue);
+QUEUE_DECL(write_buf_t, write_queue);
+// buffer held by a MSG_ZEROCOPY send until its seq completed, @see evio_set_zerocopy
+typedef struct zerocopy_buf_s {
+    evbuf_t* ref;
+    uint32_t seq;
+    int done;
+} zerocopy_buf_t;
+QUEUE_DECL(zerocopy_buf_t, zerocopy_queue);
 // sizeof(struct evio_s)=416 on linux-x64
+// fields of evio_s not touched by idle connections, @see EVLOOP_FLAG_LEAN
+struct evio_cold_s {
+    uint32_t write_high_water; // 0: no watermarks
+    uint32_t write_low_water;
+    watermark_cb watermark_cb;
+    // timers
+    int connect_timeout;    // ms
+    int close_timeout;      // ms
+    int read_timeout;       // ms
+    int write_timeout;      // ms
+    int keepalive_timeout;  // ms
+    int heartbeat_interval; // ms
+    evio_send_heartbeat_fn heartbeat_fn;
+    evtimer_t* connect_timer;
+    evtimer_t* close_timer;
+    evtimer_t* read_timer;
+    evtimer_t* write_timer;
+    evtimer_t* keepalive_timer;
+    evtimer_t* heartbeat_timer;
+    // upstream
+    struct evio_s* upstream_io; // for evio_setup_upstream
+    // unpack
+    unpack_setting_t* unpack_setting; // for evio_set_unpack
+    // batch
+    struct evio_batch_s* batch; // for evio_read_batch, @see nio.c
+    // splice
+    struct evio_splice_s* splice; // for evio_setup_tcp_upstream(..., splice), @see nio.c
+    // chain
+    struct evio_chain_s* chain; // for evio_read_chain, @see nio.c
+    // SO_RCVLOWAT set by tcp framing, 0 if kernel default
+    uint32_t rcvlowat;
+    // budget
+    const evio_budget_t* budget; // for evio_set_budget, @see evio_budget
+    // coroutines waiting for EV_READ/EV_WRITE, @see coroutine.c
+    struct evco_s* co_reader;
+    struct evco_s* co_writer;
+    // ssl
+    void* ssl;      // for evio_set_ssl
+    void* ssl_ctx;  // for evio_set_ssl_ctx
+    char* hostname; // for hssl_set_sni_hostname
+    // zerocopy
+    uint32_t zerocopy_threshold;
+    uint32_t zerocopy_seq; // of the next MSG_ZEROCOPY send, the kernel counts from 0 per socket
+    struct zerocopy_queue zerocopy_pending;
+    // NOTE: last one, lean io allocates EVIO_COLD_LEAN_SIZE without it.
+    pthread_mutex_t write_mutex; // lock write and write_queue
+};
+#define EVIO_COLD_LEAN_SIZE offsetof(struct evio_cold_s, write_mutex)
+
 struct evio_s {
     EVENT_FIELDS
     // flags
@@ -130,6 +331,16 @@ struct evio_s {
     unsigned close : 1;
     unsigned alloced_readbuf : 1; // for evio_alloc_readbuf
     unsigned alloced_ssl_ctx : 1; // for evio_new_ssl_ctx
+    unsigned udp_gro : 1;         // for evio_set_udp_gro
+    unsigned udp_nogso : 1;       // UDP_SEGMENT unsupported, @see evio_write_gso
+    unsigned write_above_high : 1; // for evio_set_write_watermarks
+    unsigned write_pause_upstream : 1;
+    unsigned budget_paused : 1;   // for evloop_set_memory_budget
+    unsigned lean : 1;            // EVLOOP_FLAG_LEAN: no write_mutex, cold fields freed by evio_close
+    unsigned slab : 1;            // allocated by evio_slab_alloc
+    unsigned zerocopy : 1;        // for evio_set_zerocopy
+    unsigned zerocopy_wait : 1;   // zerocopy completions pending, error queue watched
+    unsigned no_rcvlowat : 1;     // for evio_set_auto_rcvlowat(io, 0)
                                   // public:
     evio_type_e io_type;
     uint32_t id; // fd cannot be used as unique identifier, so we provide an id
@@ -153,7 +364,6 @@ struct evio_s {
     uint32_t small_readbytes_cnt; // for readbuf autosize
     // write
     struct write_queue write_queue;
-    pthread_mutex_t write_mutex; // lock write and write_queue
     uint32_t write_bufsize;
     uint32_t max_write_bufsize;
     // callbacks
@@ -162,58 +372,68 @@ struct evio_s {
     close_cb close_cb;
     accept_cb accept_cb;
     connect_cb connect_cb;
-    // timers
-    int connect_timeout;    // ms
-    int close_timeout;      // ms
-    int read_timeout;       // ms
-    int write_timeout;      // ms
-    int keepalive_timeout;  // ms
-    int heartbeat_interval; // ms
-    evio_send_heartbeat_fn heartbeat_fn;
-    evtimer_t* connect_timer;
-    evtimer_t* close_timer;
-    evtimer_t* read_timer;
-    evtimer_t* write_timer;
-    evtimer_t* keepalive_timer;
-    evtimer_t* heartbeat_timer;
-    // upstream
-    struct evio_s* upstream_io; // for evio_setup_upstream
-    // unpack
-    unpack_setting_t* unpack_setting; // for evio_set_unpack
-    // ssl
-    void* ssl;      // for evio_set_ssl
-    void* ssl_ctx;  // for evio_set_ssl_ctx
-    char* hostname; // for hssl_set_sni_hostname
+    // NOTE: evio_cold_none until written by evio_cold(io), so read it without check.
+    struct evio_cold_s* cold;
     // context
     void* ctx; // for evio_context / evio_set_context
 // private:
 #if defined(EVENT_POLL) || defined(EVENT_KQUEUE)
     int event_index[2]; // for poll,kqueue
 #endif
+#if defined(EVENT_EPOLL) || defined(EVENT_IOURING)
+    uint32_t epoll_events; // registered epoll events, interest cache
+#endif
+    int again_events; // for evio_ready_again
+#ifdef EVENT_IOURING
+    void* uring; // for io_uring
+#endif
 };
 /*
  * evio lifeline:
  *
  * fd =>
- * evio_get => EV_ALLOC_SIZEOF(io) => evio_init => evio_ready
+ * evio_get => EV_ALLOC_SIZEOF(io) or evio_slab_alloc => evio_init => evio_ready
  *
  * evio_read  => evio_add(EV_READ) => evio_read_cb
  * evio_write => evio_add(EV_WRITE) => evio_write_cb
  * evio_close => evio_done => evio_del(EV_RDWR) => evio_close_cb
  *
- * evloop_stop => evloop_free => evio_free => EV_FREE(io)
+ * evloop_stop => evloop_free => evio_free => EV_FREE(io) or evio_slab_free
  */
+evio_t* evio_slab_alloc();
+void evio_slab_free(evio_t* io);
 void evio_init(evio_t* io);
 void evio_ready(evio_t* io);
 void evio_done(evio_t* io);
 void evio_free(evio_t* io);
 uint32_t evio_next_id();
 
+// shared by ios without cold fields, read-only
+extern const struct evio_cold_s evio_cold_none;
+struct evio_cold_s* evio_cold_alloc(evio_t* io);
+void evio_cold_free(evio_t* io);
+static inline struct evio_cold_s* evio_cold(evio_t* io) {
+    return io->cold != &evio_cold_none ? io->cold : evio_cold_alloc(io);
+}
+
+static inline void evio_write_lock(evio_t* io) {
+    if (!io->lean)
+        recursive_mutex_lock(&io->cold->write_mutex);
+}
+static inline void evio_write_unlock(evio_t* io) {
+    if (!io->lean)
+        recursive_mutex_unlock(&io->cold->write_mutex);
+}
+
 void evio_accept_cb(evio_t* io);
 void evio_connect_cb(evio_t* io);
 void evio_handle_read(evio_t* io, void* buf, int readbytes);
 void evio_read_cb(evio_t* io, void* buf, int len);
 void evio_write_cb(evio_t* io, const void* buf, int len);
+// NOTE: called under evio_write_lock, evio_write_watermark_cb if watermark crossed.
+bool evio_write_cross_high(evio_t* io);
+bool evio_write_cross_low(evio_t* io);
+void evio_write_watermark_cb(evio_t* io, int above_high);
 void evio_close_cb(evio_t* io);
 
 void evio_del_connect_timer(evio_t* io);
@@ -225,13 +445,55 @@ void evio_del_heartbeat_timer(evio_t* io);
 
 static inline bool evio_is_loop_readbuf(evio_t* io) { return io->readbuf.base == io->loop->readbuf.base; }
 static inline bool evio_is_alloced_readbuf(evio_t* io) { return io->alloced_readbuf; }
+// bytes counted in loop->mem_used
+static inline size_t evio_memory_usage(evio_t* io) {
+    return (io->alloced_readbuf ? io->readbuf.len : 0) + io->write_bufsize;
+}
 void evio_alloc_readbuf(evio_t* io, int len);
 void evio_free_readbuf(evio_t* io);
+// own readbuf for unpack or read_until again, if returned by lean io
+void evio_prepare_readbuf(evio_t* io);
+// return empty readbuf of lean io
+void evio_lean_readbuf(evio_t* io);
 void evio_memmove_readbuf(evio_t* io);
 
-#define EVENT_ENTRY(p) container_of(p, event_t, pending_node)
-#define IDLE_ENTRY(p)  container_of(p, evidle_t, node)
-#define TIMER_ENTRY(p) container_of(p, evtimer_t, node)
+// splice upstream: io->fd => pipe => io->upstream_io->fd, bytes never copied to user space.
+// @return -1 if unsupported, then use evio_read_upstream
+int evio_read_upstream_splice(evio_t* io);
+void evio_splice_free(evio_t* io);
+void evio_chain_free(evio_t* io);
+// free pooled coroutine stacks, @see coroutine.c
+void evloop_co_cleanup(evloop_t* loop);
+// resume coroutines taken from a closed io, their co_read/co_write return -1, @see coroutine.c
+void evio_co_close(struct evco_s* reader, struct evco_s* writer);
+// cancel queued works and wait running ones, @see evwork.c
+void evloop_work_cleanup(evloop_t* loop);
+// drop pending resolves without cb, close nameserver ios, @see evdns.c
+void evloop_dns_cleanup(evloop_t* loop);
+
+// edge-triggered only for (nonblocking) stream sockets, others are level-triggered.
+static inline bool evio_is_edge_triggered(evio_t* io) {
+#ifdef EVENT_IOURING
+    if (io->loop->iouring)
+        return false;
+#endif
+    return (io->loop->flags & EVLOOP_FLAG_EDGE_TRIGGERED) && (io->io_type & EIO_TYPE_SOCK_STREAM);
+}
+// NOTE: edge will not come again if not read/write until EAGAIN,
+// so handle events again in next loop without blocking.
+void evio_ready_again(evio_t* io, int events);
+static inline const evio_budget_t* evio_budget(evio_t* io) {
+    return io->cold->budget ? io->cold->budget : &io->loop->io_budget;
+}
+// @return true if cnt syscalls or bytes used up max_cnt or max_bytes, 0 is unlimited
+static inline bool evio_budget_spent(uint32_t max_cnt, uint32_t cnt, uint32_t max_bytes, size_t bytes) {
+    return (max_cnt && cnt >= max_cnt) || (max_bytes && bytes >= max_bytes);
+}
+
+#define EVENT_ENTRY(p)   container_of(p, event_t, pending_node)
+#define IDLE_ENTRY(p)    container_of(p, evidle_t, node)
+#define TIMER_ENTRY(p)   container_of(p, evtimer_t, node)
+#define TIMEOUT_ENTRY(p) container_of(p, evtimer_t, wnode)
 
 #define EVENT_ACTIVE(ev)      \
     if (!ev->active) {        \
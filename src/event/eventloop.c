@@ -6,17 +6,21 @@
 #include "iowatcher.h"
 #include "log.h"
 #include "socket.h"
+#include "sockopt.h"
 #include "sockunion.h"
 #if defined(OS_UNIX) && HAVE_EVENTFD
 #include "sys/eventfd.h"
 #endif
+#if defined(OS_LINUX) && HAVE_TIMERFD
+#include "sys/timerfd.h"
+#endif
 
 #define EVLOOP_PAUSE_TIME            10    // ms
 #define EVLOOP_MAX_BLOCK_TIME        100   // ms
 #define EVLOOP_STAT_TIMEOUT          60000 // ms
 
 #define IO_ARRAY_INIT_SIZE           1024
-#define CUSTOM_EVENT_QUEUE_INIT_SIZE 16
+#define AGAIN_IOS_INIT_SIZE          64
 
 #define EVENTFDS_READ_INDEX          0
 #define EVENTFDS_WRITE_INDEX         1
@@ -24,6 +28,60 @@
 static void __evidle_del(evidle_t* idle);
 static void __evtimer_del(evtimer_t* timer);
 
+// stats: seqlock, only loop thread writes.
+static inline void evloop_stats_write_begin(evloop_t* loop) {
+    unsigned int seq = atomic_load_explicit(&loop->stats_seq, memory_order_relaxed);
+    atomic_store_explicit(&loop->stats_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void evloop_stats_write_end(evloop_t* loop) {
+    unsigned int seq = atomic_load_explicit(&loop->stats_seq, memory_order_relaxed);
+    atomic_store_explicit(&loop->stats_seq, seq + 1, memory_order_release);
+}
+
+static void evloop_stats_add_lag(evloop_t* loop, int64_t lag_us) {
+    evloop_stats_write_begin(loop);
+    evloop_histogram_add(&loop->stats->timer_lag, lag_us > 0 ? lag_us * 1000 : 0);
+    evloop_stats_write_end(loop);
+}
+
+static void evloop_stats_add_cb(evloop_t* loop, event_t* ev, void* user_cb, uint64_t ns) {
+    evloop_stats_t* stats = loop->stats;
+    int type = ev->event_type == EVENT_TYPE_IO    ? EVLOOP_STATS_IO
+               : ev->event_type & EVENT_TYPE_TIMER ? EVLOOP_STATS_TIMER
+               : ev->event_type == EVENT_TYPE_IDLE ? EVLOOP_STATS_IDLE
+                                                   : EVLOOP_STATS_CUSTOM;
+    evloop_stats_write_begin(loop);
+    evloop_histogram_add(&stats->callbacks[type], ns);
+    if (ns > stats->slowest[EVLOOP_STATS_SLOWEST - 1].duration_ns) {
+        int i = EVLOOP_STATS_SLOWEST - 1;
+        for (; i > 0 && ns > stats->slowest[i - 1].duration_ns; --i) {
+            stats->slowest[i] = stats->slowest[i - 1];
+        }
+        evloop_slow_cb_t* slow = &stats->slowest[i];
+        slow->cb = (void*)ev->cb;
+        slow->user_cb = user_cb;
+        slow->event_type = ev->event_type;
+        slow->fd = ev->event_type == EVENT_TYPE_IO ? ((evio_t*)ev)->fd : -1;
+        slow->duration_ns = ns;
+        slow->hrtime = loop->cur_hrtime;
+    }
+    evloop_stats_write_end(loop);
+}
+
+// NOTE: io cb is the nio dispatcher, record the user callback it will call.
+static inline void* evloop_stats_user_cb(event_t* ev) {
+    if (ev->event_type != EVENT_TYPE_IO)
+        return NULL;
+    evio_t* io = (evio_t*)ev;
+    if (io->accept)
+        return (void*)io->accept_cb;
+    if (io->connect)
+        return (void*)io->connect_cb;
+    return (void*)io->read_cb;
+}
+
 static int timers_compare(const struct heap_node* lhs, const struct heap_node* rhs) {
     return TIMER_ENTRY(lhs)->next_timeout < TIMER_ENTRY(rhs)->next_timeout;
 }
@@ -49,7 +107,58 @@ static int evloop_process_idles(evloop_t* loop) {
     return nidles;
 }
 
-static int __evloop_process_timers(struct heap* timers, uint64_t timeout) {
+// NOTE: round up to tick, so never expire earlier than next_timeout.
+// loop wakes up at the earliest deadline + slack, then fires all timers whose deadline passed,
+// so timers with overlapping [deadline, deadline + slack] share one wakeup.
+static void evtimer_wheel_add(evloop_t* loop, evtimer_t* timer) {
+    evtimeout_t* timeout = (evtimeout_t*)timer;
+    timer->wnode.expire = (timer->next_timeout + 999) / 1000;
+    timewheel_add(&loop->timers, &timer->wnode);
+    timeout->lnode.expire = timer->wnode.expire + timeout->slack;
+    timewheel_add(&loop->timer_limits, &timeout->lnode);
+}
+
+static void evtimer_wheel_del(evloop_t* loop, evtimer_t* timer) {
+    timewheel_del(&loop->timers, &timer->wnode);
+    timewheel_del(&loop->timer_limits, &((evtimeout_t*)timer)->lnode);
+}
+
+static int evloop_process_timeouts(evloop_t* loop) {
+    int ntimers = 0;
+    uint64_t now = loop->cur_hrtime;
+    struct timewheel_node* node = NULL;
+    evtimer_t* timer = NULL;
+    while ((node = timewheel_pop(&loop->timers, now / 1000)) != NULL) {
+        timer = TIMEOUT_ENTRY(node);
+        timewheel_del(&loop->timer_limits, &((evtimeout_t*)timer)->lnode);
+        if (loop->stats) {
+            evloop_stats_add_lag(loop, now - timer->next_timeout);
+        }
+        if (timer->repeat != INFINITE) {
+            --timer->repeat;
+        }
+        if (timer->repeat == 0) {
+            // NOTE: Already popped from wheel, just mark it as destroy.
+            // Real deletion occurs after evloop_process_pendings.
+            __evtimer_del(timer);
+        } else {
+            // NOTE: calc next timeout, then re-add wheel.
+            while (timer->next_timeout <= now) {
+                timer->next_timeout += (uint64_t)((evtimeout_t*)timer)->timeout * 1000;
+            }
+            evtimer_wheel_add(loop, timer);
+        }
+        EVENT_PENDING(timer);
+        ++ntimers;
+    }
+    // NOTE: just advance, deadline <= deadline + slack, so expired ones were popped above.
+    while (timewheel_pop(&loop->timer_limits, now / 1000) != NULL) {
+    }
+    return ntimers;
+}
+
+// NOTE: only eperiod_t in heap, evtimeout_t in wheel.
+static int __evloop_process_timers(evloop_t* loop, struct heap* timers, uint64_t timeout) {
     int ntimers = 0;
     evtimer_t* timer = NULL;
     while (timers->root) {
@@ -58,6 +167,9 @@ static int __evloop_process_timers(struct heap* timers, uint64_t timeout) {
         if (timer->next_timeout > timeout) {
             break;
         }
+        if (loop->stats) {
+            evloop_stats_add_lag(loop, timeout - timer->next_timeout);
+        }
         if (timer->repeat != INFINITE) {
             --timer->repeat;
         }
@@ -68,16 +180,10 @@ static int __evloop_process_timers(struct heap* timers, uint64_t timeout) {
         } else {
             // NOTE: calc next timeout, then re-insert heap.
             heap_dequeue(timers);
-            if (timer->event_type == EVENT_TYPE_TIMEOUT) {
-                while (timer->next_timeout <= timeout) {
-                    timer->next_timeout += (uint64_t)((evtimeout_t*)timer)->timeout * 1000;
-                }
-            } else if (timer->event_type == EVENT_TYPE_PERIOD) {
-                eperiod_t* period = (eperiod_t*)timer;
-                timer->next_timeout = (uint64_t)cron_next_timeout(period->minute, period->hour, period->day,
-                                                                  period->week, period->month) *
-                                      1000000;
-            }
+            eperiod_t* period = (eperiod_t*)timer;
+            timer->next_timeout = (uint64_t)cron_next_timeout(period->minute, period->hour, period->day,
+                                                              period->week, period->month) *
+                                  1000000;
             heap_insert(timers, &timer->node);
         }
         EVENT_PENDING(timer);
@@ -86,22 +192,153 @@ static int __evloop_process_timers(struct heap* timers, uint64_t timeout) {
     return ntimers;
 }
 
+static int evloop_process_hrtimers(evloop_t* loop) {
+    int ntimers = 0;
+    evtimer_t* timer = NULL;
+    evloop_hrtimer_stats_t* stats = &loop->hrtimer_stats;
+    uint64_t now_ns = gethrtime_ns();
+    uint64_t now = now_ns / 1000;
+    while (loop->hrtimers.root) {
+        timer = TIMER_ENTRY(loop->hrtimers.root);
+        if (timer->next_timeout > now) {
+            break;
+        }
+        ++stats->fires;
+        evloop_histogram_add(&stats->error, now_ns - timer->next_timeout * 1000);
+        if (timer->repeat != INFINITE) {
+            --timer->repeat;
+        }
+        if (timer->repeat == 0) {
+            __evtimer_del(timer);
+        } else {
+            heap_dequeue(&loop->hrtimers);
+            while (timer->next_timeout <= now) {
+                timer->next_timeout += ((evtimeout_t*)timer)->timeout;
+            }
+            heap_insert(&loop->hrtimers, &timer->node);
+        }
+        EVENT_PENDING(timer);
+        ++ntimers;
+    }
+    return ntimers;
+}
+
 static int evloop_process_timers(evloop_t* loop) {
     uint64_t now = evloop_now_us(loop);
-    int ntimers = __evloop_process_timers(&loop->timers, loop->cur_hrtime);
-    ntimers += __evloop_process_timers(&loop->realtimers, now);
+    int ntimers = evloop_process_timeouts(loop);
+    ntimers += __evloop_process_timers(loop, &loop->realtimers, now);
+    if (loop->hrtimers.root) {
+        ntimers += evloop_process_hrtimers(loop);
+    }
     return ntimers;
 }
 
+static void timerfd_read_cb(evio_t* io, void* buf, int readbytes) {
+    // NOTE: hrtimers expired are popped by evloop_process_hrtimers already.
+    io->loop->timerfd_expire = 0;
+}
+
+static int evloop_create_timerfd(evloop_t* loop) {
+#if defined(OS_LINUX) && HAVE_TIMERFD
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd < 0) {
+        log_error("timerfd create failed!");
+        return -1;
+    }
+    loop->timerfd = tfd;
+    evio_t* io = hread(loop, tfd, loop->readbuf.base, loop->readbuf.len, timerfd_read_cb);
+    io->priority = EVENT_HIGH_PRIORITY;
+    ++loop->intern_nevents;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+// NOTE: no timerfd, fallback to poll timeout rounded up to ms.
+// expire_us is of gethrtime_us, CLOCK_MONOTONIC as the timerfd.
+static void evloop_arm_timerfd(evloop_t* loop, uint64_t expire_us) {
+#if defined(OS_LINUX) && HAVE_TIMERFD
+    if (loop->timerfd < 0 || loop->timerfd_expire == expire_us)
+        return;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = expire_us / 1000000;
+    its.it_value.tv_nsec = expire_us % 1000000 * 1000;
+    if (timerfd_settime(loop->timerfd, TFD_TIMER_ABSTIME, &its, NULL) == 0) {
+        loop->timerfd_expire = expire_us;
+        ++loop->hrtimer_stats.arms;
+    }
+#endif
+}
+
+// NOTE: spin window = 2 * ewma of idle gap, 0 if over busy_poll_max_us,
+// so sparse traffic blocks at once and dense traffic never sleeps.
+static void evloop_busy_poll_adapt(evloop_t* loop, uint64_t gap_us) {
+    // NOTE: cap long idle gaps, so spinning resumes soon after traffic comes back.
+    gap_us = MIN(gap_us, loop->busy_poll_max_us * 2);
+    loop->busy_poll_gap_us = (loop->busy_poll_gap_us * 7 + gap_us) / 8;
+    uint64_t window = loop->busy_poll_gap_us * 2;
+    loop->busy_poll_us = window <= loop->busy_poll_max_us ? window : 0;
+}
+
+static int evloop_busy_poll_events(evloop_t* loop, int timeout) {
+    uint64_t start = gethrtime_us();
+    uint64_t now = start;
+    uint64_t window = MIN(loop->busy_poll_us, (uint64_t)timeout * 1000);
+    int nevents = 0;
+    while (window) {
+        nevents = iowatcher_poll_events(loop, 0);
+        now = gethrtime_us();
+        if (nevents != 0 || loop->status == EVLOOP_STATUS_STOP || now - start >= window)
+            break;
+    }
+    if (nevents == 0 && loop->status != EVLOOP_STATUS_STOP) {
+        nevents = iowatcher_poll_events(loop, timeout);
+        now = gethrtime_us();
+    }
+    evloop_busy_poll_adapt(loop, now - start);
+    return nevents;
+}
+
 static int evloop_process_ios(evloop_t* loop, int timeout) {
     // That is to call IO multiplexing function such as select, poll, epoll, etc.
-    int nevents = iowatcher_poll_events(loop, timeout);
+    uint64_t start_ns = loop->stats ? gethrtime_ns() : 0;
+    int nevents = (loop->flags & EVLOOP_FLAG_BUSY_POLL) && timeout > 0 ? evloop_busy_poll_events(loop, timeout)
+                                                                          : iowatcher_poll_events(loop, timeout);
+    if (loop->stats) {
+        uint64_t poll_ns = gethrtime_ns() - start_ns;
+        evloop_stats_write_begin(loop);
+        loop->stats->poll_ns += poll_ns;
+        loop->stats->loop_cnt = loop->loop_cnt;
+        evloop_stats_write_end(loop);
+    }
     if (nevents < 0) {
         log_debug("poll_events error=%d", -nevents);
     }
     return nevents < 0 ? 0 : nevents;
 }
 
+static int evloop_process_again_ios(evloop_t* loop) {
+    int nios = 0;
+    if (loop->again_ios.size > loop->fairness_stats.again_ios_max) {
+        loop->fairness_stats.again_ios_max = loop->again_ios.size;
+    }
+    for (int i = 0; i < loop->again_ios.size; ++i) {
+        evio_t* io = loop->again_ios.ptr[i];
+        int events = io->again_events & io->events;
+        io->again_events = 0;
+        if (io->ready && events) {
+            io->revents |= events;
+            EVENT_PENDING(io);
+            ++nios;
+        }
+    }
+    loop->again_ios.size = 0;
+    loop->fairness_stats.again_ios += nios;
+    return nios;
+}
+
 static int evloop_process_pendings(evloop_t* loop) {
     if (loop->npendings == 0)
         return 0;
@@ -109,6 +346,9 @@ static int evloop_process_pendings(evloop_t* loop) {
     event_t* cur = NULL;
     event_t* next = NULL;
     int ncbs = 0;
+    evloop_stats_t* stats = loop->stats;
+    uint64_t run_start_ns = stats ? gethrtime_ns() : 0;
+    uint64_t start_ns = run_start_ns, end_ns = 0;
     // NOTE: invoke event callback from high to low sorted by priority.
     for (int i = EVENT_PRIORITY_SIZE - 1; i >= 0; --i) {
         cur = loop->pendings[i];
@@ -116,7 +356,16 @@ static int evloop_process_pendings(evloop_t* loop) {
             next = cur->pending_next;
             if (cur->pending) {
                 if (cur->active && cur->cb) {
-                    cur->cb(cur);
+                    if (stats) {
+                        void* user_cb = evloop_stats_user_cb(cur);
+                        loop->stats_nested_ns = 0;
+                        cur->cb(cur);
+                        end_ns = gethrtime_ns();
+                        evloop_stats_add_cb(loop, cur, user_cb, end_ns - start_ns - loop->stats_nested_ns);
+                        start_ns = end_ns;
+                    } else {
+                        cur->cb(cur);
+                    }
                     ++ncbs;
                 }
                 cur->pending = 0;
@@ -130,9 +379,101 @@ static int evloop_process_pendings(evloop_t* loop) {
         loop->pendings[i] = NULL;
     }
     loop->npendings = 0;
+    if (stats) {
+        evloop_stats_write_begin(loop);
+        stats->run_ns += gethrtime_ns() - run_start_ns;
+        evloop_stats_write_end(loop);
+    }
     return ncbs;
 }
 
+static int evio_memory_usage_cmp(const void* a, const void* b) {
+    size_t x = evio_memory_usage(*(evio_t**)a);
+    size_t y = evio_memory_usage(*(evio_t**)b);
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// stop accepting, then stop reading the largest consumers until
+// what they hold covers the excess over mem_resume.
+// NOTE: if still growing after that, stop reading all ios holding memory.
+static void evloop_memory_throttle(evloop_t* loop, size_t used) {
+    evloop_memory_stats_t* stats = &loop->mem_stats;
+    size_t excess = stats->throttled ? used : used - loop->mem_resume;
+    if (!stats->throttled) {
+        stats->throttled = 1;
+        ++stats->throttles;
+        loop->mem_throttle_start_us = gethrtime_us();
+        log_warn("loop memory %zu over budget %zu, throttling", used, loop->mem_budget);
+    }
+    loop->mem_paused_at = used;
+    size_t paused_bytes = 0;
+    evio_t** consumers = NULL;
+    int nconsumers = 0;
+    EV_ALLOC(consumers, sizeof(evio_t*) * (loop->nios + 1));
+    for (int i = 0; i < loop->ios.maxsize; ++i) {
+        evio_t* io = loop->ios.ptr[i];
+        if (io == NULL || !io->ready || io->closed)
+            continue;
+        if (io->budget_paused) {
+            paused_bytes += evio_memory_usage(io);
+            continue;
+        }
+        if (!(io->events & EV_READ))
+            continue;
+        if (io->accept) {
+            evio_del(io, EV_READ);
+            io->budget_paused = 1;
+            ++stats->accept_pauses;
+        } else if (evio_memory_usage(io) && nconsumers <= (int)loop->nios) {
+            consumers[nconsumers++] = io;
+        }
+    }
+    qsort(consumers, nconsumers, sizeof(evio_t*), evio_memory_usage_cmp);
+    for (int i = 0; i < nconsumers && paused_bytes < excess; ++i) {
+        evio_t* io = consumers[i];
+        paused_bytes += evio_memory_usage(io);
+        evio_read_stop(io);
+        io->budget_paused = 1;
+        ++stats->read_pauses;
+    }
+    EV_FREE(consumers);
+}
+
+static void evloop_memory_resume(evloop_t* loop) {
+    evloop_memory_stats_t* stats = &loop->mem_stats;
+    stats->throttled = 0;
+    stats->throttled_us += gethrtime_us() - loop->mem_throttle_start_us;
+    for (int i = 0; i < loop->ios.maxsize; ++i) {
+        evio_t* io = loop->ios.ptr[i];
+        if (io == NULL || !io->budget_paused)
+            continue;
+        io->budget_paused = 0;
+        if (!io->ready || io->closed)
+            continue;
+        if (io->accept) {
+            evio_accept(io);
+        } else {
+            evio_read(io);
+        }
+    }
+}
+
+void evloop_memory_check(evloop_t* loop) {
+    evloop_memory_stats_t* stats = &loop->mem_stats;
+    size_t used = atomic_load_explicit(&loop->mem_used, memory_order_relaxed);
+    if (used > stats->used_max) {
+        stats->used_max = used;
+    }
+    if (used > loop->mem_budget) {
+        // NOTE: rescan ios only if still growing after last pause.
+        if (!stats->throttled || used - loop->mem_paused_at >= (loop->mem_budget - loop->mem_resume) / 4) {
+            evloop_memory_throttle(loop, used);
+        }
+    } else if (stats->throttled && used <= loop->mem_resume) {
+        evloop_memory_resume(loop);
+    }
+}
+
 // evloop_process_ios -> evloop_process_timers -> evloop_process_idles -> evloop_process_pendings
 static int evloop_process_events(evloop_t* loop) {
     // ios -> timers -> idles
@@ -144,25 +485,41 @@ static int evloop_process_events(evloop_t* loop) {
     if (loop->ntimers) {
         evloop_update_time(loop);
         int64_t blocktime_us = blocktime_ms * 1000;
-        if (loop->timers.root) {
-            int64_t min_timeout = TIMER_ENTRY(loop->timers.root)->next_timeout - loop->cur_hrtime;
+        if (loop->timer_limits.nelts) {
+            int64_t min_timeout = timewheel_next_expire(&loop->timer_limits) * 1000 - loop->cur_hrtime;
             blocktime_us = MIN(blocktime_us, min_timeout);
         }
         if (loop->realtimers.root) {
             int64_t min_timeout = TIMER_ENTRY(loop->realtimers.root)->next_timeout - evloop_now_us(loop);
             blocktime_us = MIN(blocktime_us, min_timeout);
         }
+        int64_t hrtimer_timeout = INT64_MAX;
+        if (loop->hrtimers.root) {
+            hrtimer_timeout = TIMER_ENTRY(loop->hrtimers.root)->next_timeout - gethrtime_us();
+            blocktime_us = MIN(blocktime_us, hrtimer_timeout);
+        }
         if (blocktime_us <= 0)
             goto process_timers;
         blocktime_ms = blocktime_us / 1000 + 1;
         blocktime_ms = MIN(blocktime_ms, EVLOOP_MAX_BLOCK_TIME);
+        // NOTE: timerfd wakes up poll at the hrtimer deadline, before the ms timeout.
+        if (hrtimer_timeout < (int64_t)blocktime_ms * 1000) {
+            evloop_arm_timerfd(loop, TIMER_ENTRY(loop->hrtimers.root)->next_timeout);
+        }
     }
 
+    if (loop->again_ios.size) {
+        // NOTE: no blocking, handle again_ios after poll
+        blocktime_ms = 0;
+    }
     if (loop->nios) {
         nios = evloop_process_ios(loop, blocktime_ms);
     } else {
         ev_msleep(blocktime_ms);
     }
+    if (loop->again_ios.size) {
+        nios += evloop_process_again_ios(loop);
+    }
     evloop_update_time(loop);
     // wakeup by evloop_stop
     if (loop->status == EVLOOP_STATUS_STOP) {
@@ -181,6 +538,9 @@ process_timers:
         }
     }
     int ncbs = evloop_process_pendings(loop);
+    if (loop->mem_budget) {
+        evloop_memory_check(loop);
+    }
     // printd("blocktime=%d nios=%d/%u ntimers=%d/%u nidles=%d/%u nactives=%d npendings=%d ncbs=%d\n",
     //         blocktime, nios, loop->nios, ntimers, loop->ntimers, nidles, loop->nidles,
     //         loop->nactives, npendings, ncbs);
@@ -193,37 +553,73 @@ static void evloop_stat_timer_cb(evtimer_t* timer) {
     log_debug("[loop] pid=%ld tid=%ld uptime=%lluus cnt=%llu nactives=%u nios=%u ntimers=%u nidles=%u", loop->pid,
               loop->tid, loop->cur_hrtime - loop->start_hrtime, loop->loop_cnt, loop->nactives, loop->nios, loop->ntimers,
               loop->nidles);
+    if (loop->stats) {
+        log_debug("[loop] poll=%lluus run=%lluus lag_p99=%lluus slowest=%lluus", loop->stats->poll_ns / 1000,
+                  loop->stats->run_ns / 1000, evloop_histogram_percentile(&loop->stats->timer_lag, 99) / 1000,
+                  loop->stats->slowest[0].duration_ns / 1000);
+    }
 }
 
-static void eventfd_read_cb(evio_t* io, void* buf, int readbytes) {
-    evloop_t* loop = io->loop;
-    event_t* pev = NULL;
+typedef struct custom_event_s {
+    struct mpsc_node node;
     event_t ev;
-    uint64_t count = readbytes;
+} custom_event_t;
+
+#define CUSTOM_EVENT_ENTRY(p) container_of(p, custom_event_t, node)
+
+static int evloop_write_eventfd(evloop_t* loop) {
+    int nwrite = 0;
+    uint64_t count = 1;
 #if defined(OS_UNIX) && HAVE_EVENTFD
-    assert(readbytes == sizeof(count));
-    count = *(uint64_t*)buf;
+    nwrite = write(loop->eventfds[EVENTFDS_WRITE_INDEX], &count, sizeof(count));
+#elif defined(OS_UNIX) && HAVE_PIPE
+    nwrite = write(loop->eventfds[EVENTFDS_WRITE_INDEX], "e", 1);
+#else
+    nwrite = send(loop->eventfds[EVENTFDS_WRITE_INDEX], "e", 1, 0);
 #endif
-    for (uint64_t i = 0; i < count; ++i) {
-        mutex_lock(&loop->custom_events_mutex);
-        if (event_queue_empty(&loop->custom_events)) {
-            goto unlock;
-        }
-        pev = event_queue_front(&loop->custom_events);
-        if (pev == NULL) {
-            goto unlock;
+    return nwrite;
+}
+
+static void eventfd_read_cb(evio_t* io, void* buf, int readbytes) {
+    evloop_t* loop = io->loop;
+    struct mpsc_queue* queue = &loop->custom_events;
+    struct mpsc_node* node = NULL;
+    custom_event_t* cev = NULL;
+    event_t ev;
+    // NOTE: clear wakeup flag before drain, so the posts after here will write eventfds again.
+    atomic_store(&loop->custom_events_wakeup, 0);
+    if (mpsc_queue_empty(queue)) {
+        return;
+    }
+    // NOTE: drain until empty, a snapshot of head may miss a node pushed while popping the last one.
+    // At most EVLOOP_MAX_CUSTOM_EVENTS, so a cb posting itself can not starve the loop.
+    int nevents = 0;
+    while (nevents < EVLOOP_MAX_CUSTOM_EVENTS && (node = mpsc_queue_pop(queue)) != NULL) {
+        ++nevents;
+        cev = CUSTOM_EVENT_ENTRY(node);
+        ev = cev->ev;
+        EV_FREE(cev);
+        if (ev.cb == NULL) {
+            continue;
         }
-        ev = *pev;
-        event_queue_pop_front(&loop->custom_events);
-        // NOTE: unlock before cb, avoid deadlock if evloop_post_event called in cb.
-        mutex_unlock(&loop->custom_events_mutex);
-        if (ev.cb) {
+        if (loop->stats) {
+            // NOTE: nested in eventfd io callback, which excludes it.
+            uint64_t start_ns = gethrtime_ns();
+            ev.cb(&ev);
+            uint64_t ns = gethrtime_ns() - start_ns;
+            evloop_stats_add_cb(loop, &ev, NULL, ns);
+            loop->stats_nested_ns += ns;
+        } else {
             ev.cb(&ev);
         }
     }
-    return;
-unlock:
-    mutex_unlock(&loop->custom_events_mutex);
+    // NOTE: the rest may be posted before the flag cleared, wake up the next loop for them.
+    if (nevents == EVLOOP_MAX_CUSTOM_EVENTS && !mpsc_queue_empty(queue) &&
+        !atomic_exchange(&loop->custom_events_wakeup, 1)) {
+        if (evloop_write_eventfd(loop) <= 0) {
+            atomic_store(&loop->custom_events_wakeup, 0);
+        }
+    }
 }
 
 static int evloop_create_eventfds(evloop_t* loop) {
@@ -278,28 +674,29 @@ void evloop_post_event(evloop_t* loop, event_t* ev) {
         ev->event_id = evloop_next_event_id();
     }
 
-    int nwrite = 0;
-    uint64_t count = 1;
-    mutex_lock(&loop->custom_events_mutex);
     if (loop->eventfds[EVENTFDS_WRITE_INDEX] == -1) {
-        if (evloop_create_eventfds(loop) != 0) {
-            goto unlock;
+        mutex_lock(&loop->custom_events_mutex);
+        if (loop->eventfds[EVENTFDS_WRITE_INDEX] == -1 && evloop_create_eventfds(loop) != 0) {
+            mutex_unlock(&loop->custom_events_mutex);
+            return;
         }
+        mutex_unlock(&loop->custom_events_mutex);
     }
-#if defined(OS_UNIX) && HAVE_EVENTFD
-    nwrite = write(loop->eventfds[EVENTFDS_WRITE_INDEX], &count, sizeof(count));
-#elif defined(OS_UNIX) && HAVE_PIPE
-    nwrite = write(loop->eventfds[EVENTFDS_WRITE_INDEX], "e", 1);
-#else
-    nwrite = send(loop->eventfds[EVENTFDS_WRITE_INDEX], "e", 1, 0);
-#endif
-    if (nwrite <= 0) {
+
+    custom_event_t* cev;
+    EV_ALLOC_SIZEOF(cev);
+    cev->ev = *ev;
+    mpsc_queue_push(&loop->custom_events, &cev->node);
+    // NOTE: only the first post after eventfd_read_cb wakes up the loop.
+    if (atomic_exchange(&loop->custom_events_wakeup, 1)) {
+        return;
+    }
+
+    if (evloop_write_eventfd(loop) <= 0) {
+        // NOTE: event is queued, let the next post try to wake up again.
+        atomic_store(&loop->custom_events_wakeup, 0);
         log_error("evloop_post_event failed!");
-        goto unlock;
     }
-    event_queue_push_back(&loop->custom_events, ev);
-unlock:
-    mutex_unlock(&loop->custom_events_mutex);
 }
 
 static void evloop_init(evloop_t* loop) {
@@ -318,32 +715,63 @@ static void evloop_init(evloop_t* loop) {
     // idles
     list_init(&loop->idles);
 
+    // coroutines
+    list_init(&loop->coroutines);
+
+    // works
+    list_init(&loop->works);
+    mpsc_queue_init(&loop->works_done);
+    atomic_init(&loop->works_done_wakeup, 0);
+    atomic_init(&loop->works_active, 0);
+    atomic_init(&loop->works_started, 0);
+
+    // memory budget
+    atomic_init(&loop->mem_used, 0);
+
     // timers
-    heap_init(&loop->timers, timers_compare);
     heap_init(&loop->realtimers, timers_compare);
+    heap_init(&loop->hrtimers, timers_compare);
+    loop->timerfd = -1;
 
     // ios
     io_array_init(&loop->ios, IO_ARRAY_INIT_SIZE);
+    io_array_init(&loop->again_ios, AGAIN_IOS_INIT_SIZE);
+    evloop_set_io_budget(loop, NULL);
 
     // readbuf
     loop->readbuf.len = EVLOOP_READ_BUFSIZE;
     EV_ALLOC(loop->readbuf.base, loop->readbuf.len);
 
+    // bufpool
+    for (int i = 0; i < EVLOOP_BUFPOOL_CLASSES; ++i) {
+        loop->bufpool[i].max_free = EVLOOP_BUFPOOL_MAX_FREE / (EVLOOP_BUFPOOL_MIN_SIZE << i);
+    }
+
     // iowatcher
     iowatcher_init(loop);
 
     // custom_events
     mutex_init(&loop->custom_events_mutex);
-    event_queue_init(&loop->custom_events, CUSTOM_EVENT_QUEUE_INIT_SIZE);
+    mpsc_queue_init(&loop->custom_events);
+    atomic_init(&loop->custom_events_wakeup, 0);
     // NOTE: evloop_create_eventfds when evloop_post_event or evloop_run
     loop->eventfds[0] = loop->eventfds[1] = -1;
 
     // NOTE: init start_time here, because evtimer_add use it.
     loop->start_ms = gettimeofday_ms();
     loop->start_hrtime = loop->cur_hrtime = gethrtime_us();
+    timewheel_init(&loop->timers, loop->cur_hrtime / 1000);
+    timewheel_init(&loop->timer_limits, loop->cur_hrtime / 1000);
 }
 
 static void evloop_cleanup(evloop_t* loop) {
+    // works
+    // NOTE: first, pool threads may post completions until running works done.
+    evloop_work_cleanup(loop);
+    // dns
+    // NOTE: before ios and timers, its queries hold both.
+    evloop_dns_cleanup(loop);
+
     // pendings
     printd("cleanup pendings...");
     for (int i = 0; i < EVENT_PRIORITY_SIZE; ++i) {
@@ -352,13 +780,20 @@ static void evloop_cleanup(evloop_t* loop) {
 
     // ios
     printd("cleanup ios...");
+    // NOTE: evloop_free maybe called after loop thread joined, evio_close them now, not async.
+    loop->tid = gettid();
     for (int i = 0; i < loop->ios.maxsize; ++i) {
         evio_t* io = loop->ios.ptr[i];
         if (io) {
+            // NOTE: waiting coroutines are not resumed, their stacks freed by evloop_co_cleanup.
+            if (io->cold->co_reader || io->cold->co_writer) {
+                io->cold->co_reader = io->cold->co_writer = NULL;
+            }
             evio_free(io);
         }
     }
     io_array_cleanup(&loop->ios);
+    io_array_cleanup(&loop->again_ios);
 
     // idles
     printd("cleanup idles...");
@@ -374,18 +809,31 @@ static void evloop_cleanup(evloop_t* loop) {
     // timers
     printd("cleanup timers...");
     evtimer_t* timer;
-    while (loop->timers.root) {
-        timer = TIMER_ENTRY(loop->timers.root);
-        heap_dequeue(&loop->timers);
+    struct list_head timeouts;
+    list_init(&timeouts);
+    timewheel_clear(&loop->timers, &timeouts);
+    // NOTE: lnodes of the same timers, freed by timeouts.
+    struct list_head limits;
+    list_init(&limits);
+    timewheel_clear(&loop->timer_limits, &limits);
+    node = timeouts.next;
+    while (node != &timeouts) {
+        timer = TIMEOUT_ENTRY(node);
+        node = node->next;
         EV_FREE(timer);
     }
-    heap_init(&loop->timers, NULL);
     while (loop->realtimers.root) {
         timer = TIMER_ENTRY(loop->realtimers.root);
         heap_dequeue(&loop->realtimers);
         EV_FREE(timer);
     }
     heap_init(&loop->realtimers, NULL);
+    while (loop->hrtimers.root) {
+        timer = TIMER_ENTRY(loop->hrtimers.root);
+        heap_dequeue(&loop->hrtimers);
+        EV_FREE(timer);
+    }
+    heap_init(&loop->hrtimers, NULL);
 
     // readbuf
     if (loop->readbuf.base && loop->readbuf.len) {
@@ -397,12 +845,41 @@ static void evloop_cleanup(evloop_t* loop) {
     // iowatcher
     iowatcher_cleanup(loop);
 
+    // NOTE: evio_close does not close non-socket fd
+    if (loop->timerfd >= 0) {
+        close(loop->timerfd);
+        loop->timerfd = -1;
+    }
+
     // custom_events
     mutex_lock(&loop->custom_events_mutex);
     evloop_destroy_eventfds(loop);
-    event_queue_cleanup(&loop->custom_events);
+    struct mpsc_node* cnode = NULL;
+    custom_event_t* cev = NULL;
+    while ((cnode = mpsc_queue_pop(&loop->custom_events)) != NULL) {
+        cev = CUSTOM_EVENT_ENTRY(cnode);
+        EV_FREE(cev);
+    }
     mutex_unlock(&loop->custom_events_mutex);
     mutex_destroy(&loop->custom_events_mutex);
+
+    // bufpool
+    // NOTE: last, ios and iowatcher return blocks to it.
+    for (int i = 0; i < EVLOOP_BUFPOOL_CLASSES; ++i) {
+        bufpool_class_t* cls = &loop->bufpool[i];
+        while (cls->free_list) {
+            void* block = cls->free_list;
+            cls->free_list = *(void**)block;
+            ev_free(block);
+        }
+        cls->nfree = 0;
+    }
+
+    // stats
+    EV_FREE(loop->stats);
+
+    // coroutine stacks
+    evloop_co_cleanup(loop);
 }
 
 evloop_t* evloop_new(int flags) {
@@ -410,6 +887,12 @@ evloop_t* evloop_new(int flags) {
     EV_ALLOC_SIZEOF(loop);
     evloop_init(loop);
     loop->flags |= flags;
+    if (flags & EVLOOP_FLAG_STATS) {
+        EV_ALLOC_SIZEOF(loop->stats);
+    }
+    if (flags & EVLOOP_FLAG_BUSY_POLL) {
+        evloop_set_busy_poll(loop, EVLOOP_DEFAULT_BUSY_POLL_US, 0);
+    }
     return loop;
 }
 
@@ -440,7 +923,8 @@ int evloop_run(evloop_t* loop) {
         mutex_unlock(&loop->custom_events_mutex);
 
 #ifdef DEBUG
-        evtimer_add(loop, evloop_stat_timer_cb, EVLOOP_STAT_TIMEOUT, INFINITE);
+        evtimer_t* timer = evtimer_add(loop, evloop_stat_timer_cb, EVLOOP_STAT_TIMEOUT, INFINITE);
+        evtimer_set_slack(timer, EVTIMER_DEFAULT_SLACK(EVLOOP_STAT_TIMEOUT));
         ++loop->intern_nevents;
 #endif
     }
@@ -566,6 +1050,150 @@ uint32_t evloop_nactives(evloop_t* loop) {
     return loop->nactives;
 }
 
+uint64_t evloop_naccepts(evloop_t* loop) {
+    return atomic_load_explicit(&loop->naccepts, memory_order_relaxed);
+}
+
+int evloop_bufpool_stats(evloop_t* loop, evloop_bufpool_stats_t* stats) {
+    for (int i = 0; i < EVLOOP_BUFPOOL_CLASSES; ++i) {
+        bufpool_class_t* cls = &loop->bufpool[i];
+        stats[i].size = (size_t)EVLOOP_BUFPOOL_MIN_SIZE << i;
+        stats[i].hits = cls->hits;
+        stats[i].misses = cls->misses;
+        stats[i].inuse = cls->inuse;
+        stats[i].inuse_high = cls->inuse_high;
+        stats[i].nfree = cls->nfree;
+    }
+    return EVLOOP_BUFPOOL_CLASSES;
+}
+
+// NOTE: seqlock snapshot, retried while the loop thread is writing.
+int evloop_stats(evloop_t* loop, evloop_stats_t* stats) {
+    if (loop->stats == NULL)
+        return -1;
+    unsigned int seq = 0;
+    while (1) {
+        seq = atomic_load_explicit(&loop->stats_seq, memory_order_acquire);
+        if (seq & 1) {
+            // NOTE: writer preempted in a few stores, let it finish.
+            sched_yield();
+            continue;
+        }
+        memcpy(stats, loop->stats, sizeof(evloop_stats_t));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&loop->stats_seq, memory_order_relaxed) == seq)
+            break;
+    }
+    return 0;
+}
+
+uint64_t evloop_histogram_percentile(const evloop_histogram_t* hist, double percentile) {
+    if (hist->count == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(hist->count * percentile / 100);
+    uint64_t cnt = 0;
+    for (int i = 0; i < EVLOOP_STATS_BUCKETS - 1; ++i) {
+        cnt += hist->buckets[i];
+        if (cnt > rank) {
+            uint64_t upper = 256ULL << i;
+            return MIN(upper, hist->max_ns);
+        }
+    }
+    return hist->max_ns;
+}
+
+void* evloop_bufpool_alloc(evloop_t* loop, size_t size) {
+    int idx = bufpool_class_index(size);
+    if (idx < 0)
+        return ev_malloc(size);
+    // NOTE: blocks are always malloc(class size), so interchangeable with other threads.
+    size_t block_size = (size_t)EVLOOP_BUFPOOL_MIN_SIZE << idx;
+    if (gettid() != loop->tid)
+        return ev_malloc(block_size);
+    bufpool_class_t* cls = &loop->bufpool[idx];
+    void* block = cls->free_list;
+    if (block) {
+        cls->free_list = *(void**)block;
+        cls->nfree--;
+        cls->hits++;
+    } else {
+        block = ev_malloc(block_size);
+        cls->misses++;
+    }
+    if (++cls->inuse > cls->inuse_high) {
+        cls->inuse_high = cls->inuse;
+    }
+    return block;
+}
+
+void evloop_bufpool_free(evloop_t* loop, void* ptr, size_t size) {
+    if (ptr == NULL)
+        return;
+    int idx = bufpool_class_index(size);
+    if (idx < 0 || gettid() != loop->tid) {
+        ev_free(ptr);
+        return;
+    }
+    bufpool_class_t* cls = &loop->bufpool[idx];
+    if (cls->inuse)
+        cls->inuse--;
+    if (cls->nfree >= cls->max_free) {
+        ev_free(ptr);
+        return;
+    }
+    *(void**)ptr = cls->free_list;
+    cls->free_list = ptr;
+    cls->nfree++;
+}
+
+void evloop_set_busy_poll(evloop_t* loop, uint32_t max_spin_us, int so_busy_poll_us) {
+    loop->flags |= EVLOOP_FLAG_BUSY_POLL;
+    loop->busy_poll_max_us = max_spin_us;
+    // NOTE: start with full window, adapt after first wakeups.
+    loop->busy_poll_us = max_spin_us;
+    loop->busy_poll_gap_us = max_spin_us / 2;
+    loop->so_busy_poll_us = so_busy_poll_us;
+}
+
+int evloop_set_memory_budget(evloop_t* loop, size_t budget_bytes, size_t resume_bytes) {
+    if (resume_bytes == 0) {
+        resume_bytes = budget_bytes / 4 * 3;
+    }
+    if (budget_bytes && resume_bytes >= budget_bytes)
+        return -1;
+    loop->mem_budget = budget_bytes;
+    loop->mem_resume = resume_bytes;
+    if (budget_bytes == 0 && loop->mem_stats.throttled) {
+        evloop_memory_resume(loop);
+    }
+    return 0;
+}
+
+int evloop_memory_stats(evloop_t* loop, evloop_memory_stats_t* stats) {
+    *stats = loop->mem_stats;
+    stats->budget = loop->mem_budget;
+    stats->resume = loop->mem_resume;
+    stats->used = atomic_load_explicit(&loop->mem_used, memory_order_relaxed);
+    return 0;
+}
+
+void evloop_set_io_budget(evloop_t* loop, const evio_budget_t* budget) {
+    if (budget) {
+        loop->io_budget = *budget;
+        return;
+    }
+    loop->io_budget.accepts = EVIO_DEFAULT_BUDGET_ACCEPTS;
+    loop->io_budget.reads = EVIO_DEFAULT_BUDGET_READS;
+    loop->io_budget.read_bytes = EVIO_DEFAULT_BUDGET_BYTES;
+    loop->io_budget.writes = EVIO_DEFAULT_BUDGET_WRITES;
+    loop->io_budget.write_bytes = EVIO_DEFAULT_BUDGET_BYTES;
+}
+
+int evloop_fairness_stats(evloop_t* loop, evloop_fairness_stats_t* stats) {
+    *stats = loop->fairness_stats;
+    return 0;
+}
+
 void evloop_set_userdata(evloop_t* loop, void* userdata) {
     loop->userdata = userdata;
 }
@@ -616,13 +1244,65 @@ evtimer_t* evtimer_add(evloop_t* loop, evtimer_cb cb, uint32_t timeout_ms, uint3
     if (timeout_ms >= 1000 && timeout_ms % 100 == 0) {
         timer->next_timeout = timer->next_timeout / 100000 * 100000;
     }
-    heap_insert(&loop->timers, &timer->node);
+    evtimer_wheel_add(loop, (evtimer_t*)timer);
+    EVENT_ADD(loop, timer, cb);
+    loop->ntimers++;
+    return (evtimer_t*)timer;
+}
+
+evtimer_t* evtimer_add_us(evloop_t* loop, evtimer_cb cb, uint32_t timeout_us, uint32_t repeat) {
+    if (timeout_us == 0)
+        return NULL;
+    if (loop->timerfd < 0) {
+        evloop_create_timerfd(loop);
+    }
+    evtimeout_t* timer;
+    EV_ALLOC_SIZEOF(timer);
+    timer->event_type = EVENT_TYPE_HRTIMEOUT;
+    timer->priority = EVENT_HIGHEST_PRIORITY;
+    timer->repeat = repeat;
+    timer->timeout = timeout_us;
+    timer->next_timeout = gethrtime_us() + timeout_us;
+    heap_insert(&loop->hrtimers, &timer->node);
     EVENT_ADD(loop, timer, cb);
     loop->ntimers++;
     return (evtimer_t*)timer;
 }
 
+static void evhrtimer_reset(evtimer_t* timer, uint32_t timeout_ms) {
+    evloop_t* loop = timer->loop;
+    evtimeout_t* timeout = (evtimeout_t*)timer;
+    if (timer->destroy) {
+        loop->ntimers++;
+    } else {
+        heap_remove(&loop->hrtimers, &timer->node);
+    }
+    if (timer->repeat == 0) {
+        timer->repeat = 1;
+    }
+    if (timeout_ms > 0) {
+        timeout->timeout = timeout_ms * 1000;
+    }
+    timer->next_timeout = gethrtime_us() + timeout->timeout;
+    heap_insert(&loop->hrtimers, &timer->node);
+    EVENT_RESET(timer);
+}
+
+int evloop_hrtimer_stats(evloop_t* loop, evloop_hrtimer_stats_t* stats) {
+    *stats = loop->hrtimer_stats;
+    return 0;
+}
+
+int evloop_zerocopy_stats(evloop_t* loop, evloop_zerocopy_stats_t* stats) {
+    *stats = loop->zerocopy_stats;
+    return 0;
+}
+
 void evtimer_reset(evtimer_t* timer, uint32_t timeout_ms) {
+    if (timer->event_type == EVENT_TYPE_HRTIMEOUT) {
+        evhrtimer_reset(timer, timeout_ms);
+        return;
+    }
     if (timer->event_type != EVENT_TYPE_TIMEOUT) {
         return;
     }
@@ -631,7 +1311,7 @@ void evtimer_reset(evtimer_t* timer, uint32_t timeout_ms) {
     if (timer->destroy) {
         loop->ntimers++;
     } else {
-        heap_remove(&loop->timers, &timer->node);
+        evtimer_wheel_del(loop, timer);
     }
     if (timer->repeat == 0) {
         timer->repeat = 1;
@@ -644,10 +1324,25 @@ void evtimer_reset(evtimer_t* timer, uint32_t timeout_ms) {
     if (timeout->timeout >= 1000 && timeout->timeout % 100 == 0) {
         timer->next_timeout = timer->next_timeout / 100000 * 100000;
     }
-    heap_insert(&loop->timers, &timer->node);
+    evtimer_wheel_add(loop, timer);
     EVENT_RESET(timer);
 }
 
+void evtimer_set_slack(evtimer_t* timer, uint32_t slack_ms) {
+    if (timer->event_type != EVENT_TYPE_TIMEOUT) {
+        return;
+    }
+    evtimeout_t* timeout = (evtimeout_t*)timer;
+    timeout->slack = slack_ms;
+    // NOTE: destroyed one-shot timer gets the slack by evtimer_reset
+    if (!timer->destroy) {
+        evloop_t* loop = timer->loop;
+        timewheel_del(&loop->timer_limits, &timeout->lnode);
+        timeout->lnode.expire = timer->wnode.expire + slack_ms;
+        timewheel_add(&loop->timer_limits, &timeout->lnode);
+    }
+}
+
 evtimer_t* evtimer_add_period(evloop_t* loop, evtimer_cb cb, int8_t minute, int8_t hour, int8_t day, int8_t week,
                               int8_t month, uint32_t repeat) {
     if (minute > 59 || hour > 23 || day > 31 || week > 6 || month > 12) {
@@ -674,9 +1369,11 @@ static void __evtimer_del(evtimer_t* timer) {
     if (timer->destroy)
         return;
     if (timer->event_type == EVENT_TYPE_TIMEOUT) {
-        heap_remove(&timer->loop->timers, &timer->node);
+        evtimer_wheel_del(timer->loop, timer);
     } else if (timer->event_type == EVENT_TYPE_PERIOD) {
         heap_remove(&timer->loop->realtimers, &timer->node);
+    } else if (timer->event_type == EVENT_TYPE_HRTIMEOUT) {
+        heap_remove(&timer->loop->hrtimers, &timer->node);
     }
     timer->loop->ntimers--;
     timer->destroy = 1;
@@ -696,6 +1393,8 @@ const char* evio_engine() {
     return "poll";
 #elif defined(EVENT_EPOLL)
     return "epoll";
+#elif defined(EVENT_IOURING)
+    return iouring_supported() ? "io_uring" : "epoll";
 #elif defined(EVENT_KQUEUE)
     return "kqueue";
 #elif defined(EVENT_IOCP)
@@ -715,11 +1414,15 @@ evio_t* evio_get(evloop_t* loop, int fd) {
 
     evio_t* io = loop->ios.ptr[fd];
     if (io == NULL) {
-        EV_ALLOC_SIZEOF(io);
-        evio_init(io);
+        if (loop->flags & EVLOOP_FLAG_LEAN) {
+            io = evio_slab_alloc();
+        } else {
+            EV_ALLOC_SIZEOF(io);
+        }
         io->event_type = EVENT_TYPE_IO;
         io->loop = loop;
         io->fd = fd;
+        evio_init(io);
         loop->ios.ptr[fd] = io;
     }
 
@@ -735,6 +1438,7 @@ void evio_detach(evio_t* io) {
     int fd = io->fd;
     assert(loop != NULL && fd < loop->ios.maxsize);
     loop->ios.ptr[fd] = NULL;
+    evloop_memory_add(loop, -(long long)evio_memory_usage(io));
 }
 
 void evio_attach(evloop_t* loop, evio_t* io) {
@@ -752,9 +1456,22 @@ void evio_attach(evloop_t* loop, evio_t* io) {
     }
 
     io->loop = loop;
+    // NOTE: lean io may be written by other threads now
+    if (io->lean && !(loop->flags & EVLOOP_FLAG_LEAN)) {
+        io->lean = 0;
+        if (io->cold != &evio_cold_none) {
+            io->cold = (struct evio_cold_s*)ev_zrealloc(io->cold, sizeof(struct evio_cold_s), EVIO_COLD_LEAN_SIZE);
+        }
+        recursive_mutex_init(&evio_cold(io)->write_mutex);
+    }
     // NOTE: use new_loop readbuf
-    io->readbuf.base = loop->readbuf.base;
-    io->readbuf.len = loop->readbuf.len;
+    if (!evio_is_alloced_readbuf(io)) {
+        io->readbuf.base = loop->readbuf.base;
+        io->readbuf.len = loop->readbuf.len;
+    }
+    if (previo != io) {
+        evloop_memory_add(loop, evio_memory_usage(io));
+    }
     loop->ios.ptr[fd] = io;
 }
 
@@ -799,7 +1516,8 @@ int evio_del(evio_t* io, int events) {
         iowatcher_del_event(io->loop, io->fd, events);
         io->events &= ~events;
     }
-    if (io->events == 0) {
+    // NOTE: keep active to reap zerocopy completions, @see nio_zerocopy_reap
+    if (io->events == 0 && !io->zerocopy_wait) {
         io->loop->nios--;
         // NOTE: not EVENT_DEL, avoid free
         EVENT_INACTIVE(io);
@@ -807,6 +1525,13 @@ int evio_del(evio_t* io, int events) {
     return 0;
 }
 
+void evio_ready_again(evio_t* io, int events) {
+    if (io->again_events == 0) {
+        io_array_push_back(&io->loop->again_ios, &io);
+    }
+    io->again_events |= events;
+}
+
 static void evio_close_event_cb(event_t* ev) {
     evio_t* io = (evio_t*)ev->userdata;
     uint32_t id = (uintptr_t)ev->privdata;
@@ -947,7 +1672,9 @@ evio_t* evio_create_socket(evloop_t* loop, const char* host, int port, evio_type
     if (side == EIO_SERVER_SIDE) {
 #ifdef OS_UNIX
         so_reuseaddr(sockfd, 1);
-        // so_reuseport(sockfd, 1);
+        if (loop->flags & EVLOOP_FLAG_REUSEPORT) {
+            so_reuseport(sockfd, 1);
+        }
 #endif
         if (bind(sockfd, &addr.sin, sockunion_get_addrlen(&addr)) < 0) {
             perror("bind");
@@ -15,6 +15,10 @@ typedef struct evtimer_s evtimer_t;
 typedef struct evtimeout_s evtimeout_t;
 typedef struct eperiod_s eperiod_t;
 typedef struct evio_s evio_t;
+// refcounted immutable buffer, @see evio_write_ref
+typedef struct evbuf_s evbuf_t;
+// blocking work offloaded to thread pool, @see evloop_queue_work
+typedef struct evwork_s evwork_t;
 
 typedef void (*event_cb)(event_t* ev);
 typedef void (*evidle_cb)(evidle_t* idle);
@@ -26,6 +30,11 @@ typedef void (*connect_cb)(evio_t* io);
 typedef void (*read_cb)(evio_t* io, void* buf, int readbytes);
 typedef void (*write_cb)(evio_t* io, const void* buf, int writebytes);
 typedef void (*close_cb)(evio_t* io);
+// @above_high: 1 write_bufsize reached high, 0 drained to low, @see evio_set_write_watermarks
+typedef void (*watermark_cb)(evio_t* io, int above_high);
+typedef void (*evbuf_free_cb)(void* base, size_t len, void* userdata);
+typedef void (*evwork_cb)(void* arg);
+typedef void (*evwork_after_cb)(void* arg, int status);
 
 typedef enum { EVLOOP_STATUS_STOP,
                EVLOOP_STATUS_RUNNING,
@@ -36,7 +45,8 @@ typedef enum {
     EVENT_TYPE_IO = 0x00000001,
     EVENT_TYPE_TIMEOUT = 0x00000010,
     EVENT_TYPE_PERIOD = 0x00000020,
-    EVENT_TYPE_TIMER = EVENT_TYPE_TIMEOUT | EVENT_TYPE_PERIOD,
+    EVENT_TYPE_HRTIMEOUT = 0x00000040,
+    EVENT_TYPE_TIMER = EVENT_TYPE_TIMEOUT | EVENT_TYPE_PERIOD | EVENT_TYPE_HRTIMEOUT,
     EVENT_TYPE_IDLE = 0x00000100,
     EVENT_TYPE_CUSTOM = 0x00000400, // 1024
 } event_type_e;
@@ -116,11 +126,32 @@ typedef enum {
 #define EIO_DEFAULT_CLOSE_TIMEOUT             60000 // ms
 #define EIO_DEFAULT_KEEPALIVE_TIMEOUT         75000 // ms
 #define EIO_DEFAULT_HEARTBEAT_INTERVAL        10000 // ms
+#define EIO_DEFAULT_BATCH_SIZE                64    // datagrams per recvmmsg
+#define EIO_DEFAULT_DGRAM_SIZE                2048  // bytes
+#define EIO_DEFAULT_ZEROCOPY_THRESHOLD        16384 // bytes, MSG_ZEROCOPY pays off above ~10K
+#define EIO_MAX_BATCH_SIZE                    1024  // UIO_MAXIOV
 
 // loop
 #define EVLOOP_FLAG_RUN_ONCE                   0x00000001
 #define EVLOOP_FLAG_AUTO_FREE                  0x00000002
 #define EVLOOP_FLAG_QUIT_WHEN_NO_ACTIVE_EVENTS 0x00000004
+// NOTE: server sockets created by evio_create_socket set SO_REUSEPORT,
+// so that several loops can listen on the same port, @see evloop_group.h
+#define EVLOOP_FLAG_REUSEPORT                  0x00000008
+// NOTE: stream sockets register EPOLLIN|EPOLLOUT|EPOLLET once,
+// then read/accept/write until EAGAIN within evio_budget_t.
+// Only for io_epoll.c, and evio_add with custom cb must drain itself.
+#define EVLOOP_FLAG_EDGE_TRIGGERED             0x00000010
+// NOTE: time poll and every callback, ~1 clock_gettime per callback,
+// @see evloop_stats
+#define EVLOOP_FLAG_STATS                      0x00000020
+// NOTE: spin with zero-timeout polls before blocking, the spin window adapts
+// to recent idle gaps between wakeups, @see evloop_set_busy_poll
+#define EVLOOP_FLAG_BUSY_POLL                  0x00000040
+// NOTE: for many idle connections, ios allocated from a slab without write_mutex,
+// cold fields allocated on first use and freed by evio_close, own readbufs and
+// write_queue returned once empty. evio_write must be called in loop thread only.
+#define EVLOOP_FLAG_LEAN                       0x00000080
 evloop_t* evloop_new(int flags DEFAULT(EVLOOP_FLAG_AUTO_FREE));
 
 // WARN: Forbid to call evloop_free if evloop_FLAG_AUTO_FREE set.
@@ -141,7 +172,7 @@ void evloop_update_time(evloop_t* loop);
 uint64_t evloop_now(evloop_t* loop);        // s
 uint64_t evloop_now_ms(evloop_t* loop);     // ms
 uint64_t evloop_now_us(evloop_t* loop);     // us
-uint64_t evloop_now_hrtime(evloop_t* loop); // us
+uint64_t evloop_now_hrtime(evloop_t* loop); // us, of gethrtime_us, not since epoch
 
 // export some loop's members
 // @return pid of evloop_run
@@ -158,6 +189,119 @@ uint32_t evloop_ntimers(evloop_t* loop);
 uint32_t evloop_nidles(evloop_t* loop);
 // @return number of active events
 uint32_t evloop_nactives(evloop_t* loop);
+// @return connections accepted since evloop_new, cumulative, not the connections alive now
+uint64_t evloop_naccepts(evloop_t* loop);
+
+// per-loop buffer pool, size classes: 4K, 8K, 16K, ... up to 16M (MAX_READ_BUFSIZE).
+// readbufs and queued write buffers of ios are allocated from it in loop thread.
+#define EVLOOP_BUFPOOL_CLASSES 13
+typedef struct evloop_bufpool_stats_s {
+    size_t size;         // block size of class
+    uint64_t hits;       // allocated from free list
+    uint64_t misses;     // allocated by malloc
+    uint32_t inuse;      // blocks in use
+    uint32_t inuse_high; // high watermark of inuse
+    uint32_t nfree;      // blocks cached in free list
+} evloop_bufpool_stats_t;
+// @param stats: array of EVLOOP_BUFPOOL_CLASSES
+// @return number of classes
+int evloop_bufpool_stats(evloop_t* loop, evloop_bufpool_stats_t* stats);
+
+// latency stats, enabled by EVLOOP_FLAG_STATS.
+// histogram buckets: [0] < 256ns, [i] [128ns << i, 256ns << i), [last] >= 128ns << last.
+#define EVLOOP_STATS_BUCKETS 24
+#define EVLOOP_STATS_SLOWEST 8
+typedef enum {
+    EVLOOP_STATS_IO = 0,
+    EVLOOP_STATS_TIMER,
+    EVLOOP_STATS_IDLE,
+    EVLOOP_STATS_CUSTOM,
+    EVLOOP_STATS_TYPES,
+} evloop_stats_type_e;
+typedef struct evloop_histogram_s {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t buckets[EVLOOP_STATS_BUCKETS];
+} evloop_histogram_t;
+typedef struct evloop_slow_cb_s {
+    void* cb;      // event_t::cb
+    void* user_cb; // accept_cb/connect_cb/read_cb of io, NULL for others
+    int event_type;
+    int fd;        // -1 if not io
+    uint64_t duration_ns;
+    uint64_t hrtime; // us, when it returned
+} evloop_slow_cb_t;
+typedef struct evloop_stats_s {
+    uint64_t loop_cnt;
+    uint64_t poll_ns; // blocked in iowatcher_poll_events
+    uint64_t run_ns;  // running callbacks in evloop_process_pendings
+    evloop_histogram_t callbacks[EVLOOP_STATS_TYPES];
+    evloop_histogram_t timer_lag; // loop time when expired - scheduled time
+    evloop_slow_cb_t slowest[EVLOOP_STATS_SLOWEST]; // sorted by duration_ns desc
+} evloop_stats_t;
+// NOTE: lock-free snapshot by seqlock, can be called in any thread.
+// @return -1 if EVLOOP_FLAG_STATS not set
+int evloop_stats(evloop_t* loop, evloop_stats_t* stats);
+// @return upper bound of the bucket where percentile (0~100) falls, in ns
+uint64_t evloop_histogram_percentile(const evloop_histogram_t* hist, double percentile);
+
+// busy poll: spin window never exceeds max_spin_us, stays 0 while traffic is sparse.
+// @so_busy_poll_us: > 0 set SO_BUSY_POLL on sockets of loop.
+// NOTE: call before evloop_run, sockets already added are not changed.
+#define EVLOOP_DEFAULT_BUSY_POLL_US 50
+void evloop_set_busy_poll(evloop_t* loop, uint32_t max_spin_us DEFAULT(EVLOOP_DEFAULT_BUSY_POLL_US),
+                          int so_busy_poll_us DEFAULT(0));
+
+// memory budget of readbufs and write queues of all ios in loop.
+// Over budget: stop accepting on listen ios and stop reading the largest consumers,
+// resume all of them once usage drops to resume_bytes.
+// NOTE: checked once per loop iteration, usage may overshoot by what one iteration reads and writes.
+// @budget_bytes: 0 disable
+// @resume_bytes: 0 means budget_bytes * 3 / 4
+// @return -1 if resume_bytes >= budget_bytes
+int evloop_set_memory_budget(evloop_t* loop, size_t budget_bytes, size_t resume_bytes DEFAULT(0));
+typedef struct evloop_memory_stats_s {
+    size_t budget;
+    size_t resume;
+    size_t used;          // alloced readbufs + write queues
+    size_t used_max;      // sampled once per loop iteration
+    uint64_t throttles;   // times usage went over budget
+    uint64_t throttled_us; // total time over budget until resumed
+    uint64_t accept_pauses; // listen ios stopped accepting
+    uint64_t read_pauses;   // ios stopped reading
+    int throttled;        // 1: over budget, not resumed yet
+} evloop_memory_stats_t;
+// NOTE: call in loop thread.
+int evloop_memory_stats(evloop_t* loop, evloop_memory_stats_t* stats);
+
+// io budget per loop iteration, so one busy connection cannot starve the others.
+// An io that used up its budget is put on the ready again list and handled in the next
+// iteration without waiting for poll.
+// NOTE: a read or write syscall of tcp takes the rest of bytes at most, 0 means unlimited.
+typedef struct evio_budget_s {
+    uint32_t accepts;     // accepted connections of listen io
+    uint32_t reads;       // read syscalls
+    uint32_t read_bytes;
+    uint32_t writes;      // write syscalls
+    uint32_t write_bytes;
+} evio_budget_t;
+#define EVIO_DEFAULT_BUDGET_ACCEPTS 16
+#define EVIO_DEFAULT_BUDGET_READS   4
+#define EVIO_DEFAULT_BUDGET_WRITES  16
+#define EVIO_DEFAULT_BUDGET_BYTES   (1U << 18) // 256K
+// @budget: default of ios in loop, NULL restores the defaults above
+void evloop_set_io_budget(evloop_t* loop, const evio_budget_t* budget);
+// NOTE: budget is kept as unpack_setting, NULL means loop's
+void evio_set_budget(evio_t* io, const evio_budget_t* budget);
+typedef struct evloop_fairness_stats_s {
+    uint64_t accept_exhausted; // times an io used up accepts in an iteration
+    uint64_t read_exhausted;   // reads or read_bytes
+    uint64_t write_exhausted;  // writes or write_bytes
+    uint64_t again_ios;        // ios handled from ready again list
+    uint32_t again_ios_max;    // most ios on ready again list in an iteration
+} evloop_fairness_stats_t;
+int evloop_fairness_stats(evloop_t* loop, evloop_fairness_stats_t* stats);
 
 // userdata
 void evloop_set_userdata(evloop_t* loop, void* userdata);
@@ -175,6 +319,39 @@ void* evloop_userdata(evloop_t* loop);
 // NOTE: evloop_post_event is thread-safe, used to post event from other thread to loop thread.
 void evloop_post_event(evloop_t* loop, event_t* ev);
 
+// work: run blocking work_cb in a thread pool, then after_work_cb back in loop thread.
+/*
+ * static void save_cb(void* arg) { sqlite3_exec(...); }
+ * static void on_saved(void* arg, int status) { ... }
+ * evloop_queue_work(loop, save_cb, on_saved, req);
+ */
+// NOTE: one thpool shared by all loops, created by the first evloop_queue_work,
+// or evloop_work_pool_init before it to set the number of threads.
+#define EVLOOP_WORK_THREADS 4
+// @return 0, or no effect if created already, -1 on error
+int evloop_work_pool_init(int num_threads DEFAULT(EVLOOP_WORK_THREADS));
+// NOTE: call in loop thread, completions finished together are delivered in one wakeup.
+// @status of after_work_cb: 0, or ERR_TASK_CANCELED by evloop_cancel_work.
+// after_work_cb is not called for works left on evloop_free, running ones are waited.
+// @return handle valid until after_work_cb returns, NULL on error
+evwork_t* evloop_queue_work(evloop_t* loop, evwork_cb work_cb, evwork_after_cb after_work_cb DEFAULT(NULL),
+                            void* arg DEFAULT(NULL));
+// cancel if work_cb not started yet, after_work_cb is still called with ERR_TASK_CANCELED.
+// @return 0 if canceled, -1 if started or done
+int evloop_cancel_work(evwork_t* work);
+typedef struct evloop_work_stats_s {
+    uint64_t queued;    // evloop_queue_work
+    uint64_t completed; // after_work_cb called with status 0
+    uint64_t canceled;
+    uint32_t depth;     // queued, not started or canceled yet
+    uint32_t depth_max;
+    uint32_t running;   // started, after_work_cb not called yet
+    evloop_histogram_t wait; // queued -> work_cb started
+    evloop_histogram_t run;  // work_cb
+} evloop_work_stats_t;
+// NOTE: call in loop thread.
+int evloop_work_stats(evloop_t* loop, evloop_work_stats_t* stats);
+
 // idle
 evidle_t* evidle_add(evloop_t* loop, evidle_cb cb, uint32_t repeat DEFAULT(INFINITE));
 void evidle_del(evidle_t* idle);
@@ -195,8 +372,25 @@ evtimer_t* evtimer_add_period(evloop_t* loop, evtimer_cb cb, int8_t minute DEFAU
                             int8_t day DEFAULT(-1), int8_t week DEFAULT(-1), int8_t month DEFAULT(-1),
                             uint32_t repeat DEFAULT(INFINITE));
 
+// high resolution timer: loop wakes up by timerfd armed to the deadline in us,
+// instead of poll timeout rounded up to ms.
+// NOTE: evtimer_reset restarts it with timeout_us, or evtimeout_ms * 1000 if not 0.
+evtimer_t* evtimer_add_us(evloop_t* loop, evtimer_cb cb, uint32_t timeout_us, uint32_t repeat DEFAULT(INFINITE));
+typedef struct evloop_hrtimer_stats_s {
+    uint64_t fires;
+    uint64_t arms;            // timerfd_settime
+    evloop_histogram_t error; // fired - deadline
+} evloop_hrtimer_stats_t;
+// NOTE: call in loop thread.
+int evloop_hrtimer_stats(evloop_t* loop, evloop_hrtimer_stats_t* stats);
+
 void evtimer_del(evtimer_t* timer);
 void evtimer_reset(evtimer_t* timer, uint32_t evtimeout_ms DEFAULT(0));
+// slack: timer of evtimer_add may fire up to slack_ms late,
+// timers with overlapping [deadline, deadline + slack] fire in one wakeup.
+// NOTE: heartbeat, keepalive and loop stat timers use EVTIMER_DEFAULT_SLACK(timeout).
+#define EVTIMER_DEFAULT_SLACK(timeout_ms) ((timeout_ms) / 16)
+void evtimer_set_slack(evtimer_t* timer, uint32_t slack_ms DEFAULT(0));
 
 // io
 //-----------------------low-level apis---------------------------------------
@@ -211,6 +405,8 @@ const char* evio_engine() {
     return  "poll";
 #elif defined(EVENT_EPOLL)
     return  "epoll";
+#elif defined(EVENT_IOURING)
+    return  iouring_supported() ? "io_uring" : "epoll";
 #elif defined(EVENT_KQUEUE)
     return  "kqueue";
 #elif defined(EVENT_IOCP)
@@ -281,6 +477,14 @@ void evio_set_max_write_bufsize(evio_t* io, uint32_t size);
 // @return current buffer size of write queue.
 size_t evio_write_bufsize(evio_t* io);
 #define evio_write_is_complete(io) (evio_write_bufsize(io) == 0)
+// write backpressure: cb(io, 1) once write_bufsize >= high, then cb(io, 0) once it drains to <= low.
+// @pause_upstream: also evio_read_stop(io->upstream_io) above high, evio_read it again at low,
+// which replaces the pause on every partial write of evio_write_upstream.
+// @high: 0 disables. NOTE: low < high, otherwise return -1.
+int evio_set_write_watermarks(evio_t* io, uint32_t high, uint32_t low, watermark_cb cb DEFAULT(NULL),
+                              int pause_upstream DEFAULT(0));
+// @return true between cb(io, 1) and cb(io, 0)
+bool evio_write_above_high_water(evio_t* io);
 
 uint64_t evio_last_read_time(evio_t* io);  // ms
 uint64_t evio_last_write_time(evio_t* io); // ms
@@ -355,12 +559,38 @@ int evio_read_remain(evio_t* io);
 #define evio_readstring(io)      evio_read_until_delim(io, '\0')
 #define evio_readbytes(io, len)  evio_read_until_length(io, len)
 #define evio_read_until(io, len) evio_read_until_length(io, len)
+// tcp framing of evio_read_until_length, UNPACK_BY_FIXED_LENGTH, UNPACK_BY_LENGTH_FIELD and evio_read_chain
+// sets SO_RCVLOWAT to the rest of the current frame, so the kernel wakes us once it arrived, not per segment.
+// NOTE: on by default, linux only
+// @return -1 if not tcp
+int evio_set_auto_rcvlowat(evio_t* io, int on DEFAULT(1));
 // evio_get => evio_add(io, EV_READ) => evio_cb
 evio_t* evio_read_raw(evloop_t* loop, int fd, evio_cb read_cb);
 
-// NOTE: evio_write is thread-safe, locked by recursive_mutex, allow to be called by other threads.
+// NOTE: evio_write is thread-safe, locked by recursive_mutex, allow to be called by other threads,
+// except ios of EVLOOP_FLAG_LEAN loop.
 // evio_try_write => evio_add(io, EV_WRITE) => write => write_cb
 int evio_write(evio_t* io, const void* buf, size_t len);
+// NOTE: zero-copy evio_write, io holds a ref of buf until written, the caller keeps its own ref.
+// Write one evbuf_t to many ios (fan-out) without malloc+memcpy per io.
+int evio_write_ref(evio_t* io, evbuf_t* buf);
+
+/*
+ * evbuf_t: refcounted immutable buffer, refcount is thread-safe.
+ *
+ * evbuf_t* buf = evbuf_alloc(len);
+ * memcpy(evbuf_base(buf), data, len);
+ * foreach io: evio_write_ref(io, buf);
+ * evbuf_unref(buf);
+ */
+// wrap base, free_cb(base, len, userdata) when the last ref released, NULL free_cb means no free.
+evbuf_t* evbuf_new(void* base, size_t len, evbuf_free_cb free_cb DEFAULT(NULL), void* userdata DEFAULT(NULL));
+// alloc evbuf_t and len bytes in one block, refcnt = 1
+evbuf_t* evbuf_alloc(size_t len);
+evbuf_t* evbuf_ref(evbuf_t* buf);
+void evbuf_unref(evbuf_t* buf);
+void* evbuf_base(evbuf_t* buf);
+size_t evbuf_len(evbuf_t* buf);
 
 // NOTE: evio_close is thread-safe, evio_close_async will be called actually in other thread.
 // evio_del(io, EV_RDWR) => close => close_cb
@@ -396,6 +626,52 @@ evio_t* hrecvfrom(evloop_t* loop, int sockfd, void* buf, size_t len, read_cb rea
 // evio_get -> evio_setcb_write -> evio_write
 evio_t* hsendto(evloop_t* loop, int sockfd, const void* buf, size_t len, write_cb write_cb DEFAULT(NULL));
 
+// batched datagrams for EIO_TYPE_UDP/EIO_TYPE_IP, recvmmsg/sendmmsg on linux
+typedef struct evio_dgram_s {
+    void* buf;
+    int len;
+    struct sockaddr* addr; // peer address, NULL means io->peeraddr for evio_write_batch
+} evio_dgram_t;
+typedef void (*read_batch_cb)(evio_t* io, evio_dgram_t* dgrams, int ndgrams);
+// evio_read => recvmmsg up to batch_size datagrams => read_batch_cb instead of read_cb
+// NOTE: dgrams only valid in read_batch_cb, datagrams longer than dgram_size are truncated.
+int evio_read_batch(evio_t* io, read_batch_cb read_batch_cb,
+                    int batch_size DEFAULT(EIO_DEFAULT_BATCH_SIZE),
+                    int dgram_size DEFAULT(EIO_DEFAULT_DGRAM_SIZE));
+// NOTE: thread-safe like evio_write, but datagrams are not queued if socket buffer is full.
+// @return number of datagrams sent, < ndgrams if socket buffer is full, -1 on error
+int evio_write_batch(evio_t* io, const evio_dgram_t* dgrams, int ndgrams);
+
+// UDP generic segmentation offload, linux >= 4.18.
+// send len bytes as datagrams of segment_size bytes (the last may be shorter) by UDP_SEGMENT,
+// fallback to evio_write_batch if unsupported.
+// @return bytes sent, < len if socket buffer is full, -1 on error
+int evio_write_gso(evio_t* io, const void* buf, int len, int segment_size);
+// UDP generic receive offload, linux >= 5.0.
+// coalesced datagrams are split into one read_cb per segment.
+// NOTE: not for evio_read_batch or evio_set_unpack, @return -1 if unsupported
+int evio_set_udp_gro(evio_t* io, int on DEFAULT(1));
+
+// TCP MSG_ZEROCOPY, linux >= 4.14.
+// evio_write_ref payloads and queued buffers of at least threshold bytes are sent by MSG_ZEROCOPY,
+// io holds a ref of each until the kernel reports the send completed on the socket error queue,
+// which the loop watches while completions are pending. evio_close waits for them like write_queue.
+// NOTE: in loop thread only, evio_write in other threads copies as usual.
+// NOTE: loopback and devices without scatter-gather copy anyway, @see evloop_zerocopy_stats_t.copied
+// @threshold: 0 disable
+// @return -1 if not tcp or unsupported
+int evio_set_zerocopy(evio_t* io, uint32_t threshold DEFAULT(EIO_DEFAULT_ZEROCOPY_THRESHOLD));
+typedef struct evloop_zerocopy_stats_s {
+    uint64_t sends;       // MSG_ZEROCOPY sends
+    uint64_t bytes;       // bytes of them
+    uint64_t completions; // sends reported completed
+    uint64_t copied;      // completions copied by the kernel anyway
+    uint64_t fallbacks;   // writes of zerocopy ios copied by write: below threshold or over optmem_max
+    uint32_t inflight;    // buffers held until completion
+} evloop_zerocopy_stats_t;
+// NOTE: call in loop thread.
+int evloop_zerocopy_stats(evloop_t* loop, evloop_zerocopy_stats_t* stats);
+
 //-----------------top-level apis---------------------------------------------
 // @evio_create_socket: socket -> bind -> listen
 // sockaddr_set_ipport -> socket -> evio_get(loop, sockfd) ->
@@ -450,10 +726,12 @@ void evio_setup_upstream(evio_t* io1, evio_t* io2);
 evio_t* evio_get_upstream(evio_t* io);
 
 // @tcp_upstream: evio_create_socket -> evio_setup_upstream -> evio_connect -> on_connect -> evio_read_upstream
+// @splice: socket => pipe => socket in kernel by splice(2), no read_cb/write_cb,
+// reading paused while the pipe can not be flushed, fallback to copy if unsupported.
 // @return upstream_io
 // @see examples/tcp_proxy_server.c
-evio_t* evio_setup_tcp_upstream(evio_t* io, const char* host, int port, int ssl DEFAULT(0));
-#define evio_setup_ssl_upstream(io, host, port) evio_setup_tcp_upstream(io, host, port, 1)
+evio_t* evio_setup_tcp_upstream(evio_t* io, const char* host, int port, int ssl DEFAULT(0), int splice DEFAULT(0));
+#define evio_setup_ssl_upstream(io, host, port) evio_setup_tcp_upstream(io, host, port, 1, 0)
 
 // @udp_upstream: evio_create_socket -> evio_setup_upstream -> evio_read_upstream
 // @return upstream_io
@@ -525,6 +803,25 @@ typedef struct unpack_setting_s {
 void evio_set_unpack(evio_t* io, unpack_setting_t* setting);
 void evio_unset_unpack(evio_t* io);
 
+// chained read for large frames: readv into segments of seg_size from loop->bufpool instead of readbuf,
+// frames of evio_set_unpack are delivered as views of segments, no memmove or realloc however large.
+// NOTE: UNPACK_BY_FIXED_LENGTH, UNPACK_BY_LENGTH_FIELD or no unpack (what is read at once).
+typedef struct evio_iov_s {
+    void* base;
+    size_t len;
+} evio_iov_t;
+// NOTE: iov only valid in read_chain_cb
+typedef void (*read_chain_cb)(evio_t* io, const evio_iov_t* iov, int iovcnt, int len);
+#define EIO_DEFAULT_CHAIN_SEG_SIZE (64 << 10)
+// @read_chain_cb: NULL means read_cb, only frames across segments are copied into one block.
+// NOTE: bytes left in readbuf by evio_read are moved into the chain and delivered first.
+// @return -1 if not tcp or UNPACK_BY_DELIMITER
+int evio_read_chain(evio_t* io, read_chain_cb read_chain_cb DEFAULT(NULL),
+                    int seg_size DEFAULT(EIO_DEFAULT_CHAIN_SEG_SIZE));
+// copy [offset, offset + len) of views to buf
+// @return bytes copied, < len if views are shorter
+size_t evio_iov_copy(const evio_iov_t* iov, int iovcnt, size_t offset, void* buf, size_t len);
+
 // unpack examples
 /*
 unpack_setting_t ftp_unpack_setting;
@@ -0,0 +1,188 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for CPU_SET, pthread_setaffinity_np
+#endif
+#include "evloop_group.h"
+
+#include <sched.h>
+
+#include "base.h"
+#include "event.h"
+#include "log.h"
+#include "socket.h"
+#include "sockunion.h"
+
+#define EVLOOP_GROUP_START_WAIT_TIME 1 // ms
+
+struct evloop_group_s {
+    int flags;
+    int nloops;
+    evloop_t** loops;
+    thread_t* threads;
+    atomic_uint next_loop_idx;
+    unsigned running : 1;
+};
+
+static int evloop_group_ncpu() {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    return ncpu > 0 ? (int)ncpu : 1;
+}
+
+static THREAD_ROUTINE(evloop_group_thread) {
+    evloop_t* loop = (evloop_t*)userdata;
+    evloop_run(loop);
+    return NULL;
+}
+
+static void evloop_group_set_affinity(thread_t th, int idx) {
+#ifdef OS_LINUX
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(idx % evloop_group_ncpu(), &cpuset);
+    int ret = pthread_setaffinity_np(th, sizeof(cpuset), &cpuset);
+    if (ret != 0) {
+        log_warn("evloop_group: set affinity of loop[%d] failed: %s", idx, strerror(ret));
+    }
+#endif
+}
+
+evloop_group_t* evloop_group_new(int nloops, int flags) {
+    if (nloops <= 0) {
+        nloops = evloop_group_ncpu();
+    }
+    evloop_group_t* group;
+    EV_ALLOC_SIZEOF(group);
+    group->flags = flags;
+    group->nloops = nloops;
+    EV_ALLOC(group->loops, sizeof(evloop_t*) * nloops);
+    EV_ALLOC(group->threads, sizeof(thread_t) * nloops);
+    for (int i = 0; i < nloops; ++i) {
+        // NOTE: loops are freed by evloop_group_free, not EVLOOP_FLAG_AUTO_FREE.
+        group->loops[i] = evloop_new(EVLOOP_FLAG_REUSEPORT);
+    }
+    return group;
+}
+
+void evloop_group_free(evloop_group_t** pp) {
+    if (pp == NULL || *pp == NULL)
+        return;
+    evloop_group_t* group = *pp;
+    evloop_group_stop(group);
+    for (int i = 0; i < group->nloops; ++i) {
+        evloop_free(&group->loops[i]);
+    }
+    EV_FREE(group->loops);
+    EV_FREE(group->threads);
+    EV_FREE(group);
+    *pp = NULL;
+}
+
+int evloop_group_start(evloop_group_t* group) {
+    if (group->running)
+        return -2;
+    for (int i = 0; i < group->nloops; ++i) {
+        group->threads[i] = thread_create(evloop_group_thread, group->loops[i]);
+        if (group->flags & EVLOOP_GROUP_FLAG_CPU_AFFINITY) {
+            evloop_group_set_affinity(group->threads[i], i);
+        }
+    }
+    group->running = 1;
+    // NOTE: wait all loops running, so evloop_group_stop after start is safe.
+    for (int i = 0; i < group->nloops; ++i) {
+        while (evloop_status(group->loops[i]) != EVLOOP_STATUS_RUNNING) {
+            ev_msleep(EVLOOP_GROUP_START_WAIT_TIME);
+        }
+    }
+    return 0;
+}
+
+int evloop_group_stop(evloop_group_t* group) {
+    if (!group->running)
+        return 0;
+    for (int i = 0; i < group->nloops; ++i) {
+        evloop_stop(group->loops[i]);
+    }
+    for (int i = 0; i < group->nloops; ++i) {
+        thread_join(group->threads[i], NULL);
+    }
+    group->running = 0;
+    return 0;
+}
+
+int evloop_group_size(evloop_group_t* group) {
+    return group->nloops;
+}
+
+evloop_t* evloop_group_loop(evloop_group_t* group, int idx) {
+    if (idx < 0 || idx >= group->nloops)
+        return NULL;
+    return group->loops[idx];
+}
+
+evloop_t* evloop_group_next_loop(evloop_group_t* group) {
+    unsigned int idx = atomic_fetch_add(&group->next_loop_idx, 1);
+    return group->loops[idx % group->nloops];
+}
+
+static int evio_local_port(evio_t* io) {
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    if (getsockname(evio_fd(io), &addr.sa, &addrlen) != 0) {
+        return -1;
+    }
+    return addr.sa.sa_family == AF_INET6 ? ntohs(addr.sin6.sin6_port) : ntohs(addr.sin.sin_port);
+}
+
+static int evloop_group_create_server(evloop_group_t* group, const char* host, int port, evio_type_e type,
+                                      accept_cb accept_cb, read_cb read_cb) {
+    if (group->running) {
+        log_error("evloop_group: create server after start is not supported!");
+        return -2;
+    }
+    evio_t** ios = NULL;
+    EV_ALLOC(ios, sizeof(evio_t*) * group->nloops);
+    for (int i = 0; i < group->nloops; ++i) {
+        evloop_t* loop = group->loops[i];
+        evio_t* io = NULL;
+        if (type & EIO_TYPE_SOCK_STREAM) {
+            io = evloop_create_tcp_server(loop, host, port, accept_cb);
+        } else {
+            io = evloop_create_udp_server(loop, host, port);
+            if (io) {
+                evio_setcb_read(io, read_cb);
+                evio_read(io);
+            }
+        }
+        if (io == NULL) {
+            log_error("evloop_group: create server %s:%d on loop[%d] failed!", host, port, i);
+            // NOTE: or the listeners created would take their share of the port.
+            while (--i >= 0) {
+                evio_close(ios[i]);
+            }
+            EV_FREE(ios);
+            return -1;
+        }
+        ios[i] = io;
+        if (port == 0) {
+            // NOTE: the other loops must bind the same port to share it by SO_REUSEPORT.
+            port = evio_local_port(io);
+        }
+    }
+    EV_FREE(ios);
+    return port;
+}
+
+int evloop_group_create_tcp_server(evloop_group_t* group, const char* host, int port, accept_cb accept_cb) {
+    return evloop_group_create_server(group, host, port, EIO_TYPE_TCP, accept_cb, NULL);
+}
+
+int evloop_group_create_udp_server(evloop_group_t* group, const char* host, int port, read_cb read_cb) {
+    return evloop_group_create_server(group, host, port, EIO_TYPE_UDP, NULL, read_cb);
+}
+
+uint64_t evloop_group_naccepts(evloop_group_t* group) {
+    uint64_t naccepts = 0;
+    for (int i = 0; i < group->nloops; ++i) {
+        naccepts += evloop_naccepts(group->loops[i]);
+    }
+    return naccepts;
+}
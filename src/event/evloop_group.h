@@ -0,0 +1,51 @@
+#ifndef EV_EVLOOP_GROUP_H_
+#define EV_EVLOOP_GROUP_H_
+
+#include "eventloop.h"
+
+/*
+ * evloop_group: N event loops, one thread per loop (multi-reactor).
+ *
+ * Every loop owns its own SO_REUSEPORT listener, so the kernel spreads
+ * new connections (tcp) and datagrams (udp) across loops and threads.
+ *
+ * evloop_group_t* group = evloop_group_new(0, EVLOOP_GROUP_FLAG_CPU_AFFINITY);
+ * evloop_group_create_tcp_server(group, "0.0.0.0", 1234, on_accept);
+ * evloop_group_start(group);
+ * ...
+ * evloop_group_stop(group);
+ * evloop_group_free(&group);
+ */
+
+typedef struct evloop_group_s evloop_group_t;
+
+// pin the i-th loop thread to cpu (i % ncpu)
+#define EVLOOP_GROUP_FLAG_CPU_AFFINITY 0x00000001
+
+// @param nloops: <= 0 means one loop per online cpu
+evloop_group_t* evloop_group_new(int nloops DEFAULT(0), int flags DEFAULT(0));
+// NOTE: evloop_group_free will stop and join the loop threads if running.
+void evloop_group_free(evloop_group_t** pp);
+
+// evloop_run in nloops threads, return after all loops are running.
+int evloop_group_start(evloop_group_t* group);
+// evloop_stop all loops, then join their threads.
+int evloop_group_stop(evloop_group_t* group);
+
+int evloop_group_size(evloop_group_t* group);
+evloop_t* evloop_group_loop(evloop_group_t* group, int idx);
+// round robin
+evloop_t* evloop_group_next_loop(evloop_group_t* group);
+
+// NOTE: create listeners before evloop_group_start, loops are not thread-safe.
+// port == 0 means the first loop picks a port and the other loops share it.
+// @return listening port, < 0 on error
+// @tcp_server: foreach loop: evloop_create_tcp_server with SO_REUSEPORT
+int evloop_group_create_tcp_server(evloop_group_t* group, const char* host, int port, accept_cb accept_cb);
+// @udp_server: foreach loop: evloop_create_udp_server with SO_REUSEPORT -> evio_setcb_read -> evio_read
+int evloop_group_create_udp_server(evloop_group_t* group, const char* host, int port, read_cb read_cb);
+
+// @return connections accepted by all loops so far, @see evloop_naccepts
+uint64_t evloop_group_naccepts(evloop_group_t* group);
+
+#endif // EV_EVLOOP_GROUP_H_
@@ -0,0 +1,191 @@
+#include "base.h"
+#include "errors.h"
+#include "event.h"
+#include "log.h"
+#include "thpool.h"
+#include "thread.h"
+
+typedef enum {
+    EVWORK_QUEUED = 0,
+    EVWORK_RUNNING,
+    EVWORK_CANCELED,
+} evwork_state_e;
+
+struct evwork_s {
+    struct mpsc_node node; // loop->works_done
+    struct list_node lnode; // loop->works
+    evloop_t* loop;
+    evwork_cb work_cb;
+    evwork_after_cb after_work_cb;
+    void* arg;
+    atomic_int state;
+    // NOTE: one ref by pool thread, one by loop thread, the last frees it.
+    atomic_int refcnt;
+    uint64_t queue_ns;
+    uint64_t start_ns;
+    uint64_t end_ns;
+};
+
+#define EVWORK_ENTRY(p) container_of(p, evwork_t, node)
+
+// NOTE: thpool keeps keepalive flags in globals, so all loops share one pool.
+static threadpool s_work_pool = NULL;
+static mutex_t s_work_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int evloop_work_pool_init(int num_threads) {
+    mutex_lock(&s_work_pool_mutex);
+    if (s_work_pool == NULL) {
+        threadpool pool = thpool_init(num_threads > 0 ? num_threads : EVLOOP_WORK_THREADS);
+        __atomic_store_n(&s_work_pool, pool, __ATOMIC_RELEASE);
+    }
+    int ret = s_work_pool ? 0 : -1;
+    mutex_unlock(&s_work_pool_mutex);
+    return ret;
+}
+
+static void evwork_unref(evwork_t* work) {
+    if (atomic_fetch_sub(&work->refcnt, 1) == 1) {
+        EV_FREE(work);
+    }
+}
+
+static void evloop_works_done_cb(event_t* ev) {
+    evloop_t* loop = ev->loop;
+    evloop_work_stats_t* stats = &loop->work_stats;
+    // NOTE: clear wakeup flag before drain, same as eventfd_read_cb.
+    atomic_store(&loop->works_done_wakeup, 0);
+    struct mpsc_node* node;
+    while ((node = mpsc_queue_pop(&loop->works_done)) != NULL) {
+        evwork_t* work = EVWORK_ENTRY(node);
+        list_del(&work->lnode);
+        int status = 0;
+        if (atomic_load(&work->state) == EVWORK_CANCELED) {
+            status = ERR_TASK_CANCELED;
+        } else {
+            ++stats->completed;
+            evloop_histogram_add(&stats->wait, work->start_ns - work->queue_ns);
+            evloop_histogram_add(&stats->run, work->end_ns - work->start_ns);
+        }
+        if (work->after_work_cb) {
+            work->after_work_cb(work->arg, status);
+        }
+        evwork_unref(work);
+    }
+}
+
+// NOTE: called in pool threads and loop thread.
+static void evwork_complete(evloop_t* loop, evwork_t* work) {
+    mpsc_queue_push(&loop->works_done, &work->node);
+    // NOTE: only the first completion after evloop_works_done_cb wakes up the loop.
+    if (atomic_exchange(&loop->works_done_wakeup, 1)) {
+        return;
+    }
+    event_t ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.cb = evloop_works_done_cb;
+    evloop_post_event(loop, &ev);
+}
+
+// run in pool thread
+static void evwork_run(void* arg) {
+    evwork_t* work = (evwork_t*)arg;
+    int state = EVWORK_QUEUED;
+    if (!atomic_compare_exchange_strong(&work->state, &state, EVWORK_RUNNING)) {
+        // canceled, loop thread completes it.
+        evwork_unref(work);
+        return;
+    }
+    evloop_t* loop = work->loop;
+    atomic_fetch_add(&loop->works_started, 1);
+    work->start_ns = gethrtime_ns();
+    work->work_cb(work->arg);
+    work->end_ns = gethrtime_ns();
+    evwork_complete(loop, work);
+    // NOTE: last touch of loop, @see evloop_work_cleanup
+    atomic_fetch_sub(&loop->works_active, 1);
+    evwork_unref(work);
+}
+
+evwork_t* evloop_queue_work(evloop_t* loop, evwork_cb work_cb, evwork_after_cb after_work_cb, void* arg) {
+    if (work_cb == NULL)
+        return NULL;
+    threadpool pool = __atomic_load_n(&s_work_pool, __ATOMIC_ACQUIRE);
+    if (pool == NULL) {
+        if (evloop_work_pool_init(EVLOOP_WORK_THREADS) != 0) {
+            log_error("evloop_queue_work: thpool init failed!");
+            return NULL;
+        }
+        pool = s_work_pool;
+    }
+    evwork_t* work;
+    EV_ALLOC_SIZEOF(work);
+    work->loop = loop;
+    work->work_cb = work_cb;
+    work->after_work_cb = after_work_cb;
+    work->arg = arg;
+    atomic_init(&work->state, EVWORK_QUEUED);
+    atomic_init(&work->refcnt, 2);
+    work->queue_ns = gethrtime_ns();
+    list_add(&work->lnode, &loop->works);
+    atomic_fetch_add(&loop->works_active, 1);
+    if (thpool_add_work(pool, evwork_run, work) != 0) {
+        atomic_fetch_sub(&loop->works_active, 1);
+        list_del(&work->lnode);
+        EV_FREE(work);
+        return NULL;
+    }
+    evloop_work_stats_t* stats = &loop->work_stats;
+    ++stats->queued;
+    uint32_t depth = stats->queued - atomic_load(&loop->works_started) - stats->canceled;
+    if (depth > stats->depth_max) {
+        stats->depth_max = depth;
+    }
+    return work;
+}
+
+int evloop_cancel_work(evwork_t* work) {
+    int state = EVWORK_QUEUED;
+    if (!atomic_compare_exchange_strong(&work->state, &state, EVWORK_CANCELED)) {
+        return -1;
+    }
+    evloop_t* loop = work->loop;
+    ++loop->work_stats.canceled;
+    atomic_fetch_sub(&loop->works_active, 1);
+    // NOTE: after_work_cb in next batch, never inside the caller.
+    evwork_complete(loop, work);
+    return 0;
+}
+
+int evloop_work_stats(evloop_t* loop, evloop_work_stats_t* stats) {
+    *stats = loop->work_stats;
+    uint64_t started = atomic_load(&loop->works_started);
+    stats->depth = stats->queued - started - stats->canceled;
+    // NOTE: running counts started works not delivered by evloop_works_done_cb yet.
+    stats->running = started - stats->completed;
+    return 0;
+}
+
+void evloop_work_cleanup(evloop_t* loop) {
+    struct list_node* node;
+    list_for_each(node, &loop->works) {
+        evwork_t* work = list_entry(node, evwork_t, lnode);
+        int state = EVWORK_QUEUED;
+        if (atomic_compare_exchange_strong(&work->state, &state, EVWORK_CANCELED)) {
+            atomic_fetch_sub(&loop->works_active, 1);
+        }
+    }
+    if (atomic_load(&loop->works_active)) {
+        log_warn("evloop_free: wait for %u running works", atomic_load(&loop->works_active));
+        while (atomic_load(&loop->works_active)) {
+            ev_msleep(1);
+        }
+    }
+    // NOTE: no after_work_cb, just drop loop refs.
+    while (mpsc_queue_pop(&loop->works_done) != NULL) {
+    }
+    while (!list_empty(&loop->works)) {
+        evwork_t* work = list_entry(loop->works.next, evwork_t, lnode);
+        list_del(&work->lnode);
+        evwork_unref(work);
+    }
+}
@@ -1,6 +1,6 @@
 #include "iowatcher.h"
 
-#ifdef EVENT_EPOLL
+#if defined(EVENT_EPOLL) || defined(EVENT_IOURING)
 #include <sys/epoll.h>
 
 #include "array.h"
@@ -9,6 +9,15 @@
 #include "platform.h"
 #define EVENTS_INIT_SIZE 64
 
+#ifdef EVENT_IOURING
+// NOTE: iowatcher_* are io_uring.c, epoll is the fallback.
+#define iowatcher_init        epoll_iowatcher_init
+#define iowatcher_cleanup     epoll_iowatcher_cleanup
+#define iowatcher_add_event   epoll_iowatcher_add_event
+#define iowatcher_del_event   epoll_iowatcher_del_event
+#define iowatcher_poll_events epoll_iowatcher_poll_events
+#endif
+
 ARRAY_DECL(struct epoll_event, events);
 
 typedef struct epoll_ctx_s {
@@ -37,6 +46,34 @@ int iowatcher_cleanup(evloop_t* loop) {
     return 0;
 }
 
+// NOTE: io->epoll_events caches the registered events, epoll_ctl only if changed.
+static int epoll_ctx_ctl(epoll_ctx_t* epoll_ctx, evio_t* io, uint32_t events) {
+    if (events == io->epoll_events)
+        return 0;
+    struct epoll_event ee;
+    memset(&ee, 0, sizeof(ee));
+    ee.data.fd = io->fd;
+    ee.events = events;
+    int op = io->epoll_events == 0 ? EPOLL_CTL_ADD : events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    int ret = epoll_ctl(epoll_ctx->epfd, op, io->fd, &ee);
+    if (ret != 0 && op == EPOLL_CTL_ADD && errno == EEXIST) {
+        // NOTE: fd was not closed after edge-triggered evio_done
+        ret = epoll_ctl(epoll_ctx->epfd, EPOLL_CTL_MOD, io->fd, &ee);
+    }
+    if (ret != 0)
+        return ret;
+    if (op == EPOLL_CTL_ADD) {
+        if (epoll_ctx->events.size == epoll_ctx->events.maxsize) {
+            events_double_resize(&epoll_ctx->events);
+        }
+        epoll_ctx->events.size++;
+    } else if (op == EPOLL_CTL_DEL) {
+        epoll_ctx->events.size--;
+    }
+    io->epoll_events = events;
+    return 0;
+}
+
 int iowatcher_add_event(evloop_t* loop, int fd, int events) {
     if (loop->iowatcher == NULL) {
         iowatcher_init(loop);
@@ -44,32 +81,35 @@ int iowatcher_add_event(evloop_t* loop, int fd, int events) {
     epoll_ctx_t* epoll_ctx = (epoll_ctx_t*)loop->iowatcher;
     evio_t* io = loop->ios.ptr[fd];
 
-    struct epoll_event ee;
-    memset(&ee, 0, sizeof(ee));
-    ee.data.fd = fd;
+    if (evio_is_edge_triggered(io)) {
+        // NOTE: register once, EV_READ/EV_WRITE toggle io->events only.
+        if (io->epoll_events == 0) {
+            return epoll_ctx_ctl(epoll_ctx, io, EPOLLIN | EPOLLOUT | EPOLLET);
+        }
+        if ((events & EV_READ) && !(io->events & EV_READ)) {
+            // NOTE: the edge may have come when EV_READ was not set
+            evio_ready_again(io, EV_READ);
+        }
+        return 0;
+    }
+
+    // NOTE: EPOLLERR keeps fd registered for zerocopy completions, @see evio_set_zerocopy
+    uint32_t ee_events = io->zerocopy_wait ? EPOLLERR : 0;
     // pre events
     if (io->events & EV_READ) {
-        ee.events |= EPOLLIN;
+        ee_events |= EPOLLIN;
     }
     if (io->events & EV_WRITE) {
-        ee.events |= EPOLLOUT;
+        ee_events |= EPOLLOUT;
     }
     // now events
     if (events & EV_READ) {
-        ee.events |= EPOLLIN;
+        ee_events |= EPOLLIN;
     }
     if (events & EV_WRITE) {
-        ee.events |= EPOLLOUT;
-    }
-    int op = io->events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
-    epoll_ctl(epoll_ctx->epfd, op, fd, &ee);
-    if (op == EPOLL_CTL_ADD) {
-        if (epoll_ctx->events.size == epoll_ctx->events.maxsize) {
-            events_double_resize(&epoll_ctx->events);
-        }
-        epoll_ctx->events.size++;
+        ee_events |= EPOLLOUT;
     }
-    return 0;
+    return epoll_ctx_ctl(epoll_ctx, io, ee_events);
 }
 
 int iowatcher_del_event(evloop_t* loop, int fd, int events) {
@@ -78,29 +118,31 @@ int iowatcher_del_event(evloop_t* loop, int fd, int events) {
         return 0;
     evio_t* io = loop->ios.ptr[fd];
 
-    struct epoll_event ee;
-    memset(&ee, 0, sizeof(ee));
-    ee.data.fd = fd;
+    if (io->epoll_events & EPOLLET) {
+        if (!io->ready) {
+            // NOTE: evio_done, closesocket will remove fd from epoll.
+            io->epoll_events = 0;
+            epoll_ctx->events.size--;
+        }
+        return 0;
+    }
+
+    uint32_t ee_events = io->zerocopy_wait ? EPOLLERR : 0;
     // pre events
     if (io->events & EV_READ) {
-        ee.events |= EPOLLIN;
+        ee_events |= EPOLLIN;
     }
     if (io->events & EV_WRITE) {
-        ee.events |= EPOLLOUT;
+        ee_events |= EPOLLOUT;
     }
     // now events
     if (events & EV_READ) {
-        ee.events &= ~EPOLLIN;
+        ee_events &= ~EPOLLIN;
     }
     if (events & EV_WRITE) {
-        ee.events &= ~EPOLLOUT;
-    }
-    int op = ee.events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
-    epoll_ctl(epoll_ctx->epfd, op, fd, &ee);
-    if (op == EPOLL_CTL_DEL) {
-        epoll_ctx->events.size--;
+        ee_events &= ~EPOLLOUT;
     }
-    return 0;
+    return epoll_ctx_ctl(epoll_ctx, io, ee_events);
 }
 
 int iowatcher_poll_events(evloop_t* loop, int timeout) {
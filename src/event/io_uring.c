@@ -0,0 +1,851 @@
+#include "iowatcher.h"
+
+#ifdef EVENT_IOURING
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "array.h"
+#include "defs.h"
+#include "event.h"
+#include "log.h"
+#include "platform.h"
+#include "queue.h"
+#include "thread.h"
+
+/*
+ * io_uring iowatcher:
+ * - listenfd: multishot accept, nio_accept pops the accepted connfds.
+ * - tcp: multishot recv into provided buffer ring, nio_read copies into io->readbuf.
+ * - tcp write_queue: one sendmsg of the whole write_queue per io, submitted in batch.
+ * - others (udp, eventfd, connect...): oneshot poll, then nio_read/nio_write as epoll.
+ *
+ * All SQEs are queued in iowatcher_add_event/del_event and submitted
+ * together with waiting in iowatcher_poll_events, one io_uring_enter per loop.
+ *
+ * NOTE: fallback to io_epoll.c if the kernel lacks an op used or multishot recv (< 6.0).
+ */
+
+#define IOURING_SQ_ENTRIES   1024
+#define IOURING_CQ_ENTRIES   4096
+#define IOURING_BUF_GROUP    0
+#define IOURING_BUF_COUNT    128                 // power of 2
+#define IOURING_BUF_SIZE     EVLOOP_READ_BUFSIZE // 8K
+#define IOURING_IO_MAX_BUFS  (IOURING_BUF_COUNT / 4) // held by one io, leaves the rest to others
+#define IOURING_SEND_MAX_IOV 64
+#define IOURING_FDS_INIT_SIZE 64
+#define IOURING_FREE_OPS_MAX 1024 // small ops cached
+
+typedef enum {
+    IOURING_OP_ACCEPT,
+    IOURING_OP_RECV,
+    IOURING_OP_POLLIN,
+    IOURING_OP_POLLOUT,
+    IOURING_OP_POLLERR, // zerocopy completions of io without EV_READ
+    IOURING_OP_SENDMSG,
+} iouring_op_e;
+
+// NOTE: op is user_data of sqe, free when the last cqe (without IORING_CQE_F_MORE) reaped.
+typedef struct iouring_op_s {
+    struct list_node node;
+    iouring_op_e type;
+    int fd;
+    uint32_t id; // io->id, fd may be reused before the last cqe
+    unsigned canceled : 1;
+    int nrefs;
+    // NOTE: sendmsg only, other ops are allocated without them, @see iouring_op_new
+    struct msghdr msg;
+    struct iovec iov[IOURING_SEND_MAX_IOV];
+    // NOTE: write_queue buffers owned by op if io done before send completed.
+    evbuf_t* refs[IOURING_SEND_MAX_IOV];
+} iouring_op_t;
+
+// accept: res = connfd
+// recv: res = bytes in buffer bid, 0 = EOF, < 0 = -errno
+typedef struct iouring_cqe_s {
+    int res;
+    int bid;
+    int offset;
+} iouring_cqe_t;
+
+QUEUE_DECL(iouring_cqe_t, iouring_cqes);
+
+// evio_t::uring
+typedef struct iouring_io_s {
+    iouring_op_t* read_op;
+    iouring_op_t* write_op;
+    struct iouring_cqes cqes; // completions not consumed by nio_accept/nio_read yet
+    int nsent;                // result of write_op sendmsg
+    unsigned sent : 1;
+    unsigned dirty : 1;       // in iouring_ctx_t::dirty
+} iouring_io_t;
+
+typedef struct iouring_fd_s {
+    int fd;
+    uint32_t id;
+} iouring_fd_t;
+
+ARRAY_DECL(iouring_fd_t, iouring_fds);
+
+typedef struct iouring_ctx_s {
+    int ring_fd;
+    void* ring_ptr;
+    size_t ring_size;
+    // sq
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    // cq
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+    // provided buffer ring
+    struct io_uring_buf_ring* br;
+    size_t br_size;
+    char* bufs;
+    unsigned nbufs_held; // held by iouring_io_t::cqes
+    // ops in flight
+    struct list_head ops;
+    // freed small ops to reuse, @see iouring_op_new
+    struct list_head free_ops;
+    unsigned nfree_ops;
+    // ios to arm sqes or with unconsumed completions
+    struct iouring_fds dirty;
+    mutex_t dirty_mutex; // NOTE: evio_write may evio_add(EV_WRITE) in other thread.
+} iouring_ctx_t;
+
+int epoll_iowatcher_init(evloop_t* loop);
+int epoll_iowatcher_cleanup(evloop_t* loop);
+int epoll_iowatcher_add_event(evloop_t* loop, int fd, int events);
+int epoll_iowatcher_del_event(evloop_t* loop, int fd, int events);
+int epoll_iowatcher_poll_events(evloop_t* loop, int timeout);
+
+static int io_uring_setup(unsigned entries, struct io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void iouring_ctx_free(iouring_ctx_t* ctx) {
+    if (ctx->br) {
+        munmap(ctx->br, ctx->br_size);
+    }
+    EV_FREE(ctx->bufs);
+    if (ctx->sqes) {
+        munmap(ctx->sqes, ctx->sqes_size);
+    }
+    if (ctx->ring_ptr) {
+        munmap(ctx->ring_ptr, ctx->ring_size);
+    }
+    if (ctx->ring_fd >= 0) {
+        close(ctx->ring_fd);
+    }
+    iouring_fds_cleanup(&ctx->dirty);
+    mutex_destroy(&ctx->dirty_mutex);
+    EV_FREE(ctx);
+}
+
+static void iouring_recycle_buf(iouring_ctx_t* ctx, int bid) {
+    unsigned short tail = ctx->br->tail;
+    struct io_uring_buf* buf = &ctx->br->bufs[tail & (IOURING_BUF_COUNT - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(ctx->bufs + (size_t)bid * IOURING_BUF_SIZE);
+    buf->len = IOURING_BUF_SIZE;
+    buf->bid = bid;
+    __atomic_store_n(&ctx->br->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static bool iouring_probe(int ring_fd) {
+    struct io_uring_probe* probe = NULL;
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    EV_ALLOC(probe, size);
+    bool ok = io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    // NOTE: ops submitted by this backend, multishot recv is probed by iouring_probe_recv_multishot
+    int ops[] = {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL};
+    for (int i = 0; ok && i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        ok = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    EV_FREE(probe);
+    return ok;
+}
+
+static iouring_ctx_t* iouring_ctx_new() {
+    iouring_ctx_t* ctx;
+    EV_ALLOC_SIZEOF(ctx);
+    ctx->ring_fd = -1;
+    list_init(&ctx->ops);
+    list_init(&ctx->free_ops);
+    iouring_fds_init(&ctx->dirty, IOURING_FDS_INIT_SIZE);
+    mutex_init(&ctx->dirty_mutex);
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = IOURING_CQ_ENTRIES;
+    ctx->ring_fd = io_uring_setup(IOURING_SQ_ENTRIES, &params);
+    if (ctx->ring_fd < 0)
+        goto error;
+    unsigned need_features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & need_features) != need_features || !iouring_probe(ctx->ring_fd))
+        goto error;
+
+    // rings
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ctx->ring_size = MAX(sq_size, cq_size);
+    ctx->ring_ptr = mmap(NULL, ctx->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ctx->ring_fd,
+                         IORING_OFF_SQ_RING);
+    if (ctx->ring_ptr == MAP_FAILED) {
+        ctx->ring_ptr = NULL;
+        goto error;
+    }
+    ctx->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ctx->sqes = (struct io_uring_sqe*)mmap(NULL, ctx->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                           ctx->ring_fd, IORING_OFF_SQES);
+    if (ctx->sqes == MAP_FAILED) {
+        ctx->sqes = NULL;
+        goto error;
+    }
+    char* ptr = (char*)ctx->ring_ptr;
+    ctx->sq_head = (unsigned*)(ptr + params.sq_off.head);
+    ctx->sq_tail = (unsigned*)(ptr + params.sq_off.tail);
+    ctx->sq_mask = *(unsigned*)(ptr + params.sq_off.ring_mask);
+    ctx->sq_entries = params.sq_entries;
+    ctx->cq_head = (unsigned*)(ptr + params.cq_off.head);
+    ctx->cq_tail = (unsigned*)(ptr + params.cq_off.tail);
+    ctx->cq_mask = *(unsigned*)(ptr + params.cq_off.ring_mask);
+    ctx->cqes = (struct io_uring_cqe*)(ptr + params.cq_off.cqes);
+    // NOTE: sqes[i] always at sq_array[i]
+    unsigned* sq_array = (unsigned*)(ptr + params.sq_off.array);
+    for (unsigned i = 0; i < ctx->sq_entries; ++i) {
+        sq_array[i] = i;
+    }
+
+    // provided buffer ring
+    ctx->br_size = IOURING_BUF_COUNT * sizeof(struct io_uring_buf);
+    ctx->br = (struct io_uring_buf_ring*)mmap(NULL, ctx->br_size, PROT_READ | PROT_WRITE,
+                                              MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ctx->br == MAP_FAILED) {
+        ctx->br = NULL;
+        goto error;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ctx->br;
+    reg.ring_entries = IOURING_BUF_COUNT;
+    reg.bgid = IOURING_BUF_GROUP;
+    if (io_uring_register(ctx->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+        goto error;
+    EV_ALLOC(ctx->bufs, (size_t)IOURING_BUF_COUNT * IOURING_BUF_SIZE);
+    for (int bid = 0; bid < IOURING_BUF_COUNT; ++bid) {
+        iouring_recycle_buf(ctx, bid);
+    }
+    return ctx;
+error:
+    iouring_ctx_free(ctx);
+    return NULL;
+}
+
+bool iouring_enabled(evloop_t* loop) {
+    return loop->iouring;
+}
+
+// sqes not consumed by kernel yet
+static unsigned iouring_sq_pending(iouring_ctx_t* ctx) {
+    return *ctx->sq_tail - __atomic_load_n(ctx->sq_head, __ATOMIC_ACQUIRE);
+}
+
+static int iouring_submit(iouring_ctx_t* ctx) {
+    unsigned to_submit = iouring_sq_pending(ctx);
+    if (to_submit == 0)
+        return 0;
+    return io_uring_enter(ctx->ring_fd, to_submit, 0, 0, NULL, 0);
+}
+
+static struct io_uring_sqe* iouring_get_sqe(iouring_ctx_t* ctx) {
+    unsigned tail = *ctx->sq_tail;
+    if (iouring_sq_pending(ctx) >= ctx->sq_entries) {
+        // NOTE: sq full, submit now
+        iouring_submit(ctx);
+        if (iouring_sq_pending(ctx) >= ctx->sq_entries) {
+            log_error("io_uring sq overflow!");
+            return NULL;
+        }
+    }
+    struct io_uring_sqe* sqe = &ctx->sqes[tail & ctx->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    // NOTE: kernel reads sq only in io_uring_enter, so publish tail before filling sqe is OK.
+    __atomic_store_n(ctx->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+// NOTE: IORING_RECV_MULTISHOT (linux 6.0) has no op to probe, older kernels fail it with -EINVAL,
+// so recv one byte of a socketpair by it.
+static bool iouring_probe_recv_multishot(iouring_ctx_t* ctx) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        return false;
+    bool ok = false;
+    struct io_uring_sqe* sqe = iouring_get_sqe(ctx);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fds[0];
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = IOURING_BUF_GROUP;
+    sqe->user_data = 1;
+    if (write(fds[1], "x", 1) == 1 && io_uring_enter(ctx->ring_fd, 1, 1, IORING_ENTER_GETEVENTS, NULL, 0) >= 0) {
+        unsigned head = *ctx->cq_head;
+        if (head != __atomic_load_n(ctx->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe* cqe = &ctx->cqes[head & ctx->cq_mask];
+            ok = cqe->res == 1 && (cqe->flags & IORING_CQE_F_MORE);
+            __atomic_store_n(ctx->cq_head, head + 1, __ATOMIC_RELEASE);
+        }
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return ok;
+}
+
+static int s_iouring_supported = 0;
+static void iouring_probe_once() {
+    iouring_ctx_t* ctx = iouring_ctx_new();
+    if (ctx) {
+        s_iouring_supported = iouring_probe_recv_multishot(ctx);
+        iouring_ctx_free(ctx);
+    }
+    if (!s_iouring_supported) {
+        log_warn("io_uring not supported, fallback to epoll");
+    }
+}
+
+bool iouring_supported() {
+    static thread_once_t s_once = THREAD_ONCE_INIT;
+    thread_once(&s_once, iouring_probe_once);
+    return s_iouring_supported;
+}
+
+static iouring_op_t* iouring_op_new(iouring_ctx_t* ctx, evio_t* io, iouring_op_e type) {
+    iouring_op_t* op = NULL;
+    if (type == IOURING_OP_SENDMSG) {
+        // NOTE: one op per sqe, so reuse blocks of loop->bufpool.
+        op = (iouring_op_t*)evloop_bufpool_alloc(io->loop, sizeof(iouring_op_t));
+        memset(op, 0, sizeof(iouring_op_t));
+    } else if (ctx->nfree_ops) {
+        op = container_of(ctx->free_ops.next, iouring_op_t, node);
+        list_del(&op->node);
+        --ctx->nfree_ops;
+        memset(op, 0, offsetof(iouring_op_t, msg));
+    } else {
+        // NOTE: multishot recv of each idle connection holds one, so keep it small.
+        EV_ALLOC(op, offsetof(iouring_op_t, msg));
+    }
+    op->type = type;
+    op->fd = io->fd;
+    op->id = io->id;
+    list_add(&op->node, &ctx->ops);
+    return op;
+}
+
+static void iouring_op_free(evloop_t* loop, iouring_op_t* op) {
+    for (int i = 0; i < op->nrefs; ++i) {
+        evbuf_unref(op->refs[i]);
+    }
+    list_del(&op->node);
+    iouring_ctx_t* ctx = (iouring_ctx_t*)loop->iowatcher;
+    if (op->type == IOURING_OP_SENDMSG) {
+        evloop_bufpool_free(loop, op, sizeof(iouring_op_t));
+    } else if (ctx->nfree_ops < IOURING_FREE_OPS_MAX) {
+        list_add(&op->node, &ctx->free_ops);
+        ++ctx->nfree_ops;
+    } else {
+        EV_FREE(op);
+    }
+}
+
+static void iouring_cancel(iouring_ctx_t* ctx, iouring_op_t* op) {
+    struct io_uring_sqe* sqe = iouring_get_sqe(ctx);
+    if (sqe == NULL)
+        return;
+    op->canceled = 1;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)op;
+    // NOTE: user_data = 0 means ignore this cqe
+    sqe->user_data = 0;
+}
+
+// @return io if op still belongs to it
+static evio_t* iouring_op_io(evloop_t* loop, iouring_op_t* op) {
+    if (op->fd >= loop->ios.maxsize)
+        return NULL;
+    evio_t* io = loop->ios.ptr[op->fd];
+    if (io == NULL || io->id != op->id || !io->ready || io->uring == NULL)
+        return NULL;
+    return io;
+}
+
+static void iouring_add_dirty(iouring_ctx_t* ctx, evio_t* io) {
+    iouring_io_t* uio = (iouring_io_t*)io->uring;
+    mutex_lock(&ctx->dirty_mutex);
+    if (!uio->dirty) {
+        uio->dirty = 1;
+        iouring_fd_t e = {io->fd, io->id};
+        iouring_fds_push_back(&ctx->dirty, &e);
+    }
+    mutex_unlock(&ctx->dirty_mutex);
+}
+
+// tcp reads by multishot recv, others by poll.
+// NOTE: zerocopy ios by poll, POLLIN reports the error queue too, and nio_write sends by MSG_ZEROCOPY.
+static bool iouring_recv_io(evio_t* io) {
+    return io->io_type == EIO_TYPE_TCP && !io->accept && !io->zerocopy;
+}
+
+static bool iouring_send_io(evio_t* io) {
+    return io->io_type == EIO_TYPE_TCP && !io->connect && !io->zerocopy && !write_queue_empty(&io->write_queue);
+}
+
+static void iouring_arm_read(iouring_ctx_t* ctx, evio_t* io) {
+    iouring_io_t* uio = (iouring_io_t*)io->uring;
+    iouring_op_e type = io->accept                 ? IOURING_OP_ACCEPT
+                        : !(io->events & EV_READ) ? IOURING_OP_POLLERR
+                        : iouring_recv_io(io)     ? IOURING_OP_RECV
+                                                  : IOURING_OP_POLLIN;
+    if (type == IOURING_OP_RECV &&
+        (ctx->nbufs_held == IOURING_BUF_COUNT || iouring_cqes_size(&uio->cqes) >= IOURING_IO_MAX_BUFS)) {
+        // NOTE: arm again after nio_read returns some buffers.
+        return;
+    }
+    struct io_uring_sqe* sqe = iouring_get_sqe(ctx);
+    if (sqe == NULL)
+        return;
+    iouring_op_t* op = iouring_op_new(ctx, io, type);
+    sqe->fd = io->fd;
+    sqe->user_data = (uint64_t)(uintptr_t)op;
+    switch (type) {
+    case IOURING_OP_ACCEPT:
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        break;
+    case IOURING_OP_RECV:
+        sqe->opcode = IORING_OP_RECV;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = IOURING_BUF_GROUP;
+        break;
+    default:
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->poll32_events = type == IOURING_OP_POLLERR ? POLLERR : POLLIN;
+        break;
+    }
+    uio->read_op = op;
+}
+
+static void iouring_arm_write(iouring_ctx_t* ctx, evio_t* io) {
+    iouring_io_t* uio = (iouring_io_t*)io->uring;
+    struct io_uring_sqe* sqe = iouring_get_sqe(ctx);
+    if (sqe == NULL)
+        return;
+    evio_write_lock(io);
+    iouring_op_t* op = iouring_op_new(ctx, io, iouring_send_io(io) ? IOURING_OP_SENDMSG : IOURING_OP_POLLOUT);
+    sqe->fd = io->fd;
+    sqe->user_data = (uint64_t)(uintptr_t)op;
+    if (op->type == IOURING_OP_SENDMSG) {
+        // NOTE: gather write_queue, nio_write pops what sent after completion.
+        // NOTE: sent inline by io_uring_enter mostly, so bytes of write budget at most.
+        int niov = MIN(write_queue_size(&io->write_queue), IOURING_SEND_MAX_IOV);
+        write_buf_t* pbuf = write_queue_data(&io->write_queue);
+        size_t max = evio_budget(io)->write_bytes, len = 0;
+        for (int i = 0; i < niov; ++i, ++pbuf) {
+            op->iov[i].iov_base = pbuf->base + pbuf->offset;
+            op->iov[i].iov_len = pbuf->len - pbuf->offset;
+            if (max && len + op->iov[i].iov_len >= max) {
+                op->iov[i].iov_len = max - len;
+                niov = i + 1;
+                ++io->loop->fairness_stats.write_exhausted;
+            }
+            len += op->iov[i].iov_len;
+        }
+        op->msg.msg_iov = op->iov;
+        op->msg.msg_iovlen = niov;
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->addr = (uint64_t)(uintptr_t)&op->msg;
+        sqe->msg_flags = MSG_NOSIGNAL;
+    } else {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->poll32_events = POLLOUT;
+    }
+    uio->write_op = op;
+    evio_write_unlock(io);
+}
+
+// arm sqes for dirty ios, and pend ios which have unconsumed completions.
+static int iouring_prepare(evloop_t* loop, iouring_ctx_t* ctx) {
+    int nready = 0, n = 0;
+    mutex_lock(&ctx->dirty_mutex);
+    for (int i = 0; i < ctx->dirty.size; ++i) {
+        iouring_fd_t e = ctx->dirty.ptr[i];
+        evio_t* io = e.fd < loop->ios.maxsize ? loop->ios.ptr[e.fd] : NULL;
+        if (io == NULL || io->id != e.id || io->uring == NULL)
+            continue;
+        iouring_io_t* uio = (iouring_io_t*)io->uring;
+        uio->dirty = 0;
+        if (uio->read_op && uio->read_op->type == IOURING_OP_POLLERR && (io->events & EV_READ)) {
+            // NOTE: POLLIN instead, which reports the error queue too
+            iouring_cancel(ctx, uio->read_op);
+            uio->read_op = NULL;
+        }
+        if (((io->events & EV_READ) || io->zerocopy_wait) && uio->read_op == NULL) {
+            iouring_arm_read(ctx, io);
+        }
+        if ((io->events & EV_WRITE) && uio->write_op == NULL && !uio->sent) {
+            iouring_arm_write(ctx, io);
+        }
+        bool has_cqes = !iouring_cqes_empty(&uio->cqes);
+        if (has_cqes && (io->events & EV_READ)) {
+            io->revents |= EV_READ;
+            EVENT_PENDING(io);
+            ++nready;
+        }
+        if (has_cqes || (((io->events & EV_READ) || io->zerocopy_wait) && uio->read_op == NULL)) {
+            // NOTE: keep it until completions consumed or read armed.
+            uio->dirty = 1;
+            ctx->dirty.ptr[n++] = e;
+        }
+    }
+    ctx->dirty.size = n;
+    mutex_unlock(&ctx->dirty_mutex);
+    return nready;
+}
+
+static void iouring_push_cqe(iouring_ctx_t* ctx, evio_t* io, int res, int bid) {
+    iouring_io_t* uio = (iouring_io_t*)io->uring;
+    if (uio->cqes.maxsize == 0) {
+        iouring_cqes_init(&uio->cqes, 4);
+    }
+    iouring_cqe_t cqe = {res, bid, 0};
+    iouring_cqes_push_back(&uio->cqes, &cqe);
+    if (bid >= 0) {
+        ++ctx->nbufs_held;
+        // NOTE: multishot recv of a hot io would take all buffers from others, see IOURING_IO_MAX_BUFS.
+        if (iouring_cqes_size(&uio->cqes) >= IOURING_IO_MAX_BUFS && uio->read_op && !uio->read_op->canceled) {
+            iouring_cancel(ctx, uio->read_op);
+        }
+    }
+    if (io->events & EV_READ) {
+        io->revents |= EV_READ;
+        EVENT_PENDING(io);
+    }
+    iouring_add_dirty(ctx, io);
+}
+
+static void iouring_handle_cqe(evloop_t* loop, iouring_ctx_t* ctx, struct io_uring_cqe* cqe) {
+    iouring_op_t* op = (iouring_op_t*)(uintptr_t)cqe->user_data;
+    if (op == NULL)
+        return;
+    evio_t* io = iouring_op_io(loop, op);
+    int res = cqe->res;
+    int bid = (cqe->flags & IORING_CQE_F_BUFFER) ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+    switch (op->type) {
+    case IOURING_OP_ACCEPT:
+        if (io == NULL) {
+            if (res >= 0)
+                close(res);
+        } else if (res != -ECANCELED) {
+            iouring_push_cqe(ctx, io, res, -1);
+        }
+        break;
+    case IOURING_OP_RECV:
+        if (io == NULL) {
+            if (bid >= 0)
+                iouring_recycle_buf(ctx, bid);
+        } else if (res != -ENOBUFS && res != -ECANCELED) {
+            iouring_push_cqe(ctx, io, res, bid);
+        }
+        break;
+    case IOURING_OP_POLLIN:
+    case IOURING_OP_POLLERR:
+        if (io && !op->canceled) {
+            io->revents |= EV_READ;
+            EVENT_PENDING(io);
+        }
+        break;
+    case IOURING_OP_POLLOUT:
+        if (io && !op->canceled) {
+            io->revents |= EV_WRITE;
+            EVENT_PENDING(io);
+        }
+        break;
+    case IOURING_OP_SENDMSG:
+        if (io) {
+            iouring_io_t* uio = (iouring_io_t*)io->uring;
+            uio->nsent = res;
+            uio->sent = 1;
+            io->revents |= EV_WRITE;
+            EVENT_PENDING(io);
+        }
+        break;
+    default:
+        break;
+    }
+    if (cqe->flags & IORING_CQE_F_MORE)
+        return;
+    if (io) {
+        iouring_io_t* uio = (iouring_io_t*)io->uring;
+        if (uio->read_op == op) {
+            uio->read_op = NULL;
+        } else if (uio->write_op == op) {
+            uio->write_op = NULL;
+        }
+        // NOTE: arm again in next iouring_prepare if needed.
+        iouring_add_dirty(ctx, io);
+    }
+    iouring_op_free(loop, op);
+}
+
+static int iouring_reap(evloop_t* loop, iouring_ctx_t* ctx) {
+    int ncqes = 0;
+    unsigned head = *ctx->cq_head;
+    unsigned tail = __atomic_load_n(ctx->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        for (; head != tail; ++head, ++ncqes) {
+            iouring_handle_cqe(loop, ctx, &ctx->cqes[head & ctx->cq_mask]);
+        }
+        __atomic_store_n(ctx->cq_head, head, __ATOMIC_RELEASE);
+        tail = __atomic_load_n(ctx->cq_tail, __ATOMIC_ACQUIRE);
+    }
+    return ncqes;
+}
+
+int iowatcher_init(evloop_t* loop) {
+    if (loop->iowatcher)
+        return 0;
+    if (iouring_supported()) {
+        iouring_ctx_t* ctx = iouring_ctx_new();
+        if (ctx) {
+            loop->iowatcher = ctx;
+            loop->iouring = 1;
+            return 0;
+        }
+        log_warn("io_uring setup failed: %s, fallback to epoll", strerror(errno));
+    }
+    loop->iouring = 0;
+    return epoll_iowatcher_init(loop);
+}
+
+int iowatcher_cleanup(evloop_t* loop) {
+    if (loop->iowatcher == NULL)
+        return 0;
+    if (!loop->iouring)
+        return epoll_iowatcher_cleanup(loop);
+    iouring_ctx_t* ctx = (iouring_ctx_t*)loop->iowatcher;
+    // NOTE: close ring first, kernel cancels all requests.
+    close(ctx->ring_fd);
+    ctx->ring_fd = -1;
+    struct list_node* node = ctx->ops.next;
+    while (node != &ctx->ops) {
+        iouring_op_t* op = container_of(node, iouring_op_t, node);
+        node = node->next;
+        iouring_op_free(loop, op);
+    }
+    node = ctx->free_ops.next;
+    while (node != &ctx->free_ops) {
+        iouring_op_t* op = container_of(node, iouring_op_t, node);
+        node = node->next;
+        EV_FREE(op);
+    }
+    iouring_ctx_free(ctx);
+    loop->iowatcher = NULL;
+    return 0;
+}
+
+int iowatcher_add_event(evloop_t* loop, int fd, int events) {
+    if (loop->iowatcher == NULL) {
+        iowatcher_init(loop);
+    }
+    if (!loop->iouring)
+        return epoll_iowatcher_add_event(loop, fd, events);
+    iouring_ctx_t* ctx = (iouring_ctx_t*)loop->iowatcher;
+    evio_t* io = loop->ios.ptr[fd];
+    if (io->uring == NULL) {
+        iouring_io_t* uio;
+        EV_ALLOC_SIZEOF(uio);
+        io->uring = uio;
+    }
+    iouring_add_dirty(ctx, io);
+    if (loop->status == EVLOOP_STATUS_RUNNING && gettid() != loop->tid) {
+        evloop_wakeup(loop);
+    }
+    return 0;
+}
+
+int iowatcher_del_event(evloop_t* loop, int fd, int events) {
+    if (loop->iowatcher == NULL)
+        return 0;
+    if (!loop->iouring)
+        return epoll_iowatcher_del_event(loop, fd, events);
+    iouring_ctx_t* ctx = (iouring_ctx_t*)loop->iowatcher;
+    evio_t* io = loop->ios.ptr[fd];
+    iouring_io_t* uio = (iouring_io_t*)io->uring;
+    if (uio == NULL)
+        return 0;
+    if (uio->read_op && ((events & EV_READ) || (uio->read_op->type == IOURING_OP_POLLERR && !io->zerocopy_wait))) {
+        iouring_cancel(ctx, uio->read_op);
+        uio->read_op = NULL;
+    }
+    // NOTE: sendmsg in flight is the head of write_queue, cancel it only if io done.
+    if ((events & EV_WRITE) && uio->write_op && (uio->write_op->type != IOURING_OP_SENDMSG || !io->ready)) {
+        iouring_cancel(ctx, uio->write_op);
+        uio->write_op = NULL;
+    }
+    return 0;
+}
+
+int iowatcher_poll_events(evloop_t* loop, int timeout) {
+    if (loop->iowatcher == NULL)
+        return 0;
+    if (!loop->iouring)
+        return epoll_iowatcher_poll_events(loop, timeout);
+    iouring_ctx_t* ctx = (iouring_ctx_t*)loop->iowatcher;
+    int nready = iouring_prepare(loop, ctx);
+    if (nready) {
+        timeout = 0;
+    }
+    int ret = 0;
+    if (timeout == 0) {
+        ret = iouring_submit(ctx);
+    } else {
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000LL;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        if (timeout > 0) {
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+        }
+        ret = io_uring_enter(ctx->ring_fd, iouring_sq_pending(ctx), 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                             &arg, sizeof(arg));
+    }
+    if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+        perror("io_uring_enter");
+        return ret;
+    }
+    return nready + iouring_reap(loop, ctx);
+}
+
+//-----------------nio.c---------------------------------------------
+int iouring_accept(evio_t* io) {
+    iouring_io_t* uio = (iouring_io_t*)io->uring;
+    iouring_cqe_t* cqe = uio ? iouring_cqes_front(&uio->cqes) : NULL;
+    if (cqe == NULL) {
+        errno = EAGAIN;
+        return -1;
+    }
+    int res = cqe->res;
+    iouring_cqes_pop_front(&uio->cqes);
+    if (res < 0) {
+        errno = -res;
+        return -1;
+    }
+    return res;
+}
+
+int iouring_recv(evio_t* io, void* buf, int len) {
+    iouring_ctx_t* ctx = (iouring_ctx_t*)io->loop->iowatcher;
+    iouring_io_t* uio = (iouring_io_t*)io->uring;
+    iouring_cqe_t* cqe = uio ? iouring_cqes_front(&uio->cqes) : NULL;
+    if (cqe == NULL) {
+        errno = EAGAIN;
+        return -1;
+    }
+    int res = cqe->res;
+    if (res <= 0) {
+        iouring_cqes_pop_front(&uio->cqes);
+        if (res < 0) {
+            errno = -res;
+            return -1;
+        }
+        return 0;
+    }
+    int nread = MIN(len, res - cqe->offset);
+    memcpy(buf, ctx->bufs + (size_t)cqe->bid * IOURING_BUF_SIZE + cqe->offset, nread);
+    cqe->offset += nread;
+    if (cqe->offset == res) {
+        iouring_recycle_buf(ctx, cqe->bid);
+        --ctx->nbufs_held;
+        iouring_cqes_pop_front(&uio->cqes);
+    }
+    return nread;
+}
+
+bool iouring_recv_pending(evio_t* io) {
+    iouring_io_t* uio = (iouring_io_t*)io->uring;
+    return uio && !iouring_cqes_empty(&uio->cqes);
+}
+
+bool iouring_sent(evio_t* io, int* nsent) {
+    iouring_io_t* uio = (iouring_io_t*)io->uring;
+    if (uio == NULL || !uio->sent)
+        return false;
+    *nsent = uio->nsent;
+    uio->sent = 0;
+    return true;
+}
+
+void iouring_io_done(evio_t* io) {
+    iouring_io_t* uio = (iouring_io_t*)io->uring;
+    if (uio == NULL || !io->loop->iouring)
+        return;
+    iouring_ctx_t* ctx = (iouring_ctx_t*)io->loop->iowatcher;
+    // unconsumed completions
+    iouring_cqe_t* cqe = NULL;
+    while ((cqe = iouring_cqes_front(&uio->cqes)) != NULL) {
+        if (cqe->bid >= 0) {
+            iouring_recycle_buf(ctx, cqe->bid);
+            --ctx->nbufs_held;
+        } else if (io->accept && cqe->res >= 0) {
+            close(cqe->res);
+        }
+        iouring_cqes_pop_front(&uio->cqes);
+    }
+    // NOTE: kernel may still read write_queue buffers until the canceled sendmsg completed.
+    iouring_op_t* op = NULL;
+    struct list_node* node = ctx->ops.next;
+    for (; node != &ctx->ops; node = node->next) {
+        op = container_of(node, iouring_op_t, node);
+        if (op->type == IOURING_OP_SENDMSG && op->fd == io->fd && op->id == io->id) {
+            evio_write_lock(io);
+            for (int i = 0; i < op->msg.msg_iovlen && !write_queue_empty(&io->write_queue); ++i) {
+                op->refs[op->nrefs++] = write_queue_front(&io->write_queue)->ref;
+                write_queue_pop_front(&io->write_queue);
+            }
+            evio_write_unlock(io);
+            break;
+        }
+    }
+    // NOTE: keep uio and cqes for the next connection of this fd, @see iouring_io_free
+    struct iouring_cqes cqes = uio->cqes;
+    memset(uio, 0, sizeof(iouring_io_t));
+    uio->cqes = cqes;
+}
+
+void iouring_io_free(evio_t* io) {
+    iouring_io_t* uio = (iouring_io_t*)io->uring;
+    if (uio == NULL)
+        return;
+    iouring_io_done(io);
+    iouring_cqes_cleanup(&uio->cqes);
+    EV_FREE(io->uring);
+}
+#endif
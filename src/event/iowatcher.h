@@ -3,7 +3,8 @@
 
 #include "eventloop.h"
 
-#if !defined(EVENT_SELECT) && !defined(EVENT_POLL) && !defined(EVENT_EPOLL) && !defined(EVENT_KQUEUE)
+#if !defined(EVENT_SELECT) && !defined(EVENT_POLL) && !defined(EVENT_EPOLL) && !defined(EVENT_KQUEUE) && \
+    !defined(EVENT_IOURING)
 #ifdef OS_LINUX
 #define EVENT_EPOLL
 #elif defined(OS_MAC)
@@ -21,4 +22,22 @@ int iowatcher_add_event(evloop_t* loop, int fd, int events);
 int iowatcher_del_event(evloop_t* loop, int fd, int events);
 int iowatcher_poll_events(evloop_t* loop, int timeout);
 
+#ifdef EVENT_IOURING
+// NOTE: io_uring falls back to epoll at runtime if kernel lacks support.
+bool iouring_supported();
+bool iouring_enabled(evloop_t* loop);
+// io_uring completes accept/recv/sendmsg in kernel, nio.c consumes the results.
+// @return connfd, -1 and errno = EAGAIN if no more
+int iouring_accept(evio_t* io);
+// @return bytes copied from provided buffers, 0 = EOF, -1 and errno = EAGAIN if no more
+int iouring_recv(evio_t* io, void* buf, int len);
+bool iouring_recv_pending(evio_t* io);
+// @return true if write_queue sendmsg completed, *nsent = bytes sent or -errno
+bool iouring_sent(evio_t* io, int* nsent);
+// evio_done: release unconsumed completions
+void iouring_io_done(evio_t* io);
+// evio_free: iouring_io_done and free io->uring
+void iouring_io_free(evio_t* io);
+#endif
+
 #endif
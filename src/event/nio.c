@@ -1,9 +1,38 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for recvmmsg, sendmmsg
+#endif
 
+#include "errors.h"
 #include "event.h"
 #include "iowatcher.h"
 #include "log.h"
 #include "socket.h"
+#include "sockopt.h"
 #include "sockunion.h"
+#include "unpack.h"
+
+#ifdef OS_UNIX
+#include <sys/uio.h> // for writev
+#endif
+#ifdef OS_LINUX
+#include <fcntl.h> // for pipe2, F_SETPIPE_SZ
+#include <netinet/udp.h> // for UDP_SEGMENT, UDP_GRO
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#include <linux/errqueue.h> // for sock_extended_err, SO_EE_ORIGIN_ZEROCOPY
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#endif
+#define UDP_MAX_SEGMENTS    64
+#define UDP_MAX_PAYLOAD     65507
 
 static void __connect_timeout_cb(evtimer_t* timer) {
     evio_t* io = (evio_t*)timer->privdata;
@@ -11,8 +40,8 @@ static void __connect_timeout_cb(evtimer_t* timer) {
         char localaddrstr[SU_ADDRSTRLEN] = {0};
         char peeraddrstr[SU_ADDRSTRLEN] = {0};
         log_warn("connect timeout [%s] <=> [%s]",
-                 SU_ADDRSTR(io->localaddr, localaddrstr),
-                 SU_ADDRSTR(io->peeraddr, peeraddrstr));
+                 SU_ADDRSTR(evio_localaddr(io), localaddrstr),
+                 SU_ADDRSTR(evio_peeraddr(io), peeraddrstr));
         io->error = ETIMEDOUT;
         evio_close(io);
     }
@@ -24,8 +53,8 @@ static void __close_timeout_cb(evtimer_t* timer) {
         char localaddrstr[SU_ADDRSTRLEN] = {0};
         char peeraddrstr[SU_ADDRSTRLEN] = {0};
         log_warn("close timeout [%s] <=> [%s]",
-                 SU_ADDRSTR(io->localaddr, localaddrstr),
-                 SU_ADDRSTR(io->peeraddr, peeraddrstr));
+                 SU_ADDRSTR(evio_localaddr(io), localaddrstr),
+                 SU_ADDRSTR(evio_peeraddr(io), peeraddrstr));
         io->error = ETIMEDOUT;
         evio_close(io);
     }
@@ -65,7 +94,7 @@ static void __close_cb(evio_t* io) {
 
 static void ssl_server_handshake(evio_t* io) {
     // printd("ssl server handshake...\n");
-    // int ret = hssl_accept(io->ssl);
+    // int ret = hssl_accept(io->cold->ssl);
     // if (ret == 0) {
     //     // handshake finish
     //     evio_del(io, EV_READ);
@@ -84,7 +113,7 @@ static void ssl_server_handshake(evio_t* io) {
 
 static void ssl_client_handshake(evio_t* io) {
     // printd("ssl client handshake...\n");
-    // int ret = hssl_connect(io->ssl);
+    // int ret = hssl_connect(io->cold->ssl);
     // if (ret == 0) {
     //     // handshake finish
     //     evio_del(io, EV_READ);
@@ -104,11 +133,21 @@ static void ssl_client_handshake(evio_t* io) {
 static void nio_accept(evio_t* io) {
     // printd("nio_accept listenfd=%d\n", io->fd);
     int connfd = 0, err = 0, accept_cnt = 0;
+    const evio_budget_t* budget = evio_budget(io);
     socklen_t addrlen;
     evio_t* connio = NULL;
-    while (accept_cnt++ < 3) {
+    while (!evio_budget_spent(budget->accepts, accept_cnt++, 0, 0)) {
         addrlen = sizeof(sockaddr_u);
-        connfd = accept(io->fd, io->peeraddr, &addrlen);
+#ifdef EVENT_IOURING
+        if (iouring_enabled(io->loop)) {
+            // NOTE: accepted by multishot accept already
+            connfd = iouring_accept(io);
+            if (connfd >= 0) {
+                getpeername(connfd, evio_peeraddr(io), &addrlen);
+            }
+        } else
+#endif
+            connfd = accept(io->fd, evio_peeraddr(io), &addrlen);
         if (connfd < 0) {
             err = socket_errno();
             if (err == EAGAIN || err == EINTR) {
@@ -120,25 +159,26 @@ static void nio_accept(evio_t* io) {
             }
         }
         addrlen = sizeof(sockaddr_u);
-        getsockname(connfd, io->localaddr, &addrlen);
+        getsockname(connfd, evio_localaddr(io), &addrlen);
         connio = evio_get(io->loop, connfd);
+        atomic_fetch_add_explicit(&io->loop->naccepts, 1, memory_order_relaxed);
         // NOTE: inherit from listenio
         connio->accept_cb = io->accept_cb;
         connio->userdata = io->userdata;
-        if (io->unpack_setting) {
-            evio_set_unpack(connio, io->unpack_setting);
+        if (io->cold->unpack_setting) {
+            evio_set_unpack(connio, io->cold->unpack_setting);
         }
 
         if (io->io_type == EIO_TYPE_SSL) {
-            // if (connio->ssl == NULL) {
-            //     // io->ssl_ctx > g_ssl_ctx > hssl_ctx_new
+            // if (connio->cold->ssl == NULL) {
+            //     // io->cold->ssl_ctx > g_ssl_ctx > hssl_ctx_new
             //     hssl_ctx_t ssl_ctx = NULL;
-            //     if (io->ssl_ctx) {
-            //         ssl_ctx = io->ssl_ctx;
+            //     if (io->cold->ssl_ctx) {
+            //         ssl_ctx = io->cold->ssl_ctx;
             //     } else if (g_ssl_ctx) {
             //         ssl_ctx = g_ssl_ctx;
             //     } else {
-            //         io->ssl_ctx = ssl_ctx = hssl_ctx_new(NULL);
+            //         io->cold->ssl_ctx = ssl_ctx = hssl_ctx_new(NULL);
             //         io->alloced_ssl_ctx = 1;
             //     }
             //     if (ssl_ctx == NULL) {
@@ -150,7 +190,7 @@ static void nio_accept(evio_t* io) {
             //         io->error = ERR_NEW_SSL;
             //         goto accept_error;
             //     }
-            //     connio->ssl = ssl;
+            //     connio->cold->ssl = ssl;
             // }
             // evio_enable_ssl(connio);
             // ssl_server_handshake(connio);
@@ -159,6 +199,11 @@ static void nio_accept(evio_t* io) {
             __accept_cb(connio);
         }
     }
+    // NOTE: edge-triggered must accept until EAGAIN, level-triggered need not wait for poll either.
+    if (!io->closed && (io->events & EV_READ)) {
+        ++io->loop->fairness_stats.accept_exhausted;
+        evio_ready_again(io, EV_READ);
+    }
     return;
 
 accept_error:
@@ -169,24 +214,24 @@ accept_error:
 static void nio_connect(evio_t* io) {
     // printd("nio_connect connfd=%d\n", io->fd);
     socklen_t addrlen = sizeof(sockaddr_u);
-    int ret = getpeername(io->fd, io->peeraddr, &addrlen);
+    int ret = getpeername(io->fd, evio_peeraddr(io), &addrlen);
     if (ret < 0) {
         io->error = socket_errno();
         goto connect_error;
     } else {
         addrlen = sizeof(sockaddr_u);
-        getsockname(io->fd, io->localaddr, &addrlen);
+        getsockname(io->fd, evio_localaddr(io), &addrlen);
 
         if (io->io_type == EIO_TYPE_SSL) {
-            // if (io->ssl == NULL) {
-            //     // io->ssl_ctx > g_ssl_ctx > hssl_ctx_new
+            // if (io->cold->ssl == NULL) {
+            //     // io->cold->ssl_ctx > g_ssl_ctx > hssl_ctx_new
             //     hssl_ctx_t ssl_ctx = NULL;
-            //     if (io->ssl_ctx) {
-            //         ssl_ctx = io->ssl_ctx;
+            //     if (io->cold->ssl_ctx) {
+            //         ssl_ctx = io->cold->ssl_ctx;
             //     } else if (g_ssl_ctx) {
             //         ssl_ctx = g_ssl_ctx;
             //     } else {
-            //         io->ssl_ctx = ssl_ctx = hssl_ctx_new(NULL);
+            //         io->cold->ssl_ctx = ssl_ctx = hssl_ctx_new(NULL);
             //         io->alloced_ssl_ctx = 1;
             //     }
             //     if (ssl_ctx == NULL) {
@@ -198,10 +243,10 @@ static void nio_connect(evio_t* io) {
             //         io->error = ERR_NEW_SSL;
             //         goto connect_error;
             //     }
-            //     io->ssl = ssl;
+            //     io->cold->ssl = ssl;
             // }
-            // if (io->hostname) {
-            //     hssl_set_sni_hostname(io->ssl, io->hostname);
+            // if (io->cold->hostname) {
+            //     hssl_set_sni_hostname(io->cold->ssl, io->cold->hostname);
             // }
             // ssl_client_handshake(io);
         } else {
@@ -239,9 +284,15 @@ static int __nio_read(evio_t* io, void* buf, int len) {
     int nread = 0;
     switch (io->io_type) {
     case EIO_TYPE_SSL:
-        // nread = hssl_read(io->ssl, buf, len);
+        // nread = hssl_read(io->cold->ssl, buf, len);
         // break;
     case EIO_TYPE_TCP:
+#ifdef EVENT_IOURING
+        if (iouring_enabled(io->loop)) {
+            nread = iouring_recv(io, buf, len);
+            break;
+        }
+#endif
 #ifdef OS_UNIX
         nread = read(io->fd, buf, len);
 #else
@@ -266,7 +317,7 @@ static int __nio_write(evio_t* io, const void* buf, int len) {
     int nwrite = 0;
     switch (io->io_type) {
     case EIO_TYPE_SSL:
-        // nwrite = hssl_write(io->ssl, buf, len);
+        // nwrite = hssl_write(io->cold->ssl, buf, len);
         // break;
     case EIO_TYPE_TCP:
 #ifdef OS_UNIX
@@ -288,24 +339,542 @@ static int __nio_write(evio_t* io, const void* buf, int len) {
     return nwrite;
 }
 
+// evio_close later: once write_queue empty and zerocopy sends completed.
+static void nio_close_later(evio_t* io) {
+    if (io->close && !io->zerocopy_wait) {
+        io->close = 0;
+        evio_close(io);
+    }
+}
+
+#ifdef OS_LINUX
+static void evio_handle_events(evio_t* io);
+
+// NOTE: loop thread only, so zerocopy_pending and loop->zerocopy_stats need no lock.
+static bool nio_zerocopy(evio_t* io, size_t len) {
+    if (!io->zerocopy || gettid() != io->loop->tid)
+        return false;
+    if (len < io->cold->zerocopy_threshold) {
+        ++io->loop->zerocopy_stats.fallbacks;
+        return false;
+    }
+    return true;
+}
+
+// sendmsg by MSG_ZEROCOPY, hold refs of the buffers sent until completed, @see nio_zerocopy_reap
+static int __nio_write_zerocopy(evio_t* io, struct iovec* iov, write_buf_t* pbuf, int niov) {
+    evloop_zerocopy_stats_t* stats = &io->loop->zerocopy_stats;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = niov;
+    int nwrite = sendmsg(io->fd, &msg, MSG_ZEROCOPY);
+    if (nwrite < 0 && socket_errno() == ENOBUFS) {
+        // NOTE: notifications pending over net.core.optmem_max, copy this one
+        ++stats->fallbacks;
+        return sendmsg(io->fd, &msg, 0);
+    }
+    if (nwrite <= 0)
+        return nwrite;
+    struct evio_cold_s* cold = io->cold;
+    struct zerocopy_queue* pending = &cold->zerocopy_pending;
+    if (pending->maxsize == 0) {
+        zerocopy_queue_init(pending, 4);
+    }
+    uint32_t seq = cold->zerocopy_seq++;
+    for (int i = 0, n = 0; i < niov && n < nwrite; n += iov[i].iov_len, ++i) {
+        zerocopy_buf_t zbuf = {evbuf_ref(pbuf[i].ref), seq, 0};
+        zerocopy_queue_push_back(pending, &zbuf);
+        ++stats->inflight;
+    }
+    ++stats->sends;
+    stats->bytes += nwrite;
+    if (!io->zerocopy_wait) {
+        // NOTE: keep io active and watched by the loop for EPOLLERR, even if no EV_READ/EV_WRITE.
+        io->zerocopy_wait = 1;
+        evio_add(io, io->cb ? (evio_cb)io->cb : evio_handle_events, 0);
+    }
+    return nwrite;
+}
+
+// sends never completed, dropped by the RST of evio_close
+static void nio_zerocopy_release(evloop_t* loop, struct zerocopy_queue* pending) {
+    loop->zerocopy_stats.inflight -= zerocopy_queue_size(pending);
+    while (!zerocopy_queue_empty(pending)) {
+        evbuf_unref(zerocopy_queue_front(pending)->ref);
+        zerocopy_queue_pop_front(pending);
+    }
+    zerocopy_queue_cleanup(pending);
+}
+
+// reap completions [lo, hi] from the error queue, release buffers of completed sends in order.
+static void nio_zerocopy_reap(evio_t* io) {
+    struct zerocopy_queue* pending = &io->cold->zerocopy_pending;
+    evloop_zerocopy_stats_t* stats = &io->loop->zerocopy_stats;
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+    for (;;) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(io->fd, &msg, MSG_ERRQUEUE) < 0)
+            break;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+                !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+                continue;
+            struct sock_extended_err* serr = (struct sock_extended_err*)CMSG_DATA(cmsg);
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+            uint32_t lo = serr->ee_info, hi = serr->ee_data;
+            stats->completions += hi - lo + 1;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                stats->copied += hi - lo + 1;
+            }
+            zerocopy_buf_t* zbuf = zerocopy_queue_data(pending);
+            for (int i = 0; i < zerocopy_queue_size(pending); ++i, ++zbuf) {
+                if ((int32_t)(zbuf->seq - lo) >= 0 && (int32_t)(hi - zbuf->seq) >= 0) {
+                    zbuf->done = 1;
+                }
+            }
+        }
+    }
+    while (!zerocopy_queue_empty(pending) && zerocopy_queue_front(pending)->done) {
+        evbuf_unref(zerocopy_queue_front(pending)->ref);
+        zerocopy_queue_pop_front(pending);
+        --stats->inflight;
+    }
+    if (!zerocopy_queue_empty(pending))
+        return;
+    io->zerocopy_wait = 0;
+    iowatcher_del_event(io->loop, io->fd, 0);
+    evio_del(io, 0);
+    evio_write_lock(io);
+    bool drained = write_queue_empty(&io->write_queue);
+    evio_write_unlock(io);
+    if (drained) {
+        nio_close_later(io);
+    }
+}
+#endif
+
+// NOTE: MSG_ZEROCOPY if ref, @see evio_set_zerocopy
+static int __nio_write_ref(evio_t* io, const void* buf, int len, evbuf_t* ref) {
+#ifdef OS_LINUX
+    if (ref && nio_zerocopy(io, len)) {
+        struct iovec iov = {(void*)buf, (size_t)len};
+        write_buf_t wbuf = {(char*)buf, (size_t)len, 0, ref};
+        return __nio_write_zerocopy(io, &iov, &wbuf, 1);
+    }
+#endif
+    return __nio_write(io, buf, len);
+}
+
+// evio_read_batch: one block [evio_batch_t][dgrams][addrs][msgs][iovs][bufs]
+struct evio_batch_s {
+    int size;
+    int dgram_size;
+    read_batch_cb read_batch_cb;
+    evio_dgram_t* dgrams;
+    sockaddr_u* addrs;
+#ifdef OS_LINUX
+    struct mmsghdr* msgs;
+    struct iovec* iovs;
+#endif
+    char* bufs;
+};
+
+// @return number of datagrams, -1 and errno if none
+static int __nio_read_batch(evio_t* io) {
+    struct evio_batch_s* batch = io->cold->batch;
+#ifdef OS_LINUX
+    for (int i = 0; i < batch->size; ++i) {
+        batch->msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_u);
+    }
+    int n = recvmmsg(io->fd, batch->msgs, batch->size, 0, NULL);
+    for (int i = 0; i < n; ++i) {
+        batch->dgrams[i].len = batch->msgs[i].msg_len;
+    }
+    return n;
+#else
+    int n = 0;
+    for (; n < batch->size; ++n) {
+        socklen_t addrlen = sizeof(sockaddr_u);
+        int nread = recvfrom(io->fd, batch->dgrams[n].buf, batch->dgram_size, 0, &batch->addrs[n].sa, &addrlen);
+        if (nread < 0)
+            break;
+        batch->dgrams[n].len = nread;
+    }
+    return n ? n : -1;
+#endif
+}
+
+static void nio_read_batch(evio_t* io) {
+    int n = __nio_read_batch(io);
+    if (n < 0) {
+        int err = socket_errno();
+        if (err != EAGAIN && err != EMSGSIZE) {
+            io->error = err;
+        }
+        return;
+    }
+    io->last_read_hrtime = io->loop->cur_hrtime;
+    // NOTE: level-triggered, read the remain in next loop.
+    io->cold->batch->read_batch_cb(io, io->cold->batch->dgrams, n);
+}
+
+#ifdef OS_LINUX
+// recvmsg a GRO coalesced datagram, read_cb for each segment.
+static void nio_read_gro(evio_t* io) {
+    char* buf = io->readbuf.base;
+    struct iovec iov = {buf, io->readbuf.len};
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = io->peeraddr;
+    msg.msg_namelen = sizeof(sockaddr_u);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    int nread = recvmsg(io->fd, &msg, 0);
+    if (nread < 0) {
+        int err = socket_errno();
+        if (err != EAGAIN && err != EMSGSIZE) {
+            io->error = err;
+        }
+        return;
+    }
+    int segment_size = nread;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    for (; cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(int));
+            break;
+        }
+    }
+    io->last_read_hrtime = io->loop->cur_hrtime;
+    for (int offset = 0; offset < nread && !io->closed; offset += segment_size) {
+        evio_read_cb(io, buf + offset, MIN(segment_size, nread - offset));
+    }
+}
+#endif
+
+// evio_read_chain: bytes [head, head + len) of segs, each seg_size from loop->bufpool
+QUEUE_DECL(void*, chain_segs);
+#define EIO_CHAIN_READV_SEGS 16
+#define EIO_CHAIN_MAX_HEAD   64 // for length field peeked across segments
+
+struct evio_chain_s {
+    int seg_size;
+    read_chain_cb read_chain_cb;
+    chain_segs segs;
+    size_t head;
+    size_t len;
+    size_t need; // length of the pending frame, 0 if unknown
+    evio_iov_t* views;
+    int maxviews;
+    unsigned delivering : 1;
+    unsigned orphan : 1; // evio_chain_free in read_chain_cb, freed once it returns
+};
+
+static void nio_chain_release(evloop_t* loop, struct evio_chain_s* chain) {
+    while (!chain_segs_empty(&chain->segs)) {
+        evloop_bufpool_free(loop, *chain_segs_front(&chain->segs), chain->seg_size);
+        evloop_memory_add(loop, -(long long)chain->seg_size);
+        chain_segs_pop_front(&chain->segs);
+    }
+    chain_segs_cleanup(&chain->segs);
+    EV_FREE(chain->views);
+    EV_FREE(chain);
+}
+
+static void nio_chain_consume(evloop_t* loop, struct evio_chain_s* chain, size_t len) {
+    chain->head += len;
+    chain->len -= len;
+    // NOTE: no segment kept by drained chain, as readbuf of lean io.
+    while (!chain_segs_empty(&chain->segs) && (chain->head >= chain->seg_size || chain->len == 0)) {
+        evloop_bufpool_free(loop, *chain_segs_front(&chain->segs), chain->seg_size);
+        evloop_memory_add(loop, -(long long)chain->seg_size);
+        chain_segs_pop_front(&chain->segs);
+        chain->head = chain->len ? chain->head - chain->seg_size : 0;
+    }
+}
+
+// copy [buf, buf + len) behind the pending bytes, fresh segments as needed
+static void nio_chain_append(evloop_t* loop, struct evio_chain_s* chain, const char* buf, size_t len) {
+    while (len) {
+        size_t space = chain_segs_size(&chain->segs) * chain->seg_size - chain->head - chain->len;
+        if (space == 0) {
+            void* seg = evloop_bufpool_alloc(loop, chain->seg_size);
+            chain_segs_push_back(&chain->segs, &seg);
+            evloop_memory_add(loop, chain->seg_size);
+            space = chain->seg_size;
+        }
+        size_t n = MIN(space, len);
+        memcpy((char*)*chain_segs_back(&chain->segs) + chain->seg_size - space, buf, n);
+        chain->len += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+// @return views of [0, len) of chain
+static int nio_chain_views(struct evio_chain_s* chain, size_t len) {
+    int nviews = (chain->head + len + chain->seg_size - 1) / chain->seg_size;
+    if (nviews > chain->maxviews) {
+        EV_FREE(chain->views);
+        chain->maxviews = MAX(nviews, chain->maxviews * 2);
+        EV_ALLOC(chain->views, sizeof(evio_iov_t) * chain->maxviews);
+    }
+    void** segs = chain_segs_data(&chain->segs);
+    size_t offset = chain->head;
+    for (int i = 0; i < nviews; ++i) {
+        chain->views[i].base = (char*)segs[i] + offset;
+        chain->views[i].len = MIN(chain->seg_size - offset, len);
+        len -= chain->views[i].len;
+        offset = 0;
+    }
+    return nviews;
+}
+
+// @return length of the front frame, 0 if unknown yet, -1 if invalid
+static long long nio_chain_frame_len(evio_t* io) {
+    struct evio_chain_s* chain = io->cold->chain;
+    unpack_setting_t* setting = io->cold->unpack_setting;
+    if (setting == NULL || setting->mode == UNPACK_MODE_NONE)
+        return chain->len;
+    if (setting->mode == UNPACK_BY_FIXED_LENGTH)
+        return setting->fixed_length;
+    int len = MIN(chain->len, EIO_CHAIN_MAX_HEAD);
+    const unsigned char* p = (const unsigned char*)*chain_segs_front(&chain->segs) + chain->head;
+    unsigned char head[EIO_CHAIN_MAX_HEAD];
+    if (chain->seg_size - chain->head < len) {
+        int nviews = nio_chain_views(chain, len);
+        evio_iov_copy(chain->views, nviews, 0, head, len);
+        p = head;
+    }
+    return unpack_length_field(setting, p, len);
+}
+
+static void nio_chain_deliver(evio_t* io, size_t len) {
+    struct evio_chain_s* chain = io->cold->chain;
+    int nviews = nio_chain_views(chain, len);
+    chain->delivering = 1;
+    if (chain->read_chain_cb) {
+        if (io->read_flags & EIO_READ_ONCE) {
+            io->read_flags &= ~EIO_READ_ONCE;
+            evio_read_stop(io);
+        }
+        chain->read_chain_cb(io, chain->views, nviews, len);
+        if (io->loop->mem_budget) {
+            evloop_memory_check(io->loop);
+        }
+    } else if (nviews == 1) {
+        evio_read_cb(io, chain->views[0].base, len);
+    } else {
+        // NOTE: only frames across segments are copied
+        void* buf = evloop_bufpool_alloc(io->loop, len);
+        evio_iov_copy(chain->views, nviews, 0, buf, len);
+        evio_read_cb(io, buf, len);
+        evloop_bufpool_free(io->loop, buf, len);
+    }
+    chain->delivering = 0;
+}
+
+static void nio_chain_unpack(evio_t* io) {
+    struct evio_chain_s* chain = io->cold->chain;
+    while (chain->len && !io->closed) {
+        unpack_setting_t* setting = io->cold->unpack_setting;
+        long long len = nio_chain_frame_len(io);
+        if (len < 0 || (setting && len > setting->package_max_length)) {
+            // hloge("package length over %d bytes!", (int)setting->package_max_length);
+            io->error = ERR_OVER_LIMIT;
+            evio_close(io);
+            return;
+        }
+        if (len == 0 || len > chain->len) {
+            chain->need = len;
+            return;
+        }
+        chain->need = 0;
+        nio_chain_deliver(io, len);
+        if (chain->orphan) {
+            nio_chain_release(io->loop, chain);
+            return;
+        }
+        nio_chain_consume(io->loop, chain, len);
+    }
+}
+
+// @return bytes to complete the current frame, 0 if unknown
+static size_t nio_frame_remain(evio_t* io) {
+    struct evio_chain_s* chain = io->cold->chain;
+    if (chain)
+        return chain->need > chain->len ? chain->need - chain->len : 0;
+    size_t len = 0, buffered = io->readbuf.tail - io->readbuf.head;
+    unpack_setting_t* setting = io->cold->unpack_setting;
+    if (setting == NULL) {
+        if (io->read_flags & EIO_READ_UNTIL_LENGTH)
+            len = io->read_until_length;
+    } else if (setting->mode == UNPACK_BY_FIXED_LENGTH) {
+        len = setting->fixed_length;
+    } else if (setting->mode == UNPACK_BY_LENGTH_FIELD) {
+        long long n = unpack_length_field(setting, (unsigned char*)io->readbuf.base + io->readbuf.head, buffered);
+        len = n > 0 ? n : 0;
+    }
+    return len > buffered ? len - buffered : 0;
+}
+
+// SO_RCVLOWAT to the rest of the current frame, reset once delivered.
+static void nio_update_rcvlowat(evio_t* io) {
+#ifdef OS_LINUX
+    if (io->io_type != EIO_TYPE_TCP || io->closed)
+        return;
+    size_t remain = io->no_rcvlowat ? 0 : nio_frame_remain(io);
+    uint32_t rcvlowat = remain < EVIO_MIN_RCVLOWAT ? 0 : MIN(remain, EVIO_MAX_RCVLOWAT);
+    if (rcvlowat == io->cold->rcvlowat)
+        return;
+    int val = rcvlowat ? rcvlowat : 1;
+    if (setsockopt(io->fd, SOL_SOCKET, SO_RCVLOWAT, &val, sizeof(val)) == 0) {
+        evio_cold(io)->rcvlowat = rcvlowat;
+    }
+#endif
+}
+
+// readv into free space of the back segment and fresh segments, enough for the pending frame.
+static void nio_read_chain(evio_t* io) {
+    struct evio_chain_s* chain = io->cold->chain;
+    struct iovec iov[EIO_CHAIN_READV_SEGS + 1];
+    int niov = 0, nfresh = 0, nread = 0, read_cnt = 0, more = 0;
+    size_t seg_size = 0, space = 0, total = 0, want = 0, read_bytes = 0;
+    const evio_budget_t* budget = evio_budget(io);
+    uint32_t max_reads = budget->reads;
+read:
+    seg_size = chain->seg_size;
+    space = chain_segs_size(&chain->segs) * seg_size - chain->head - chain->len;
+    niov = 0;
+    if (space) {
+        iov[niov].iov_base = (char*)*chain_segs_back(&chain->segs) + seg_size - space;
+        iov[niov].iov_len = space;
+        ++niov;
+    }
+    want = chain->need > chain->len ? chain->need - chain->len : 0;
+    if (want > space) {
+        nfresh = MIN((want - space + seg_size - 1) / seg_size, EIO_CHAIN_READV_SEGS);
+    } else {
+        nfresh = want == 0 && space < seg_size / 2 ? 1 : 0;
+    }
+#ifdef EVENT_IOURING
+    // NOTE: received into ring buffers already, copy one completion at most per call.
+    if (iouring_enabled(io->loop)) {
+        nfresh = space ? 0 : 1;
+    }
+#endif
+    total = space;
+    for (int i = 0; i < nfresh; ++i) {
+        iov[niov].iov_base = evloop_bufpool_alloc(io->loop, seg_size);
+        iov[niov].iov_len = seg_size;
+        total += seg_size;
+        ++niov;
+    }
+#ifdef EVENT_IOURING
+    if (iouring_enabled(io->loop)) {
+        nread = iouring_recv(io, iov[0].iov_base, iov[0].iov_len);
+        total = iov[0].iov_len;
+    } else
+#endif
+        nread = readv(io->fd, iov, niov);
+    // keep filled fresh segments
+    for (int i = niov - nfresh; i < niov; ++i) {
+        if (nread > 0 && (size_t)nread > space + (size_t)(i - (niov - nfresh)) * seg_size) {
+            chain_segs_push_back(&chain->segs, &iov[i].iov_base);
+            evloop_memory_add(io->loop, seg_size);
+        } else {
+            evloop_bufpool_free(io->loop, iov[i].iov_base, seg_size);
+        }
+    }
+    if (nread < 0) {
+        int err = socket_errno();
+        if (err == EAGAIN || err == EMSGSIZE)
+            return;
+        io->error = err;
+        goto read_error;
+    }
+    if (nread == 0) {
+        goto disconnect;
+    }
+    chain->len += nread;
+    io->last_read_hrtime = io->loop->cur_hrtime;
+    nio_chain_unpack(io);
+    if (io->closed || io->cold->chain != chain)
+        return;
+    nio_update_rcvlowat(io);
+    read_bytes += nread;
+    more = nread == total;
+#ifdef EVENT_IOURING
+    if (iouring_enabled(io->loop)) {
+        // NOTE: copies of what received, no syscalls to count
+        more = iouring_recv_pending(io);
+        max_reads = 0;
+    }
+#endif
+    if (more && (io->events & EV_READ)) {
+        if (!evio_budget_spent(max_reads, ++read_cnt, budget->read_bytes, read_bytes)) {
+            goto read;
+        }
+        ++io->loop->fairness_stats.read_exhausted;
+        evio_ready_again(io, EV_READ);
+    }
+    return;
+read_error:
+disconnect:
+    evio_close(io);
+}
+
 static void nio_read(evio_t* io) {
     // printd("nio_read fd=%d\n", io->fd);
     void* buf;
-    int len = 0, nread = 0, err = 0;
+    int len = 0, nread = 0, err = 0, read_cnt = 0, more = 0;
+    size_t read_bytes = 0;
+    const evio_budget_t* budget = evio_budget(io);
+    uint32_t max_reads = budget->reads;
+#ifdef OS_LINUX
+    if (io->udp_gro) {
+        nio_read_gro(io);
+        return;
+    }
+#endif
+    if (io->cold->batch) {
+        nio_read_batch(io);
+        return;
+    }
+    if (io->cold->chain) {
+        nio_read_chain(io);
+        return;
+    }
 read:
+    if (io->lean) {
+        evio_prepare_readbuf(io);
+    }
     buf = io->readbuf.base + io->readbuf.tail;
     if (io->read_flags & EIO_READ_UNTIL_LENGTH) {
         len = io->read_until_length - (io->readbuf.tail - io->readbuf.head);
     } else {
         len = io->readbuf.len - io->readbuf.tail;
     }
+    // NOTE: never truncate datagrams
+    if (budget->read_bytes && (io->io_type & EIO_TYPE_SOCK_STREAM)) {
+        len = MIN(len, budget->read_bytes - read_bytes);
+    }
     assert(len > 0);
     nread = __nio_read(io, buf, len);
     // printd("read retval=%d\n", nread);
     if (nread < 0) {
         err = socket_errno();
         if (err == EAGAIN) {
-            // goto read_done;
+            // NOTE: read again within budget, lean io returns readbuf taken for nothing
+            evio_lean_readbuf(io);
             return;
         } else if (err == EMSGSIZE) {
             // ignore
@@ -320,13 +889,32 @@ read:
         goto disconnect;
     }
     io->readbuf.tail += nread;
+    read_bytes += nread;
     __read_cb(io, buf, nread);
-    if (nread == len && !io->closed) {
-        // NOTE: ssl may have own cache
-        if (io->io_type == EIO_TYPE_SSL) {
+    nio_update_rcvlowat(io);
+    if (io->closed)
+        return;
+    // NOTE: ssl may have own cache
+    if (nread == len && io->io_type == EIO_TYPE_SSL) {
+        // read continue
+        goto read;
+    }
+    // NOTE: a short read of stream means drained, edge-triggered must read until EAGAIN.
+    more = nread == len;
+#ifdef EVENT_IOURING
+    // NOTE: io_uring may have received more, copies of which are no syscalls to count
+    if (io->io_type == EIO_TYPE_TCP && iouring_enabled(io->loop)) {
+        more = iouring_recv_pending(io);
+        max_reads = 0;
+    }
+#endif
+    if (more && (io->events & EV_READ)) {
+        if (!evio_budget_spent(max_reads, ++read_cnt, budget->read_bytes, read_bytes)) {
             // read continue
             goto read;
         }
+        ++io->loop->fairness_stats.read_exhausted;
+        evio_ready_again(io, EV_READ);
     }
     return;
 read_error:
@@ -336,29 +924,125 @@ disconnect:
     }
 }
 
+// NOTE: writev the write_queue for tcp, write the front only for others, one datagram per buffer.
+// @max: bytes of tcp at most, 0 unlimited
+static int __nio_write_queue(evio_t* io, int* len, size_t max) {
+    write_buf_t* pbuf = write_queue_front(&io->write_queue);
+    int niov = write_queue_size(&io->write_queue);
+#ifdef OS_UNIX
+    if (io->io_type == EIO_TYPE_TCP && (niov > 1 || io->zerocopy)) {
+        struct iovec iov[EVIO_WRITEV_MAX_IOV];
+        niov = MIN(niov, EVIO_WRITEV_MAX_IOV);
+        *len = 0;
+        for (int i = 0; i < niov; ++i) {
+            iov[i].iov_base = pbuf[i].base + pbuf[i].offset;
+            iov[i].iov_len = pbuf[i].len - pbuf[i].offset;
+            if (max && *len + iov[i].iov_len >= max) {
+                iov[i].iov_len = max - *len;
+                niov = i + 1;
+            }
+            *len += iov[i].iov_len;
+        }
+#ifdef OS_LINUX
+        if (nio_zerocopy(io, *len)) {
+            return __nio_write_zerocopy(io, iov, pbuf, niov);
+        }
+#endif
+        return writev(io->fd, iov, niov);
+    }
+#endif
+    *len = pbuf->len - pbuf->offset;
+    if (max && io->io_type == EIO_TYPE_TCP) {
+        *len = MIN(*len, max);
+    }
+    return __nio_write(io, pbuf->base + pbuf->offset, *len);
+}
+
+// pop nwrite bytes from the front of write_queue, write_cb for each buffer.
+static void nio_write_consume(evio_t* io, int nwrite) {
+    while (nwrite > 0 && !io->closed) {
+        write_buf_t* pbuf = write_queue_front(&io->write_queue);
+        char* buf = pbuf->base + pbuf->offset;
+        evbuf_t* ref = pbuf->ref;
+        int len = MIN(pbuf->len - pbuf->offset, nwrite);
+        pbuf->offset += len;
+        io->write_bufsize -= len;
+        evloop_memory_add(io->loop, -len);
+        nwrite -= len;
+        bool complete = pbuf->offset == pbuf->len;
+        if (complete) {
+            // NOTE: after write_cb, pbuf maybe invalid.
+            write_queue_pop_front(&io->write_queue);
+        }
+        __write_cb(io, buf, len);
+        if (complete) {
+            evbuf_unref(ref);
+        }
+        if (evio_write_cross_low(io)) {
+            evio_write_watermark_cb(io, 0);
+        }
+    }
+}
+
+#ifdef EVENT_IOURING
+// pop what sendmsg of write_queue sent, @see io_uring.c
+static void nio_write_sent(evio_t* io, int nsent) {
+    if (nsent < 0) {
+        io->error = -nsent;
+        goto write_error;
+    }
+    if (nsent == 0) {
+        goto disconnect;
+    }
+    nio_write_consume(io, nsent);
+    if (io->closed) {
+        evio_write_unlock(io);
+        return;
+    }
+    if (write_queue_empty(&io->write_queue)) {
+        evio_del(io, EV_WRITE);
+        if (io->lean) {
+            write_queue_cleanup(&io->write_queue);
+        }
+        evio_write_unlock(io);
+        nio_close_later(io);
+        return;
+    }
+    // NOTE: io_uring sendmsg the remain in next loop
+    evio_write_unlock(io);
+    return;
+write_error:
+disconnect:
+    evio_write_unlock(io);
+    evio_close(io);
+}
+#endif
+
 static void nio_write(evio_t* io) {
     // printd("nio_write fd=%d\n", io->fd);
-    int nwrite = 0, err = 0;
-    recursive_mutex_lock(&io->write_mutex);
+    int nwrite = 0, len = 0, err = 0, write_cnt = 0;
+    size_t write_bytes = 0;
+    const evio_budget_t* budget = evio_budget(io);
+    evio_write_lock(io);
+#ifdef EVENT_IOURING
+    if (iouring_enabled(io->loop) && iouring_sent(io, &nwrite)) {
+        nio_write_sent(io, nwrite);
+        return;
+    }
+#endif
 write:
     if (write_queue_empty(&io->write_queue)) {
-        recursive_mutex_unlock(&io->write_mutex);
-        if (io->close) {
-            io->close = 0;
-            evio_close(io);
-        }
+        evio_write_unlock(io);
+        nio_close_later(io);
         return;
     }
-    offset_buf_t* pbuf = write_queue_front(&io->write_queue);
-    char* base = pbuf->base;
-    char* buf = base + pbuf->offset;
-    int len = pbuf->len - pbuf->offset;
-    nwrite = __nio_write(io, buf, len);
+    // NOTE: a syscall writes the rest of budget at most
+    nwrite = __nio_write_queue(io, &len, budget->write_bytes ? budget->write_bytes - write_bytes : 0);
     // printd("write retval=%d\n", nwrite);
     if (nwrite < 0) {
         err = socket_errno();
         if (err == EAGAIN) {
-            recursive_mutex_unlock(&io->write_mutex);
+            evio_write_unlock(io);
             return;
         } else {
             // perror("write");
@@ -369,30 +1053,42 @@ write:
     if (nwrite == 0) {
         goto disconnect;
     }
-    pbuf->offset += nwrite;
-    io->write_bufsize -= nwrite;
-    __write_cb(io, buf, nwrite);
+    nio_write_consume(io, nwrite);
+    write_bytes += nwrite;
     if (nwrite == len) {
-        // NOTE: after write_cb, pbuf maybe invalid.
-        // EV_FREE(pbuf->base);
-        EV_FREE(base);
-        write_queue_pop_front(&io->write_queue);
         if (!io->closed) {
+            if (!write_queue_empty(&io->write_queue) &&
+                evio_budget_spent(budget->writes, ++write_cnt, budget->write_bytes, write_bytes)) {
+                // NOTE: edge will not come again until EAGAIN, level-triggered need not wait for poll either.
+                ++io->loop->fairness_stats.write_exhausted;
+                evio_ready_again(io, EV_WRITE);
+                evio_write_unlock(io);
+                return;
+            }
             // write continue
             goto write;
         }
     }
-    recursive_mutex_unlock(&io->write_mutex);
+    evio_write_unlock(io);
     return;
 write_error:
 disconnect:
-    recursive_mutex_unlock(&io->write_mutex);
+    evio_write_unlock(io);
     if (io->io_type & EIO_TYPE_SOCK_STREAM) {
         evio_close(io);
     }
 }
 
 static void evio_handle_events(evio_t* io) {
+#ifdef OS_LINUX
+    if (io->zerocopy_wait) {
+        nio_zerocopy_reap(io);
+        if (io->closed) {
+            io->revents = 0;
+            return;
+        }
+    }
+#endif
     if ((io->events & EV_READ) && (io->revents & EV_READ)) {
         if (io->accept) {
             nio_accept(io);
@@ -403,11 +1099,14 @@ static void evio_handle_events(evio_t* io) {
 
     if ((io->events & EV_WRITE) && (io->revents & EV_WRITE)) {
         // NOTE: del EV_WRITE, if write_queue empty
-        recursive_mutex_lock(&io->write_mutex);
+        evio_write_lock(io);
         if (write_queue_empty(&io->write_queue)) {
             evio_del(io, EV_WRITE);
+            if (io->lean) {
+                write_queue_cleanup(&io->write_queue);
+            }
         }
-        recursive_mutex_unlock(&io->write_mutex);
+        evio_write_unlock(io);
         if (io->connect) {
             // NOTE: connect just do once
             // ONESHOT
@@ -428,7 +1127,7 @@ int evio_accept(evio_t* io) {
 }
 
 int evio_connect(evio_t* io) {
-    int ret = connect(io->fd, io->peeraddr, SU_ADDRLEN(io->peeraddr));
+    int ret = connect(io->fd, evio_peeraddr(io), SU_ADDRLEN(io->peeraddr));
 #ifdef OS_WIN
     if (ret < 0 && socket_errno() != WSAEWOULDBLOCK) {
 #else
@@ -444,9 +1143,10 @@ int evio_connect(evio_t* io) {
         nio_connect_async(io);
         return 0;
     }
-    int timeout = io->connect_timeout ? io->connect_timeout : EIO_DEFAULT_CONNECT_TIMEOUT;
-    io->connect_timer = evtimer_add(io->loop, __connect_timeout_cb, timeout, 1);
-    io->connect_timer->privdata = io;
+    struct evio_cold_s* cold = evio_cold(io);
+    int timeout = cold->connect_timeout ? cold->connect_timeout : EIO_DEFAULT_CONNECT_TIMEOUT;
+    cold->connect_timer = evtimer_add(io->loop, __connect_timeout_cb, timeout, 1);
+    cold->connect_timer->privdata = io;
     io->connect = 1;
     return evio_add(io, evio_handle_events, EV_WRITE);
 }
@@ -457,21 +1157,24 @@ int evio_read(evio_t* io) {
         return -1;
     }
     evio_add(io, evio_handle_events, EV_READ);
+    nio_update_rcvlowat(io);
     if (io->readbuf.tail > io->readbuf.head &&
-        io->unpack_setting == NULL &&
+        io->cold->unpack_setting == NULL &&
         io->read_flags == 0) {
         evio_read_remain(io);
     }
     return 0;
 }
 
-int evio_write(evio_t* io, const void* buf, size_t len) {
+// NOTE: ref == NULL means copy the remain, else enqueue a ref of buf.
+static int __evio_write(evio_t* io, const void* buf, size_t len, evbuf_t* ref) {
     if (io->closed) {
         log_error("evio_write called but fd[%d] already closed!", io->fd);
         return -1;
     }
     int nwrite = 0, err = 0;
-    recursive_mutex_lock(&io->write_mutex);
+    bool above_high = false;
+    evio_write_lock(io);
 #if WITH_KCP
     if (io->io_type == EIO_TYPE_KCP) {
         nwrite = evio_write_kcp(io, buf, len);
@@ -481,7 +1184,7 @@ int evio_write(evio_t* io, const void* buf, size_t len) {
 #endif
     if (write_queue_empty(&io->write_queue)) {
     try_write:
-        nwrite = __nio_write(io, buf, len);
+        nwrite = __nio_write_ref(io, buf, len, ref);
         // printd("write retval=%d\n", nwrite);
         if (nwrite < 0) {
             err = socket_errno();
@@ -510,17 +1213,25 @@ int evio_write(evio_t* io, const void* buf, size_t len) {
             // io->error = ERR_OVER_LIMIT;
             goto write_error;
         }
-        offset_buf_t remain;
+        write_buf_t remain;
         remain.len = len - nwrite;
         remain.offset = 0;
-        // NOTE: free in nio_write
-        EV_ALLOC(remain.base, remain.len);
-        memcpy(remain.base, ((char*)buf) + nwrite, remain.len);
+        // NOTE: unref in nio_write
+        if (ref) {
+            remain.ref = evbuf_ref(ref);
+            remain.base = (char*)buf + nwrite;
+        } else {
+            remain.ref = evloop_evbuf_alloc(io->loop, remain.len);
+            remain.base = remain.ref->base;
+            memcpy(remain.base, ((char*)buf) + nwrite, remain.len);
+        }
         if (io->write_queue.maxsize == 0) {
             write_queue_init(&io->write_queue, 4);
         }
         write_queue_push_back(&io->write_queue, &remain);
         io->write_bufsize += remain.len;
+        evloop_memory_add(io->loop, remain.len);
+        above_high = evio_write_cross_high(io);
         if (io->write_bufsize > WRITE_BUFSIZE_HIGH_WATER) {
             log_warn("write len=%d enqueue %u, bufsize=%u over high water %u",
                      len, (unsigned int)(remain.len - remain.offset),
@@ -529,14 +1240,17 @@ int evio_write(evio_t* io, const void* buf, size_t len) {
         }
     }
 write_done:
-    recursive_mutex_unlock(&io->write_mutex);
+    evio_write_unlock(io);
     if (nwrite > 0) {
         __write_cb(io, buf, nwrite);
     }
+    if (above_high && !io->closed) {
+        evio_write_watermark_cb(io, 1);
+    }
     return nwrite;
 write_error:
 disconnect:
-    recursive_mutex_unlock(&io->write_mutex);
+    evio_write_unlock(io);
     /* NOTE:
      * We usually free resources in hclose_cb,
      * if evio_close_sync, we have to be very careful to avoid using freed resources.
@@ -548,6 +1262,437 @@ disconnect:
     return nwrite < 0 ? nwrite : -1;
 }
 
+int evio_write(evio_t* io, const void* buf, size_t len) {
+    return __evio_write(io, buf, len, NULL);
+}
+
+int evio_write_ref(evio_t* io, evbuf_t* buf) {
+    return __evio_write(io, buf->base, buf->len, buf);
+}
+
+int evio_read_batch(evio_t* io, read_batch_cb read_batch_cb, int batch_size, int dgram_size) {
+    if (!(io->io_type & (EIO_TYPE_UDP | EIO_TYPE_IP)) || read_batch_cb == NULL || io->udp_gro) {
+        log_error("evio_read_batch only for udp/ip io without gro!");
+        return -1;
+    }
+    batch_size = LIMIT(1, batch_size, EIO_MAX_BATCH_SIZE);
+    if (dgram_size <= 0)
+        dgram_size = EIO_DEFAULT_DGRAM_SIZE;
+    struct evio_batch_s* batch = io->cold->batch;
+    if (batch == NULL || batch->size != batch_size || batch->dgram_size != dgram_size) {
+        EV_FREE(io->cold->batch);
+        size_t size = sizeof(struct evio_batch_s) + batch_size * (sizeof(evio_dgram_t) + sizeof(sockaddr_u));
+#ifdef OS_LINUX
+        size += batch_size * (sizeof(struct mmsghdr) + sizeof(struct iovec));
+#endif
+        EV_ALLOC(batch, size + (size_t)batch_size * dgram_size);
+        char* p = (char*)(batch + 1);
+        batch->dgrams = (evio_dgram_t*)p;
+        p += batch_size * sizeof(evio_dgram_t);
+        batch->addrs = (sockaddr_u*)p;
+        p += batch_size * sizeof(sockaddr_u);
+#ifdef OS_LINUX
+        batch->msgs = (struct mmsghdr*)p;
+        p += batch_size * sizeof(struct mmsghdr);
+        batch->iovs = (struct iovec*)p;
+        p += batch_size * sizeof(struct iovec);
+#endif
+        batch->bufs = p;
+        for (int i = 0; i < batch_size; ++i) {
+            batch->dgrams[i].buf = batch->bufs + (size_t)i * dgram_size;
+            batch->dgrams[i].addr = &batch->addrs[i].sa;
+#ifdef OS_LINUX
+            batch->iovs[i].iov_base = batch->dgrams[i].buf;
+            batch->iovs[i].iov_len = dgram_size;
+            batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+            batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+            batch->msgs[i].msg_hdr.msg_iovlen = 1;
+#endif
+        }
+        batch->size = batch_size;
+        batch->dgram_size = dgram_size;
+        evio_cold(io)->batch = batch;
+    }
+    batch->read_batch_cb = read_batch_cb;
+    return evio_read(io);
+}
+
+int evio_read_chain(evio_t* io, read_chain_cb read_chain_cb, int seg_size) {
+    unpack_setting_t* setting = io->cold->unpack_setting;
+    if (io->io_type != EIO_TYPE_TCP || (setting && setting->mode == UNPACK_BY_DELIMITER)) {
+        log_error("evio_read_chain only for tcp io without delimiter unpack!");
+        return -1;
+    }
+    // NOTE: varint of 10 bytes at most
+    if (setting && setting->mode == UNPACK_BY_LENGTH_FIELD && setting->body_offset + 10 > EIO_CHAIN_MAX_HEAD) {
+        log_error("evio_read_chain length field header over %d bytes!", EIO_CHAIN_MAX_HEAD);
+        return -1;
+    }
+    // NOTE: power of 2 as bufpool classes
+    seg_size = LIMIT(EVLOOP_BUFPOOL_MIN_SIZE, seg_size, (int)MAX_READ_BUFSIZE);
+    seg_size = 1 << (32 - __builtin_clz((unsigned int)seg_size - 1));
+    struct evio_chain_s* chain = io->cold->chain;
+    if (chain && chain->seg_size != seg_size) {
+        if (chain->len) {
+            log_error("evio_read_chain cannot change seg_size with pending bytes!");
+            return -1;
+        }
+        evio_chain_free(io);
+        chain = NULL;
+    }
+    if (chain == NULL) {
+        EV_ALLOC_SIZEOF(chain);
+        chain->seg_size = seg_size;
+        evio_cold(io)->chain = chain;
+    }
+    chain->read_chain_cb = read_chain_cb;
+    // NOTE: readbuf of evio_set_unpack not used any more, its unconsumed bytes go first.
+    size_t leftover = io->readbuf.tail - io->readbuf.head;
+    if (leftover) {
+        nio_chain_append(io->loop, chain, io->readbuf.base + io->readbuf.head, leftover);
+        io->readbuf.head = io->readbuf.tail = 0;
+    }
+    evio_free_readbuf(io);
+    if (leftover) {
+        nio_chain_unpack(io);
+        if (io->closed || io->cold->chain != chain)
+            return 0;
+    }
+    return evio_read(io);
+}
+
+size_t evio_iov_copy(const evio_iov_t* iov, int iovcnt, size_t offset, void* buf, size_t len) {
+    size_t copied = 0;
+    for (int i = 0; i < iovcnt && copied < len; ++i) {
+        if (offset >= iov[i].len) {
+            offset -= iov[i].len;
+            continue;
+        }
+        size_t n = MIN(iov[i].len - offset, len - copied);
+        memcpy((char*)buf + copied, (char*)iov[i].base + offset, n);
+        copied += n;
+        offset = 0;
+    }
+    return copied;
+}
+
+int evio_write_batch(evio_t* io, const evio_dgram_t* dgrams, int ndgrams) {
+    if (io->closed) {
+        log_error("evio_write_batch called but fd[%d] already closed!", io->fd);
+        return -1;
+    }
+    int nsent = 0, n = 0;
+    evio_write_lock(io);
+    while (nsent < ndgrams) {
+#ifdef OS_LINUX
+        struct mmsghdr msgs[EIO_DEFAULT_BATCH_SIZE];
+        struct iovec iovs[EIO_DEFAULT_BATCH_SIZE];
+        int cnt = MIN(ndgrams - nsent, EIO_DEFAULT_BATCH_SIZE);
+        memset(msgs, 0, sizeof(struct mmsghdr) * cnt);
+        for (int i = 0; i < cnt; ++i) {
+            const evio_dgram_t* dgram = &dgrams[nsent + i];
+            struct sockaddr* addr = dgram->addr ? dgram->addr : io->peeraddr;
+            iovs[i].iov_base = dgram->buf;
+            iovs[i].iov_len = dgram->len;
+            msgs[i].msg_hdr.msg_name = addr;
+            msgs[i].msg_hdr.msg_namelen = SU_ADDRLEN(addr);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        n = sendmmsg(io->fd, msgs, cnt, 0);
+#else
+        const evio_dgram_t* dgram = &dgrams[nsent];
+        struct sockaddr* addr = dgram->addr ? dgram->addr : io->peeraddr;
+        n = sendto(io->fd, dgram->buf, dgram->len, 0, addr, SU_ADDRLEN(addr)) < 0 ? -1 : 1;
+#endif
+        if (n <= 0)
+            break;
+        nsent += n;
+    }
+    evio_write_unlock(io);
+    if (nsent == 0 && n < 0 && socket_errno() != EAGAIN) {
+        io->error = socket_errno();
+        return -1;
+    }
+    if (nsent > 0) {
+        io->last_write_hrtime = io->loop->cur_hrtime;
+        for (int i = 0; i < nsent && io->write_cb; ++i) {
+            evio_write_cb(io, dgrams[i].buf, dgrams[i].len);
+        }
+    }
+    return nsent;
+}
+
+int evio_write_gso(evio_t* io, const void* buf, int len, int segment_size) {
+    if (io->closed) {
+        log_error("evio_write_gso called but fd[%d] already closed!", io->fd);
+        return -1;
+    }
+    if (segment_size <= 0 || segment_size > UDP_MAX_PAYLOAD) {
+        return -1;
+    }
+    // NOTE: kernel limits a GSO send to UDP_MAX_SEGMENTS segments of one datagram size.
+    int max_chunk = MIN(UDP_MAX_SEGMENTS, UDP_MAX_PAYLOAD / segment_size) * segment_size;
+    const char* p = (const char*)buf;
+    int nsent = 0, err = 0;
+#ifdef OS_LINUX
+    evio_write_lock(io);
+    while (nsent < len && !io->udp_nogso) {
+        int chunk = MIN(len - nsent, max_chunk);
+        struct iovec iov = {(void*)(p + nsent), chunk};
+        char control[CMSG_SPACE(sizeof(uint16_t))];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = io->peeraddr;
+        msg.msg_namelen = SU_ADDRLEN(io->peeraddr);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if (chunk > segment_size) {
+            memset(control, 0, sizeof(control));
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso_size = segment_size;
+            memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+        }
+        if (sendmsg(io->fd, &msg, 0) < 0) {
+            err = socket_errno();
+            if (err == EINVAL || err == EIO || err == ENOPROTOOPT || err == EOPNOTSUPP) {
+                // NOTE: no UDP_SEGMENT support, evio_write_batch the remain
+                log_warn("UDP_SEGMENT failed: %s, fallback to sendmmsg", strerror(err));
+                io->udp_nogso = 1;
+                err = 0;
+            }
+            break;
+        }
+        nsent += chunk;
+    }
+    evio_write_unlock(io);
+#else
+    io->udp_nogso = 1;
+#endif
+    if (io->udp_nogso && err == 0) {
+        evio_dgram_t dgrams[UDP_MAX_SEGMENTS];
+        while (nsent < len) {
+            int n = 0, chunk = 0;
+            for (; n < UDP_MAX_SEGMENTS && nsent + chunk < len; ++n) {
+                dgrams[n].buf = (void*)(p + nsent + chunk);
+                dgrams[n].len = MIN(segment_size, len - nsent - chunk);
+                dgrams[n].addr = NULL;
+                chunk += dgrams[n].len;
+            }
+            int nwrite = evio_write_batch(io, dgrams, n);
+            if (nwrite < 0)
+                return nsent ? nsent : -1;
+            for (int i = 0; i < nwrite; ++i) {
+                nsent += dgrams[i].len;
+            }
+            if (nwrite < n)
+                break;
+        }
+        return nsent;
+    }
+    if (nsent == 0 && err != 0 && err != EAGAIN) {
+        io->error = err;
+        return -1;
+    }
+    if (nsent > 0) {
+        io->last_write_hrtime = io->loop->cur_hrtime;
+        evio_write_cb(io, buf, nsent);
+    }
+    return nsent;
+}
+
+int evio_set_udp_gro(evio_t* io, int on) {
+    if (!(io->io_type & EIO_TYPE_UDP) || io->cold->batch || io->cold->unpack_setting) {
+        log_error("evio_set_udp_gro only for udp io without batch or unpack!");
+        return -1;
+    }
+#if defined(OS_LINUX) && defined(SOL_UDP)
+    if (setsockopt(io->fd, SOL_UDP, UDP_GRO, &on, sizeof(on)) < 0) {
+        return -1;
+    }
+    io->udp_gro = on ? 1 : 0;
+    // NOTE: a coalesced datagram is up to 64K
+    if (on && (evio_is_loop_readbuf(io) || io->readbuf.len < UDP_MAX_PAYLOAD)) {
+        evio_alloc_readbuf(io, 65536);
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int evio_set_auto_rcvlowat(evio_t* io, int on) {
+    if (io->io_type != EIO_TYPE_TCP) {
+        log_error("evio_set_auto_rcvlowat only for tcp io!");
+        return -1;
+    }
+    io->no_rcvlowat = on ? 0 : 1;
+    nio_update_rcvlowat(io);
+    return 0;
+}
+
+int evio_set_zerocopy(evio_t* io, uint32_t threshold) {
+    if (io->io_type != EIO_TYPE_TCP) {
+        log_error("evio_set_zerocopy only for tcp io!");
+        return -1;
+    }
+#if defined(OS_LINUX) && (defined(EVENT_EPOLL) || defined(EVENT_IOURING))
+    int on = threshold ? 1 : 0;
+    if (on && setsockopt(io->fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) < 0) {
+        return -1;
+    }
+    // NOTE: SO_ZEROCOPY stays on, sends without MSG_ZEROCOPY are not affected.
+    evio_cold(io)->zerocopy_threshold = threshold;
+    io->zerocopy = on;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+#ifdef OS_LINUX
+struct evio_splice_s {
+    int pipefd[2];
+    size_t pending; // bytes in pipe
+};
+
+static struct evio_splice_s* evio_splice_new() {
+    struct evio_splice_s* sp;
+    EV_ALLOC_SIZEOF(sp);
+    if (pipe2(sp->pipefd, O_NONBLOCK | O_CLOEXEC) != 0) {
+        EV_FREE(sp);
+        return NULL;
+    }
+    // NOTE: bigger pipe, fewer syscalls, ignore failure.
+    fcntl(sp->pipefd[1], F_SETPIPE_SZ, EVIO_SPLICE_PIPE_SIZE);
+    return sp;
+}
+
+// @return false if src or dst closed
+static bool nio_splice_flush(evio_t* src, evio_t* dst) {
+    struct evio_splice_s* sp = src->cold->splice;
+    while (sp->pending) {
+        ssize_t n = splice(sp->pipefd[0], NULL, dst->fd, NULL, sp->pending, SPLICE_F_NONBLOCK | SPLICE_F_MOVE);
+        if (n < 0) {
+            if (socket_errno() == EAGAIN) {
+                // NOTE: backpressure, stop reading src until dst writable.
+                evio_del(src, EV_READ);
+                evio_add(dst, (evio_cb)dst->cb, EV_WRITE);
+                return true;
+            }
+            dst->error = socket_errno();
+            evio_close(dst);
+            return false;
+        }
+        sp->pending -= n;
+        dst->last_write_hrtime = dst->loop->cur_hrtime;
+    }
+    return true;
+}
+
+// src->fd => pipe => dst->fd until EAGAIN, pipe full or budget exhausted.
+static void nio_splice(evio_t* src, evio_t* dst) {
+    struct evio_splice_s* sp = src->cold->splice;
+    const evio_budget_t* budget = evio_budget(src);
+    for (uint32_t cnt = 0; !evio_budget_spent(budget->reads, cnt, 0, 0); ++cnt) {
+        if (!nio_splice_flush(src, dst) || sp->pending)
+            return;
+        ssize_t n = splice(src->fd, NULL, sp->pipefd[1], NULL, EVIO_SPLICE_PIPE_SIZE, SPLICE_F_NONBLOCK | SPLICE_F_MOVE);
+        if (n < 0) {
+            if (socket_errno() == EAGAIN)
+                return;
+            src->error = socket_errno();
+            evio_close(src);
+            return;
+        }
+        if (n == 0) {
+            // EOF, evio_close_upstream closes dst
+            evio_close(src);
+            return;
+        }
+        sp->pending = n;
+        src->last_read_hrtime = src->loop->cur_hrtime;
+    }
+    // NOTE: src may not be polled again, flush or arm EV_WRITE of dst for the last chunk.
+    if (!nio_splice_flush(src, dst))
+        return;
+    ++src->loop->fairness_stats.read_exhausted;
+    if (evio_is_edge_triggered(src)) {
+        evio_ready_again(src, EV_READ);
+    }
+}
+
+static void nio_splice_handle_events(evio_t* io) {
+    evio_t* upstream_io = io->cold->upstream_io;
+    int revents = io->revents;
+    io->revents = 0;
+    if (upstream_io == NULL || io->closed)
+        return;
+    if ((revents & EV_WRITE) && (io->events & EV_WRITE)) {
+        // flush upstream pipe, then read upstream again
+        if (!nio_splice_flush(upstream_io, io))
+            return;
+        if (upstream_io->cold->splice->pending == 0) {
+            evio_del(io, EV_WRITE);
+            evio_add(upstream_io, (evio_cb)upstream_io->cb, EV_READ);
+            nio_splice(upstream_io, io);
+        }
+    }
+    if ((revents & EV_READ) && (io->events & EV_READ) && !io->closed && !upstream_io->closed) {
+        nio_splice(io, upstream_io);
+    }
+}
+#endif
+
+int evio_read_upstream_splice(evio_t* io) {
+#ifdef OS_LINUX
+    evio_t* upstream_io = io->cold->upstream_io;
+    if (upstream_io == NULL)
+        return -1;
+#ifdef EVENT_IOURING
+    // NOTE: io_uring reads tcp by multishot recv, which races with splice.
+    if (iouring_enabled(io->loop))
+        return -1;
+#endif
+    if (io->cold->splice == NULL && (io->cold->splice = evio_splice_new()) == NULL)
+        return -1;
+    if (upstream_io->cold->splice == NULL && (upstream_io->cold->splice = evio_splice_new()) == NULL)
+        return -1;
+    evio_add(io, nio_splice_handle_events, EV_READ);
+    evio_add(upstream_io, nio_splice_handle_events, EV_READ);
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+void evio_splice_free(evio_t* io) {
+#ifdef OS_LINUX
+    if (io->cold->splice) {
+        close(io->cold->splice->pipefd[0]);
+        close(io->cold->splice->pipefd[1]);
+        EV_FREE(io->cold->splice);
+    }
+#endif
+}
+
+void evio_chain_free(evio_t* io) {
+    struct evio_chain_s* chain = io->cold->chain;
+    if (chain == NULL)
+        return;
+    io->cold->chain = NULL;
+    if (chain->delivering) {
+        chain->orphan = 1;
+        return;
+    }
+    nio_chain_release(io->loop, chain);
+}
+
 int evio_close(evio_t* io) {
     if (io->closed)
         return 0;
@@ -555,36 +1700,69 @@ int evio_close(evio_t* io) {
         return evio_close_async(io);
     }
 
-    recursive_mutex_lock(&io->write_mutex);
+    evio_write_lock(io);
     if (io->closed) {
-        recursive_mutex_unlock(&io->write_mutex);
+        evio_write_unlock(io);
         return 0;
     }
-    if (!write_queue_empty(&io->write_queue) && io->error == 0 && io->close == 0) {
+    if ((!write_queue_empty(&io->write_queue) || io->zerocopy_wait) && io->error == 0 && io->close == 0) {
         io->close = 1;
-        recursive_mutex_unlock(&io->write_mutex);
-        log_warn("write_queue not empty, close later.");
-        int timeout_ms = io->close_timeout ? io->close_timeout : EIO_DEFAULT_CLOSE_TIMEOUT;
-        io->close_timer = evtimer_add(io->loop, __close_timeout_cb, timeout_ms, 1);
-        io->close_timer->privdata = io;
+        evio_write_unlock(io);
+        log_warn("write_queue not empty or zerocopy sends not completed, close later.");
+        struct evio_cold_s* cold = evio_cold(io);
+        int timeout_ms = cold->close_timeout ? cold->close_timeout : EIO_DEFAULT_CLOSE_TIMEOUT;
+        cold->close_timer = evtimer_add(io->loop, __close_timeout_cb, timeout_ms, 1);
+        cold->close_timer->privdata = io;
         return 0;
     }
     io->closed = 1;
-    recursive_mutex_unlock(&io->write_mutex);
+    evio_write_unlock(io);
+    // NOTE: taken before evio_done, resumed once fd closed.
+    struct evco_s* co_reader = io->cold->co_reader;
+    struct evco_s* co_writer = io->cold->co_writer;
+    if (co_reader || co_writer) {
+        io->cold->co_reader = io->cold->co_writer = NULL;
+    }
 
+#ifdef OS_LINUX
+    struct zerocopy_queue zerocopy_pending;
+    memset(&zerocopy_pending, 0, sizeof(zerocopy_pending));
+    if (io->zerocopy_wait) {
+        // NOTE: the last chance, then RST on close drops the send queue, so the kernel
+        // sends no more from what is still pending, released once fd closed.
+        nio_zerocopy_reap(io);
+        if (io->zerocopy_wait) {
+            so_linger(io->fd, 0);
+            zerocopy_pending = io->cold->zerocopy_pending;
+            memset(&io->cold->zerocopy_pending, 0, sizeof(zerocopy_pending));
+        }
+    }
+#endif
     evio_done(io);
     __close_cb(io);
-    if (io->ssl) {
-        // hssl_free(io->ssl);
-        // io->ssl = NULL;
+    if (io->cold->ssl) {
+        // hssl_free(io->cold->ssl);
+        // io->cold->ssl = NULL;
+    }
+    if (io->cold->ssl_ctx && io->alloced_ssl_ctx) {
+        // hssl_ctx_free(io->cold->ssl_ctx);
+        // io->cold->ssl_ctx = NULL;
     }
-    if (io->ssl_ctx && io->alloced_ssl_ctx) {
-        // hssl_ctx_free(io->ssl_ctx);
-        // io->ssl_ctx = NULL;
+    SAFE_FREE(io->cold->hostname);
+    // NOTE: closed lean io keeps no cold fields, reads evio_cold_none until reused.
+    if (io->lean) {
+        evio_cold_free(io);
     }
-    SAFE_FREE(io->hostname);
     if (io->io_type & EIO_TYPE_SOCKET) {
         closesocket(io->fd);
     }
+#ifdef OS_LINUX
+    if (zerocopy_pending.maxsize) {
+        nio_zerocopy_release(io->loop, &zerocopy_pending);
+    }
+#endif
+    if (co_reader || co_writer) {
+        evio_co_close(co_reader, co_writer);
+    }
     return 0;
 }
@@ -2,8 +2,123 @@
 #include "errors.h"
 #include "event.h"
 
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define UNPACK_SCAN_X86
+#include <immintrin.h>
+#endif
+
+typedef const unsigned char* (*unpack_scan_fn)(const unsigned char* p, const unsigned char* ep,
+                                               const unsigned char* delimiter, int delimiter_bytes);
+
+static const unsigned char* unpack_scan_scalar(const unsigned char* p, const unsigned char* ep,
+                                               const unsigned char* delimiter, int delimiter_bytes) {
+    int i = 0;
+    for (; ep - p >= delimiter_bytes; ++p) {
+        for (i = 0; i < delimiter_bytes; ++i) {
+            if (p[i] != delimiter[i])
+                break;
+        }
+        if (i == delimiter_bytes)
+            return p;
+    }
+    return NULL;
+}
+
+#ifdef UNPACK_SCAN_X86
+// NOTE: compare first and last byte of delimiter at 16/32 positions at once,
+// then verify the middle bytes of candidates.
+__attribute__((target("sse2"))) static const unsigned char* unpack_scan_sse2(const unsigned char* p,
+                                                                            const unsigned char* ep,
+                                                                            const unsigned char* delimiter,
+                                                                            int delimiter_bytes) {
+    const __m128i first = _mm_set1_epi8((char)delimiter[0]);
+    const __m128i last = _mm_set1_epi8((char)delimiter[delimiter_bytes - 1]);
+    while (ep - p >= 16 + delimiter_bytes - 1) {
+        __m128i b0 = _mm_loadu_si128((const __m128i*)p);
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(p + delimiter_bytes - 1));
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(b0, first), _mm_cmpeq_epi8(b1, last)));
+        while (mask) {
+            int i = __builtin_ctz(mask);
+            if (delimiter_bytes <= 2 || memcmp(p + i + 1, delimiter + 1, delimiter_bytes - 2) == 0)
+                return p + i;
+            mask &= mask - 1;
+        }
+        p += 16;
+    }
+    return unpack_scan_scalar(p, ep, delimiter, delimiter_bytes);
+}
+
+__attribute__((target("avx2"))) static const unsigned char* unpack_scan_avx2(const unsigned char* p,
+                                                                            const unsigned char* ep,
+                                                                            const unsigned char* delimiter,
+                                                                            int delimiter_bytes) {
+    const __m256i first = _mm256_set1_epi8((char)delimiter[0]);
+    const __m256i last = _mm256_set1_epi8((char)delimiter[delimiter_bytes - 1]);
+    while (ep - p >= 32 + delimiter_bytes - 1) {
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)p);
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(p + delimiter_bytes - 1));
+        unsigned int mask =
+            (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(b0, first), _mm256_cmpeq_epi8(b1, last)));
+        while (mask) {
+            int i = __builtin_ctz(mask);
+            if (delimiter_bytes <= 2 || memcmp(p + i + 1, delimiter + 1, delimiter_bytes - 2) == 0)
+                return p + i;
+            mask &= mask - 1;
+        }
+        p += 32;
+    }
+    return unpack_scan_sse2(p, ep, delimiter, delimiter_bytes);
+}
+#endif
+
+static int s_scan_level = -1;
+static unpack_scan_fn s_scan = NULL;
+
+static unpack_scan_fn unpack_scan_fn_of(int level) {
+    switch (level) {
+    case UNPACK_SCAN_SCALAR:
+        return unpack_scan_scalar;
+#ifdef UNPACK_SCAN_X86
+    case UNPACK_SCAN_SSE2:
+        return __builtin_cpu_supports("sse2") ? unpack_scan_sse2 : NULL;
+    case UNPACK_SCAN_AVX2:
+        return __builtin_cpu_supports("avx2") ? unpack_scan_avx2 : NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+int unpack_set_scan_level(int level) {
+    unpack_scan_fn fn = unpack_scan_fn_of(level);
+    if (fn == NULL)
+        return -1;
+    s_scan_level = level;
+    s_scan = fn;
+    return 0;
+}
+
+int unpack_scan_level() {
+    if (s_scan == NULL) {
+        // NOTE: racing first callers select the same one.
+        int level = UNPACK_SCAN_AVX2;
+        while (unpack_set_scan_level(level) != 0) {
+            --level;
+        }
+    }
+    return s_scan_level;
+}
+
+const unsigned char* unpack_find_delimiter(const unsigned char* p, const unsigned char* ep,
+                                           const unsigned char* delimiter, int delimiter_bytes) {
+    if (s_scan == NULL) {
+        unpack_scan_level();
+    }
+    return s_scan(p, ep, delimiter, delimiter_bytes);
+}
+
 int evio_unpack(evio_t* io, void* buf, int readbytes) {
-    unpack_setting_t* setting = io->unpack_setting;
+    unpack_setting_t* setting = io->cold->unpack_setting;
     switch (setting->mode) {
     case UNPACK_BY_FIXED_LENGTH:
         return evio_unpack_by_fixed_length(io, buf, readbytes);
@@ -20,7 +135,7 @@ int evio_unpack(evio_t* io, void* buf, int readbytes) {
 int evio_unpack_by_fixed_length(evio_t* io, void* buf, int readbytes) {
     const unsigned char* sp = (const unsigned char*)io->readbuf.base + io->readbuf.head;
     const unsigned char* ep = (const unsigned char*)buf + readbytes;
-    unpack_setting_t* setting = io->unpack_setting;
+    unpack_setting_t* setting = io->cold->unpack_setting;
 
     int fixed_length = setting->fixed_length;
     assert(io->readbuf.len >= fixed_length);
@@ -50,36 +165,24 @@ int evio_unpack_by_fixed_length(evio_t* io, void* buf, int readbytes) {
 int evio_unpack_by_delimiter(evio_t* io, void* buf, int readbytes) {
     const unsigned char* sp = (const unsigned char*)io->readbuf.base + io->readbuf.head;
     const unsigned char* ep = (const unsigned char*)buf + readbytes;
-    unpack_setting_t* setting = io->unpack_setting;
+    unpack_setting_t* setting = io->cold->unpack_setting;
 
     unsigned char* delimiter = setting->delimiter;
     int delimiter_bytes = setting->delimiter_bytes;
 
+    // NOTE: [sp, buf) was scanned by last call, only its tail may begin a delimiter.
     const unsigned char* p = (const unsigned char*)buf - delimiter_bytes + 1;
     if (p < sp)
         p = sp;
-    int remain = ep - p;
     int handled = 0;
-    int i = 0;
-    while (remain >= delimiter_bytes) {
-        for (i = 0; i < delimiter_bytes; ++i) {
-            if (p[i] != delimiter[i]) {
-                goto not_match;
-            }
-        }
-    match:
+    while ((p = unpack_find_delimiter(p, ep, delimiter, delimiter_bytes)) != NULL) {
         p += delimiter_bytes;
-        remain -= delimiter_bytes;
         evio_read_cb(io, (void*)sp, p - sp);
         handled += p - sp;
         sp = p;
-        continue;
-    not_match:
-        ++p;
-        --remain;
     }
 
-    remain = ep - sp;
+    int remain = ep - sp;
     io->readbuf.head = 0;
     io->readbuf.tail = remain;
     if (remain) {
@@ -102,43 +205,50 @@ int evio_unpack_by_delimiter(evio_t* io, void* buf, int readbytes) {
     return handled;
 }
 
+long long unpack_length_field(unpack_setting_t* setting, const unsigned char* p, int len) {
+    if (len < setting->body_offset)
+        return 0;
+    unsigned int head_len = setting->body_offset;
+    unsigned int body_len = 0;
+    const unsigned char* lp = p + setting->length_field_offset;
+    if (setting->length_field_coding == BIG_ENDIAN) {
+        for (int i = 0; i < setting->length_field_bytes; ++i) {
+            body_len = (body_len << 8) | (unsigned int)*lp++;
+        }
+    } else if (setting->length_field_coding == LITTLE_ENDIAN) {
+        for (int i = 0; i < setting->length_field_bytes; ++i) {
+            body_len |= ((unsigned int)*lp++) << (i * 8);
+        }
+    } else if (setting->length_field_coding == ENCODE_BY_VARINT) {
+        int varint_bytes = p + len - lp;
+        body_len = varint_decode(lp, &varint_bytes);
+        if (varint_bytes == 0)
+            return 0;
+        if (varint_bytes == -1)
+            return -1;
+        head_len = setting->body_offset + varint_bytes - setting->length_field_bytes;
+    }
+    return (unsigned int)(head_len + body_len + setting->length_adjustment);
+}
+
 int evio_unpack_by_length_field(evio_t* io, void* buf, int readbytes) {
     const unsigned char* sp = (const unsigned char*)io->readbuf.base + io->readbuf.head;
     const unsigned char* ep = (const unsigned char*)buf + readbytes;
-    unpack_setting_t* setting = io->unpack_setting;
+    unpack_setting_t* setting = io->cold->unpack_setting;
 
     const unsigned char* p = sp;
     int remain = ep - p;
     int handled = 0;
-    unsigned int head_len = setting->body_offset;
-    unsigned int body_len = 0;
-    unsigned int package_len = head_len;
-    const unsigned char* lp = NULL;
-    while (remain >= setting->body_offset) {
-        body_len = 0;
-        lp = p + setting->length_field_offset;
-        if (setting->length_field_coding == BIG_ENDIAN) {
-            for (int i = 0; i < setting->length_field_bytes; ++i) {
-                body_len = (body_len << 8) | (unsigned int)*lp++;
-            }
-        } else if (setting->length_field_coding == LITTLE_ENDIAN) {
-            for (int i = 0; i < setting->length_field_bytes; ++i) {
-                body_len |= ((unsigned int)*lp++) << (i * 8);
-            }
-        } else if (setting->length_field_coding == ENCODE_BY_VARINT) {
-            int varint_bytes = ep - lp;
-            body_len = varint_decode(lp, &varint_bytes);
-            if (varint_bytes == 0)
-                break;
-            if (varint_bytes == -1) {
-                // hloge("varint is too big!");
-                io->error = ERR_OVER_LIMIT;
-                evio_close(io);
-                return -1;
-            }
-            head_len = setting->body_offset + varint_bytes - setting->length_field_bytes;
+    unsigned int package_len = setting->body_offset;
+    long long n = 0;
+    while ((n = unpack_length_field(setting, p, remain)) != 0) {
+        if (n < 0) {
+            // hloge("varint is too big!");
+            io->error = ERR_OVER_LIMIT;
+            evio_close(io);
+            return -1;
         }
-        package_len = head_len + body_len + setting->length_adjustment;
+        package_len = n;
         if (remain >= package_len) {
             evio_read_cb(io, (void*)p, package_len);
             handled += package_len;
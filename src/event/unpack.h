@@ -7,5 +7,20 @@ int evio_unpack(evio_t* io, void* buf, int readbytes);
 int evio_unpack_by_fixed_length(evio_t* io, void* buf, int readbytes);
 int evio_unpack_by_delimiter(evio_t* io, void* buf, int readbytes);
 int evio_unpack_by_length_field(evio_t* io, void* buf, int readbytes);
+// @return package length of the frame at p, 0 if [p, p+len) is too short to decode it, -1 if varint is too big
+long long unpack_length_field(unpack_setting_t* setting, const unsigned char* p, int len);
+
+// delimiter scanner, the best one supported by cpu is selected at first use.
+typedef enum {
+    UNPACK_SCAN_SCALAR = 0,
+    UNPACK_SCAN_SSE2 = 1,
+    UNPACK_SCAN_AVX2 = 2,
+} unpack_scan_e;
+// @return first delimiter in [p, ep), NULL if not found
+const unsigned char* unpack_find_delimiter(const unsigned char* p, const unsigned char* ep,
+                                           const unsigned char* delimiter, int delimiter_bytes);
+int unpack_scan_level();
+// @return -1 if unsupported by cpu
+int unpack_set_scan_level(int level);
 
 #endif // EV_UNPACK_H_
@@ -93,6 +93,14 @@ int so_reuseport(int sockfd, int on) {
                       sizeof(int));
 }
 
+int so_busy_poll(int sockfd, int us) {
+#ifdef SO_BUSY_POLL
+    return setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(int));
+#else
+    return -10;
+#endif
+}
+
 int so_setfilter(int sockfd, struct sock_fprog fprog) {
     return setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog));
 }
@@ -40,6 +40,10 @@ int so_reuseaddr(int sockfd, int on);
 
 int so_reuseport(int sockfd, int on);
 
+// Linux only, busy poll the device queue for up to us microseconds
+// on blocking reads, raising it above net.core.busy_read needs CAP_NET_ADMIN.
+int so_busy_poll(int sockfd, int us);
+
 int so_setfilter(int sockfd, struct sock_fprog fprog);
 
 // Set or receive the Type-Of-Service (TOS) field that is
@@ -59,6 +59,31 @@ int main(void) {
         // cmocka_unit_test(test_color),
         // cmocka_unit_test(test_socket),
         // cmocka_unit_test(test_sockopt),
+        // cmocka_unit_test(test_evloop_group),
+        // cmocka_unit_test(test_io_uring),
+        // cmocka_unit_test(test_epoll_et),
+        // cmocka_unit_test(test_timewheel),
+        // cmocka_unit_test(test_post_event),
+        // cmocka_unit_test(test_write_ref),
+        // cmocka_unit_test(test_bufpool),
+        // cmocka_unit_test(test_udp_batch),
+        // cmocka_unit_test(test_udp_gso),
+        // cmocka_unit_test(test_splice_upstream),
+        // cmocka_unit_test(test_loop_stats),
+        // cmocka_unit_test(test_busy_poll),
+        // cmocka_unit_test(test_unpack_scan),
+        // cmocka_unit_test(test_coroutine),
+        // cmocka_unit_test(test_queue_work),
+        // cmocka_unit_test(test_write_watermarks),
+        // cmocka_unit_test(test_memory_budget),
+        // cmocka_unit_test(test_timer_slack),
+        // cmocka_unit_test(test_hrtimer),
+        // cmocka_unit_test(test_lean_evio),
+        // cmocka_unit_test(test_zerocopy),
+        // cmocka_unit_test(test_read_chain),
+        // cmocka_unit_test(test_rcvlowat),
+        // cmocka_unit_test(test_io_budget),
+        // cmocka_unit_test(test_evdns),
         cmocka_unit_test(test_linenoise),
     };
 
@@ -99,5 +99,30 @@ void test_ncurses();
 void test_socket();
 void test_sockopt();
 void test_linenoise();
+void test_evloop_group();
+void test_io_uring();
+void test_epoll_et();
+void test_timewheel();
+void test_post_event();
+void test_write_ref();
+void test_bufpool();
+void test_udp_batch();
+void test_udp_gso();
+void test_splice_upstream();
+void test_loop_stats();
+void test_busy_poll();
+void test_unpack_scan();
+void test_coroutine();
+void test_queue_work();
+void test_write_watermarks();
+void test_memory_budget();
+void test_timer_slack();
+void test_hrtimer();
+void test_lean_evio();
+void test_zerocopy();
+void test_read_chain();
+void test_rcvlowat();
+void test_io_budget();
+void test_evdns();
 
 #endif // !TEST_H
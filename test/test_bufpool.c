@@ -0,0 +1,173 @@
+#include "base.h"
+#include "eventloop.h"
+#include "socket.h"
+#include "sockopt.h"
+#include "sockunion.h"
+#include "test.h"
+#include "thread.h"
+
+#define TEST_CHUNK      (64 << 10) // 64K per request
+#define TEST_SOCKBUF    (16 << 10) // small socket buffers, so echoes are queued
+#define TEST_CONNS      8
+#define TEST_WARMUP     100
+#define TEST_ROUNDS     200
+
+// NOTE: override libc malloc family to count every allocation in the process
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+static atomic_int s_counting = ATOMIC_VAR_INIT(0);
+static atomic_long s_mallocs = ATOMIC_VAR_INIT(0);
+
+void* malloc(size_t size) {
+    if (s_counting) ++s_mallocs;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size) {
+    if (s_counting) ++s_mallocs;
+    return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    if (s_counting) ++s_mallocs;
+    return __libc_realloc(ptr, size);
+}
+
+static int s_echo_port = 0;
+static sockaddr_u s_echo_addr;
+static sockaddr_u s_proxy_addr;
+static atomic_int s_echo_closed = ATOMIC_VAR_INIT(0);
+
+static void on_echo(evio_t* io, void* buf, int readbytes) {
+    evio_write(io, buf, readbytes);
+    evio_readbytes(io, TEST_CHUNK);
+}
+
+static void on_echo_close(evio_t* io) { ++s_echo_closed; }
+
+static void on_echo_accept(evio_t* io) {
+    so_sndbuf(evio_fd(io), TEST_SOCKBUF);
+    evio_setcb_read(io, on_echo);
+    evio_setcb_close(io, on_echo_close);
+    // NOTE: read_until_length allocates readbuf from loop->bufpool
+    evio_readbytes(io, TEST_CHUNK);
+}
+
+static void on_proxy_accept(evio_t* io) {
+    so_sndbuf(evio_fd(io), TEST_SOCKBUF);
+    evio_setup_tcp_upstream(io, LOCALHOST, s_echo_port, 0, 0);
+}
+
+static THREAD_ROUTINE(loop_thread) {
+    evloop_run((evloop_t*)userdata);
+    return NULL;
+}
+
+static void listen_addr(evio_t* listenio, sockaddr_u* addr) {
+    socklen_t addrlen = sizeof(*addr);
+    getsockname(evio_fd(listenio), &addr->sa, &addrlen);
+}
+
+static int connect_addr(sockaddr_u* addr) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    so_rcvbuf(fd, TEST_SOCKBUF);
+    assert(connect(fd, &addr->sa, sizeof(addr->sin)) == 0);
+    return fd;
+}
+
+static void request(int fd, char* sendbuf, char* recvbuf, int seq) {
+    memset(sendbuf, seq, TEST_CHUNK);
+    assert(writen(fd, sendbuf, TEST_CHUNK) == TEST_CHUNK);
+    assert(readn(fd, recvbuf, TEST_CHUNK) == TEST_CHUNK);
+    assert(memcmp(sendbuf, recvbuf, TEST_CHUNK) == 0);
+}
+
+// echo: connect, request, close every round
+static void echo_rounds(int rounds, char* sendbuf, char* recvbuf) {
+    for (int i = 0; i < rounds; ++i) {
+        int fd = connect_addr(&s_echo_addr);
+        request(fd, sendbuf, recvbuf, i);
+        close(fd);
+    }
+}
+
+// NOTE: closes of the loop may lag behind, wait so they are counted in echo rounds
+static void wait_echo_closed(int n) {
+    while (s_echo_closed < n) {
+        ev_msleep(1);
+    }
+}
+
+// proxy: long-lived connections through evio_setup_tcp_upstream
+static void proxy_rounds(int* fds, int rounds, char* sendbuf, char* recvbuf) {
+    for (int i = 0; i < rounds; ++i) {
+        request(fds[i % TEST_CONNS], sendbuf, recvbuf, i);
+    }
+}
+
+static void print_stats(evloop_t* loop) {
+    evloop_bufpool_stats_t stats[EVLOOP_BUFPOOL_CLASSES];
+    int n = evloop_bufpool_stats(loop, stats);
+    for (int i = 0; i < n; ++i) {
+        if (stats[i].hits || stats[i].misses) {
+            printf("bufpool %zuK: hits=%llu misses=%llu inuse=%u high=%u free=%u\n", stats[i].size >> 10,
+                   (unsigned long long)stats[i].hits, (unsigned long long)stats[i].misses, stats[i].inuse,
+                   stats[i].inuse_high, stats[i].nfree);
+        }
+    }
+}
+
+void test_bufpool() {
+    evloop_t* loop = evloop_new(0);
+    evio_t* echoio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_echo_accept);
+    evio_t* proxyio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_proxy_accept);
+    assert(echoio != NULL && proxyio != NULL);
+    listen_addr(echoio, &s_echo_addr);
+    listen_addr(proxyio, &s_proxy_addr);
+    s_echo_port = ntohs(s_echo_addr.sin.sin_port);
+    thread_t th = thread_create(loop_thread, loop);
+
+    char* sendbuf = (char*)malloc(TEST_CHUNK);
+    char* recvbuf = (char*)malloc(TEST_CHUNK);
+    int fds[TEST_CONNS];
+    for (int i = 0; i < TEST_CONNS; ++i) {
+        fds[i] = connect_addr(&s_proxy_addr);
+    }
+
+    // warm up the pools, then steady state must not malloc at all.
+    echo_rounds(TEST_WARMUP, sendbuf, recvbuf);
+    wait_echo_closed(TEST_WARMUP);
+    proxy_rounds(fds, TEST_WARMUP, sendbuf, recvbuf);
+    long allocs = ev_alloc_cnt();
+    s_mallocs = 0;
+    s_counting = 1;
+    echo_rounds(TEST_ROUNDS, sendbuf, recvbuf);
+    wait_echo_closed(TEST_WARMUP + TEST_ROUNDS);
+    s_counting = 0;
+    long echo_mallocs = s_mallocs;
+    s_mallocs = 0;
+    s_counting = 1;
+    proxy_rounds(fds, TEST_ROUNDS, sendbuf, recvbuf);
+    s_counting = 0;
+    long proxy_mallocs = s_mallocs;
+    printf("echo: rounds=%d mallocs=%ld\n", TEST_ROUNDS, echo_mallocs);
+    printf("proxy: rounds=%d mallocs=%ld\n", TEST_ROUNDS, proxy_mallocs);
+    printf("ev_alloc_cnt: %ld\n", ev_alloc_cnt() - allocs);
+
+    for (int i = 0; i < TEST_CONNS; ++i) {
+        close(fds[i]);
+    }
+    evloop_stop(loop);
+    thread_join(th, NULL);
+    print_stats(loop);
+    evloop_free(&loop);
+    free(sendbuf);
+    free(recvbuf);
+#ifdef EVENT_IOURING
+    // NOTE: peer closed while sendmsg in flight, evio_close allocates a close timer for at most each connection.
+    assert(echo_mallocs <= TEST_ROUNDS && proxy_mallocs == 0);
+#else
+    assert(echo_mallocs == 0 && proxy_mallocs == 0);
+#endif
+}
@@ -0,0 +1,78 @@
+#include <netinet/tcp.h>
+
+#include "base.h"
+#include "datetime.h"
+#include "eventloop.h"
+#include "socket.h"
+#include "sockunion.h"
+#include "test.h"
+#include "thread.h"
+
+#define TEST_WARMUP 1000
+#define TEST_PINGS  20000
+#define TEST_MSG    64
+
+static void on_echo(evio_t* io, void* buf, int readbytes) {
+    evio_write(io, buf, readbytes);
+}
+
+static void on_accept(evio_t* io) {
+    int on = 1;
+    setsockopt(evio_fd(io), IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    evio_setcb_read(io, on_echo);
+    evio_read(io);
+}
+
+static THREAD_ROUTINE(loop_thread) {
+    evloop_run((evloop_t*)userdata);
+    return NULL;
+}
+
+static int cmp_u64(const void* lhs, const void* rhs) {
+    uint64_t l = *(const uint64_t*)lhs, r = *(const uint64_t*)rhs;
+    return l < r ? -1 : l > r;
+}
+
+static void run_pingpong(int flags, int so_busy_poll_us) {
+    evloop_t* loop = evloop_new(flags);
+    if (so_busy_poll_us) {
+        evloop_set_busy_poll(loop, EVLOOP_DEFAULT_BUSY_POLL_US, so_busy_poll_us);
+    }
+    evio_t* listenio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_accept);
+    assert(listenio != NULL);
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(evio_fd(listenio), &addr.sa, &addrlen);
+    thread_t th = thread_create(loop_thread, loop);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    assert(connect(fd, &addr.sa, addrlen) == 0);
+    char msg[TEST_MSG], reply[TEST_MSG];
+    memset(msg, 'p', sizeof(msg));
+    uint64_t* rtts = (uint64_t*)malloc(TEST_PINGS * sizeof(uint64_t));
+    for (int i = 0; i < TEST_WARMUP + TEST_PINGS; ++i) {
+        uint64_t start = gethrtime_ns();
+        assert(writen(fd, msg, TEST_MSG) == TEST_MSG);
+        assert(readn(fd, reply, TEST_MSG) == TEST_MSG);
+        if (i >= TEST_WARMUP) {
+            rtts[i - TEST_WARMUP] = gethrtime_ns() - start;
+        }
+    }
+    close(fd);
+
+    evloop_stop(loop);
+    thread_join(th, NULL);
+    evloop_free(&loop);
+    qsort(rtts, TEST_PINGS, sizeof(uint64_t), cmp_u64);
+    printf("%s so_busy_poll=%d: pings=%d p50=%.1fus p99=%.1fus max=%.1fus\n",
+           flags & EVLOOP_FLAG_BUSY_POLL ? "busy poll" : "blocking", so_busy_poll_us, TEST_PINGS, rtts[TEST_PINGS / 2] / 1e3, rtts[TEST_PINGS * 99 / 100] / 1e3, rtts[TEST_PINGS - 1] / 1e3);
+    free(rtts);
+}
+
+void test_busy_poll() {
+    run_pingpong(0, 0);
+    run_pingpong(EVLOOP_FLAG_BUSY_POLL, 0);
+    run_pingpong(EVLOOP_FLAG_BUSY_POLL, 50);
+}
@@ -0,0 +1,229 @@
+#include <sys/wait.h>
+
+#include "base.h"
+#include "coroutine.h"
+#include "datetime.h"
+#include "eventloop.h"
+#include "socket.h"
+#include "sockunion.h"
+#include "test.h"
+
+#define TEST_SWITCHES 10000000
+#ifdef EVCO_STACK_GUARD
+// NOTE: two mappings per guarded stack, within vm.max_map_count
+#define TEST_PARKED 20000
+#else
+#define TEST_PARKED 100000
+#endif
+#define TEST_SESSIONS 2000
+#define TEST_REQUESTS 10
+
+static evco_t* s_co = NULL;
+static int s_running = 0;
+static long s_nfinished = 0;
+
+static long rss_kb() {
+    long pages = 0, resident = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        fscanf(fp, "%ld %ld", &pages, &resident);
+        fclose(fp);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// context switch: co_resume <=> co_suspend
+static void pingpong(void* arg) {
+    s_co = co_self();
+    while (s_running) {
+        co_suspend();
+    }
+}
+
+static void bench_switch() {
+    evloop_t* loop = evloop_new(0);
+    s_running = 1;
+    assert(co_create(loop, pingpong, NULL, 0) == 0);
+    uint64_t start = gethrtime_ns();
+    for (int i = 0; i < TEST_SWITCHES; ++i) {
+        co_resume(s_co);
+    }
+    uint64_t elapsed_ns = gethrtime_ns() - start;
+    s_running = 0;
+    co_resume(s_co);
+    evloop_free(&loop);
+    printf("switch: resume+suspend=%d %.1fns/switch\n", TEST_SWITCHES, elapsed_ns / 2.0 / TEST_SWITCHES);
+}
+
+// memory: TEST_PARKED coroutines parked in co_sleep
+static void parked(void* arg) {
+    co_sleep(100);
+    ++s_nfinished;
+}
+
+static void bench_memory() {
+    evloop_t* loop = evloop_new(EVLOOP_FLAG_QUIT_WHEN_NO_ACTIVE_EVENTS);
+    s_nfinished = 0;
+    long rss = rss_kb();
+    long allocs = ev_alloc_cnt();
+    uint64_t start = gethrtime_us();
+    for (int i = 0; i < TEST_PARKED; ++i) {
+        assert(co_create(loop, parked, NULL, 0) == 0);
+    }
+    uint64_t create_us = gethrtime_us() - start;
+    long parked_kb = rss_kb() - rss;
+    long parked_allocs = ev_alloc_cnt() - allocs;
+    evloop_run(loop);
+    assert(s_nfinished == TEST_PARKED);
+    evloop_free(&loop);
+    printf("memory: coroutines=%d create=%.0fns/co rss=%ldKB (%.0f bytes/co, incl. %ld timers)\n", TEST_PARKED,
+           create_us * 1000.0 / TEST_PARKED, parked_kb, parked_kb * 1024.0 / TEST_PARKED, parked_allocs);
+}
+
+// sessions: co_accept/co_connect/co_read_until/co_read/co_write on one loop
+static int s_port = 0;
+static long s_nrequests = 0;
+
+static void echo_session(void* arg) {
+    evio_t* io = (evio_t*)arg;
+    char line[256];
+    int n;
+    while ((n = co_read_until(io, line, sizeof(line), "\r\n")) > 0) {
+        if (co_write(io, line, n) != n)
+            break;
+    }
+    evio_close(io);
+}
+
+static void echo_server(void* arg) {
+    evio_t* listenio = (evio_t*)arg;
+    evio_t* io;
+    while ((io = co_accept(listenio)) != NULL) {
+        co_create(event_loop(listenio), echo_session, io, 0);
+    }
+}
+
+static void client_session(void* arg) {
+    evloop_t* loop = (evloop_t*)arg;
+    evio_t* io = co_connect(loop, LOCALHOST, s_port);
+    assert(io != NULL);
+    char req[64], resp[64];
+    for (int i = 0; i < TEST_REQUESTS; ++i) {
+        int len = snprintf(req, sizeof(req), "hello %d from %d\r\n", i, evio_fd(io));
+        assert(co_write(io, req, len) == len);
+        // NOTE: half by co_read, half by co_read_until
+        int n = 0;
+        if (i & 1) {
+            while (n < len) {
+                int ret = co_read(io, resp + n, len - n);
+                assert(ret > 0);
+                n += ret;
+            }
+        } else {
+            n = co_read_until(io, resp, sizeof(resp), "\r\n");
+        }
+        assert(n == len && memcmp(req, resp, len) == 0);
+        ++s_nrequests;
+        co_sleep(1);
+    }
+    evio_close(io);
+    if (++s_nfinished == TEST_SESSIONS) {
+        evloop_stop(loop);
+    }
+}
+
+static void bench_sessions() {
+    evloop_t* loop = evloop_new(0);
+    evio_t* listenio = evio_create_socket(loop, LOCALHOST, 0, EIO_TYPE_TCP, EIO_SERVER_SIDE);
+    assert(listenio != NULL);
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(evio_fd(listenio), &addr.sa, &addrlen);
+    s_port = ntohs(addr.sin.sin_port);
+    s_nfinished = s_nrequests = 0;
+    co_create(loop, echo_server, listenio, 0);
+    uint64_t start = gethrtime_us();
+    for (int i = 0; i < TEST_SESSIONS; ++i) {
+        co_create(loop, client_session, loop, 0);
+    }
+    evloop_run(loop);
+    uint64_t elapsed_us = gethrtime_us() - start;
+    assert(s_nrequests == TEST_SESSIONS * TEST_REQUESTS);
+    // NOTE: server coroutines still suspended, freed with loop.
+    evloop_free(&loop);
+    printf("sessions: %d x %d requests in %llums\n", TEST_SESSIONS, TEST_REQUESTS, (unsigned long long)elapsed_us / 1000);
+}
+
+// close: evio_close by a timer wakes the coroutine waiting in co_read
+static int s_closed_read = 0;
+
+static void closed_reader(void* arg) {
+    evio_t* io = (evio_t*)arg;
+    char buf[64];
+    s_closed_read = co_read(io, buf, sizeof(buf));
+    ++s_nfinished;
+    evloop_stop(event_loop(io));
+}
+
+static void on_close_timer(evtimer_t* timer) {
+    evio_close((evio_t*)event_userdata(timer));
+}
+
+static void on_deadline(evtimer_t* timer) {
+    evloop_stop(event_loop(timer));
+}
+
+static void check_close_wakeup() {
+    evloop_t* loop = evloop_new(0);
+    int socks[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, socks) == 0);
+    evio_t* io = evio_get(loop, socks[0]);
+    s_nfinished = 0;
+    s_closed_read = 0;
+    assert(co_create(loop, closed_reader, io, 0) == 0);
+    evtimer_t* timer = evtimer_add(loop, on_close_timer, 10, 1);
+    event_set_userdata(timer, io);
+    evtimer_add(loop, on_deadline, 1000, 1);
+    evloop_run(loop);
+    assert(s_nfinished == 1 && s_closed_read == -1);
+    close(socks[1]);
+    evloop_free(&loop);
+    printf("close: co_read woken with -1\n");
+}
+
+#ifdef EVCO_STACK_GUARD
+// overflow of the default stack faults on its guard page, in a child process
+static int recurse(volatile char* prev) {
+    volatile char frame[1024];
+    frame[0] = prev ? prev[0] + 1 : 0;
+    return recurse(frame) + frame[sizeof(frame) - 1];
+}
+
+static void overflow(void* arg) {
+    recurse(NULL);
+}
+
+static void check_stack_guard() {
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        evloop_t* loop = evloop_new(0);
+        co_create(loop, overflow, NULL, 0);
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+    printf("stack guard: overflow => SIGSEGV\n");
+}
+#endif
+
+void test_coroutine() {
+#ifdef EVCO_STACK_GUARD
+    check_stack_guard();
+#endif
+    check_close_wakeup();
+    bench_switch();
+    bench_memory();
+    bench_sessions();
+}
@@ -53,6 +53,13 @@ void test_datetime() {
     printf("%d ms since system boot\n", gettick_ms());
     printf("%lld us since system boot\n", gethrtime_us());
     printf("%s elapsed since system boot\n", duration_fmt((int)gettick_ms() / 1000, time_str));
+    // NOTE: all of CLOCK_MONOTONIC, not gettimeofday, @see HAVE_CLOCK_GETTIME
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    unsigned long long mono_us = ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    assert(gethrtime_us() - mono_us < 1000000);
+    assert(gethrtime_ns() / 1000 - mono_us < 1000000);
+    assert(gettick_ms() - (unsigned int)(mono_us / 1000) < 1000);
 
     // 本地时间
     dt = datetime_now();
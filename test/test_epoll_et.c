@@ -0,0 +1,135 @@
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+#include "base.h"
+#include "datetime.h"
+#include "eventloop.h"
+#include "socket.h"
+#include "sockopt.h"
+#include "sockunion.h"
+#include "test.h"
+#include "thread.h"
+
+#define TEST_SHORT_CONNS  1000
+#define TEST_BULK_CONNS   16
+#define TEST_BULK_SIZE    (1 << 20) // 1M
+#define TEST_SOCKBUF      (16 << 10) // small socket buffers, so server toggles EV_WRITE
+#define TEST_MSG_SIZE     64
+
+static int s_port = 0;
+static atomic_long s_epoll_ctl_calls = ATOMIC_VAR_INIT(0);
+
+// NOTE: override libc epoll_ctl to count syscalls issued by io_epoll.c
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event* ev) {
+    ++s_epoll_ctl_calls;
+    return syscall(SYS_epoll_ctl, epfd, op, fd, ev);
+}
+
+static void on_echo(evio_t* io, void* buf, int readbytes) {
+    evio_write(io, buf, readbytes);
+}
+
+static void on_accept(evio_t* io) {
+    so_sndbuf(evio_fd(io), TEST_SOCKBUF);
+    evio_setcb_read(io, on_echo);
+    evio_read(io);
+}
+
+static THREAD_ROUTINE(loop_thread) {
+    evloop_run((evloop_t*)userdata);
+    return NULL;
+}
+
+static int connect_server(int rcvbuf) {
+    sockaddr_u addr;
+    memset(&addr, 0, sizeof(addr));
+    sockunion_set_ipport(&addr, LOCALHOST, s_port);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (rcvbuf > 0) {
+        so_rcvbuf(fd, rcvbuf);
+    }
+    assert(connect(fd, &addr.sa, sockunion_get_addrlen(&addr)) == 0);
+    tcp_nodelay(fd, 1);
+    return fd;
+}
+
+static void run_short_conns() {
+    char buf[TEST_MSG_SIZE] = {0};
+    for (int i = 0; i < TEST_SHORT_CONNS; ++i) {
+        int fd = connect_server(0);
+        assert(writen(fd, buf, sizeof(buf)) == sizeof(buf));
+        assert(readn(fd, buf, sizeof(buf)) == sizeof(buf));
+        close(fd);
+    }
+}
+
+static THREAD_ROUTINE(bulk_client) {
+    char* sendbuf = (char*)malloc(TEST_BULK_SIZE);
+    char* recvbuf = (char*)malloc(TEST_BULK_SIZE);
+    for (int i = 0; i < TEST_BULK_SIZE; ++i) {
+        sendbuf[i] = (char)(i * 31 + (i >> 13));
+    }
+    int fd = connect_server(TEST_SOCKBUF);
+    // NOTE: write and read in chunks, a 1M writen would deadlock with small socket buffers.
+    int chunk = TEST_SOCKBUF / 2;
+    for (int off = 0; off < TEST_BULK_SIZE; off += chunk) {
+        assert(writen(fd, sendbuf + off, chunk) == chunk);
+        assert(readn(fd, recvbuf + off, chunk) == chunk);
+    }
+    assert(memcmp(sendbuf, recvbuf, TEST_BULK_SIZE) == 0);
+    close(fd);
+    free(sendbuf);
+    free(recvbuf);
+    return NULL;
+}
+
+static void run_bulk_conns() {
+    thread_t clients[TEST_BULK_CONNS];
+    for (int i = 0; i < TEST_BULK_CONNS; ++i) {
+        clients[i] = thread_create(bulk_client, NULL);
+    }
+    for (int i = 0; i < TEST_BULK_CONNS; ++i) {
+        thread_join(clients[i], NULL);
+    }
+}
+
+static void run_echo(const char* name, int flags) {
+    evloop_t* loop = evloop_new(flags);
+    evio_t* listenio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_accept);
+    assert(listenio != NULL);
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(evio_fd(listenio), &addr.sa, &addrlen);
+    s_port = ntohs(addr.sin.sin_port);
+    thread_t th = thread_create(loop_thread, loop);
+    while (evloop_status(loop) != EVLOOP_STATUS_RUNNING) {
+        ev_msleep(1);
+    }
+
+    s_epoll_ctl_calls = 0;
+    unsigned long long start = gettimeofday_us();
+    run_short_conns();
+    long short_calls = s_epoll_ctl_calls;
+    double short_ms = (gettimeofday_us() - start) / 1e3;
+
+    s_epoll_ctl_calls = 0;
+    start = gettimeofday_us();
+    run_bulk_conns();
+    long bulk_calls = s_epoll_ctl_calls;
+    double bulk_ms = (gettimeofday_us() - start) / 1e3;
+
+    printf("%s: short conns=%d epoll_ctl=%ld (%.2f/conn) %.0fms\n", name, TEST_SHORT_CONNS, short_calls,
+           (double)short_calls / TEST_SHORT_CONNS, short_ms);
+    printf("%s: bulk conns=%d bytes=%d epoll_ctl=%ld %.0fms\n", name, TEST_BULK_CONNS, TEST_BULK_SIZE, bulk_calls,
+           bulk_ms);
+
+    evloop_stop(loop);
+    thread_join(th, NULL);
+    evloop_free(&loop);
+}
+
+void test_epoll_et() {
+    printf("engine=%s\n", evio_engine());
+    run_echo("LT", 0);
+    run_echo("ET", EVLOOP_FLAG_EDGE_TRIGGERED);
+}
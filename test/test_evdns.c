@@ -0,0 +1,330 @@
+#include "base.h"
+#include "datetime.h"
+#include "errors.h"
+#include "evdns.h"
+#include "eventloop.h"
+#include "socket.h"
+#include "sockunion.h"
+#include "test.h"
+
+// a nameserver in the loop answering by name:
+// a.test A 10.0.0.1 10.0.0.2 ttl 300, AAAA fd00::1 ttl 60; short.test A 10.0.0.3 ttl 1, AAAA NODATA without SOA;
+// none.test NXDOMAIN with SOA minimum 5; fail.test SERVFAIL; spoof.test a wrong id before the answer;
+// drop.test never answered.
+#define TEST_SOA_TTL     600
+#define TEST_SOA_MINIMUM 5
+
+static int s_server_queries = 0;
+static int s_expect = 0;
+static int s_done = 0;
+static int s_status = 0;
+static evdns_addrs_t s_addrs;
+
+static int put_u16(uint8_t* p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+    return 2;
+}
+
+static int put_u32(uint8_t* p, uint32_t v) {
+    put_u16(p, v >> 16);
+    return 2 + put_u16(p + 2, v & 0xFFFF);
+}
+
+// answer of a type, name as a pointer to the question
+static int put_rr(uint8_t* p, uint16_t type, uint32_t ttl, const char* ip) {
+    sockaddr_u addr;
+    assert(str2sockunion(ip, &addr) == 0);
+    int len = type == 1 ? 4 : 16;
+    int off = put_u16(p, 0xC00C);
+    off += put_u16(p + off, type);
+    off += put_u16(p + off, 1);
+    off += put_u32(p + off, ttl);
+    off += put_u16(p + off, len);
+    memcpy(p + off, sockunion_get_addr(&addr), len);
+    return off + len;
+}
+
+static int put_soa(uint8_t* p) {
+    int off = put_u16(p, 0xC00C);
+    off += put_u16(p + off, 6);
+    off += put_u16(p + off, 1);
+    off += put_u32(p + off, TEST_SOA_TTL);
+    off += put_u16(p + off, 2 + 5 * 4);
+    // NOTE: root as mname and rname
+    p[off++] = 0;
+    p[off++] = 0;
+    for (int i = 0; i < 4; ++i) {
+        off += put_u32(p + off, 1);
+    }
+    return off + put_u32(p + off, TEST_SOA_MINIMUM);
+}
+
+static void on_server_read(evio_t* io, void* buf, int readbytes) {
+    const uint8_t* query = (const uint8_t*)buf;
+    ++s_server_queries;
+    // NOTE: question of labels without compression
+    char name[256] = {0};
+    int off = 12;
+    while (query[off]) {
+        if (name[0])
+            strcat(name, ".");
+        strncat(name, (const char*)query + off + 1, query[off]);
+        off += 1 + query[off];
+    }
+    off += 1;
+    uint16_t qtype = (query[off] << 8) | query[off + 1];
+    off += 4;
+    if (strcmp(name, "drop.test") == 0)
+        return;
+
+    uint8_t msg[512];
+    memcpy(msg, query, off);
+    int rcode = 0, an = 0, ns = 0;
+    int len = off;
+    if (strcmp(name, "a.test") == 0 || strcmp(name, "spoof.test") == 0) {
+        if (qtype == 1) {
+            len += put_rr(msg + len, 1, 300, "10.0.0.1");
+            len += put_rr(msg + len, 1, 300, "10.0.0.2");
+            an = 2;
+        } else {
+            len += put_rr(msg + len, 28, 60, "fd00::1");
+            an = 1;
+        }
+    } else if (strcmp(name, "short.test") == 0) {
+        if (qtype == 1) {
+            len += put_rr(msg + len, 1, 1, "10.0.0.3");
+            an = 1;
+        }
+    } else if (strcmp(name, "none.test") == 0) {
+        rcode = 3;
+        len += put_soa(msg + len);
+        ns = 1;
+    } else {
+        rcode = 2;
+    }
+    put_u16(msg + 2, 0x8180 | rcode);
+    put_u16(msg + 6, an);
+    put_u16(msg + 8, ns);
+    put_u16(msg + 10, 0);
+    if (strcmp(name, "spoof.test") == 0) {
+        // NOTE: as a blind spoofer guessing the id
+        msg[1] ^= 0xFF;
+        evio_write(io, msg, len);
+        msg[1] ^= 0xFF;
+    }
+    evio_write(io, msg, len);
+}
+
+static void on_resolved(evdns_req_t* req, int status, const evdns_addrs_t* addrs, void* userdata) {
+    s_status = status;
+    s_addrs = *addrs;
+    if (++s_done == s_expect) {
+        evloop_stop((evloop_t*)userdata);
+    }
+}
+
+static void on_unexpected(evdns_req_t* req, int status, const evdns_addrs_t* addrs, void* userdata) { assert(0); }
+
+static void on_deadline(evtimer_t* timer) {
+    printf("evdns: %d of %d resolves done in time\n", s_done, s_expect);
+    assert(0);
+}
+
+// resolve and run the loop until cb called
+static void resolve(evloop_t* loop, const char* name, int family) {
+    s_done = 0;
+    s_expect = 1;
+    s_status = -1;
+    if (evdns_resolve(loop, name, family, on_resolved, loop) != NULL) {
+        evtimer_t* deadline = evtimer_add(loop, on_deadline, 5000, 1);
+        evloop_run(loop);
+        evtimer_del(deadline);
+    }
+    assert(s_done == 1);
+}
+
+static void on_sleep(evtimer_t* timer) { evloop_stop(event_loop(timer)); }
+
+static void sleep_in_loop(evloop_t* loop, int ms) {
+    evtimer_add(loop, on_sleep, ms, 1);
+    evloop_run(loop);
+}
+
+static int local_port(int fd) {
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(fd, &addr.sa, &addrlen);
+    return ntohs(addr.sin.sin_port);
+}
+
+static void check_ip(int i, const char* ip) {
+    char buf[SU_ADDRSTRLEN];
+    assert(i < s_addrs.naddrs);
+    assert(strcmp(sockunion2str(&s_addrs.addrs[i], buf, sizeof(buf)), ip) == 0);
+}
+
+static void test_answers(evloop_t* loop) {
+    evdns_stats_t stats;
+    // A and AAAA in parallel, A first
+    resolve(loop, "a.test", AF_UNSPEC);
+    assert(s_status == 0 && s_addrs.naddrs == 3 && s_addrs.ttl == 60);
+    check_ip(0, "10.0.0.1");
+    check_ip(1, "10.0.0.2");
+    check_ip(2, "fd00::1");
+    assert(s_server_queries == 2);
+
+    // cached by ttl, names case-insensitive
+    resolve(loop, "A.Test.", AF_INET6);
+    assert(s_status == 0 && s_addrs.naddrs == 1 && s_addrs.ttl <= 60);
+    resolve(loop, "a.test", AF_INET);
+    assert(s_status == 0 && s_addrs.naddrs == 2);
+    assert(s_server_queries == 2);
+
+    // NOTE: NODATA of AAAA cached for EVDNS_NEGATIVE_TTL, A expires in 1s
+    resolve(loop, "short.test", AF_UNSPEC);
+    assert(s_status == 0 && s_addrs.naddrs == 1 && s_addrs.ttl == 1);
+    resolve(loop, "short.test", AF_INET6);
+    assert(s_status == ERR_DNS_NODATA && s_addrs.naddrs == 0 && s_addrs.ttl <= EVDNS_NEGATIVE_TTL);
+    assert(s_server_queries == 4);
+    sleep_in_loop(loop, 1100);
+    resolve(loop, "short.test", AF_UNSPEC);
+    assert(s_status == 0 && s_addrs.naddrs == 1);
+    assert(s_server_queries == 5);
+
+    // NXDOMAIN cached by SOA minimum
+    resolve(loop, "none.test", AF_UNSPEC);
+    assert(s_status == ERR_DNS_NXDOMAIN && s_addrs.ttl == TEST_SOA_MINIMUM);
+    resolve(loop, "none.test", AF_INET);
+    assert(s_status == ERR_DNS_NXDOMAIN && s_server_queries == 7);
+
+    // SERVFAIL tried attempts times, not cached
+    evdns_set_timeout(loop, 0, 2);
+    resolve(loop, "fail.test", AF_INET);
+    assert(s_status == ERR_DNS_SERVFAIL && s_server_queries == 9);
+
+    // spoofed answer dropped
+    evdns_stats(loop, &stats);
+    uint64_t mismatches = stats.mismatches;
+    resolve(loop, "spoof.test", AF_INET);
+    assert(s_status == 0 && s_addrs.naddrs == 2);
+    evdns_stats(loop, &stats);
+    assert(stats.mismatches == mismatches + 1);
+
+    evdns_flush_cache(loop, "a.test");
+    resolve(loop, "a.test", AF_INET);
+    assert(s_status == 0 && s_server_queries == 11);
+}
+
+static void test_coalesce(evloop_t* loop) {
+    evdns_stats_t before, after;
+    evdns_stats(loop, &before);
+    int queries = s_server_queries;
+    evdns_flush_cache(loop, NULL);
+    s_done = 0;
+    s_expect = 4;
+    for (int i = 0; i < s_expect; ++i) {
+        assert(evdns_resolve(loop, "a.test", AF_UNSPEC, on_resolved, loop) != NULL);
+    }
+    evloop_run(loop);
+    assert(s_done == s_expect && s_status == 0 && s_addrs.naddrs == 3);
+    evdns_stats(loop, &after);
+    // NOTE: one query of each type for all
+    assert(s_server_queries == queries + 2);
+    assert(after.coalesced == before.coalesced + 6 && after.queries == before.queries + 2);
+    assert(after.inflight == 0);
+
+    // cancelled, the query stopped and its answer dropped
+    evdns_flush_cache(loop, NULL);
+    evdns_req_t* req = evdns_resolve(loop, "a.test", AF_UNSPEC, on_unexpected, NULL);
+    assert(req != NULL);
+    evdns_stats(loop, &before);
+    assert(before.inflight == 2);
+    evdns_cancel(req);
+    evdns_stats(loop, &after);
+    assert(after.inflight == 0);
+    sleep_in_loop(loop, 50);
+    evdns_stats(loop, &after);
+    assert(after.mismatches == before.mismatches + 2);
+
+    // pending ones dropped by evloop_free
+    assert(evdns_resolve(loop, "drop.test", AF_UNSPEC, on_unexpected, NULL) != NULL);
+}
+
+static void test_sync(evloop_t* loop) {
+    int queries = s_server_queries;
+    // NOTE: cb called before evdns_resolve returns
+    s_done = 0;
+    s_expect = 0;
+    assert(evdns_resolve(loop, "10.1.2.3", AF_UNSPEC, on_resolved, loop) == NULL);
+    assert(s_status == 0 && s_addrs.naddrs == 1);
+    check_ip(0, "10.1.2.3");
+    assert(evdns_resolve(loop, "::1", AF_INET, on_resolved, loop) == NULL);
+    assert(s_status == ERR_DNS_NODATA);
+    assert(evdns_resolve(loop, "localhost", AF_UNSPEC, on_resolved, loop) == NULL);
+    assert(s_status == 0 && s_addrs.naddrs == 2);
+    check_ip(0, "127.0.0.1");
+    check_ip(1, "::1");
+    assert(evdns_resolve(loop, "x.Localhost.", AF_INET6, on_resolved, loop) == NULL);
+    assert(s_status == 0 && s_addrs.naddrs == 1);
+    const char* invalid[] = {"", ".", "a..test", ".a.test", "a b.test", "a.test.."};
+    for (int i = 0; i < 6; ++i) {
+        assert(evdns_resolve(loop, invalid[i], AF_UNSPEC, on_resolved, loop) == NULL);
+        assert(s_status == ERR_INVALID_PARAM);
+    }
+    assert(s_done == 10 && s_server_queries == queries);
+}
+
+// the first nameserver never answers, the second does after its timeout
+static void test_retry(int port) {
+    evloop_t* loop = evloop_new(0);
+    evio_t* server = evloop_create_udp_server(loop, LOCALHOST, port);
+    assert(server != NULL);
+    evio_setcb_read(server, on_server_read);
+    evio_read(server);
+    int dead = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_u addr;
+    sockunion_set_ipport(&addr, LOCALHOST, 0);
+    assert(bind(dead, &addr.sa, sockunion_get_addrlen(&addr)) == 0);
+    char servers[64];
+    snprintf(servers, sizeof(servers), "127.0.0.1:%d, 127.0.0.1:%d", local_port(dead), port);
+    assert(evdns_set_nameservers(loop, servers) == 2);
+    evdns_set_timeout(loop, 100, 1);
+
+    uint64_t start = gethrtime_us();
+    resolve(loop, "a.test", AF_INET);
+    uint64_t elapsed_ms = (gethrtime_us() - start) / 1000;
+    assert(s_status == 0 && s_addrs.naddrs == 2 && elapsed_ms >= 90);
+    // NOTE: both nameservers tried once
+    resolve(loop, "drop.test", AF_INET);
+    assert(s_status == ERR_TASK_TIMEOUT);
+    evdns_stats_t stats;
+    evdns_stats(loop, &stats);
+    printf("evdns: requests=%llu hits=%llu coalesced=%llu queries=%llu retries=%llu timeouts=%llu mismatches=%llu\n",
+           (unsigned long long)stats.requests, (unsigned long long)stats.cache_hits,
+           (unsigned long long)stats.coalesced, (unsigned long long)stats.queries, (unsigned long long)stats.retries,
+           (unsigned long long)stats.timeouts, (unsigned long long)stats.mismatches);
+    assert(stats.retries == 2 && stats.timeouts == 1);
+    evloop_free(&loop);
+    closesocket(dead);
+}
+
+void test_evdns() {
+    evloop_t* loop = evloop_new(0);
+    evio_t* server = evloop_create_udp_server(loop, LOCALHOST, 0);
+    assert(server != NULL);
+    evio_setcb_read(server, on_server_read);
+    evio_read(server);
+    int port = local_port(evio_fd(server));
+    char servers[32];
+    snprintf(servers, sizeof(servers), "127.0.0.1:%d", port);
+    assert(evdns_set_nameservers(loop, servers) == 1);
+    assert(evdns_set_nameservers(loop, "example.com, 300.0.0.1") == -1);
+
+    test_sync(loop);
+    test_answers(loop);
+    test_coalesce(loop);
+    evloop_free(&loop);
+
+    test_retry(port);
+}
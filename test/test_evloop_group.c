@@ -0,0 +1,215 @@
+#include <sys/resource.h>
+
+#include "base.h"
+#include "datetime.h"
+#include "evloop_group.h"
+#include "socket.h"
+#include "sockopt.h"
+#include "sockunion.h"
+#include "test.h"
+#include "thread.h"
+
+#define TEST_CLIENTS_PER_LOOP 4
+#define TEST_DURATION_MS      1000
+#define TEST_MSG_SIZE         64
+#define TEST_MAX_SPREAD_CONNS 1000
+
+static int s_port = 0;
+static atomic_long s_nrequests = ATOMIC_VAR_INIT(0);
+
+static void on_echo(evio_t* io, void* buf, int readbytes) {
+    evio_write(io, buf, readbytes);
+}
+
+static void on_accept(evio_t* io) {
+    evio_setcb_read(io, on_echo);
+    evio_read(io);
+}
+
+static THREAD_ROUTINE(echo_client) {
+    char buf[TEST_MSG_SIZE] = {0};
+    sockaddr_u addr;
+    memset(&addr, 0, sizeof(addr));
+    sockunion_set_ipport(&addr, LOCALHOST, s_port);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(fd, &addr.sa, sockunion_get_addrlen(&addr)) == 0);
+    tcp_nodelay(fd, 1);
+    long nrequests = 0;
+    unsigned long long end = gettimeofday_ms() + TEST_DURATION_MS;
+    while (gettimeofday_ms() < end) {
+        if (writen(fd, buf, sizeof(buf)) != sizeof(buf))
+            break;
+        if (readn(fd, buf, sizeof(buf)) != sizeof(buf))
+            break;
+        ++nrequests;
+    }
+    close(fd);
+    s_nrequests += nrequests;
+    return NULL;
+}
+
+static uint64_t wait_naccepts(evloop_group_t* group, uint64_t naccepts) {
+    for (int i = 0; i < 1000 && evloop_group_naccepts(group) < naccepts; ++i) {
+        ev_msleep(1);
+    }
+    return evloop_group_naccepts(group);
+}
+
+// NOTE: SO_REUSEPORT hashes the 4-tuple, so connect more until every loop accepted one.
+// @return connections made
+static int spread_connects(evloop_group_t* group, uint64_t naccepts) {
+    sockaddr_u addr;
+    memset(&addr, 0, sizeof(addr));
+    sockunion_set_ipport(&addr, LOCALHOST, s_port);
+    int nconns = 0;
+    for (int i = 0; i < evloop_group_size(group) && nconns < TEST_MAX_SPREAD_CONNS;) {
+        if (evloop_naccepts(evloop_group_loop(group, i)) > 0) {
+            ++i;
+            continue;
+        }
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        assert(connect(fd, &addr.sa, sockunion_get_addrlen(&addr)) == 0);
+        close(fd);
+        ++nconns;
+        wait_naccepts(group, naccepts + nconns);
+    }
+    return nconns;
+}
+
+static double run_echo(int nloops) {
+    evloop_group_t* group = evloop_group_new(nloops, EVLOOP_GROUP_FLAG_CPU_AFFINITY);
+    s_port = evloop_group_create_tcp_server(group, LOCALHOST, 0, on_accept);
+    assert(s_port > 0);
+    evloop_group_start(group);
+
+    int nclients = nloops * TEST_CLIENTS_PER_LOOP;
+    thread_t* clients = (thread_t*)calloc(nclients, sizeof(thread_t));
+    s_nrequests = 0;
+    unsigned long long start = gettimeofday_us();
+    for (int i = 0; i < nclients; ++i) {
+        clients[i] = thread_create(echo_client, NULL);
+    }
+    for (int i = 0; i < nclients; ++i) {
+        thread_join(clients[i], NULL);
+    }
+    double seconds = (gettimeofday_us() - start) / 1e6;
+    double qps = s_nrequests / seconds;
+    assert(wait_naccepts(group, nclients) == nclients);
+    int nspread = spread_connects(group, nclients);
+
+    printf("loops=%d clients=%d requests=%ld qps=%.0f accepts=[", nloops, nclients, (long)s_nrequests, qps);
+    for (int i = 0; i < nloops; ++i) {
+        printf(i ? " %llu" : "%llu", (unsigned long long)evloop_naccepts(evloop_group_loop(group, i)));
+    }
+    printf("] +%d\n", nspread);
+    // NOTE: spread across the loops, every client served
+    for (int i = 0; i < nloops; ++i) {
+        assert(evloop_naccepts(evloop_group_loop(group, i)) > 0);
+    }
+    assert(evloop_group_naccepts(group) == nclients + nspread);
+    assert(s_nrequests >= nclients);
+
+    free(clients);
+    evloop_group_free(&group);
+    return qps;
+}
+
+// udp: datagrams of different source ports spread across the loops
+#define TEST_MAX_DATAGRAMS 1000
+#define TEST_MAX_LOOPS     64
+
+static atomic_int s_ndatagrams[TEST_MAX_LOOPS];
+
+static void on_datagram(evio_t* io, void* buf, int readbytes) {
+    int idx = (int)(intptr_t)evloop_userdata(event_loop(io));
+    atomic_fetch_add(&s_ndatagrams[idx], 1);
+}
+
+static int udp_received(int nloops) {
+    int n = 0;
+    for (int i = 0; i < nloops; ++i) {
+        n += atomic_load(&s_ndatagrams[i]);
+    }
+    return n;
+}
+
+static void run_udp(int nloops) {
+    evloop_group_t* group = evloop_group_new(nloops, 0);
+    for (int i = 0; i < nloops; ++i) {
+        evloop_set_userdata(evloop_group_loop(group, i), (void*)(intptr_t)i);
+        atomic_store(&s_ndatagrams[i], 0);
+    }
+    int port = evloop_group_create_udp_server(group, LOCALHOST, 0, on_datagram);
+    assert(port > 0);
+    evloop_group_start(group);
+
+    sockaddr_u addr;
+    memset(&addr, 0, sizeof(addr));
+    sockunion_set_ipport(&addr, LOCALHOST, port);
+    int nsent = 0, spread = 0;
+    while (!spread && nsent < TEST_MAX_DATAGRAMS) {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        assert(sendto(fd, "ping", 4, 0, &addr.sa, sockunion_get_addrlen(&addr)) == 4);
+        close(fd);
+        ++nsent;
+        for (int i = 0; i < 1000 && udp_received(nloops) < nsent; ++i) {
+            ev_msleep(1);
+        }
+        spread = 1;
+        for (int i = 0; i < nloops; ++i) {
+            spread = spread && atomic_load(&s_ndatagrams[i]) > 0;
+        }
+    }
+    printf("udp loops=%d datagrams=%d [", nloops, nsent);
+    for (int i = 0; i < nloops; ++i) {
+        printf(i ? " %d" : "%d", atomic_load(&s_ndatagrams[i]));
+    }
+    printf("]\n");
+    assert(spread && udp_received(nloops) == nsent);
+    evloop_group_free(&group);
+}
+
+// a listener failed: the ones created are closed, the port is free again
+static void run_create_failed() {
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockunion_set_ipport(&addr, LOCALHOST, 0);
+    assert(bind(fd, &addr.sa, sizeof(addr.sin)) == 0);
+    getsockname(fd, &addr.sa, &addrlen);
+    int port = ntohs(addr.sin.sin_port);
+    close(fd);
+
+    evloop_group_t* group = evloop_group_new(2, 0);
+    // NOTE: one fd left, for the listener of loop[0] only
+    struct rlimit rlim, limited;
+    assert(getrlimit(RLIMIT_NOFILE, &rlim) == 0);
+    int nextfd = dup(0);
+    close(nextfd);
+    limited = rlim;
+    limited.rlim_cur = nextfd + 1;
+    assert(setrlimit(RLIMIT_NOFILE, &limited) == 0);
+    int ret = evloop_group_create_tcp_server(group, LOCALHOST, port, on_accept);
+    assert(setrlimit(RLIMIT_NOFILE, &rlim) == 0);
+    assert(ret == -1);
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(bind(fd, &addr.sa, sizeof(addr.sin)) == 0 && listen(fd, 8) == 0);
+    close(fd);
+    evloop_group_free(&group);
+}
+
+void test_evloop_group() {
+    run_create_failed();
+    int ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int maxloops = ncpu > 1 ? ncpu : 2;
+    double base_qps = 0;
+    for (int nloops = 1; nloops <= maxloops; nloops *= 2) {
+        double qps = run_echo(nloops);
+        if (nloops == 1) {
+            base_qps = qps;
+        }
+        printf("loops=%d speedup=%.2fx (ncpu=%d)\n", nloops, qps / base_qps, ncpu);
+    }
+    run_udp(maxloops);
+}
@@ -0,0 +1,100 @@
+#include "base.h"
+#include "datetime.h"
+#include "eventloop.h"
+#include "test.h"
+
+#define TEST_TICKS     2000
+#define TEST_PACING_US 100 // e.g. 10k packets/s pacing
+#define TEST_MAX_P50_US 100
+
+static int s_ticks = 0;
+
+static void on_tick(evtimer_t* timer) {
+    if (++s_ticks == TEST_TICKS) {
+        evloop_stop(event_loop(timer));
+    }
+}
+
+static double cpu_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// ms timer: poll timeout rounded up to ms, plus 1ms
+static void run_ms_timer() {
+    evloop_t* loop = evloop_new(EVLOOP_FLAG_STATS);
+    s_ticks = 0;
+    evtimer_add(loop, on_tick, 1, TEST_TICKS);
+    uint64_t start = gethrtime_us();
+    evloop_run(loop);
+    uint64_t elapsed_us = gethrtime_us() - start;
+    evloop_stats_t stats;
+    evloop_stats(loop, &stats);
+    printf("evtimer_add 1ms: ticks=%d in %llums, error p50=%.0fus p99=%.0fus max=%.0fus\n", TEST_TICKS,
+           (unsigned long long)elapsed_us / 1000, evloop_histogram_percentile(&stats.timer_lag, 50) / 1e3,
+           evloop_histogram_percentile(&stats.timer_lag, 99) / 1e3, stats.timer_lag.max_ns / 1e3);
+    evloop_free(&loop);
+}
+
+static void run_hrtimer(uint32_t interval_us) {
+    evloop_t* loop = evloop_new(0);
+    s_ticks = 0;
+    assert(evtimer_add_us(loop, on_tick, interval_us, TEST_TICKS) != NULL);
+    uint64_t start = gethrtime_us();
+    double cpu_start = cpu_ms();
+    evloop_run(loop);
+    double cpu = cpu_ms() - cpu_start;
+    uint64_t elapsed_us = gethrtime_us() - start;
+    evloop_hrtimer_stats_t stats;
+    evloop_hrtimer_stats(loop, &stats);
+    uint64_t p50_ns = evloop_histogram_percentile(&stats.error, 50);
+    printf("evtimer_add_us %uus: ticks=%d in %llums, cpu=%.0f%%, arms=%llu, error p50=%.0fus p99=%.0fus max=%.0fus\n",
+           interval_us, TEST_TICKS, (unsigned long long)elapsed_us / 1000, cpu * 1e5 / elapsed_us,
+           (unsigned long long)stats.arms, p50_ns / 1e3, evloop_histogram_percentile(&stats.error, 99) / 1e3,
+           stats.error.max_ns / 1e3);
+    assert(stats.fires == TEST_TICKS);
+    // NOTE: percentile is the bucket upper bound, so 2x of real p50 at most.
+    assert(p50_ns < 2 * TEST_MAX_P50_US * 1000);
+    // NOTE: no busy wait
+    assert(cpu * 1000 < elapsed_us * 0.8);
+    evloop_free(&loop);
+}
+
+// one-shot, reset and del
+static uint64_t s_deadline_us = 0;
+static int s_fired = 0;
+
+static void on_oneshot(evtimer_t* timer) {
+    assert(gethrtime_us() >= s_deadline_us);
+    if (++s_fired == 1) {
+        // NOTE: reset in its own callback, fire once more
+        s_deadline_us = gethrtime_us() + 300;
+        evtimer_reset(timer, 0);
+    }
+}
+
+static void on_never(evtimer_t* timer) { assert(0); }
+
+static void on_stop(evtimer_t* timer) { evloop_stop(event_loop(timer)); }
+
+static void run_oneshot() {
+    evloop_t* loop = evloop_new(0);
+    s_fired = 0;
+    s_deadline_us = gethrtime_us() + 300;
+    evtimer_add_us(loop, on_oneshot, 300, 1);
+    evtimer_t* never = evtimer_add_us(loop, on_never, 500, 1);
+    evtimer_del(never);
+    evtimer_add_us(loop, on_stop, 5000, 1);
+    evloop_run(loop);
+    assert(s_fired == 2);
+    assert(evloop_ntimers(loop) == 0);
+    evloop_free(&loop);
+}
+
+void test_hrtimer() {
+    run_ms_timer();
+    run_hrtimer(TEST_PACING_US);
+    run_hrtimer(TEST_PACING_US / 2);
+    run_oneshot();
+}
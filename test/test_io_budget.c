@@ -0,0 +1,196 @@
+#include "base.h"
+#include "datetime.h"
+#include "eventloop.h"
+#include "socket.h"
+#include "sockopt.h"
+#include "sockunion.h"
+#include "test.h"
+
+// one tenant uploads and downloads in bulk between two ios of the loop, others ping through the same loop.
+// NOTE: pings carry their send time, the delay until the loop reads them is measured.
+#define TEST_PINGERS      4
+#define TEST_PINGS        500
+#define TEST_PING_GAP_MS  1
+#define TEST_BULK_BUFSIZE (4 << 20)
+#define TEST_HIGH_WATER   (12 << 20) // under MAX_WRITE_BUFSIZE
+#define TEST_LOW_WATER    (4 << 20)
+#define TEST_SOCK_BUFSIZE (4 << 20)
+
+typedef struct {
+    uint64_t p99;       // ping delay in us
+    uint64_t max;       // ping delay in us
+    int max_readbytes;  // of bulk ios per read_cb
+    int max_writebytes; // of bulk ios per write_cb
+} test_result_t;
+
+static evbuf_t* s_bulk_buf = NULL;
+static evio_t* s_bulk_ios[2];
+static evio_t* s_ping_ios[TEST_PINGERS];
+static int s_ping_connected = 0;
+static int s_pings = 0;
+static int s_closing = 0;
+static long s_bulk_bytes = 0;
+static int s_refilling = 0;
+static int s_closed = 0;
+static uint64_t s_delays[TEST_PINGS * TEST_PINGERS];
+static int s_ndelays = 0;
+static test_result_t s_result;
+static evloop_fairness_stats_t s_stats;
+
+// NOTE: refilled above low water, so the write queue never drains and writes stay in nio_write
+static void refill(evio_t* io) {
+    s_refilling = 1;
+    while (!evio_write_above_high_water(io)) {
+        if (evio_write_ref(io, s_bulk_buf) < 0)
+            break;
+    }
+    s_refilling = 0;
+}
+
+static void on_watermark(evio_t* io, int above_high) {
+    // NOTE: closed once write_queue drained
+    if (!above_high && !s_closing) {
+        refill(io);
+    }
+}
+
+static void on_bulk_read(evio_t* io, void* buf, int readbytes) {
+    s_bulk_bytes += readbytes;
+    s_result.max_readbytes = MAX(s_result.max_readbytes, readbytes);
+}
+
+static void on_bulk_write(evio_t* io, const void* buf, int writebytes) {
+    // NOTE: a try write of evio_write_ref is out of budgets
+    if (!s_refilling) {
+        s_result.max_writebytes = MAX(s_result.max_writebytes, writebytes);
+    }
+}
+
+static void on_ping(evio_t* io, void* buf, int readbytes) {
+    uint64_t now = gethrtime_us();
+    for (int off = 0; off + (int)sizeof(uint64_t) <= readbytes && s_ndelays < TEST_PINGS * TEST_PINGERS;
+         off += sizeof(uint64_t)) {
+        uint64_t start;
+        memcpy(&start, (char*)buf + off, sizeof(start));
+        s_delays[s_ndelays++] = now - start;
+    }
+}
+
+static void on_close(evio_t* io) {
+    // NOTE: bulk ios and server side of pingers
+    if (++s_closed == TEST_PINGERS + 2) {
+        evloop_fairness_stats(event_loop(io), &s_stats);
+        evloop_stop(event_loop(io));
+    }
+}
+
+static void on_tick(evtimer_t* timer) {
+    if (s_ping_connected < TEST_PINGERS || s_bulk_ios[0] == NULL || s_bulk_ios[1] == NULL)
+        return;
+    if (s_pings++ < TEST_PINGS) {
+        uint64_t start = gethrtime_us();
+        for (int i = 0; i < TEST_PINGERS; ++i) {
+            evio_write(s_ping_ios[i], &start, sizeof(start));
+        }
+        return;
+    }
+    evtimer_del(timer);
+    s_closing = 1;
+    for (int i = 0; i < TEST_PINGERS; ++i) {
+        evio_close(s_ping_ios[i]);
+    }
+    evio_close(s_bulk_ios[0]);
+    evio_close(s_bulk_ios[1]);
+}
+
+static void start_bulk(evio_t* io, int i) {
+    s_bulk_ios[i] = io;
+    // NOTE: as a tenant of high bandwidth, large socket buffers let a syscall move megabytes
+    so_sndbuf(evio_fd(io), TEST_SOCK_BUFSIZE);
+    so_rcvbuf(evio_fd(io), TEST_SOCK_BUFSIZE);
+    evio_setcb_read(io, on_bulk_read);
+    evio_setcb_write(io, on_bulk_write);
+    evio_set_write_watermarks(io, TEST_HIGH_WATER, TEST_LOW_WATER, on_watermark, 0);
+    evio_read(io);
+    refill(io);
+}
+
+static void on_bulk_accept(evio_t* io) {
+    evio_setcb_close(io, on_close);
+    start_bulk(io, 0);
+}
+
+static void on_bulk_connect(evio_t* io) { start_bulk(io, 1); }
+
+static void on_ping_accept(evio_t* io) {
+    evio_setcb_close(io, on_close);
+    evio_setcb_read(io, on_ping);
+    evio_read(io);
+}
+
+static void on_ping_connect(evio_t* io) { s_ping_ios[s_ping_connected++] = io; }
+
+static int listen_port(evio_t* listenio) {
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(evio_fd(listenio), &addr.sa, &addrlen);
+    return ntohs(addr.sin.sin_port);
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static test_result_t run_pings(const evio_budget_t* budget, const char* name) {
+    memset(&s_result, 0, sizeof(s_result));
+    s_closed = 0;
+    s_ping_connected = 0;
+    s_pings = 0;
+    s_closing = 0;
+    s_bulk_bytes = 0;
+    s_ndelays = 0;
+    s_bulk_ios[0] = s_bulk_ios[1] = NULL;
+    evloop_t* loop = evloop_new(0);
+    evloop_set_io_budget(loop, budget);
+    evio_t* bulk_listenio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_bulk_accept);
+    evio_t* ping_listenio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_ping_accept);
+    assert(bulk_listenio != NULL && ping_listenio != NULL);
+    assert(evloop_create_tcp_client(loop, LOCALHOST, listen_port(bulk_listenio), on_bulk_connect, on_close) != NULL);
+    for (int i = 0; i < TEST_PINGERS; ++i) {
+        assert(evloop_create_tcp_client(loop, LOCALHOST, listen_port(ping_listenio), on_ping_connect, NULL) != NULL);
+    }
+    evtimer_add(loop, on_tick, TEST_PING_GAP_MS, INFINITE);
+    evloop_run(loop);
+    evloop_free(&loop);
+
+    assert(s_ndelays == TEST_PINGS * TEST_PINGERS);
+    qsort(s_delays, s_ndelays, sizeof(uint64_t), compare_u64);
+    s_result.p99 = s_delays[s_ndelays * 99 / 100];
+    s_result.max = s_delays[s_ndelays - 1];
+    printf("%s: bulk %ldMB, max read %dK write %dK per syscall, ping delay p50=%lluus p99=%lluus max=%lluus, "
+           "exhausted accepts=%llu reads=%llu writes=%llu, again ios=%llu (max %u)\n",
+           name, s_bulk_bytes >> 20, s_result.max_readbytes >> 10, s_result.max_writebytes >> 10,
+           (unsigned long long)s_delays[s_ndelays / 2], (unsigned long long)s_result.p99,
+           (unsigned long long)s_result.max, (unsigned long long)s_stats.accept_exhausted,
+           (unsigned long long)s_stats.read_exhausted, (unsigned long long)s_stats.write_exhausted,
+           (unsigned long long)s_stats.again_ios, s_stats.again_ios_max);
+    return s_result;
+}
+
+static void on_free(void* base, size_t len, void* userdata) { free(base); }
+
+void test_io_budget() {
+    s_bulk_buf = evbuf_new(calloc(1, TEST_BULK_BUFSIZE), TEST_BULK_BUFSIZE, on_free, NULL);
+    // NOTE: as before budgets, 3 accepts and 1 read of any bytes per wakeup, writes until write_queue empty
+    evio_budget_t unbounded = {3, 1, 0, 0, 0};
+    test_result_t before = run_pings(&unbounded, "unbounded");
+    assert(MAX(before.max_readbytes, before.max_writebytes) > EVIO_DEFAULT_BUDGET_BYTES);
+    test_result_t after = run_pings(NULL, "default budget");
+    // NOTE: a bulk io moves no more than its bytes budget before others get served
+    assert(after.max_readbytes <= EVIO_DEFAULT_BUDGET_BYTES && after.max_writebytes <= EVIO_DEFAULT_BUDGET_BYTES);
+    assert(s_stats.read_exhausted > 0 && s_stats.write_exhausted > 0 && s_stats.again_ios > 0);
+    printf("ping delay p99 %lluus -> %lluus, max %lluus -> %lluus by io budget\n", (unsigned long long)before.p99,
+           (unsigned long long)after.p99, (unsigned long long)before.max, (unsigned long long)after.max);
+    evbuf_unref(s_bulk_buf);
+}
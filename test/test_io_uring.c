@@ -0,0 +1,99 @@
+#include "base.h"
+#include "datetime.h"
+#include "evloop_group.h"
+#include "socket.h"
+#include "sockopt.h"
+#include "sockunion.h"
+#include "test.h"
+#include "thread.h"
+
+#define TEST_CLIENTS     4
+#define TEST_DURATION_MS 1000
+#define TEST_MSG_SIZE    64
+#define TEST_BULK_SIZE   (4 << 20) // 4M
+#define TEST_SOCKBUF     (64 << 10) // small socket buffers, so server enqueues write_queue
+
+static int s_port = 0;
+static atomic_long s_nrequests = ATOMIC_VAR_INIT(0);
+
+static void on_echo(evio_t* io, void* buf, int readbytes) {
+    evio_write(io, buf, readbytes);
+}
+
+static void on_accept(evio_t* io) {
+    so_sndbuf(evio_fd(io), TEST_SOCKBUF);
+    evio_setcb_read(io, on_echo);
+    evio_read(io);
+}
+
+static int connect_server(int rcvbuf) {
+    sockaddr_u addr;
+    memset(&addr, 0, sizeof(addr));
+    sockunion_set_ipport(&addr, LOCALHOST, s_port);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (rcvbuf > 0) {
+        so_rcvbuf(fd, rcvbuf);
+    }
+    assert(connect(fd, &addr.sa, sockunion_get_addrlen(&addr)) == 0);
+    tcp_nodelay(fd, 1);
+    return fd;
+}
+
+static THREAD_ROUTINE(echo_client) {
+    char buf[TEST_MSG_SIZE] = {0};
+    int fd = connect_server(0);
+    long nrequests = 0;
+    unsigned long long end = gettimeofday_ms() + TEST_DURATION_MS;
+    while (gettimeofday_ms() < end) {
+        if (writen(fd, buf, sizeof(buf)) != sizeof(buf))
+            break;
+        if (readn(fd, buf, sizeof(buf)) != sizeof(buf))
+            break;
+        ++nrequests;
+    }
+    close(fd);
+    s_nrequests += nrequests;
+    return NULL;
+}
+
+static void test_bulk_echo() {
+    char* sendbuf = (char*)malloc(TEST_BULK_SIZE);
+    char* recvbuf = (char*)malloc(TEST_BULK_SIZE);
+    for (int i = 0; i < TEST_BULK_SIZE; ++i) {
+        sendbuf[i] = (char)(i * 31 + (i >> 13));
+    }
+    int fd = connect_server(TEST_SOCKBUF);
+    assert(writen(fd, sendbuf, TEST_BULK_SIZE) == TEST_BULK_SIZE);
+    assert(readn(fd, recvbuf, TEST_BULK_SIZE) == TEST_BULK_SIZE);
+    assert(memcmp(sendbuf, recvbuf, TEST_BULK_SIZE) == 0);
+    close(fd);
+    free(sendbuf);
+    free(recvbuf);
+    printf("bulk echo %d bytes ok\n", TEST_BULK_SIZE);
+}
+
+void test_io_uring() {
+    printf("engine=%s\n", evio_engine());
+    evloop_group_t* group = evloop_group_new(1, 0);
+    s_port = evloop_group_create_tcp_server(group, LOCALHOST, 0, on_accept);
+    assert(s_port > 0);
+    evloop_group_start(group);
+
+    test_bulk_echo();
+
+    thread_t clients[TEST_CLIENTS];
+    s_nrequests = 0;
+    unsigned long long start = gettimeofday_us();
+    for (int i = 0; i < TEST_CLIENTS; ++i) {
+        clients[i] = thread_create(echo_client, NULL);
+    }
+    for (int i = 0; i < TEST_CLIENTS; ++i) {
+        thread_join(clients[i], NULL);
+    }
+    double seconds = (gettimeofday_us() - start) / 1e6;
+    printf("engine=%s clients=%d requests=%ld qps=%.0f\n", evio_engine(), TEST_CLIENTS, (long)s_nrequests,
+           s_nrequests / seconds);
+    assert(evloop_group_naccepts(group) == TEST_CLIENTS + 1);
+
+    evloop_group_free(&group);
+}
@@ -0,0 +1,189 @@
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "base.h"
+#include "eventloop.h"
+#include "socket.h"
+#include "sockunion.h"
+#include "test.h"
+
+// idle connections of a line protocol server: one request, keepalive, then idle.
+// NOTE: loopback socketpairs, capped by RLIMIT_NOFILE.
+#define TEST_PAIRS        1000000
+#define TEST_KEEPALIVE_MS 60000
+#define TEST_REQUEST      "ping\n"
+#define TEST_REQUEST_LEN  5
+
+static int (*s_fds)[2] = NULL;
+static int s_pairs = 0;
+static int s_replies = 0;
+
+static long rss_kb() {
+    long pages = 0, resident = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        fscanf(fp, "%ld %ld", &pages, &resident);
+        fclose(fp);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void on_line(evio_t* io, void* buf, int readbytes) {
+    assert(readbytes == TEST_REQUEST_LEN && memcmp(buf, TEST_REQUEST, readbytes) == 0);
+    evio_write(io, buf, readbytes);
+    evio_read_until_delim(io, '\n');
+    if (++s_replies == s_pairs) {
+        evloop_stop(event_loop(io));
+    }
+}
+
+static evio_t* serve(evloop_t* loop, int fd) {
+    evio_t* io = evio_get(loop, fd);
+    evio_setcb_read(io, on_line);
+    evio_set_keepalive_timeout(io, TEST_KEEPALIVE_MS);
+    evio_read_until_delim(io, '\n');
+    return io;
+}
+
+static void recv_reply(int fd) {
+    char buf[TEST_REQUEST_LEN];
+    assert(read(fd, buf, sizeof(buf)) == TEST_REQUEST_LEN && memcmp(buf, TEST_REQUEST, sizeof(buf)) == 0);
+}
+
+// @return rss bytes per idle connection, measured in a child process for a clean heap
+static long run_idle(int flags) {
+    int pipefd[2];
+    assert(pipe(pipefd) == 0);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        long rss = rss_kb();
+        evloop_t* loop = evloop_new(flags);
+        s_replies = 0;
+        for (int i = 0; i < s_pairs; ++i) {
+            serve(loop, s_fds[i][0]);
+            assert(write(s_fds[i][1], TEST_REQUEST, TEST_REQUEST_LEN) == TEST_REQUEST_LEN);
+        }
+        evloop_run(loop);
+        assert(s_replies == s_pairs);
+        long per_conn = (rss_kb() - rss) * 1024 / s_pairs;
+        for (int i = 0; i < s_pairs; ++i) {
+            recv_reply(s_fds[i][1]);
+        }
+        assert(write(pipefd[1], &per_conn, sizeof(per_conn)) == sizeof(per_conn));
+        _exit(0);
+    }
+    long per_conn = 0;
+    assert(read(pipefd[0], &per_conn, sizeof(per_conn)) == sizeof(per_conn));
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    close(pipefd[0]);
+    close(pipefd[1]);
+    printf("idle connections=%d %s: rss %ld bytes/conn, %ldMB per 1M connections\n", s_pairs,
+           flags & EVLOOP_FLAG_LEAN ? "lean" : "default", per_conn, per_conn * 1000000 / (1 << 20));
+    return per_conn;
+}
+
+// lean server: requests split over reads keep own readbuf, returned once idle
+static unpack_setting_t s_setting;
+static int s_naccepts = 0;
+static int s_lines = 0;
+static int s_packets = 0;
+static int s_client_fds[2];
+
+static void check_done(evloop_t* loop) {
+    if (s_lines == 1 && s_packets == 2) {
+        evloop_stop(loop);
+    }
+}
+
+static void on_lean_line(evio_t* io, void* buf, int readbytes) {
+    assert(readbytes == TEST_REQUEST_LEN && memcmp(buf, TEST_REQUEST, readbytes) == 0);
+    // NOTE: filled on first use
+    sockaddr_u peeraddr;
+    socklen_t addrlen = sizeof(peeraddr);
+    getsockname(s_client_fds[0], &peeraddr.sa, &addrlen);
+    assert(memcmp(evio_peeraddr(io), &peeraddr, addrlen) == 0);
+    ++s_lines;
+    check_done(event_loop(io));
+}
+
+static void on_lean_packet(evio_t* io, void* buf, int readbytes) {
+    assert(readbytes == 4 && memcmp(buf, s_packets ? "efgh" : "abcd", 4) == 0);
+    ++s_packets;
+    check_done(event_loop(io));
+}
+
+static void on_lean_accept(evio_t* io) {
+    if (s_naccepts++ == 0) {
+        evio_setcb_read(io, on_lean_line);
+        evio_read_until_delim(io, '\n');
+    } else {
+        evio_setcb_read(io, on_lean_packet);
+        evio_set_unpack(io, &s_setting);
+        evio_read(io);
+    }
+}
+
+static void on_rest(evtimer_t* timer) {
+    assert(write(s_client_fds[0], "ng\n", 3) == 3);
+    assert(write(s_client_fds[1], "gh", 2) == 2);
+}
+
+static void run_lean_server() {
+    evloop_t* loop = evloop_new(EVLOOP_FLAG_LEAN);
+    evio_t* listenio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_lean_accept);
+    assert(listenio != NULL);
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(evio_fd(listenio), &addr.sa, &addrlen);
+    memset(&s_setting, 0, sizeof(s_setting));
+    s_setting.mode = UNPACK_BY_FIXED_LENGTH;
+    s_setting.fixed_length = 4;
+    for (int i = 0; i < 2; ++i) {
+        s_client_fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+        assert(connect(s_client_fds[i], &addr.sa, addrlen) == 0);
+    }
+    assert(write(s_client_fds[0], "pi", 2) == 2);
+    assert(write(s_client_fds[1], "abcdef", 6) == 6);
+    evtimer_add(loop, on_rest, 20, 1);
+    evloop_run(loop);
+    assert(s_lines == 1 && s_packets == 2);
+
+    // NOTE: 8K readbuf of evio_read_until_delim taken from loop->bufpool, and returned
+    evloop_bufpool_stats_t pool[EVLOOP_BUFPOOL_CLASSES];
+    evloop_bufpool_stats(loop, pool);
+    assert(pool[1].size == 8192 && pool[1].misses > 0);
+    evloop_memory_stats_t stats;
+    evloop_memory_stats(loop, &stats);
+    assert(stats.used == 0);
+    close(s_client_fds[0]);
+    close(s_client_fds[1]);
+    evloop_free(&loop);
+}
+
+void test_lean_evio() {
+    run_lean_server();
+
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    s_pairs = MIN(TEST_PAIRS, ((long)rl.rlim_cur - 64) / 2);
+    s_fds = calloc(s_pairs, sizeof(*s_fds));
+    for (int i = 0; i < s_pairs; ++i) {
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, s_fds[i]) == 0);
+    }
+
+    long normal = run_idle(0);
+    long lean = run_idle(EVLOOP_FLAG_LEAN);
+    printf("lean: %.1fx less memory per idle connection\n", (double)normal / lean);
+    assert(lean * 4 < normal);
+
+    for (int i = 0; i < s_pairs; ++i) {
+        close(s_fds[i][0]);
+        close(s_fds[i][1]);
+    }
+    free(s_fds);
+}
@@ -0,0 +1,152 @@
+#include "base.h"
+#include "datetime.h"
+#include "eventloop.h"
+#include "test.h"
+#include "thread.h"
+
+#define TEST_POSTS   1000000
+#define TEST_SLOW_MS 20
+
+static long s_nhandled = 0;
+static atomic_int s_done = ATOMIC_VAR_INIT(0);
+static atomic_int s_reading = ATOMIC_VAR_INIT(0);
+static long s_snapshots = 0;
+
+static void on_noop(event_t* ev) {
+    if (++s_nhandled == TEST_POSTS) {
+        s_done = 1;
+    }
+}
+
+static void on_slow(event_t* ev) {
+    // NOTE: the clock of stats, or it may end up to 999ns short of TEST_SLOW_MS
+    uint64_t end = gethrtime_ns() + TEST_SLOW_MS * 1000000ULL;
+    while (gethrtime_ns() < end)
+        ;
+}
+
+static void on_tick(evtimer_t* timer) {
+}
+
+static THREAD_ROUTINE(loop_thread) {
+    evloop_run((evloop_t*)userdata);
+    return NULL;
+}
+
+static void check_histogram(const evloop_histogram_t* hist) {
+    uint64_t cnt = 0;
+    for (int i = 0; i < EVLOOP_STATS_BUCKETS; ++i) {
+        cnt += hist->buckets[i];
+    }
+    assert(cnt == hist->count);
+}
+
+static void check_stats(const evloop_stats_t* stats) {
+    for (int i = 0; i < EVLOOP_STATS_TYPES; ++i) {
+        check_histogram(&stats->callbacks[i]);
+    }
+    check_histogram(&stats->timer_lag);
+    for (int i = 1; i < EVLOOP_STATS_SLOWEST; ++i) {
+        assert(stats->slowest[i - 1].duration_ns >= stats->slowest[i].duration_ns);
+    }
+}
+
+// snapshot concurrently, every snapshot must be consistent.
+static THREAD_ROUTINE(reader_thread) {
+    evloop_t* loop = (evloop_t*)userdata;
+    evloop_stats_t stats;
+    while (s_reading) {
+        assert(evloop_stats(loop, &stats) == 0);
+        check_stats(&stats);
+        ++s_snapshots;
+        ev_usleep(100);
+    }
+    return NULL;
+}
+
+static double run_posts(int flags) {
+    evloop_t* loop = evloop_new(flags);
+    evtimer_add(loop, on_tick, 1, INFINITE);
+    s_nhandled = 0;
+    s_done = 0;
+    s_snapshots = 0;
+    s_reading = 1;
+    thread_t th = thread_create(loop_thread, loop);
+    while (evloop_status(loop) != EVLOOP_STATUS_RUNNING) {
+        ev_msleep(1);
+    }
+    thread_t reader = 0;
+    if (flags & EVLOOP_FLAG_STATS) {
+        reader = thread_create(reader_thread, loop);
+    }
+
+    event_t ev;
+    memset(&ev, 0, sizeof(ev));
+    evloop_stats_t stats;
+    if (flags & EVLOOP_FLAG_STATS) {
+        // NOTE: post on_slow while idle, or callbacks preempted by the producer may be slower.
+        assert(evloop_stats(loop, &stats) == 0);
+        uint64_t ncustom = stats.callbacks[EVLOOP_STATS_CUSTOM].count;
+        ev.cb = on_slow;
+        evloop_post_event(loop, &ev);
+        do {
+            ev_msleep(1);
+            assert(evloop_stats(loop, &stats) == 0);
+        } while (stats.callbacks[EVLOOP_STATS_CUSTOM].count == ncustom);
+        assert(stats.slowest[0].cb == (void*)on_slow);
+        assert(stats.slowest[0].duration_ns >= TEST_SLOW_MS * 1000000ULL);
+        assert(stats.slowest[0].event_type == EVENT_TYPE_CUSTOM && stats.slowest[0].fd == -1);
+    }
+    ev.cb = on_noop;
+    uint64_t start = gethrtime_us();
+    for (int i = 0; i < TEST_POSTS; ++i) {
+        evloop_post_event(loop, &ev);
+    }
+    while (!s_done) {
+        sched_yield();
+    }
+    uint64_t elapsed_us = gethrtime_us() - start;
+    // let timers fire for a while
+    ev_msleep(100);
+    s_reading = 0;
+    if (reader) {
+        thread_join(reader, NULL);
+    }
+
+    if (flags & EVLOOP_FLAG_STATS) {
+        assert(evloop_stats(loop, &stats) == 0);
+        check_stats(&stats);
+        const evloop_histogram_t* custom = &stats.callbacks[EVLOOP_STATS_CUSTOM];
+        const evloop_histogram_t* timer = &stats.callbacks[EVLOOP_STATS_TIMER];
+        assert(custom->count >= TEST_POSTS + 1);
+        assert(timer->count > 0 && stats.timer_lag.count >= timer->count);
+        printf("loops=%llu poll=%llums run=%llums snapshots=%ld\n", (unsigned long long)stats.loop_cnt,
+               (unsigned long long)stats.poll_ns / 1000000, (unsigned long long)stats.run_ns / 1000000, s_snapshots);
+        printf("custom: count=%llu avg=%lluns p50=%lluns p99=%lluns max=%lluns\n", (unsigned long long)custom->count,
+               (unsigned long long)(custom->sum_ns / custom->count),
+               (unsigned long long)evloop_histogram_percentile(custom, 50),
+               (unsigned long long)evloop_histogram_percentile(custom, 99), (unsigned long long)custom->max_ns);
+        printf("timer lag: count=%llu p50=%lluus p99=%lluus max=%lluus\n", (unsigned long long)stats.timer_lag.count,
+               (unsigned long long)evloop_histogram_percentile(&stats.timer_lag, 50) / 1000,
+               (unsigned long long)evloop_histogram_percentile(&stats.timer_lag, 99) / 1000,
+               (unsigned long long)stats.timer_lag.max_ns / 1000);
+        for (int i = 0; i < EVLOOP_STATS_SLOWEST && stats.slowest[i].cb; ++i) {
+            printf("slowest[%d]: cb=%p user_cb=%p type=%d fd=%d %lluus\n", i, stats.slowest[i].cb,
+                   stats.slowest[i].user_cb, stats.slowest[i].event_type, stats.slowest[i].fd,
+                   (unsigned long long)stats.slowest[i].duration_ns / 1000);
+        }
+    } else {
+        assert(evloop_stats(loop, &stats) == -1);
+    }
+
+    evloop_stop(loop);
+    thread_join(th, NULL);
+    evloop_free(&loop);
+    return elapsed_us * 1000.0 / TEST_POSTS;
+}
+
+void test_loop_stats() {
+    double off = run_posts(0);
+    double on = run_posts(EVLOOP_FLAG_STATS);
+    printf("posts=%d stats off: %.0fns/event, on: %.0fns/event\n", TEST_POSTS, off, on);
+}
@@ -0,0 +1,185 @@
+#include "base.h"
+#include "datetime.h"
+#include "eventloop.h"
+#include "socket.h"
+#include "sockopt.h"
+#include "sockunion.h"
+#include "test.h"
+#include "thread.h"
+
+#define TEST_BUDGET     (4 << 20)
+#define TEST_RESUME     (3 << 20)
+#define TEST_SOCKBUF    (16 << 10)
+// swarm: echo clients which send 1MB each but do not read until drain
+#define TEST_CLIENTS    32
+#define TEST_LATE       8
+#define TEST_PER_CLIENT (1 << 20)
+#define TEST_CHUNK      (64 << 10)
+#define TEST_STALL_MS   100
+#define TEST_TIMEOUT_MS 10000
+
+static atomic_int s_naccepts = ATOMIC_VAR_INIT(0);
+static atomic_int s_throttled = ATOMIC_VAR_INIT(0);
+static size_t s_used_max = 0;
+
+static void on_echo(evio_t* io, void* buf, int readbytes) { evio_write(io, buf, readbytes); }
+
+static void on_accept(evio_t* io) {
+    so_sndbuf(evio_fd(io), TEST_SOCKBUF);
+    evio_setcb_read(io, on_echo);
+    evio_read_start(io);
+    atomic_fetch_add(&s_naccepts, 1);
+}
+
+static void on_probe(evtimer_t* timer) {
+    evloop_memory_stats_t stats;
+    evloop_memory_stats(event_loop(timer), &stats);
+    if (stats.used > s_used_max) {
+        s_used_max = stats.used;
+    }
+    atomic_store(&s_throttled, stats.throttled);
+}
+
+static THREAD_ROUTINE(loop_thread) {
+    evloop_run((evloop_t*)userdata);
+    return NULL;
+}
+
+static int connect_client(sockaddr_u* addr, socklen_t addrlen) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    so_rcvbuf(fd, TEST_SOCKBUF);
+    assert(connect(fd, &addr->sa, addrlen) == 0);
+    nonblocking(fd);
+    return fd;
+}
+
+// @return bytes sent, from offset *sent of the (i & 0xFF) pattern
+static int send_pattern(int fd, long* sent) {
+    static char buf[TEST_CHUNK];
+    int len = MIN(TEST_CHUNK, TEST_PER_CLIENT - *sent);
+    if (len <= 0)
+        return 0;
+    for (int i = 0; i < len; ++i) {
+        buf[i] = (char)((*sent + i) & 0xFF);
+    }
+    int n = write(fd, buf, len);
+    if (n > 0)
+        *sent += n;
+    return n > 0 ? n : 0;
+}
+
+static int recv_pattern(int fd, long* received) {
+    static char buf[TEST_CHUNK];
+    int n = read(fd, buf, sizeof(buf));
+    if (n <= 0)
+        return 0;
+    for (int i = 0; i < n; ++i) {
+        assert(buf[i] == (char)((*received + i) & 0xFF));
+    }
+    *received += n;
+    return n;
+}
+
+static void run_swarm(int budget) {
+    atomic_store(&s_naccepts, 0);
+    atomic_store(&s_throttled, 0);
+    s_used_max = 0;
+    evloop_t* loop = evloop_new(0);
+    if (budget) {
+        assert(evloop_set_memory_budget(loop, TEST_BUDGET, TEST_RESUME) == 0);
+    }
+    evio_t* listenio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_accept);
+    assert(listenio != NULL);
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(evio_fd(listenio), &addr.sa, &addrlen);
+    evtimer_add(loop, on_probe, 1, INFINITE);
+    thread_t th = thread_create(loop_thread, loop);
+
+    int fds[TEST_CLIENTS + TEST_LATE];
+    long sent[TEST_CLIENTS] = {0}, received[TEST_CLIENTS] = {0};
+    for (int i = 0; i < TEST_CLIENTS; ++i) {
+        fds[i] = connect_client(&addr, addrlen);
+    }
+    while (atomic_load(&s_naccepts) < TEST_CLIENTS) {
+        ev_msleep(1);
+    }
+
+    // fill: send until the server stops reading or socket buffers are full
+    uint64_t last_progress = gethrtime_us() / 1000;
+    while (gethrtime_us() / 1000 - last_progress < TEST_STALL_MS) {
+        int progress = 0;
+        for (int i = 0; i < TEST_CLIENTS; ++i) {
+            progress += send_pattern(fds[i], &sent[i]);
+        }
+        if (progress) {
+            last_progress = gethrtime_us() / 1000;
+        } else {
+            ev_msleep(1);
+        }
+    }
+    long total_sent = 0;
+    for (int i = 0; i < TEST_CLIENTS; ++i) {
+        total_sent += sent[i];
+    }
+
+    // late clients are not accepted while throttled
+    for (int i = TEST_CLIENTS; i < TEST_CLIENTS + TEST_LATE; ++i) {
+        fds[i] = connect_client(&addr, addrlen);
+    }
+    ev_msleep(TEST_STALL_MS);
+    int throttled = atomic_load(&s_throttled);
+    int naccepts_throttled = atomic_load(&s_naccepts);
+    if (budget) {
+        assert(throttled && naccepts_throttled == TEST_CLIENTS);
+    }
+
+    // drain: read all echoes and send the rest
+    uint64_t start = gethrtime_us() / 1000;
+    long total_received = 0;
+    while (total_received < (long)TEST_CLIENTS * TEST_PER_CLIENT) {
+        assert(gethrtime_us() / 1000 - start < TEST_TIMEOUT_MS);
+        int progress = 0;
+        for (int i = 0; i < TEST_CLIENTS; ++i) {
+            int n = recv_pattern(fds[i], &received[i]);
+            total_received += n;
+            progress += n + send_pattern(fds[i], &sent[i]);
+        }
+        if (!progress) {
+            ev_msleep(1);
+        }
+    }
+    while (atomic_load(&s_naccepts) < TEST_CLIENTS + TEST_LATE) {
+        assert(gethrtime_us() / 1000 - start < TEST_TIMEOUT_MS);
+        ev_msleep(1);
+    }
+    uint64_t drain_ms = gethrtime_us() / 1000 - start;
+    for (int i = 0; i < TEST_CLIENTS + TEST_LATE; ++i) {
+        close(fds[i]);
+    }
+    evloop_stop(loop);
+    thread_join(th, NULL);
+
+    evloop_memory_stats_t stats;
+    evloop_memory_stats(loop, &stats);
+    printf("swarm %s: clients=%d x %dK, sent before stall=%ldK, peak usage=%zuK, late accepted while stalled=%d/%d, "
+           "drain=%llums, throttles=%llu throttled=%llums accept_pauses=%llu read_pauses=%llu\n",
+           budget ? "budget" : "unbounded", TEST_CLIENTS, TEST_PER_CLIENT >> 10, total_sent >> 10,
+           MAX(s_used_max, stats.used_max) >> 10, naccepts_throttled - TEST_CLIENTS, TEST_LATE,
+           (unsigned long long)drain_ms, (unsigned long long)stats.throttles,
+           (unsigned long long)stats.throttled_us / 1000, (unsigned long long)stats.accept_pauses,
+           (unsigned long long)stats.read_pauses);
+    if (budget) {
+        assert(stats.throttles > 0 && !stats.throttled);
+        assert(stats.accept_pauses > 0 && stats.read_pauses > 0);
+        // NOTE: plus what is read and echoed before the largest ones are paused,
+        // and io_uring holds sends in flight longer.
+        assert(stats.used_max < 3 * TEST_BUDGET);
+    }
+    evloop_free(&loop);
+}
+
+void test_memory_budget() {
+    run_swarm(0);
+    run_swarm(1);
+}
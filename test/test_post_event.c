@@ -0,0 +1,130 @@
+#include "base.h"
+#include "datetime.h"
+#include "eventloop.h"
+#include "test.h"
+#include "thread.h"
+
+#define TEST_TOTAL_POSTS 2000000
+
+static evloop_t* s_loop = NULL;
+static int s_posts_per_producer = 0;
+static long s_nhandled = 0;
+static long s_nsum = 0;
+static atomic_int s_done = ATOMIC_VAR_INIT(0);
+
+static void on_custom_event(event_t* ev) {
+    s_nsum += (long)(intptr_t)event_userdata(ev);
+    if (++s_nhandled == TEST_TOTAL_POSTS) {
+        s_done = 1;
+    }
+}
+
+static THREAD_ROUTINE(loop_thread) {
+    evloop_run(s_loop);
+    return NULL;
+}
+
+static THREAD_ROUTINE(producer_thread) {
+    event_t ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.cb = on_custom_event;
+    for (int i = 0; i < s_posts_per_producer; ++i) {
+        ev.userdata = (void*)(intptr_t)(i & 0xFF);
+        evloop_post_event(s_loop, &ev);
+    }
+    return NULL;
+}
+
+static void run_producers(int nproducers) {
+    s_loop = evloop_new(0);
+    s_posts_per_producer = TEST_TOTAL_POSTS / nproducers;
+    s_nhandled = s_nsum = 0;
+    s_done = 0;
+    thread_t th = thread_create(loop_thread, NULL);
+    while (evloop_status(s_loop) != EVLOOP_STATUS_RUNNING) {
+        ev_msleep(1);
+    }
+
+    thread_t* producers = (thread_t*)calloc(nproducers, sizeof(thread_t));
+    uint64_t start = gethrtime_us();
+    for (int i = 0; i < nproducers; ++i) {
+        producers[i] = thread_create(producer_thread, NULL);
+    }
+    for (int i = 0; i < nproducers; ++i) {
+        thread_join(producers[i], NULL);
+    }
+    uint64_t posted_us = gethrtime_us() - start;
+    while (!s_done) {
+        sched_yield();
+    }
+    uint64_t handled_us = gethrtime_us() - start;
+
+    evloop_stop(s_loop);
+    thread_join(th, NULL);
+    evloop_free(&s_loop);
+    free(producers);
+
+    long expected_sum = 0;
+    for (int i = 0; i < s_posts_per_producer; ++i) {
+        expected_sum += i & 0xFF;
+    }
+    assert(s_nsum == expected_sum * nproducers);
+    printf("producers=%d posts=%d post=%.0f/s handled=%.0f/s\n", nproducers, TEST_TOTAL_POSTS,
+           TEST_TOTAL_POSTS / (posted_us / 1e6), TEST_TOTAL_POSTS / (handled_us / 1e6));
+}
+
+// bursts of producers, each burst must be handled without any later post to wake up the loop
+#define TEST_BURSTS          2000
+#define TEST_BURST_PRODUCERS 4
+#define TEST_BURST_POSTS     8
+
+static atomic_long s_burst_handled = ATOMIC_VAR_INIT(0);
+
+static void on_burst_event(event_t* ev) { atomic_fetch_add(&s_burst_handled, 1); }
+
+static THREAD_ROUTINE(burst_thread) {
+    event_t ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.cb = on_burst_event;
+    for (int i = 0; i < TEST_BURST_POSTS; ++i) {
+        evloop_post_event(s_loop, &ev);
+    }
+    return NULL;
+}
+
+static void run_bursts() {
+    s_loop = evloop_new(0);
+    atomic_store(&s_burst_handled, 0);
+    thread_t th = thread_create(loop_thread, NULL);
+    while (evloop_status(s_loop) != EVLOOP_STATUS_RUNNING) {
+        ev_msleep(1);
+    }
+    long expected = 0;
+    for (int burst = 0; burst < TEST_BURSTS; ++burst) {
+        thread_t producers[TEST_BURST_PRODUCERS];
+        for (int i = 0; i < TEST_BURST_PRODUCERS; ++i) {
+            producers[i] = thread_create(burst_thread, NULL);
+        }
+        for (int i = 0; i < TEST_BURST_PRODUCERS; ++i) {
+            thread_join(producers[i], NULL);
+        }
+        expected += TEST_BURST_PRODUCERS * TEST_BURST_POSTS;
+        // NOTE: no more posts until handled, a node stuck in the queue never gets here
+        uint64_t start = gethrtime_us();
+        while (atomic_load(&s_burst_handled) != expected) {
+            assert(gethrtime_us() - start < 1000000);
+            sched_yield();
+        }
+    }
+    evloop_stop(s_loop);
+    thread_join(th, NULL);
+    evloop_free(&s_loop);
+    printf("bursts=%d producers=%d posts=%ld all handled\n", TEST_BURSTS, TEST_BURST_PRODUCERS, expected);
+}
+
+void test_post_event() {
+    run_bursts();
+    run_producers(1);
+    run_producers(4);
+    run_producers(16);
+}
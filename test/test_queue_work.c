@@ -0,0 +1,163 @@
+#include "base.h"
+#include "datetime.h"
+#include "errors.h"
+#include "eventloop.h"
+#include "test.h"
+
+#define TEST_THREADS    4
+#define TEST_JOBS       64
+#define TEST_JOB_MS     20 // blocking job, e.g. a sqlite write
+#define TEST_TICK_MS    1
+#define TEST_BATCH_JOBS 10000
+
+static int s_done = 0;
+static int s_canceled = 0;
+static uint64_t s_max_lag_us = 0;
+static uint64_t s_last_tick_us = 0;
+static atomic_int s_gate = ATOMIC_VAR_INIT(0);
+
+static void blocking_job(void* arg) { ev_msleep(TEST_JOB_MS); }
+
+static void gated_job(void* arg) {
+    while (!atomic_load(&s_gate)) {
+        ev_msleep(1);
+    }
+}
+
+static void noop_job(void* arg) {}
+
+static void on_job_done(void* arg, int status) {
+    if (status == ERR_TASK_CANCELED) {
+        ++s_canceled;
+    } else {
+        assert(status == 0);
+        ++s_done;
+    }
+    evloop_t* loop = (evloop_t*)arg;
+    if (s_done + s_canceled == TEST_JOBS) {
+        evloop_stop(loop);
+    }
+}
+
+static void on_tick(evtimer_t* timer) {
+    uint64_t now = gethrtime_us();
+    if (s_last_tick_us && now - s_last_tick_us > s_max_lag_us) {
+        s_max_lag_us = now - s_last_tick_us;
+    }
+    s_last_tick_us = now;
+}
+
+static void on_inline_job(evtimer_t* timer) {
+    blocking_job(NULL);
+    on_job_done(event_loop(timer), 0);
+}
+
+// run jobs inline in loop callback, or offloaded, while a 1ms timer ticks
+static void run_jobs(int offload) {
+    evloop_t* loop = evloop_new(0);
+    s_done = s_canceled = 0;
+    s_max_lag_us = s_last_tick_us = 0;
+    evtimer_add(loop, on_tick, TEST_TICK_MS, INFINITE);
+    uint64_t start = gethrtime_us();
+    if (offload) {
+        for (int i = 0; i < TEST_JOBS; ++i) {
+            assert(evloop_queue_work(loop, blocking_job, on_job_done, loop) != NULL);
+        }
+        evloop_run(loop);
+    } else {
+        evtimer_add(loop, on_inline_job, TEST_TICK_MS, TEST_JOBS);
+        evloop_run(loop);
+    }
+    uint64_t elapsed_us = gethrtime_us() - start;
+    if (offload) {
+        evloop_work_stats_t stats;
+        evloop_work_stats(loop, &stats);
+        assert(stats.queued == TEST_JOBS && stats.completed == TEST_JOBS && stats.depth == 0 && stats.running == 0);
+        printf("offload: jobs=%d x %dms in %llums, max tick gap %.1fms, depth_max=%u wait p50=%.1fms p99=%.1fms "
+               "run p50=%.1fms\n",
+               TEST_JOBS, TEST_JOB_MS, (unsigned long long)elapsed_us / 1000, s_max_lag_us / 1000.0, stats.depth_max,
+               evloop_histogram_percentile(&stats.wait, 50) / 1e6, evloop_histogram_percentile(&stats.wait, 99) / 1e6,
+               evloop_histogram_percentile(&stats.run, 50) / 1e6);
+        assert(stats.depth_max >= TEST_JOBS - TEST_THREADS);
+    } else {
+        printf("inline: jobs=%d x %dms in %llums, max tick gap %.1fms\n", TEST_JOBS, TEST_JOB_MS,
+               (unsigned long long)elapsed_us / 1000, s_max_lag_us / 1000.0);
+    }
+    evloop_free(&loop);
+}
+
+// cancel jobs not started, started ones can not be canceled
+static void run_cancel() {
+    evloop_t* loop = evloop_new(0);
+    s_done = s_canceled = 0;
+    atomic_store(&s_gate, 0);
+    evwork_t* works[TEST_JOBS];
+    for (int i = 0; i < TEST_JOBS; ++i) {
+        works[i] = evloop_queue_work(loop, gated_job, on_job_done, loop);
+    }
+    // NOTE: wait all pool threads blocked in the first jobs.
+    evloop_work_stats_t stats;
+    do {
+        ev_msleep(1);
+        evloop_work_stats(loop, &stats);
+    } while (stats.running < TEST_THREADS);
+    assert(stats.depth == TEST_JOBS - TEST_THREADS);
+    int ncanceled = 0;
+    for (int i = 0; i < TEST_JOBS; ++i) {
+        if (evloop_cancel_work(works[i]) == 0) {
+            ++ncanceled;
+        }
+    }
+    assert(ncanceled == TEST_JOBS - TEST_THREADS);
+    evloop_work_stats(loop, &stats);
+    assert(stats.depth == 0 && stats.canceled == ncanceled);
+    atomic_store(&s_gate, 1);
+    evloop_run(loop);
+    assert(s_canceled == ncanceled && s_done == TEST_THREADS);
+    printf("cancel: jobs=%d canceled=%d done=%d\n", TEST_JOBS, s_canceled, s_done);
+
+    // NOTE: evloop_free cancels queued ones and waits running ones, no after_work_cb.
+    atomic_store(&s_gate, 0);
+    s_done = s_canceled = 0;
+    for (int i = 0; i < TEST_JOBS; ++i) {
+        evloop_queue_work(loop, gated_job, on_job_done, loop);
+    }
+    do {
+        ev_msleep(1);
+        evloop_work_stats(loop, &stats);
+    } while (stats.running < TEST_THREADS);
+    atomic_store(&s_gate, 1);
+    evloop_free(&loop);
+    assert(s_done == 0 && s_canceled == 0);
+}
+
+// completions are delivered in batches, not one wakeup per job
+static void on_batch_done(void* arg, int status) {
+    if (++s_done == TEST_BATCH_JOBS) {
+        evloop_stop((evloop_t*)arg);
+    }
+}
+
+static void run_batch() {
+    evloop_t* loop = evloop_new(EVLOOP_FLAG_STATS);
+    s_done = 0;
+    for (int i = 0; i < TEST_BATCH_JOBS; ++i) {
+        evloop_queue_work(loop, noop_job, on_batch_done, loop);
+    }
+    evloop_run(loop);
+    evloop_stats_t stats;
+    evloop_stats(loop, &stats);
+    uint64_t nbatches = stats.callbacks[EVLOOP_STATS_CUSTOM].count;
+    printf("batch: jobs=%d wakeups=%llu (%.1f completions/wakeup)\n", TEST_BATCH_JOBS, (unsigned long long)nbatches,
+           (double)TEST_BATCH_JOBS / nbatches);
+    assert(nbatches < TEST_BATCH_JOBS);
+    evloop_free(&loop);
+}
+
+void test_queue_work() {
+    evloop_work_pool_init(TEST_THREADS);
+    run_jobs(0);
+    run_jobs(1);
+    run_cancel();
+    run_batch();
+}
@@ -0,0 +1,153 @@
+#include "base.h"
+#include "eventloop.h"
+#include "socket.h"
+#include "sockunion.h"
+#include "test.h"
+#include "thread.h"
+
+// large messages arriving in 16K chunks paced as from a network: [4 bytes big endian length][body]
+#define TEST_FRAMES     32
+#define TEST_FRAME_SIZE (1 << 20)
+#define TEST_CHUNK_SIZE (16 << 10)
+#define TEST_PACING_US  50
+
+enum {
+    MODE_READ_UNTIL = 0, // evio_read_until_length of header, then body
+    MODE_UNPACK = 1,     // UNPACK_BY_LENGTH_FIELD
+    MODE_CHAIN = 2,      // UNPACK_BY_LENGTH_FIELD with evio_read_chain
+};
+
+static const char* s_mode_names[] = {"evio_read_until_length", "UNPACK_BY_LENGTH_FIELD", "evio_read_chain"};
+
+static unpack_setting_t s_setting;
+static int s_mode = 0;
+static int s_auto = 0;
+static int s_frames = 0;
+static uint64_t s_start_cnt = 0;
+static uint64_t s_wakeups = 0;
+
+static int frame_body_len(int i) { return TEST_FRAME_SIZE + i * 7; }
+
+static void check_body(unsigned char* body, int len) {
+    assert(len == frame_body_len(s_frames));
+    assert(body[0] == (unsigned char)s_frames && body[len - 1] == (unsigned char)~s_frames);
+    ++s_frames;
+}
+
+static void on_body(evio_t* io, void* buf, int readbytes);
+
+static void on_header(evio_t* io, void* buf, int readbytes) {
+    unsigned char* p = (unsigned char*)buf;
+    assert(readbytes == 4);
+    evio_setcb_read(io, on_body);
+    evio_read_until_length(io, (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+}
+
+static void on_body(evio_t* io, void* buf, int readbytes) {
+    check_body((unsigned char*)buf, readbytes);
+    evio_setcb_read(io, on_header);
+    evio_read_until_length(io, 4);
+}
+
+static void on_frame(evio_t* io, void* buf, int readbytes) { check_body((unsigned char*)buf + 4, readbytes - 4); }
+
+static void on_frame_views(evio_t* io, const evio_iov_t* iov, int iovcnt, int len) {
+    unsigned char first = 0;
+    evio_iov_copy(iov, iovcnt, 4, &first, 1);
+    const evio_iov_t* back = &iov[iovcnt - 1];
+    assert(len - 4 == frame_body_len(s_frames));
+    assert(first == (unsigned char)s_frames && ((unsigned char*)back->base)[back->len - 1] == (unsigned char)~s_frames);
+    ++s_frames;
+}
+
+static void on_close(evio_t* io) {
+    s_wakeups = evloop_count(event_loop(io)) - s_start_cnt;
+    evloop_stop(event_loop(io));
+}
+
+static void on_accept(evio_t* io) {
+    evio_setcb_close(io, on_close);
+    assert(evio_set_auto_rcvlowat(io, s_auto) == 0);
+    s_start_cnt = evloop_count(event_loop(io));
+    if (s_mode == MODE_READ_UNTIL) {
+        evio_setcb_read(io, on_header);
+        evio_read_until_length(io, 4);
+    } else if (s_mode == MODE_UNPACK) {
+        evio_setcb_read(io, on_frame);
+        evio_set_unpack(io, &s_setting);
+        evio_read(io);
+    } else {
+        evio_set_unpack(io, &s_setting);
+        evio_read_chain(io, on_frame_views, EIO_DEFAULT_CHAIN_SEG_SIZE);
+    }
+}
+
+static THREAD_ROUTINE(loop_thread) {
+    evloop_run((evloop_t*)userdata);
+    return NULL;
+}
+
+static void send_frame(int fd, char* buf, int i) {
+    int body_len = frame_body_len(i);
+    buf[0] = (char)(body_len >> 24);
+    buf[1] = (char)(body_len >> 16);
+    buf[2] = (char)(body_len >> 8);
+    buf[3] = (char)body_len;
+    buf[4] = (char)i;
+    buf[4 + body_len - 1] = (char)~i;
+    for (int off = 0; off < 4 + body_len;) {
+        int n = write(fd, buf + off, MIN(TEST_CHUNK_SIZE, 4 + body_len - off));
+        assert(n > 0);
+        off += n;
+        usleep(TEST_PACING_US);
+    }
+}
+
+// @return wakeups per frame
+static double run_frames(int mode, int on) {
+    s_mode = mode;
+    s_auto = on;
+    s_frames = 0;
+    memset(&s_setting, 0, sizeof(s_setting));
+    s_setting.mode = UNPACK_BY_LENGTH_FIELD;
+    s_setting.package_max_length = 2 * TEST_FRAME_SIZE;
+    s_setting.body_offset = 4;
+    s_setting.length_field_offset = 0;
+    s_setting.length_field_bytes = 4;
+    s_setting.length_field_coding = BIG_ENDIAN;
+
+    evloop_t* loop = evloop_new(0);
+    evio_t* listenio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_accept);
+    assert(listenio != NULL);
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(evio_fd(listenio), &addr.sa, &addrlen);
+    thread_t th = thread_create(loop_thread, loop);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(fd, &addr.sa, addrlen) == 0);
+    char* buf = (char*)calloc(1, 4 + frame_body_len(TEST_FRAMES));
+    for (int i = 0; i < TEST_FRAMES; ++i) {
+        send_frame(fd, buf, i);
+    }
+    close(fd);
+    thread_join(th, NULL);
+    free(buf);
+
+    assert(s_frames == TEST_FRAMES);
+    double per_frame = (double)s_wakeups / TEST_FRAMES;
+    printf("%s rcvlowat=%s: %d frames x %dK in %dK chunks, wakeups=%llu (%.1f per frame)\n",
+           s_mode_names[mode], on ? "auto" : "off",
+           TEST_FRAMES, TEST_FRAME_SIZE >> 10, TEST_CHUNK_SIZE >> 10, (unsigned long long)s_wakeups, per_frame);
+    evloop_free(&loop);
+    return per_frame;
+}
+
+void test_rcvlowat() {
+    for (int mode = MODE_READ_UNTIL; mode <= MODE_CHAIN; ++mode) {
+        double off = run_frames(mode, 0);
+        double on = run_frames(mode, 1);
+        printf("wakeups per frame reduced %.1fx by SO_RCVLOWAT\n", off / on);
+        assert(on * 2 < off);
+    }
+}
@@ -0,0 +1,274 @@
+#include "base.h"
+#include "eventloop.h"
+#include "socket.h"
+#include "sockunion.h"
+#include "test.h"
+#include "thread.h"
+
+// bulk of length field frames: [4 bytes big endian length][body], 1~8MB ones between small ones
+#define TEST_FRAMES     256
+#define TEST_LARGE_SIZE (1 << 20)
+#define TEST_SMALL_SIZE 1000
+#define TEST_MAX_LENGTH (16 << 20)
+
+enum {
+    MODE_READBUF = 0, // evio_set_unpack + evio_read
+    MODE_VIEWS = 1,   // evio_read_chain with read_chain_cb
+    MODE_COPY = 2,    // evio_read_chain, read_cb with contiguous frames
+};
+
+static const char* s_mode_names[] = {"readbuf", "chain views", "chain copy"};
+static unpack_setting_t s_setting;
+static int s_mode = 0;
+static int s_frames = 0;
+static long s_bytes = 0;
+static double s_cpu_start = 0;
+static double s_cpu_ms = 0;
+static long long s_mem_used = 0;
+
+static double thread_cpu_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int frame_body_len(int i) { return (i % 4 == 3 ? TEST_LARGE_SIZE * (1 + i % 8) : TEST_SMALL_SIZE) + i * 7; }
+
+// NOTE: first and last byte of body only, verifying is not measured
+static void check_frame(int len, unsigned char first, unsigned char last) {
+    assert(len == 4 + frame_body_len(s_frames));
+    assert(first == (unsigned char)s_frames && last == (unsigned char)~s_frames);
+    ++s_frames;
+    s_bytes += len;
+}
+
+static void on_frame(evio_t* io, void* buf, int readbytes) {
+    unsigned char* p = (unsigned char*)buf;
+    check_frame(readbytes, p[4], p[readbytes - 1]);
+}
+
+static void on_frame_views(evio_t* io, const evio_iov_t* iov, int iovcnt, int len) {
+    unsigned char first = 0;
+    evio_iov_copy(iov, iovcnt, 4, &first, 1);
+    const evio_iov_t* back = &iov[iovcnt - 1];
+    check_frame(len, first, ((unsigned char*)back->base)[back->len - 1]);
+}
+
+static void on_close(evio_t* io) {
+    s_cpu_ms = thread_cpu_ms() - s_cpu_start;
+    evloop_memory_stats_t stats;
+    evloop_memory_stats(event_loop(io), &stats);
+    s_mem_used = stats.used;
+    evloop_stop(event_loop(io));
+}
+
+static void on_accept(evio_t* io) {
+    evio_setcb_close(io, on_close);
+    evio_set_unpack(io, &s_setting);
+    s_cpu_start = thread_cpu_ms();
+    if (s_mode == MODE_READBUF) {
+        evio_setcb_read(io, on_frame);
+        evio_read(io);
+    } else if (s_mode == MODE_VIEWS) {
+        assert(evio_read_chain(io, on_frame_views, EIO_DEFAULT_CHAIN_SEG_SIZE) == 0);
+    } else {
+        evio_setcb_read(io, on_frame);
+        assert(evio_read_chain(io, NULL, EIO_DEFAULT_CHAIN_SEG_SIZE) == 0);
+    }
+}
+
+static THREAD_ROUTINE(loop_thread) {
+    evloop_run((evloop_t*)userdata);
+    return NULL;
+}
+
+static void send_frame(int fd, char* buf, int i) {
+    int body_len = frame_body_len(i);
+    buf[0] = (char)(body_len >> 24);
+    buf[1] = (char)(body_len >> 16);
+    buf[2] = (char)(body_len >> 8);
+    buf[3] = (char)body_len;
+    buf[4] = (char)i;
+    buf[4 + body_len - 1] = (char)~i;
+    for (int off = 0; off < 4 + body_len;) {
+        int n = write(fd, buf + off, 4 + body_len - off);
+        assert(n > 0);
+        off += n;
+    }
+}
+
+// @return server loop thread cpu ms per GB
+static double run_bulk(int mode) {
+    s_mode = mode;
+    s_frames = 0;
+    s_bytes = 0;
+    memset(&s_setting, 0, sizeof(s_setting));
+    s_setting.mode = UNPACK_BY_LENGTH_FIELD;
+    s_setting.package_max_length = TEST_MAX_LENGTH;
+    s_setting.body_offset = 4;
+    s_setting.length_field_offset = 0;
+    s_setting.length_field_bytes = 4;
+    s_setting.length_field_coding = BIG_ENDIAN;
+
+    evloop_t* loop = evloop_new(0);
+    evio_t* listenio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_accept);
+    assert(listenio != NULL);
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(evio_fd(listenio), &addr.sa, &addrlen);
+    thread_t th = thread_create(loop_thread, loop);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(fd, &addr.sa, addrlen) == 0);
+    char* buf = (char*)calloc(1, 4 + TEST_LARGE_SIZE * 8 + TEST_FRAMES * 7);
+    for (int i = 0; i < TEST_FRAMES; ++i) {
+        send_frame(fd, buf, i);
+    }
+    close(fd);
+    thread_join(th, NULL);
+    free(buf);
+
+    assert(s_frames == TEST_FRAMES);
+    // NOTE: segments returned once drained
+    assert(s_mem_used == 0);
+    double cpu_per_gb = s_cpu_ms * (1 << 30) / s_bytes;
+    printf("%s: %d frames %ldMB, cpu %.0fms per GB\n", s_mode_names[mode], s_frames, s_bytes >> 20, cpu_per_gb);
+    evloop_free(&loop);
+    return cpu_per_gb;
+}
+
+// fixed length frames across small segments, closed in read_chain_cb
+#define TEST_FIXED_LENGTH 3000
+#define TEST_FIXED_FRAMES 30
+#define TEST_FIXED_CLOSE  20
+
+static int s_fixed_frames = 0;
+static int s_socks[2];
+
+static void on_fixed_frame(evio_t* io, const evio_iov_t* iov, int iovcnt, int len) {
+    assert(len == TEST_FIXED_LENGTH);
+    char frame[TEST_FIXED_LENGTH];
+    assert(evio_iov_copy(iov, iovcnt, 0, frame, len) == len);
+    for (int i = 0; i < len; ++i) {
+        assert(frame[i] == (char)(s_fixed_frames * TEST_FIXED_LENGTH + i));
+    }
+    if (++s_fixed_frames == TEST_FIXED_CLOSE) {
+        // NOTE: chain freed once read_chain_cb returns
+        evio_close(io);
+    }
+}
+
+static void on_fixed_close(evio_t* io) { evloop_stop(event_loop(io)); }
+
+static void run_fixed_close() {
+    evloop_t* loop = evloop_new(0);
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, s_socks) == 0);
+    static char data[TEST_FIXED_LENGTH * TEST_FIXED_FRAMES];
+    for (int i = 0; i < (int)sizeof(data); ++i) {
+        data[i] = (char)i;
+    }
+    assert(write(s_socks[1], data, sizeof(data)) == sizeof(data));
+    unpack_setting_t setting;
+    memset(&setting, 0, sizeof(setting));
+    setting.mode = UNPACK_BY_FIXED_LENGTH;
+    setting.fixed_length = TEST_FIXED_LENGTH;
+    evio_t* io = evio_get(loop, s_socks[0]);
+    evio_setcb_close(io, on_fixed_close);
+    evio_set_unpack(io, &setting);
+    assert(evio_read_chain(io, on_fixed_frame, 4096) == 0);
+    evloop_run(loop);
+    assert(s_fixed_frames == TEST_FIXED_CLOSE);
+    evloop_memory_stats_t stats;
+    evloop_memory_stats(loop, &stats);
+    assert(stats.used == 0);
+    close(s_socks[1]);
+    evloop_free(&loop);
+}
+
+// switched from evio_read to evio_read_chain with half a frame left in readbuf,
+// frames of [2 bytes big endian length][body of its index]
+#define TEST_SWITCH_BODY   1000
+#define TEST_SWITCH_FRAMES 8
+
+static int s_switch_frames = 0;
+static evio_t* s_switch_io = NULL;
+
+static void check_switch_frame(const evio_iov_t* iov, int iovcnt, int len) {
+    assert(len == 2 + TEST_SWITCH_BODY);
+    char frame[2 + TEST_SWITCH_BODY];
+    assert(evio_iov_copy(iov, iovcnt, 0, frame, len) == len);
+    for (int i = 2; i < len; ++i) {
+        assert(frame[i] == (char)s_switch_frames);
+    }
+    ++s_switch_frames;
+}
+
+static void on_switch_frame_views(evio_t* io, const evio_iov_t* iov, int iovcnt, int len) {
+    check_switch_frame(iov, iovcnt, len);
+    if (s_switch_frames == TEST_SWITCH_FRAMES) {
+        evio_close(io);
+    }
+}
+
+static void on_switch_timer(evtimer_t* timer) {
+    assert(evio_read_chain(s_switch_io, on_switch_frame_views, 4096) == 0);
+}
+
+static void on_switch_frame(evio_t* io, void* buf, int readbytes) {
+    evio_iov_t iov = {buf, (size_t)readbytes};
+    check_switch_frame(&iov, 1, readbytes);
+    evio_read_stop(io);
+    evtimer_add(event_loop(io), on_switch_timer, 10, 1);
+}
+
+static void run_switch() {
+    evloop_t* loop = evloop_new(0);
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, s_socks) == 0);
+    static char data[(2 + TEST_SWITCH_BODY) * TEST_SWITCH_FRAMES];
+    for (int i = 0; i < TEST_SWITCH_FRAMES; ++i) {
+        char* p = data + i * (2 + TEST_SWITCH_BODY);
+        p[0] = (char)(TEST_SWITCH_BODY >> 8);
+        p[1] = (char)TEST_SWITCH_BODY;
+        memset(p + 2, i, TEST_SWITCH_BODY);
+    }
+    int first = (2 + TEST_SWITCH_BODY) * 3 / 2;
+    assert(write(s_socks[1], data, first) == first);
+    unpack_setting_t setting;
+    memset(&setting, 0, sizeof(setting));
+    setting.mode = UNPACK_BY_LENGTH_FIELD;
+    setting.package_max_length = TEST_MAX_LENGTH;
+    setting.body_offset = 2;
+    setting.length_field_offset = 0;
+    setting.length_field_bytes = 2;
+    setting.length_field_coding = BIG_ENDIAN;
+    s_switch_io = evio_get(loop, s_socks[0]);
+    evio_setcb_close(s_switch_io, on_fixed_close);
+    evio_setcb_read(s_switch_io, on_switch_frame);
+    evio_set_unpack(s_switch_io, &setting);
+    evio_read(s_switch_io);
+    thread_t th = thread_create(loop_thread, loop);
+    // NOTE: the rest only after the switch, its half frame comes from readbuf
+    while (s_switch_frames == 0) {
+        ev_msleep(1);
+    }
+    ev_msleep(50);
+    assert(write(s_socks[1], data + first, sizeof(data) - first) == (int)sizeof(data) - first);
+    thread_join(th, NULL);
+    assert(s_switch_frames == TEST_SWITCH_FRAMES);
+    evloop_memory_stats_t stats;
+    evloop_memory_stats(loop, &stats);
+    assert(stats.used == 0);
+    close(s_socks[1]);
+    evloop_free(&loop);
+}
+
+void test_read_chain() {
+    run_fixed_close();
+    run_switch();
+    double readbuf = run_bulk(MODE_READBUF);
+    double views = run_bulk(MODE_VIEWS);
+    double copy = run_bulk(MODE_COPY);
+    printf("chain views: %.1fx less cpu than readbuf, chain copy: %.1fx\n", readbuf / views, readbuf / copy);
+    // NOTE: chain copy pays a copy of frames across segments, for read_cb only.
+    assert(views < readbuf);
+}
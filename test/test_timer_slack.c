@@ -0,0 +1,100 @@
+#include "base.h"
+#include "datetime.h"
+#include "eventloop.h"
+#include "test.h"
+
+// 100k heartbeats of 1s plus 0~99ms jitter, phases spread over 1s as connections come and go
+// NOTE: without jitter, evtimer_add rounds 1000ms to 100ms granularity already.
+#define TEST_HEARTBEATS    100000
+#define TEST_INTERVAL_MS   1000
+#define TEST_JITTER_MS     100
+#define TEST_SPAWN_PER_MS  (TEST_HEARTBEATS / TEST_INTERVAL_MS)
+#define TEST_MEASURE_MS    3000
+#define TEST_LAG_TOLERANCE 20 // ms, beyond slack
+
+static uint32_t s_slack = 0;
+static int s_spawned = 0;
+static uint64_t s_fires = 0;
+static uint64_t s_start_fires = 0;
+static uint64_t s_start_cnt = 0;
+static uint64_t s_wakeups = 0;
+
+static void on_heartbeat(evtimer_t* timer) { ++s_fires; }
+
+static void on_stop(evtimer_t* timer) {
+    evloop_t* loop = event_loop(timer);
+    s_wakeups = evloop_count(loop) - s_start_cnt;
+    evloop_stop(loop);
+}
+
+static void on_spawn(evtimer_t* timer) {
+    evloop_t* loop = event_loop(timer);
+    for (int i = 0; i < TEST_SPAWN_PER_MS; ++i) {
+        uint32_t interval_ms = TEST_INTERVAL_MS + (s_spawned + i) % TEST_JITTER_MS;
+        evtimer_t* heartbeat = evtimer_add(loop, on_heartbeat, interval_ms, INFINITE);
+        evtimer_set_slack(heartbeat, s_slack);
+    }
+    s_spawned += TEST_SPAWN_PER_MS;
+    if (s_spawned == TEST_HEARTBEATS) {
+        s_start_cnt = evloop_count(loop);
+        s_start_fires = s_fires;
+        evtimer_add(loop, on_stop, TEST_MEASURE_MS, 1);
+    }
+}
+
+static uint64_t run_heartbeats(uint32_t slack_ms) {
+    s_slack = slack_ms;
+    s_spawned = 0;
+    s_fires = s_start_fires = s_start_cnt = s_wakeups = 0;
+    evloop_t* loop = evloop_new(EVLOOP_FLAG_STATS);
+    evtimer_add(loop, on_spawn, 1, TEST_HEARTBEATS / TEST_SPAWN_PER_MS);
+    evloop_run(loop);
+    evloop_stats_t stats;
+    evloop_stats(loop, &stats);
+    uint64_t fires = s_fires - s_start_fires;
+    double max_lag_ms = stats.timer_lag.max_ns / 1e6;
+    printf("heartbeats=%d interval=%d~%dms slack=%ums: %llu fires in %dms, wakeups=%llu (%.0f/s, %.1f fires/wakeup), "
+           "max lag=%.1fms\n",
+           TEST_HEARTBEATS, TEST_INTERVAL_MS, TEST_INTERVAL_MS + TEST_JITTER_MS - 1, slack_ms, (unsigned long long)fires,
+           TEST_MEASURE_MS,           (unsigned long long)s_wakeups, s_wakeups * 1000.0 / TEST_MEASURE_MS, (double)fires / s_wakeups, max_lag_ms);
+    // NOTE: late by slack at most
+    assert(fires >= (uint64_t)TEST_HEARTBEATS * (TEST_MEASURE_MS / (TEST_INTERVAL_MS + TEST_JITTER_MS) - 1));
+    assert(max_lag_ms < slack_ms + TEST_LAG_TOLERANCE);
+    evloop_free(&loop);
+    return s_wakeups;
+}
+
+// slack kept after evtimer_reset, and never fires before deadline
+static uint64_t s_deadline_us = 0;
+static int s_resets = 0;
+
+static void on_reset_timer(evtimer_t* timer) {
+    uint64_t now = gethrtime_us();
+    assert(now >= s_deadline_us);
+    if (++s_resets == 5) {
+        evloop_stop(event_loop(timer));
+        return;
+    }
+    s_deadline_us = now + 20 * 1000;
+    evtimer_reset(timer, 20);
+}
+
+static void run_reset() {
+    evloop_t* loop = evloop_new(0);
+    s_resets = 0;
+    evtimer_t* timer = evtimer_add(loop, on_reset_timer, 20, 1);
+    evtimer_set_slack(timer, 10);
+    s_deadline_us = gethrtime_us() + 20 * 1000;
+    evloop_run(loop);
+    assert(s_resets == 5);
+    evloop_free(&loop);
+}
+
+void test_timer_slack() {
+    uint64_t exact = run_heartbeats(0);
+    uint64_t slack = run_heartbeats(EVTIMER_DEFAULT_SLACK(TEST_INTERVAL_MS));
+    run_heartbeats(TEST_INTERVAL_MS / 4);
+    printf("wakeups reduced %.1fx by default slack\n", (double)exact / slack);
+    assert(slack * 5 < exact);
+    run_reset();
+}
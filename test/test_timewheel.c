@@ -0,0 +1,149 @@
+#include "base.h"
+#include "datetime.h"
+#include "eventloop.h"
+#include "heap.h"
+#include "test.h"
+#include "timewheel.h"
+
+#define TEST_NODES        100000
+#define TEST_TIMERS       1000000
+#define TEST_RESETS       4000000
+#define TEST_LOOP_TIMERS  100
+#define TEST_MAX_LATE_MS  20
+
+static void test_timewheel_expire() {
+    struct timewheel tw;
+    uint64_t now = 123456789;
+    timewheel_init(&tw, now);
+    struct timewheel_node* nodes = (struct timewheel_node*)calloc(TEST_NODES, sizeof(struct timewheel_node));
+    int npops = 0, ndels = 0;
+    srand(1);
+    for (int i = 0; i < TEST_NODES; ++i) {
+        // NOTE: cover root wheel, every level and out of range
+        int bits = rand() % 36;
+        nodes[i].expire = now + ((uint64_t)rand() << 4 ^ rand()) % (1ULL << bits);
+        timewheel_add(&tw, &nodes[i]);
+    }
+    for (int i = 0; i < TEST_NODES; i += 7) {
+        timewheel_del(&tw, &nodes[i]);
+        timewheel_del(&tw, &nodes[i]);
+        nodes[i].expire = 0;
+        ++ndels;
+    }
+    assert(tw.nelts == TEST_NODES - ndels);
+    uint64_t prev = now - 1;
+    while (tw.nelts) {
+        uint64_t next = timewheel_next_expire(&tw);
+        assert(next >= tw.cur);
+        // NOTE: jump to next expire or a random step
+        now = rand() % 2 ? next : now + rand() % 100000;
+        struct timewheel_node* node;
+        while ((node = timewheel_pop(&tw, now)) != NULL) {
+            // never early, never late
+            assert(node->expire <= now && node->expire > prev);
+            node->expire = 0;
+            ++npops;
+        }
+        prev = now;
+    }
+    assert(npops + ndels == TEST_NODES);
+    free(nodes);
+    printf("timewheel expire %d nodes ok\n", npops);
+}
+
+static int s_nfired = 0;
+static int s_max_late_ms = 0;
+
+static void on_timeout(evtimer_t* timer) {
+    uint64_t expected = (uint64_t)(uintptr_t)event_userdata(timer);
+    int late_ms = (int)((int64_t)(gethrtime_us() - expected) / 1000);
+    assert(late_ms >= 0);
+    if (late_ms > s_max_late_ms) {
+        s_max_late_ms = late_ms;
+    }
+    if (++s_nfired == TEST_LOOP_TIMERS) {
+        evloop_stop(event_loop(timer));
+    }
+}
+
+static void test_timewheel_evloop() {
+    evloop_t* loop = evloop_new(0);
+    for (int i = 0; i < TEST_LOOP_TIMERS; ++i) {
+        uint32_t timeout_ms = 1 + i * 3;
+        evtimer_t* timer = evtimer_add(loop, on_timeout, timeout_ms, 1);
+        event_set_userdata(timer, (void*)(uintptr_t)(gethrtime_us() + timeout_ms * 1000));
+    }
+    evloop_run(loop);
+    evloop_free(&loop);
+    printf("evtimer fired=%d max_late=%dms\n", s_nfired, s_max_late_ms);
+    assert(s_nfired == TEST_LOOP_TIMERS && s_max_late_ms <= TEST_MAX_LATE_MS);
+}
+
+static void on_never(evtimer_t* timer) {
+    assert(0);
+}
+
+static void test_timewheel_reset_bench() {
+    evloop_t* loop = evloop_new(0);
+    evtimer_t** timers = (evtimer_t**)malloc(sizeof(evtimer_t*) * TEST_TIMERS);
+    for (int i = 0; i < TEST_TIMERS; ++i) {
+        timers[i] = evtimer_add(loop, on_never, 60000 + i % 1000, 1);
+    }
+    unsigned int seed = 1;
+    uint64_t start = gethrtime_us();
+    for (int i = 0; i < TEST_RESETS; ++i) {
+        // NOTE: like evio_set_read_timeout on every read
+        evtimer_reset(timers[rand_r(&seed) % TEST_TIMERS], 30000 + i % 60000);
+    }
+    uint64_t wheel_us = gethrtime_us() - start;
+    printf("timewheel: timers=%d resets=%d %.1fns/reset\n", TEST_TIMERS, TEST_RESETS,
+           wheel_us * 1000.0 / TEST_RESETS);
+    for (int i = 0; i < TEST_TIMERS; ++i) {
+        evtimer_del(timers[i]);
+    }
+    free(timers);
+    evloop_free(&loop);
+}
+
+// the old loop->timers for comparison
+struct heap_timer {
+    struct heap_node node;
+    uint64_t next_timeout;
+};
+
+static int heap_timer_compare(const struct heap_node* lhs, const struct heap_node* rhs) {
+    return ((struct heap_timer*)lhs)->next_timeout < ((struct heap_timer*)rhs)->next_timeout;
+}
+
+static void test_heap_reset_bench() {
+    struct heap heap;
+    heap_init(&heap, heap_timer_compare);
+    struct heap_timer** timers = (struct heap_timer**)malloc(sizeof(struct heap_timer*) * TEST_TIMERS);
+    uint64_t now = gethrtime_us();
+    for (int i = 0; i < TEST_TIMERS; ++i) {
+        timers[i] = (struct heap_timer*)calloc(1, sizeof(struct heap_timer));
+        timers[i]->next_timeout = now + (60000 + i % 1000) * 1000ULL;
+        heap_insert(&heap, &timers[i]->node);
+    }
+    unsigned int seed = 1;
+    uint64_t start = gethrtime_us();
+    for (int i = 0; i < TEST_RESETS; ++i) {
+        struct heap_timer* timer = timers[rand_r(&seed) % TEST_TIMERS];
+        heap_remove(&heap, &timer->node);
+        timer->next_timeout = now + (30000 + i % 60000) * 1000ULL;
+        heap_insert(&heap, &timer->node);
+    }
+    uint64_t heap_us = gethrtime_us() - start;
+    printf("heap: timers=%d resets=%d %.1fns/reset\n", TEST_TIMERS, TEST_RESETS, heap_us * 1000.0 / TEST_RESETS);
+    for (int i = 0; i < TEST_TIMERS; ++i) {
+        free(timers[i]);
+    }
+    free(timers);
+}
+
+void test_timewheel() {
+    test_timewheel_expire();
+    test_timewheel_evloop();
+    test_timewheel_reset_bench();
+    test_heap_reset_bench();
+}
@@ -0,0 +1,121 @@
+#include "base.h"
+#include "datetime.h"
+#include "eventloop.h"
+#include "socket.h"
+#include "sockopt.h"
+#include "sockunion.h"
+#include "test.h"
+#include "thread.h"
+
+#define TEST_PACKETS  1000000
+#define TEST_DGRAM    64
+#define TEST_WINDOW   256 // in flight, so nothing is dropped by the receiver
+#define TEST_BATCH    64
+#define TEST_SOCKBUF  (1 << 20)
+
+static atomic_long s_received = ATOMIC_VAR_INIT(0);
+static long s_bytes = 0;
+static long s_reads = 0;
+static uint64_t s_loop_cpu_us = 0;
+
+static void on_read(evio_t* io, void* buf, int readbytes) {
+    s_bytes += readbytes;
+    ++s_reads;
+    ++s_received;
+}
+
+static void on_read_batch(evio_t* io, evio_dgram_t* dgrams, int ndgrams) {
+    for (int i = 0; i < ndgrams; ++i) {
+        assert(dgrams[i].addr != NULL);
+        s_bytes += dgrams[i].len;
+    }
+    ++s_reads;
+    s_received += ndgrams;
+}
+
+static uint64_t thread_cpu_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static THREAD_ROUTINE(loop_thread) {
+    evloop_run((evloop_t*)userdata);
+    s_loop_cpu_us = thread_cpu_us();
+    return NULL;
+}
+
+// @return false if datagrams were dropped
+static bool wait_received(long sent, long window) {
+    uint64_t deadline = gethrtime_us() + 1000000;
+    while (sent - s_received > window) {
+        if (gethrtime_us() > deadline)
+            return false;
+        sched_yield();
+    }
+    return true;
+}
+
+static void run_udp(int batch) {
+    evloop_t* loop = evloop_new(0);
+    evio_t* server = evloop_create_udp_server(loop, LOCALHOST, 0);
+    assert(server != NULL);
+    so_rcvbuf(evio_fd(server), TEST_SOCKBUF);
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(evio_fd(server), &addr.sa, &addrlen);
+    evio_t* client = evloop_create_udp_client(loop, LOCALHOST, ntohs(addr.sin.sin_port));
+    assert(client != NULL);
+    if (batch) {
+        evio_read_batch(server, on_read_batch, TEST_BATCH, EIO_DEFAULT_DGRAM_SIZE);
+    } else {
+        evio_setcb_read(server, on_read);
+        evio_read(server);
+    }
+    s_received = 0;
+    s_bytes = s_reads = 0;
+    thread_t th = thread_create(loop_thread, loop);
+    while (evloop_status(loop) != EVLOOP_STATUS_RUNNING) {
+        ev_msleep(1);
+    }
+
+    char payload[TEST_DGRAM];
+    memset(payload, 'x', sizeof(payload));
+    evio_dgram_t dgrams[TEST_BATCH];
+    for (int i = 0; i < TEST_BATCH; ++i) {
+        dgrams[i].buf = payload;
+        dgrams[i].len = TEST_DGRAM;
+        dgrams[i].addr = NULL;
+    }
+    uint64_t start = gethrtime_us();
+    long sent = 0;
+    while (sent < TEST_PACKETS) {
+        if (!wait_received(sent, TEST_WINDOW))
+            break;
+        if (batch) {
+            int n = evio_write_batch(client, dgrams, TEST_BATCH);
+            assert(n >= 0);
+            sent += n;
+        } else {
+            assert(evio_write(client, payload, TEST_DGRAM) == TEST_DGRAM);
+            ++sent;
+        }
+    }
+    wait_received(sent, 0);
+    uint64_t elapsed_us = gethrtime_us() - start;
+
+    evloop_stop(loop);
+    thread_join(th, NULL);
+    evloop_free(&loop);
+    long received = s_received;
+    assert(s_bytes == received * TEST_DGRAM);
+    printf("%s: packets=%ld dropped=%ld %.0fpps reads=%ld (%.1f dgrams/read) loop cpu %.0fns/packet\n",
+           batch ? "recvmmsg/sendmmsg" : "recvfrom/sendto", received, sent - received,
+           received / (elapsed_us / 1e6), s_reads, (double)received / s_reads,
+           s_loop_cpu_us * 1000.0 / received);
+}
+
+void test_udp_batch() {
+    run_udp(0);
+    run_udp(1);
+}
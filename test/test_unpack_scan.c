@@ -0,0 +1,157 @@
+#include "base.h"
+#include "datetime.h"
+#include "eventloop.h"
+#include "socket.h"
+#include "sockunion.h"
+#include "test.h"
+#include "thread.h"
+#include "unpack.h"
+
+#define TEST_BUFSIZE  (64 << 20) // pipelined lines
+#define TEST_ROUNDS   4
+#define TEST_LINES    200000
+
+static const char* s_level_names[] = {"scalar", "sse2", "avx2"};
+
+static const unsigned char* naive_find(const unsigned char* p, const unsigned char* ep, const unsigned char* delim,
+                                       int n) {
+    for (; ep - p >= n; ++p) {
+        if (memcmp(p, delim, n) == 0)
+            return p;
+    }
+    return NULL;
+}
+
+// random buffers over a tiny alphabet, so partial matches are frequent.
+static void check_correctness(int level) {
+    const char* delims[] = {"\n", "\r\n", "\r\n\r\n", "abcabcab"};
+    unsigned char buf[256];
+    srand(level + 1);
+    for (int d = 0; d < (int)(sizeof(delims) / sizeof(delims[0])); ++d) {
+        const unsigned char* delim = (const unsigned char*)delims[d];
+        int n = strlen(delims[d]);
+        for (int iter = 0; iter < 20000; ++iter) {
+            int len = rand() % sizeof(buf);
+            for (int i = 0; i < len; ++i) {
+                buf[i] = delim[rand() % n] + (rand() % 8 == 0);
+            }
+            int offset = len ? rand() % (len + 1) : 0;
+            const unsigned char* expected = naive_find(buf + offset, buf + len, delim, n);
+            const unsigned char* found = unpack_find_delimiter(buf + offset, buf + len, delim, n);
+            assert(found == expected);
+        }
+    }
+}
+
+static int fill_lines(char* buf, int size, const char* delim) {
+    int n = strlen(delim), len = 0, seq = 0;
+    while (1) {
+        // RESP/log like lines of 16~144 bytes
+        int linelen = 16 + (seq * 37) % 128;
+        if (len + linelen + n > size)
+            break;
+        memset(buf + len, 'a' + seq % 26, linelen);
+        // a lone '\r' inside lines, so "\r\n" scanning must verify
+        buf[len + linelen / 2] = '\r';
+        memcpy(buf + len + linelen, delim, n);
+        len += linelen + n;
+        ++seq;
+    }
+    return len;
+}
+
+static void bench_scan(int level, const char* delim, const unsigned char* buf, int len) {
+    const unsigned char* ep = buf + len;
+    int n = strlen(delim);
+    long lines = 0;
+    uint64_t start = gethrtime_us();
+    for (int r = 0; r < TEST_ROUNDS; ++r) {
+        const unsigned char* p = buf;
+        while ((p = unpack_find_delimiter(p, ep, (const unsigned char*)delim, n)) != NULL) {
+            p += n;
+            ++lines;
+        }
+    }
+    uint64_t elapsed_us = gethrtime_us() - start;
+    printf("%s delimiter=%d bytes: lines=%ld %.0fMB/s\n", s_level_names[level], n, lines / TEST_ROUNDS,
+           (double)len * TEST_ROUNDS / elapsed_us);
+}
+
+// end to end: pipelined lines through evio_set_unpack
+static unpack_setting_t s_setting;
+static atomic_long s_lines = ATOMIC_VAR_INIT(0);
+
+static void on_line(evio_t* io, void* buf, int readbytes) {
+    const char* line = (const char*)buf;
+    assert(readbytes >= 4 && memcmp(line + readbytes - 4, "\r\n\r\n", 4) == 0);
+    ++s_lines;
+}
+
+static void on_accept(evio_t* io) {
+    evio_setcb_read(io, on_line);
+    evio_set_unpack(io, &s_setting);
+    evio_read(io);
+}
+
+static THREAD_ROUTINE(loop_thread) {
+    evloop_run((evloop_t*)userdata);
+    return NULL;
+}
+
+static void run_unpack(char* buf, int len, long nlines) {
+    evloop_t* loop = evloop_new(0);
+    evio_t* listenio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_accept);
+    assert(listenio != NULL);
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(evio_fd(listenio), &addr.sa, &addrlen);
+    thread_t th = thread_create(loop_thread, loop);
+    s_lines = 0;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(fd, &addr.sa, addrlen) == 0);
+    uint64_t start = gethrtime_us();
+    assert(writen(fd, buf, len) == len);
+    while (s_lines != nlines) {
+        sched_yield();
+    }
+    uint64_t elapsed_us = gethrtime_us() - start;
+    close(fd);
+    evloop_stop(loop);
+    thread_join(th, NULL);
+    evloop_free(&loop);
+    printf("%s evio_unpack_by_delimiter: lines=%ld %.0fMB/s\n", s_level_names[unpack_scan_level()], nlines,
+           (double)len / elapsed_us);
+}
+
+void test_unpack_scan() {
+    int best = unpack_scan_level();
+    char* buf = (char*)malloc(TEST_BUFSIZE);
+    for (int level = UNPACK_SCAN_SCALAR; level <= UNPACK_SCAN_AVX2; ++level) {
+        if (unpack_set_scan_level(level) != 0) {
+            printf("%s unsupported\n", s_level_names[level]);
+            continue;
+        }
+        check_correctness(level);
+        int len = fill_lines(buf, TEST_BUFSIZE, "\r\n");
+        bench_scan(level, "\r\n", (const unsigned char*)buf, len);
+        len = fill_lines(buf, TEST_BUFSIZE, "\r\n\r\n");
+        bench_scan(level, "\r\n\r\n", (const unsigned char*)buf, len);
+    }
+
+    memset(&s_setting, 0, sizeof(s_setting));
+    s_setting.mode = UNPACK_BY_DELIMITER;
+    s_setting.package_max_length = DEFAULT_PACKAGE_MAX_LENGTH;
+    memcpy(s_setting.delimiter, "\r\n\r\n", 4);
+    s_setting.delimiter_bytes = 4;
+    int len = fill_lines(buf, TEST_BUFSIZE, "\r\n\r\n");
+    long nlines = 0;
+    for (const unsigned char* p = (const unsigned char*)buf;
+         (p = naive_find(p, (const unsigned char*)buf + len, (const unsigned char*)"\r\n\r\n", 4)) != NULL; p += 4) {
+        ++nlines;
+    }
+    unpack_set_scan_level(UNPACK_SCAN_SCALAR);
+    run_unpack(buf, len, nlines);
+    unpack_set_scan_level(best);
+    run_unpack(buf, len, nlines);
+    free(buf);
+}
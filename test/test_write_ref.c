@@ -0,0 +1,131 @@
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "base.h"
+#include "datetime.h"
+#include "eventloop.h"
+#include "socket.h"
+#include "sockopt.h"
+#include "sockunion.h"
+#include "test.h"
+#include "thread.h"
+
+#define TEST_SUBSCRIBERS 256
+#define TEST_MESSAGES    32
+#define TEST_MSG_SIZE    4096
+#define TEST_SOCKBUF     (16 << 10) // small socket buffers, so messages are queued
+
+static int s_port = 0;
+static evio_t* s_ios[TEST_SUBSCRIBERS];
+static atomic_int s_nios = ATOMIC_VAR_INIT(0);
+static atomic_int s_published = ATOMIC_VAR_INIT(0);
+static atomic_long s_writev_calls = ATOMIC_VAR_INIT(0);
+static long s_publish_allocs = 0;
+static uint64_t s_publish_us = 0;
+
+// NOTE: override libc writev to count syscalls issued by nio_write
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
+    ++s_writev_calls;
+    return syscall(SYS_writev, fd, iov, iovcnt);
+}
+
+static void on_accept(evio_t* io) {
+    so_sndbuf(evio_fd(io), TEST_SOCKBUF);
+    // NOTE: read to close on peer closed
+    evio_read(io);
+    s_ios[s_nios++] = io;
+}
+
+static void fill_message(char* buf, int seq) {
+    for (int i = 0; i < TEST_MSG_SIZE; ++i) {
+        buf[i] = (char)(seq * 7 + i);
+    }
+}
+
+static void on_publish(event_t* ev) {
+    int zero_copy = (int)(intptr_t)event_userdata(ev);
+    long allocs = ev_alloc_cnt();
+    uint64_t start = gethrtime_us();
+    char msg[TEST_MSG_SIZE];
+    for (int seq = 0; seq < TEST_MESSAGES; ++seq) {
+        if (zero_copy) {
+            evbuf_t* buf = evbuf_alloc(TEST_MSG_SIZE);
+            fill_message((char*)evbuf_base(buf), seq);
+            for (int i = 0; i < TEST_SUBSCRIBERS; ++i) {
+                evio_write_ref(s_ios[i], buf);
+            }
+            evbuf_unref(buf);
+        } else {
+            fill_message(msg, seq);
+            for (int i = 0; i < TEST_SUBSCRIBERS; ++i) {
+                evio_write(s_ios[i], msg, TEST_MSG_SIZE);
+            }
+        }
+    }
+    s_publish_us = gethrtime_us() - start;
+    s_publish_allocs = ev_alloc_cnt() - allocs;
+    s_published = 1;
+}
+
+static THREAD_ROUTINE(loop_thread) {
+    evloop_run((evloop_t*)userdata);
+    return NULL;
+}
+
+static void run_fanout(int zero_copy) {
+    evloop_t* loop = evloop_new(0);
+    evio_t* listenio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_accept);
+    assert(listenio != NULL);
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(evio_fd(listenio), &addr.sa, &addrlen);
+    s_port = ntohs(addr.sin.sin_port);
+    s_nios = 0;
+    s_published = 0;
+    thread_t th = thread_create(loop_thread, loop);
+
+    int fds[TEST_SUBSCRIBERS];
+    for (int i = 0; i < TEST_SUBSCRIBERS; ++i) {
+        fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+        so_rcvbuf(fds[i], TEST_SOCKBUF);
+        assert(connect(fds[i], &addr.sa, addrlen) == 0);
+    }
+    while (s_nios != TEST_SUBSCRIBERS) {
+        ev_msleep(1);
+    }
+
+    s_writev_calls = 0;
+    uint64_t start = gethrtime_us();
+    event_t ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.cb = on_publish;
+    ev.userdata = (void*)(intptr_t)zero_copy;
+    evloop_post_event(loop, &ev);
+    while (!s_published) {
+        ev_msleep(1);
+    }
+
+    char expected[TEST_MSG_SIZE], msg[TEST_MSG_SIZE];
+    for (int i = 0; i < TEST_SUBSCRIBERS; ++i) {
+        for (int seq = 0; seq < TEST_MESSAGES; ++seq) {
+            fill_message(expected, seq);
+            assert(readn(fds[i], msg, TEST_MSG_SIZE) == TEST_MSG_SIZE);
+            assert(memcmp(msg, expected, TEST_MSG_SIZE) == 0);
+        }
+        close(fds[i]);
+    }
+    uint64_t total_us = gethrtime_us() - start;
+
+    printf("%s: subscribers=%d messages=%d publish=%lluus allocs=%ld total=%lluus writev=%ld\n",
+           zero_copy ? "evio_write_ref" : "evio_write", TEST_SUBSCRIBERS, TEST_MESSAGES,
+           (unsigned long long)s_publish_us, s_publish_allocs, (unsigned long long)total_us, (long)s_writev_calls);
+
+    evloop_stop(loop);
+    thread_join(th, NULL);
+    evloop_free(&loop);
+}
+
+void test_write_ref() {
+    run_fanout(0);
+    run_fanout(1);
+}
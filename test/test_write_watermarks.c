@@ -0,0 +1,277 @@
+#include "base.h"
+#include "datetime.h"
+#include "eventloop.h"
+#include "socket.h"
+#include "sockopt.h"
+#include "sockunion.h"
+#include "test.h"
+#include "thread.h"
+
+#define TEST_HIGH_WATER (256 << 10)
+#define TEST_LOW_WATER  (64 << 10)
+#define TEST_SOCKBUF    (16 << 10)
+// pub/sub: 16MB/s to each subscriber, the slow one reads 1MB/s
+#define TEST_SUBSCRIBERS 4
+#define TEST_MSG_SIZE    1024
+#define TEST_MSGS_PER_MS 16
+#define TEST_PUBLISH_MS  1500
+#define TEST_SLOW_READ   (8 << 10)
+#define TEST_SLOW_MS     8
+// proxy: client => proxy => sink reading one small socket buffer per ms
+#define TEST_PROXY_TOTAL (64 << 20)
+#define TEST_PROXY_CHUNK (64 << 10)
+
+typedef struct subscriber_s {
+    evio_t* io;
+    long published;
+    long dropped;
+    uint32_t max_bufsize;
+    int highs;
+    int lows;
+    int closed;
+} subscriber_t;
+
+static subscriber_t s_subs[TEST_SUBSCRIBERS];
+static int s_nsubs = 0;
+static int s_watermarks = 0;
+static atomic_int s_publishing = ATOMIC_VAR_INIT(0);
+
+static void on_sub_watermark(evio_t* io, int above_high) {
+    subscriber_t* sub = (subscriber_t*)evio_context(io);
+    if (above_high) {
+        ++sub->highs;
+    } else {
+        ++sub->lows;
+    }
+}
+
+static void on_sub_close(evio_t* io) {
+    subscriber_t* sub = (subscriber_t*)evio_context(io);
+    sub->closed = 1;
+}
+
+static void on_sub_accept(evio_t* io) {
+    subscriber_t* sub = &s_subs[s_nsubs++];
+    memset(sub, 0, sizeof(*sub));
+    sub->io = io;
+    so_sndbuf(evio_fd(io), TEST_SOCKBUF);
+    evio_set_context(io, sub);
+    evio_setcb_close(io, on_sub_close);
+    if (s_watermarks) {
+        evio_set_write_watermarks(io, TEST_HIGH_WATER, TEST_LOW_WATER, on_sub_watermark, 0);
+    }
+    // NOTE: read to detect peer close
+    evio_read_start(io);
+}
+
+// fan-out: skip subscribers above high water instead of queueing for them
+static void on_publish(evtimer_t* timer) {
+    if (!atomic_load(&s_publishing))
+        return;
+    static char msg[TEST_MSG_SIZE];
+    for (int i = 0; i < s_nsubs; ++i) {
+        subscriber_t* sub = &s_subs[i];
+        if (sub->closed)
+            continue;
+        for (int j = 0; j < TEST_MSGS_PER_MS; ++j) {
+            if (evio_write_above_high_water(sub->io)) {
+                ++sub->dropped;
+                continue;
+            }
+            if (evio_write(sub->io, msg, sizeof(msg)) < 0)
+                break;
+            ++sub->published;
+            if (evio_write_bufsize(sub->io) > sub->max_bufsize) {
+                sub->max_bufsize = evio_write_bufsize(sub->io);
+            }
+        }
+    }
+}
+
+static THREAD_ROUTINE(loop_thread) {
+    evloop_run((evloop_t*)userdata);
+    return NULL;
+}
+
+static void run_pubsub(int watermarks) {
+    s_watermarks = watermarks;
+    s_nsubs = 0;
+    evloop_t* loop = evloop_new(0);
+    evio_t* listenio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_sub_accept);
+    assert(listenio != NULL);
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(evio_fd(listenio), &addr.sa, &addrlen);
+    evtimer_add(loop, on_publish, 1, INFINITE);
+    thread_t th = thread_create(loop_thread, loop);
+
+    int fds[TEST_SUBSCRIBERS];
+    for (int i = 0; i < TEST_SUBSCRIBERS; ++i) {
+        fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+        so_rcvbuf(fds[i], TEST_SOCKBUF);
+        assert(connect(fds[i], &addr.sa, addrlen) == 0);
+        nonblocking(fds[i]);
+    }
+    while (s_nsubs < TEST_SUBSCRIBERS) {
+        ev_msleep(1);
+    }
+    // NOTE: fds[0] is the slow one
+    char* buf = (char*)malloc(TEST_PROXY_CHUNK);
+    long received[TEST_SUBSCRIBERS] = {0};
+    atomic_store(&s_publishing, 1);
+    uint64_t start = gethrtime_us() / 1000, last_slow_read = start;
+    while (gethrtime_us() / 1000 - start < TEST_PUBLISH_MS) {
+        uint64_t now = gethrtime_us() / 1000;
+        if (now - last_slow_read >= TEST_SLOW_MS) {
+            int n = read(fds[0], buf, TEST_SLOW_READ);
+            if (n > 0)
+                received[0] += n;
+            last_slow_read = now;
+        }
+        for (int i = 1; i < TEST_SUBSCRIBERS; ++i) {
+            int n;
+            while ((n = read(fds[i], buf, TEST_PROXY_CHUNK)) > 0) {
+                received[i] += n;
+            }
+        }
+        ev_msleep(1);
+    }
+    atomic_store(&s_publishing, 0);
+    for (int i = 0; i < TEST_SUBSCRIBERS; ++i) {
+        close(fds[i]);
+    }
+    evloop_stop(loop);
+    thread_join(th, NULL);
+    free(buf);
+
+    subscriber_t* slow = &s_subs[0];
+    uint32_t fast_max_bufsize = 0;
+    long fast_dropped = 0;
+    for (int i = 1; i < s_nsubs; ++i) {
+        fast_max_bufsize = MAX(fast_max_bufsize, s_subs[i].max_bufsize);
+        fast_dropped += s_subs[i].dropped;
+    }
+    printf("pubsub %s: slow: published=%ld dropped=%ld max queued=%uK highs=%d lows=%d closed=%d received=%ldK; "
+           "fast: max queued=%uK dropped=%ld\n",
+           watermarks ? "watermarks" : "unbounded", slow->published, slow->dropped, slow->max_bufsize >> 10, slow->highs,
+           slow->lows, slow->closed, received[0] >> 10, fast_max_bufsize >> 10, fast_dropped);
+    if (watermarks) {
+        assert(slow->max_bufsize < TEST_HIGH_WATER + TEST_MSG_SIZE);
+        assert(slow->highs > 0 && slow->lows > 0 && slow->dropped > 0 && !slow->closed);
+    }
+    evloop_free(&loop);
+}
+
+// proxy: pause client reads above high water of upstream, resume at low water
+static int s_sink_port = 0;
+static int s_sinkfd = -1;
+static long s_sink_bytes = 0;
+static uint32_t s_proxy_max_bufsize = 0;
+static int s_proxy_pauses = 0;
+
+static void on_proxy_read(evio_t* io, void* buf, int readbytes) {
+    evio_t* upstream_io = evio_get_upstream(io);
+    write_cb old_write_cb = evio_getcb_write(upstream_io);
+    evio_write_upstream(io, buf, readbytes);
+    if (evio_write_bufsize(upstream_io) > s_proxy_max_bufsize) {
+        s_proxy_max_bufsize = evio_write_bufsize(upstream_io);
+    }
+    // NOTE: without watermarks, evio_write_upstream pauses on every partial write.
+    if (old_write_cb == NULL && evio_getcb_write(upstream_io) != NULL) {
+        ++s_proxy_pauses;
+    }
+}
+
+static void on_proxy_watermark(evio_t* io, int above_high) {
+    if (above_high)
+        ++s_proxy_pauses;
+}
+
+static void on_proxy_accept(evio_t* io) {
+    evio_t* upstream_io = evio_setup_tcp_upstream(io, LOCALHOST, s_sink_port, 0, 0);
+    assert(upstream_io != NULL);
+    evio_setcb_read(io, on_proxy_read);
+    if (s_watermarks) {
+        evio_set_write_watermarks(upstream_io, TEST_HIGH_WATER, TEST_LOW_WATER, on_proxy_watermark, 1);
+    }
+}
+
+static THREAD_ROUTINE(sink_thread) {
+    int fd = accept(s_sinkfd, NULL, NULL);
+    assert(fd >= 0);
+    char* buf = (char*)malloc(TEST_PROXY_CHUNK);
+    s_sink_bytes = 0;
+    while (s_sink_bytes < TEST_PROXY_TOTAL) {
+        ssize_t n = read(fd, buf, TEST_PROXY_CHUNK);
+        assert(n > 0);
+        for (ssize_t i = 0; i < n; ++i) {
+            assert(buf[i] == (char)((s_sink_bytes + i) & 0xFF));
+        }
+        s_sink_bytes += n;
+        // NOTE: slow consumer
+        ev_msleep(1);
+    }
+    assert(writen(fd, "ok", 2) == 2);
+    assert(read(fd, buf, TEST_PROXY_CHUNK) == 0);
+    close(fd);
+    free(buf);
+    return NULL;
+}
+
+static void run_proxy(int watermarks) {
+    s_watermarks = watermarks;
+    s_proxy_max_bufsize = 0;
+    s_proxy_pauses = 0;
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    s_sinkfd = socket(AF_INET, SOCK_STREAM, 0);
+    so_rcvbuf(s_sinkfd, TEST_SOCKBUF);
+    sockunion_set_ipport(&addr, LOCALHOST, 0);
+    assert(bind(s_sinkfd, &addr.sa, sizeof(addr.sin)) == 0 && listen(s_sinkfd, 8) == 0);
+    getsockname(s_sinkfd, &addr.sa, &addrlen);
+    s_sink_port = ntohs(addr.sin.sin_port);
+    thread_t sink = thread_create(sink_thread, NULL);
+
+    evloop_t* loop = evloop_new(0);
+    evio_t* proxyio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_proxy_accept);
+    assert(proxyio != NULL);
+    addrlen = sizeof(addr);
+    getsockname(evio_fd(proxyio), &addr.sa, &addrlen);
+    thread_t th = thread_create(loop_thread, loop);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(fd, &addr.sa, addrlen) == 0);
+    char* buf = (char*)malloc(TEST_PROXY_CHUNK);
+    for (int i = 0; i < TEST_PROXY_CHUNK; ++i) {
+        buf[i] = (char)(i & 0xFF);
+    }
+    uint64_t start = gethrtime_us();
+    for (long sent = 0; sent < TEST_PROXY_TOTAL; sent += TEST_PROXY_CHUNK) {
+        assert(writen(fd, buf, TEST_PROXY_CHUNK) == TEST_PROXY_CHUNK);
+    }
+    char ack[2];
+    assert(readn(fd, ack, 2) == 2 && memcmp(ack, "ok", 2) == 0);
+    uint64_t elapsed_us = gethrtime_us() - start;
+    close(fd);
+    thread_join(sink, NULL);
+    close(s_sinkfd);
+    evloop_stop(loop);
+    thread_join(th, NULL);
+    evloop_free(&loop);
+    free(buf);
+    assert(s_sink_bytes == TEST_PROXY_TOTAL);
+    printf("proxy %s: bytes=%d %.0fMB/s max queued=%uK pauses=%d\n",
+           watermarks ? "watermarks" : "pause on partial write", TEST_PROXY_TOTAL,
+           TEST_PROXY_TOTAL / 1048576.0 / (elapsed_us / 1e6), s_proxy_max_bufsize >> 10, s_proxy_pauses);
+    if (watermarks) {
+        // NOTE: plus the last read before pause
+        assert(s_proxy_max_bufsize < 2 * TEST_HIGH_WATER);
+    }
+}
+
+void test_write_watermarks() {
+    run_pubsub(0);
+    run_pubsub(1);
+    run_proxy(0);
+    run_proxy(1);
+}
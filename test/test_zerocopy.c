@@ -0,0 +1,198 @@
+#include "base.h"
+#include "eventloop.h"
+#include "socket.h"
+#include "sockunion.h"
+#include "test.h"
+#include "thread.h"
+
+// bulk transfer: 256K evio_write_ref payloads, bounded by write watermarks
+#define TEST_MSG_SIZE   (256 << 10)
+#define TEST_MESSAGES   2048 // 512MB
+#define TEST_BUFS       4
+#define TEST_HIGH_WATER (1 << 20)
+#define TEST_LOW_WATER  (256 << 10)
+
+static evbuf_t* s_bufs[TEST_BUFS];
+static atomic_int s_freed = ATOMIC_VAR_INIT(0);
+static int s_zerocopy = 0;
+static int s_sent = 0;
+static int s_closing = 0;
+static double s_cpu_start = 0;
+static double s_cpu_ms = 0;
+static evloop_zerocopy_stats_t s_stats;
+
+static double thread_cpu_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void on_free(void* base, size_t len, void* userdata) {
+    free(base);
+    atomic_fetch_add(&s_freed, 1);
+}
+
+static void send_more(evio_t* io) {
+    while (s_sent < TEST_MESSAGES && !evio_write_above_high_water(io)) {
+        if (evio_write_ref(io, s_bufs[s_sent++ % TEST_BUFS]) < 0)
+            return;
+    }
+    if (s_sent == TEST_MESSAGES && !s_closing) {
+        // NOTE: closed once write_queue drained and zerocopy sends completed
+        s_closing = 1;
+        evio_close(io);
+    }
+}
+
+static void on_watermark(evio_t* io, int above_high) {
+    if (!above_high) {
+        send_more(io);
+    }
+}
+
+static void on_close(evio_t* io) {
+    s_cpu_ms = thread_cpu_ms() - s_cpu_start;
+    evloop_zerocopy_stats(event_loop(io), &s_stats);
+    evloop_stop(event_loop(io));
+}
+
+static void on_accept(evio_t* io) {
+    if (s_zerocopy) {
+        assert(evio_set_zerocopy(io, EIO_DEFAULT_ZEROCOPY_THRESHOLD) == 0);
+    }
+    evio_set_write_watermarks(io, TEST_HIGH_WATER, TEST_LOW_WATER, on_watermark, 0);
+    evio_setcb_close(io, on_close);
+    // NOTE: no evio_read, so completions are watched without EV_READ
+    s_cpu_start = thread_cpu_ms();
+    send_more(io);
+}
+
+static THREAD_ROUTINE(loop_thread) {
+    evloop_run((evloop_t*)userdata);
+    return NULL;
+}
+
+static void run_bulk(int zerocopy) {
+    s_zerocopy = zerocopy;
+    s_sent = s_closing = 0;
+    atomic_store(&s_freed, 0);
+    for (int i = 0; i < TEST_BUFS; ++i) {
+        char* base = (char*)malloc(TEST_MSG_SIZE);
+        for (int j = 0; j < TEST_MSG_SIZE; ++j) {
+            base[j] = (char)(i * 31 + j);
+        }
+        s_bufs[i] = evbuf_new(base, TEST_MSG_SIZE, on_free, NULL);
+    }
+    evloop_t* loop = evloop_new(0);
+    evio_t* listenio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_accept);
+    assert(listenio != NULL);
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(evio_fd(listenio), &addr.sa, &addrlen);
+    thread_t th = thread_create(loop_thread, loop);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(fd, &addr.sa, addrlen) == 0);
+    static char buf[TEST_MSG_SIZE];
+    long received = 0;
+    int n = 0;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        // NOTE: in order, so check against the buffer being sent
+        for (int off = 0; off < n;) {
+            long msg = (received + off) / TEST_MSG_SIZE;
+            int pos = (received + off) % TEST_MSG_SIZE;
+            int len = MIN(n - off, TEST_MSG_SIZE - pos);
+            assert(memcmp(buf + off, (char*)evbuf_base(s_bufs[msg % TEST_BUFS]) + pos, len) == 0);
+            off += len;
+        }
+        received += n;
+    }
+    close(fd);
+    thread_join(th, NULL);
+    assert(received == (long)TEST_MESSAGES * TEST_MSG_SIZE);
+
+    // NOTE: io released its refs of bufs, so they are freed with ours
+    for (int i = 0; i < TEST_BUFS; ++i) {
+        evbuf_unref(s_bufs[i]);
+    }
+    assert(atomic_load(&s_freed) == TEST_BUFS);
+    printf("%s: %ldMB x %dK, cpu %.0fms per GB, zerocopy sends=%llu bytes=%lluMB completions=%llu copied=%llu "
+           "fallbacks=%llu\n",
+           zerocopy ? "MSG_ZEROCOPY" : "copy", received >> 20, TEST_MSG_SIZE >> 10,
+           s_cpu_ms * (1 << 30) / received, (unsigned long long)s_stats.sends,
+           (unsigned long long)s_stats.bytes >> 20, (unsigned long long)s_stats.completions,
+           (unsigned long long)s_stats.copied, (unsigned long long)s_stats.fallbacks);
+    if (zerocopy) {
+        assert(s_stats.sends > 0 && s_stats.completions == s_stats.sends);
+        assert(s_stats.inflight == 0);
+    } else {
+        assert(s_stats.sends == 0);
+    }
+    evloop_free(&loop);
+}
+
+// forced close: the peer reads nothing, so sends are pending when the close timeout fires
+#define TEST_FORCED_MESSAGES 8
+#define TEST_CLOSE_TIMEOUT   100 // ms
+
+static atomic_int s_forced_closed = ATOMIC_VAR_INIT(0);
+
+static void on_forced_close(evio_t* io) {
+    atomic_store(&s_forced_closed, 1);
+}
+
+static void on_forced_accept(evio_t* io) {
+    assert(evio_set_zerocopy(io, EIO_DEFAULT_ZEROCOPY_THRESHOLD) == 0);
+    evio_set_close_timeout(io, TEST_CLOSE_TIMEOUT);
+    evio_setcb_close(io, on_forced_close);
+    for (int i = 0; i < TEST_FORCED_MESSAGES; ++i) {
+        assert(evio_write_ref(io, s_bufs[i % TEST_BUFS]) >= 0);
+    }
+    evio_close(io);
+}
+
+static void run_forced_close() {
+    atomic_store(&s_freed, 0);
+    atomic_store(&s_forced_closed, 0);
+    for (int i = 0; i < TEST_BUFS; ++i) {
+        s_bufs[i] = evbuf_new(calloc(1, TEST_MSG_SIZE), TEST_MSG_SIZE, on_free, NULL);
+    }
+    evloop_t* loop = evloop_new(0);
+    evio_t* listenio = evloop_create_tcp_server(loop, LOCALHOST, 0, on_forced_accept);
+    assert(listenio != NULL);
+    sockaddr_u addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(evio_fd(listenio), &addr.sa, &addrlen);
+    thread_t th = thread_create(loop_thread, loop);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(fd, &addr.sa, addrlen) == 0);
+    while (!atomic_load(&s_forced_closed)) {
+        ev_msleep(1);
+    }
+    // NOTE: pending sends dropped by RST, not sent from released buffers
+    static char buf[TEST_MSG_SIZE];
+    int n = 0;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    }
+    assert(n < 0 && errno == ECONNRESET);
+    close(fd);
+    evloop_stop(loop);
+    thread_join(th, NULL);
+    // NOTE: released once fd closed, after close_cb
+    evloop_zerocopy_stats(loop, &s_stats);
+    assert(s_stats.inflight == 0);
+    for (int i = 0; i < TEST_BUFS; ++i) {
+        evbuf_unref(s_bufs[i]);
+    }
+    assert(atomic_load(&s_freed) == TEST_BUFS);
+    printf("forced close: sends=%llu completions=%llu, peer reset\n", (unsigned long long)s_stats.sends,
+           (unsigned long long)s_stats.completions);
+    evloop_free(&loop);
+}
+
+void test_zerocopy() {
+    run_forced_close();
+    run_bulk(0);
+    run_bulk(1);
+}